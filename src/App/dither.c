@@ -0,0 +1,179 @@
+/**
+ * @file dither.c
+ * @author Mohamed Hassanin
+ * @brief Requantization of the samples of high resolution sources to the
+ * 16 bits of the stream. Cutting the low bits leaves an error that follows
+ * the signal, a quiet tone gets harmonics. A TPDF dither of 1 LSB of the
+ * output added before the rounding turns it into a steady noise. A 32-bit
+ * xorshift gives the uniform noise of both channels of a frame in its two
+ * halves, the difference with those of the previous frame taken by one
+ * halving SHSUB16 is triangular. The optional noise shaping feeds the
+ * error back through a 3 tap filter, the noise moves from the 2 to 5 kHz
+ * the ear is the most sensitive to above 15 kHz.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/dither.h"
+
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define DITHER_TAPS 3
+#define DITHER_COEF_SHIFT 12
+// the filter is designed for 44.1 kHz, at lower rates it would move the
+// noise to where it's heard
+#define DITHER_SHAPING_MIN_RATE 44100
+// the error fed back is held to that many LSBs of the output, a clipped
+// sample would feed its whole overshoot back
+#define DITHER_ERROR_MAX_LSB 4
+#define DITHER_SEED 0x2545F491
+
+//---------------------------------------------------------------------------//
+//variable definitions
+
+// Q12 error feedback, the noise is shaped by
+// 1 - 1.623 z^-1 + 0.982 z^-2 - 0.109 z^-3
+static const int32_t gShape[DITHER_TAPS] = {6648, -4022, 446};
+
+static uint32_t gRate = 0;
+static bool gIsShapingOn = false;
+static uint32_t gSeed = DITHER_SEED; // the uniform halves of the last frame
+static int32_t gError[2][DITHER_TAPS];
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static inline uint32_t Dither_Noise(uint32_t* Seed);
+static inline int32_t Dither_Shape(int32_t Sample, int32_t Noise, int32_t* Error,
+                                   uint8_t Shift, int32_t ErrorMax);
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+void
+Dither_SetRate(uint32_t Rate)
+{
+  gRate = Rate;
+}
+
+/**
+ * @brief Forget the errors of the last stream.
+ */
+void
+Dither_Reset(void)
+{
+  memset(gError, 0, sizeof(gError));
+}
+
+/**
+ * @brief Turn the noise shaping on or off, it's used from 44.1 kHz up.
+ */
+void
+Dither_SetShaping(bool IsOn)
+{
+  gIsShapingOn = IsOn;
+  Dither_Reset();
+}
+
+/**
+ * @brief Check the noise shaping is applied at the rate of the stream.
+ */
+bool
+Dither_IsShaping(void)
+{
+  return gIsShapingOn && gRate >= DITHER_SHAPING_MIN_RATE;
+}
+
+/**
+ * @brief Get the TPDF noise of a frame, a signed halfword per channel,
+ * +-32767 being +-1 LSB of the output.
+ */
+static inline uint32_t
+Dither_Noise(uint32_t* Seed)
+{
+  uint32_t Last = *Seed;
+  uint32_t Noise = Last;
+
+  Noise ^= Noise << 13;
+  Noise ^= Noise >> 17;
+  Noise ^= Noise << 5;
+  *Seed = Noise;
+  return __SHSUB16(Noise, Last);
+}
+
+/**
+ * @brief Requantize a sample of one channel with its error fed back, the
+ * noise and the error are in units of the input.
+ */
+static inline int32_t
+Dither_Shape(int32_t Sample, int32_t Noise, int32_t* Error, uint8_t Shift, int32_t ErrorMax)
+{
+  int32_t Wanted = Sample - ((gShape[0] * Error[0] + gShape[1] * Error[1] +
+                              gShape[2] * Error[2]) >> DITHER_COEF_SHIFT);
+  int32_t Out = __SSAT((Wanted + Noise + (1 << (Shift - 1))) >> Shift, 16);
+  int32_t Diff = (Out << Shift) - Wanted;
+
+  if(Diff > ErrorMax) Diff = ErrorMax;
+  if(Diff < -ErrorMax) Diff = -ErrorMax;
+  Error[2] = Error[1];
+  Error[1] = Error[0];
+  Error[0] = Diff;
+  return Out;
+}
+
+/**
+ * @brief Requantize the samples of both channels to interleaved 16-bit
+ * ones, the frames are written a word at a time.
+ *
+ * @param Bits of the input samples, 17 to 31
+ */
+void
+Dither_Requantize(int16_t* Samples, const int32_t* Left, const int32_t* Right,
+                  uint8_t Bits, uint32_t Frames)
+{
+  const uint8_t Shift = Bits - 16;
+  // the noise halves are Q15 of an output LSB
+  const uint8_t NoiseShift = 16 + 15 - Shift;
+  const int32_t Half = 1 << (Shift - 1);
+  uint32_t Seed = gSeed;
+  uint32_t Tpdf;
+  int32_t L;
+  int32_t R;
+
+  if(Dither_IsShaping())
+    {
+      const int32_t ErrorMax = DITHER_ERROR_MAX_LSB << Shift;
+
+      for(uint32_t i = 0; i < Frames; i++)
+        {
+          Tpdf = Dither_Noise(&Seed);
+          L = Dither_Shape(Left[i], (int32_t)(Tpdf << 16) >> NoiseShift, gError[0],
+                           Shift, ErrorMax);
+          R = Dither_Shape(Right[i], (int32_t)Tpdf >> NoiseShift, gError[1],
+                           Shift, ErrorMax);
+          __UNALIGNED_UINT32_WRITE(&Samples[2 * i], __PKHBT(L, R, 16));
+        }
+    }
+  else
+    {
+      for(uint32_t i = 0; i < Frames; i++)
+        {
+          Tpdf = Dither_Noise(&Seed);
+          L = __SSAT((Left[i] + ((int32_t)(Tpdf << 16) >> NoiseShift) + Half) >> Shift, 16);
+          R = __SSAT((Right[i] + ((int32_t)Tpdf >> NoiseShift) + Half) >> Shift, 16);
+          __UNALIGNED_UINT32_WRITE(&Samples[2 * i], __PKHBT(L, R, 16));
+        }
+    }
+
+  gSeed = Seed;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,29 @@
+/**
+ * @file dither.h
+ * @author Mohamed Hassanin
+ * @brief Requantization of the samples of high resolution sources to the
+ * 16 bits of the stream, with TPDF dither and an optional noise shaping.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef DITHER_H_
+#define DITHER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void Dither_SetRate(uint32_t Rate);
+void Dither_Reset(void);
+void Dither_SetShaping(bool IsOn);
+bool Dither_IsShaping(void);
+void Dither_Requantize(int16_t* Samples, const int32_t* Left, const int32_t* Right,
+                       uint8_t Bits, uint32_t Frames);
+
+#endif
+//---------------------------------------------------------------------------//
@@ -0,0 +1,544 @@
+/**
+ * @file eq.c
+ * @author Mohamed Hassanin
+ * @brief Parametric equalizer of the stereo stream, a cascade of direct
+ * form I biquads per channel. The coefficients are designed in floating
+ * point when a band or the sampling rate changes, into a second set that
+ * replaces the running one at the start of the next half buffer. The
+ * biquads run on Q15 samples with Q15 coefficients scaled down for
+ * headroom, summed by the dual 16-bit MAC into a 64-bit accumulator.
+ * The bands whose Q15 coefficients miss their response, the low ones
+ * with poles and zeros close to z = 1, run on Q28 coefficients instead.
+ * The fractions the outputs drop are fed back shaped by (1 - z^-1)^2, so
+ * those poles don't lift the rounding noise into the band.
+ * The input is trimmed by the largest boost the bands of a channel can
+ * add up to, the limiter gives the trim back as makeup gain.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/eq.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define EQ_PI 3.14159265f
+// share of the CPU the biquads may take, the bands past the budget are
+// bypassed. The cost of a biquad per sample is measured while it runs,
+// until then it's the count of the Eq_RunWideStage loop, the longer one:
+// the load, four unpacks, the error feedback, five MACs, the 64-bit shift,
+// the saturation, the fraction kept, two packs, the store and the branch
+#define EQ_STAGE_CYCLES 24
+#define EQ_LOAD_PERCENT 30
+// design limits
+#define EQ_FREQ_MIN 20
+#define EQ_Q100_MIN 10
+#define EQ_Q100_MAX 2000
+// coefficient fraction bits, fewer for the larger coefficients
+#define EQ_FRAC_MAX 14
+#define EQ_FRAC_MIN 12
+#define EQ_WIDE_FRAC 28
+// largest error of the Q15 coefficients, in power gain at DC, at the
+// band frequency and at Nyquist, about 0.05 dB
+#define EQ_ERROR_MAX 0.012f
+// largest trim of the input for the boosts
+#define EQ_HEADROOM_MAX_DB10 240
+#define EQ_TRIM_UNITY 0x8000 // Q15
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  uint32_t B0;  // b0 in the low half
+  uint32_t B12; // b1 in the low half, b2 in the high one
+  uint32_t A12; // -a1 in the low half, -a2 in the high one
+  int32_t Wide[5]; // b0, b1, b2, -a1, -a2 in Q28
+  uint8_t Frac; // fraction bits of the coefficients
+  bool IsWide;  // run on the Q28 ones
+} EqStage_t;
+
+typedef struct {
+  uint32_t X; // x[n-1] in the low half, x[n-2] in the high one
+  uint32_t Y; // y[n-1] in the low half, y[n-2] in the high one
+  int32_t Error[2]; // fractions cut off y[n-1] and y[n-2] by the Q28 biquads
+} EqState_t;
+
+typedef struct {
+  EqStage_t Stages[EQ_CHANNELS][EQ_BANDS];
+  uint8_t Bands[EQ_CHANNELS][EQ_BANDS]; // band of each stage
+  uint8_t Num[EQ_CHANNELS];
+  uint8_t Mask[EQ_CHANNELS];  // bands run
+  uint8_t Fresh[EQ_CHANNELS]; // bands not run by the set it replaces
+  uint8_t Bypassed;
+  int16_t HeadroomDb10;
+  uint16_t Trim;   // Q15, of the channels without a stage to fold it in
+  uint32_t Makeup; // Q16, the inverse of the trim
+} EqSet_t;
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static EqBand_t gBands[EQ_CHANNELS][EQ_BANDS];
+static uint32_t gRate = 0;
+
+// the running set and the one designed for the next half
+static EqSet_t gSets[2] = {
+  {.Trim = EQ_TRIM_UNITY, .Makeup = EQ_MAKEUP_UNITY},
+  {.Trim = EQ_TRIM_UNITY, .Makeup = EQ_MAKEUP_UNITY},
+};
+static uint8_t gActive = 0;
+static bool gIsSwapPending = false;
+// by band, a band keeps its history over a coefficient change
+static EqState_t gStates[EQ_CHANNELS][EQ_BANDS];
+
+static uint32_t gCyclesPerFrame10 = 0;
+// the least measured, the runs an interrupt cut into only add to it
+static uint32_t gStageCycles10 = EQ_STAGE_CYCLES * 10;
+static bool gIsStageMeasured = false;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static uint8_t Eq_MaxStages(void);
+static bool Eq_IsRunnable(const EqBand_t* Band);
+static float Eq_GainSq(const float* C, float W);
+static void Eq_Design(const EqBand_t* Band, float Trim, EqStage_t* Stage);
+static void Eq_Build(void);
+static void Eq_RunStage(const EqStage_t* Stage, EqState_t* State,
+                        int16_t* Samples, uint32_t Frames);
+static void Eq_RunWideStage(const EqStage_t* Stage, EqState_t* State,
+                            int16_t* Samples, uint32_t Frames);
+static void Eq_RunTrim(uint16_t Trim, int16_t* Samples, uint32_t Frames);
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Design the bands for a new sampling rate.
+ */
+void
+Eq_SetRate(uint32_t Rate)
+{
+  if(Rate == gRate) return;
+  gRate = Rate;
+  Eq_Build();
+}
+
+/**
+ * @brief Set a band of one or both channels, it's heard from the next
+ * half buffer on.
+ *
+ * @return false for invalid parameters or when the enabled bands would
+ * go over the CPU budget of the current rate
+ */
+bool
+Eq_SetBand(uint8_t Channels, uint8_t Band, const EqBand_t* Params)
+{
+  uint8_t Stages = 0;
+
+  if(Band >= EQ_BANDS || !(Channels & EQ_CHANNEL_BOTH)) return false;
+  if(Params->Type != EQ_BAND_OFF &&
+      (Params->Type > EQ_BAND_HIGH_SHELF || Params->Freq < EQ_FREQ_MIN ||
+       Params->Q100 < EQ_Q100_MIN || Params->Q100 > EQ_Q100_MAX ||
+       Params->GainDb10 > EQ_GAIN_MAX_DB10 || Params->GainDb10 < -EQ_GAIN_MAX_DB10))
+    {
+      return false;
+    }
+
+  for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+    {
+      for(uint8_t i = 0; i < EQ_BANDS; i++)
+        {
+          const EqBand_t* Next = ((Channels & (1 << Ch)) && i == Band) ? Params : &gBands[Ch][i];
+          if(Next->Type != EQ_BAND_OFF) Stages++;
+        }
+    }
+  if(Stages > Eq_MaxStages()) return false;
+
+  for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+    {
+      if(Channels & (1 << Ch)) gBands[Ch][Band] = *Params;
+    }
+  Eq_Build();
+  return true;
+}
+
+void
+Eq_GetBand(uint8_t Channel, uint8_t Band, EqBand_t* Params)
+{
+  if(Channel >= EQ_CHANNELS || Band >= EQ_BANDS)
+    {
+      memset(Params, 0, sizeof(EqBand_t));
+      return;
+    }
+  *Params = gBands[Channel][Band];
+}
+
+/**
+ * @brief Equalize interleaved stereo samples, a new set of coefficients
+ * takes over here.
+ */
+void
+Eq_Process(int16_t* Samples, uint32_t Frames)
+{
+  uint32_t Start = DWT->CYCCNT;
+  const EqSet_t* Set;
+
+  if(gIsSwapPending)
+    {
+      gActive ^= 1;
+      gIsSwapPending = false;
+      for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+        {
+          for(uint8_t i = 0; i < EQ_BANDS; i++)
+            {
+              if(gSets[gActive].Fresh[Ch] & (1 << i))
+                {
+                  memset(&gStates[Ch][i], 0, sizeof(EqState_t));
+                }
+            }
+        }
+    }
+
+  Set = &gSets[gActive];
+  if((Set->Num[0] == 0 && Set->Num[1] == 0) || Frames == 0)
+    {
+      gCyclesPerFrame10 = 0;
+      return;
+    }
+
+  for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+    {
+      if(Set->Num[Ch] == 0 && Set->Trim != EQ_TRIM_UNITY)
+        {
+          Eq_RunTrim(Set->Trim, &Samples[Ch], Frames);
+        }
+      for(uint8_t i = 0; i < Set->Num[Ch]; i++)
+        {
+          const EqStage_t* Stage = &Set->Stages[Ch][i];
+          EqState_t* State = &gStates[Ch][Set->Bands[Ch][i]];
+
+          if(Stage->IsWide) Eq_RunWideStage(Stage, State, &Samples[Ch], Frames);
+          else Eq_RunStage(Stage, State, &Samples[Ch], Frames);
+        }
+    }
+  gCyclesPerFrame10 = (DWT->CYCCNT - Start) * 10 / Frames;
+
+  if(Set->Num[0] + Set->Num[1] > 0)
+    {
+      uint32_t StageCycles10 = gCyclesPerFrame10 / (Set->Num[0] + Set->Num[1]);
+
+      if(StageCycles10 == 0) StageCycles10 = 1;
+      if(!gIsStageMeasured || StageCycles10 < gStageCycles10)
+        {
+          gStageCycles10 = StageCycles10;
+          gIsStageMeasured = true;
+        }
+    }
+}
+
+void
+Eq_GetStats(EqStats_t* Stats)
+{
+  const EqSet_t* Set = &gSets[gIsSwapPending ? gActive ^ 1 : gActive];
+
+  Stats->Stages[0] = Set->Num[0];
+  Stats->Stages[1] = Set->Num[1];
+  Stats->Bypassed = Set->Bypassed;
+  Stats->MaxStages = Eq_MaxStages();
+  Stats->CyclesPerFrame10 = gCyclesPerFrame10;
+  Stats->StageCycles10 = gStageCycles10;
+  Stats->HeadroomDb10 = Set->HeadroomDb10;
+}
+
+/**
+ * @brief Get the Q16 gain that gives back the trim of the running set.
+ */
+uint32_t
+Eq_GetMakeup(void)
+{
+  return gSets[gActive].Makeup;
+}
+
+/**
+ * @brief Get the number of biquads the budget allows at the current rate,
+ * both channels together, at the measured cost of a biquad.
+ */
+static uint8_t
+Eq_MaxStages(void)
+{
+  uint32_t Max;
+
+  if(gRate == 0) return EQ_CHANNELS * EQ_BANDS;
+  Max = (SystemCoreClock / 100 * EQ_LOAD_PERCENT) * 10 / (gRate * gStageCycles10);
+  return (Max < EQ_CHANNELS * EQ_BANDS) ? (uint8_t)Max : EQ_CHANNELS * EQ_BANDS;
+}
+
+/**
+ * @brief Check a band is enabled and below the Nyquist frequency.
+ */
+static bool
+Eq_IsRunnable(const EqBand_t* Band)
+{
+  return Band->Type != EQ_BAND_OFF && gRate != 0 &&
+      (uint32_t)Band->Freq * 100 < gRate * 45;
+}
+
+/**
+ * @brief Get the power gain of a biquad at an angular frequency, from its
+ * b0, b1, b2, -a1 and -a2.
+ */
+static float
+Eq_GainSq(const float* C, float W)
+{
+  float Cos = cosf(W);
+  float Sin = sinf(W);
+  float Cos2 = cosf(2.0f * W);
+  float Sin2 = sinf(2.0f * W);
+  float NumRe = C[0] + C[1] * Cos + C[2] * Cos2;
+  float NumIm = -C[1] * Sin - C[2] * Sin2;
+  float DenRe = 1.0f - C[3] * Cos - C[4] * Cos2;
+  float DenIm = C[3] * Sin + C[4] * Sin2;
+
+  return (NumRe * NumRe + NumIm * NumIm) / (DenRe * DenRe + DenIm * DenIm);
+}
+
+/**
+ * @brief Compute the coefficients of a band, from the cookbook formulae
+ * of R. Bristow-Johnson, and quantize them with as many fraction bits as
+ * the largest one allows. The feed forward ones are scaled by the trim.
+ * A band the Q15 coefficients can't hold gets the Q28 ones.
+ */
+static void
+Eq_Design(const EqBand_t* Band, float Trim, EqStage_t* Stage)
+{
+  float A = powf(10.0f, Band->GainDb10 / 400.0f);
+  float W0 = 2.0f * EQ_PI * Band->Freq / gRate;
+  float Cos = cosf(W0);
+  float Alpha = sinf(W0) * 50.0f / Band->Q100; // sin(w0) / 2Q
+  float Shelf = 2.0f * sqrtf(A) * Alpha;
+  float B[3];
+  float Den[3];
+  float Max = 0.0f;
+  int32_t Q[5];
+  float Qf[5];
+  uint8_t Frac;
+
+  switch(Band->Type)
+  {
+    case EQ_BAND_LOW_SHELF:
+      B[0] = A * ((A + 1) - (A - 1) * Cos + Shelf);
+      B[1] = 2 * A * ((A - 1) - (A + 1) * Cos);
+      B[2] = A * ((A + 1) - (A - 1) * Cos - Shelf);
+      Den[0] = (A + 1) + (A - 1) * Cos + Shelf;
+      Den[1] = -2 * ((A - 1) + (A + 1) * Cos);
+      Den[2] = (A + 1) + (A - 1) * Cos - Shelf;
+      break;
+    case EQ_BAND_HIGH_SHELF:
+      B[0] = A * ((A + 1) + (A - 1) * Cos + Shelf);
+      B[1] = -2 * A * ((A - 1) + (A + 1) * Cos);
+      B[2] = A * ((A + 1) + (A - 1) * Cos - Shelf);
+      Den[0] = (A + 1) - (A - 1) * Cos + Shelf;
+      Den[1] = 2 * ((A - 1) - (A + 1) * Cos);
+      Den[2] = (A + 1) - (A - 1) * Cos - Shelf;
+      break;
+    case EQ_BAND_PEAK:
+    default:
+      B[0] = 1 + Alpha * A;
+      B[1] = -2 * Cos;
+      B[2] = 1 - Alpha * A;
+      Den[0] = 1 + Alpha / A;
+      Den[1] = -2 * Cos;
+      Den[2] = 1 - Alpha / A;
+      break;
+  }
+
+  // normalize, the feedback terms are negated for the MAC
+  float C[5] = {Trim * B[0] / Den[0], Trim * B[1] / Den[0], Trim * B[2] / Den[0],
+                -Den[1] / Den[0], -Den[2] / Den[0]};
+  for(uint8_t i = 0; i < 5; i++)
+    {
+      if(fabsf(C[i]) > Max) Max = fabsf(C[i]);
+    }
+
+  for(Frac = EQ_FRAC_MAX; Frac > EQ_FRAC_MIN; Frac--)
+    {
+      if(Max * (1 << Frac) < 32767.0f) break;
+    }
+  for(uint8_t i = 0; i < 5; i++)
+    {
+      Q[i] = __SSAT((int32_t)lrintf(C[i] * (1 << Frac)), 16);
+      Qf[i] = (float)Q[i] / (1 << Frac);
+      Stage->Wide[i] = (int32_t)lrintf(C[i] * (1 << EQ_WIDE_FRAC));
+    }
+
+  Stage->B0 = (uint16_t)Q[0];
+  Stage->B12 = __PKHBT(Q[1], Q[2], 16);
+  Stage->A12 = __PKHBT(Q[3], Q[4], 16);
+  Stage->Frac = Frac;
+  Stage->IsWide = false;
+
+  const float Ws[3] = {0.0f, W0, EQ_PI};
+  for(uint8_t i = 0; i < 3; i++)
+    {
+      float Ideal = Eq_GainSq(C, Ws[i]);
+
+      if(fabsf(Eq_GainSq(Qf, Ws[i]) - Ideal) > EQ_ERROR_MAX * Ideal)
+        {
+          Stage->Frac = EQ_WIDE_FRAC;
+          Stage->IsWide = true;
+        }
+    }
+}
+
+/**
+ * @brief Design the enabled bands into the set that is not running, both
+ * channels take their bands in the same order until the budget is spent.
+ * The headroom is the sum of the boosts of a channel, the largest of both
+ * channels, so the stereo image is kept.
+ */
+static void
+Eq_Build(void)
+{
+  const EqSet_t* Old = &gSets[gActive];
+  EqSet_t* Set = &gSets[gActive ^ 1];
+  uint8_t Max = Eq_MaxStages();
+  uint8_t Total = 0;
+  int16_t Boost[EQ_CHANNELS] = {0};
+  float Trim;
+
+  memset(Set, 0, sizeof(EqSet_t));
+  for(uint8_t i = 0; i < EQ_BANDS; i++)
+    {
+      for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+        {
+          if(!Eq_IsRunnable(&gBands[Ch][i])) continue;
+          if(Total == Max)
+            {
+              Set->Bypassed++;
+              continue;
+            }
+          Set->Bands[Ch][Set->Num[Ch]++] = i;
+          Set->Mask[Ch] |= 1 << i;
+          if(gBands[Ch][i].GainDb10 > 0) Boost[Ch] += gBands[Ch][i].GainDb10;
+          Total++;
+        }
+    }
+
+  Set->HeadroomDb10 = (Boost[0] > Boost[1]) ? Boost[0] : Boost[1];
+  if(Set->HeadroomDb10 > EQ_HEADROOM_MAX_DB10) Set->HeadroomDb10 = EQ_HEADROOM_MAX_DB10;
+  Trim = powf(10.0f, -Set->HeadroomDb10 / 200.0f);
+  Set->Trim = (uint16_t)lrintf(Trim * EQ_TRIM_UNITY);
+  Set->Makeup = (uint32_t)lrintf(EQ_MAKEUP_UNITY / Trim);
+
+  for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+    {
+      for(uint8_t i = 0; i < Set->Num[Ch]; i++)
+        {
+          Eq_Design(&gBands[Ch][Set->Bands[Ch][i]], (i == 0) ? Trim : 1.0f,
+                    &Set->Stages[Ch][i]);
+        }
+      Set->Fresh[Ch] = Set->Mask[Ch] & ~Old->Mask[Ch];
+    }
+  gIsSwapPending = true;
+}
+
+/**
+ * @brief Run a biquad over a channel of interleaved stereo samples,
+ * y = b0 x + b1 x1 + b2 x2 - a1 y1 - a2 y2 in two dual MACs and a multiply.
+ */
+static void
+Eq_RunStage(const EqStage_t* Stage, EqState_t* State,
+            int16_t* Samples, uint32_t Frames)
+{
+  const int32_t B0 = (int16_t)Stage->B0;
+  const uint32_t B12 = Stage->B12;
+  const uint32_t A12 = Stage->A12;
+  const uint8_t Frac = Stage->Frac;
+  const int32_t Mask = (1 << Frac) - 1;
+  uint32_t X = State->X;
+  uint32_t Y = State->Y;
+  int32_t E1 = State->Error[0];
+  int32_t E2 = State->Error[1];
+  int32_t In;
+  int32_t Out;
+  int64_t Acc;
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      In = Samples[2 * i];
+      Acc = (2 * E1 - E2) + B0 * In;
+      Acc = (int64_t)__SMLALD(B12, X, (uint64_t)Acc);
+      Acc = (int64_t)__SMLALD(A12, Y, (uint64_t)Acc);
+      Out = __SSAT((int32_t)(Acc >> Frac), 16);
+      E2 = E1;
+      E1 = (int32_t)Acc & Mask;
+      X = __PKHBT(In, X, 16);
+      Y = __PKHBT(Out, Y, 16);
+      Samples[2 * i] = (int16_t)Out;
+    }
+  State->X = X;
+  State->Y = Y;
+  State->Error[0] = E1;
+  State->Error[1] = E2;
+}
+
+/**
+ * @brief Run a biquad on Q28 coefficients over a channel of interleaved
+ * stereo samples, the history stays packed as for Eq_RunStage.
+ */
+static void
+Eq_RunWideStage(const EqStage_t* Stage, EqState_t* State,
+                int16_t* Samples, uint32_t Frames)
+{
+  const int32_t B0 = Stage->Wide[0];
+  const int32_t B1 = Stage->Wide[1];
+  const int32_t B2 = Stage->Wide[2];
+  const int32_t A1 = Stage->Wide[3];
+  const int32_t A2 = Stage->Wide[4];
+  uint32_t X = State->X;
+  uint32_t Y = State->Y;
+  int32_t E1 = State->Error[0];
+  int32_t E2 = State->Error[1];
+  int32_t In;
+  int32_t Out;
+  int64_t Acc;
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      In = Samples[2 * i];
+      Acc = (int64_t)(2 * E1 - E2) + (int64_t)B0 * In;
+      Acc += (int64_t)B1 * (int16_t)X + (int64_t)B2 * ((int32_t)X >> 16);
+      Acc += (int64_t)A1 * (int16_t)Y + (int64_t)A2 * ((int32_t)Y >> 16);
+      Out = __SSAT((int32_t)(Acc >> EQ_WIDE_FRAC), 16);
+      E2 = E1;
+      E1 = (int32_t)(Acc & (((int64_t)1 << EQ_WIDE_FRAC) - 1));
+      X = __PKHBT(In, X, 16);
+      Y = __PKHBT(Out, Y, 16);
+      Samples[2 * i] = (int16_t)Out;
+    }
+  State->X = X;
+  State->Y = Y;
+  State->Error[0] = E1;
+  State->Error[1] = E2;
+}
+
+/**
+ * @brief Scale a channel of interleaved stereo samples by a Q15 trim.
+ */
+static void
+Eq_RunTrim(uint16_t Trim, int16_t* Samples, uint32_t Frames)
+{
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      Samples[2 * i] = (int16_t)((Samples[2 * i] * Trim) >> 15);
+    }
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,64 @@
+/**
+ * @file eq.h
+ * @author Mohamed Hassanin
+ * @brief Parametric equalizer of the stereo stream, a cascade of fixed
+ * point biquads per channel.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef EQ_H_
+#define EQ_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define EQ_BANDS 8 // per channel
+#define EQ_CHANNELS 2
+#define EQ_CHANNEL_LEFT 0x01
+#define EQ_CHANNEL_RIGHT 0x02
+#define EQ_CHANNEL_BOTH (EQ_CHANNEL_LEFT | EQ_CHANNEL_RIGHT)
+#define EQ_GAIN_MAX_DB10 120 // +-12 dB
+#define EQ_MAKEUP_UNITY 0x10000 // Q16
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef enum {
+  EQ_BAND_OFF,
+  EQ_BAND_PEAK,
+  EQ_BAND_LOW_SHELF,
+  EQ_BAND_HIGH_SHELF,
+} EqBandType_t;
+
+typedef struct {
+  EqBandType_t Type;
+  uint16_t Freq;   // center or corner frequency in Hz
+  int16_t GainDb10; // in 0.1 dB
+  uint16_t Q100;   // quality factor x100, the shelves use it as the slope
+} EqBand_t;
+
+typedef struct {
+  uint8_t Stages[EQ_CHANNELS]; // biquads run per channel
+  uint8_t Bypassed;            // enabled bands left out by the budget
+  uint8_t MaxStages;           // biquads the budget allows at this rate
+  uint32_t CyclesPerFrame10;   // measured, x10
+  uint32_t StageCycles10;      // of a biquad per sample, x10
+  int16_t HeadroomDb10;        // trim of the input for the boosts
+} EqStats_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void Eq_SetRate(uint32_t Rate);
+bool Eq_SetBand(uint8_t Channels, uint8_t Band, const EqBand_t* Params);
+void Eq_GetBand(uint8_t Channel, uint8_t Band, EqBand_t* Params);
+void Eq_Process(int16_t* Samples, uint32_t Frames);
+void Eq_GetStats(EqStats_t* Stats);
+uint32_t Eq_GetMakeup(void);
+
+#endif
+//---------------------------------------------------------------------------//
@@ -0,0 +1,117 @@
+/**
+ * @file event_loop.c
+ * @author Mohamed Hassanin
+ * @brief Sleep between the main loop iterations until an interrupt
+ * brings some work, with per-source wake counters and CPU load
+ * measurement.
+ * @version 0.1
+ * @date 2021-12-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/event_loop.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define LOAD_WINDOW_MS 1000
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static volatile uint32_t gPendingEvents = 0;
+static EventLoopStats_t gStats;
+
+static uint32_t gWindowStartTick;
+static uint32_t gWindowStartCycles;
+static uint32_t gSleepCycles;
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Start the cycle counter used for the CPU load.
+ */
+void
+EventLoop_Init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  gWindowStartTick = HAL_GetTick();
+  gWindowStartCycles = DWT->CYCCNT;
+  gSleepCycles = 0;
+}
+
+/**
+ * @brief Mark some work for the main loop, called from the interrupts.
+ */
+void
+EventLoop_Notify(EventSrc_t Src)
+{
+  __disable_irq();
+  gPendingEvents |= 1UL << Src;
+  __enable_irq();
+}
+
+/**
+ * @brief Sleep until the next interrupt unless some work is already
+ * pending. The interrupts are masked around the check so an event that
+ * comes right before the WFI still wakes it up.
+ */
+void
+EventLoop_Sleep(void)
+{
+  uint32_t Events;
+  uint32_t Start;
+  uint32_t Now;
+
+  __disable_irq();
+  if(gPendingEvents == 0)
+    {
+      Start = DWT->CYCCNT;
+      __DSB();
+      __WFI();
+      gSleepCycles += DWT->CYCCNT - Start;
+    }
+  // the waking interrupt is served here
+  __enable_irq();
+
+  __disable_irq();
+  Events = gPendingEvents;
+  gPendingEvents = 0;
+  __enable_irq();
+
+  if(Events == 0)
+    {
+      gStats.OtherWakes++;
+    }
+  for(uint8_t Src = 0; Src < EVENT_SRC_NUM; Src++)
+    {
+      if(Events & (1UL << Src)) gStats.Wakes[Src]++;
+    }
+
+  Now = HAL_GetTick();
+  if(Now - gWindowStartTick >= LOAD_WINDOW_MS)
+    {
+      uint32_t Total = DWT->CYCCNT - gWindowStartCycles;
+      gStats.CpuLoad = 1000 - (uint16_t)(((uint64_t)gSleepCycles * 1000) / Total);
+      gWindowStartTick = Now;
+      gWindowStartCycles = DWT->CYCCNT;
+      gSleepCycles = 0;
+    }
+}
+
+/**
+ * @brief Get the wake counters and the CPU load of the last second.
+ */
+void
+EventLoop_GetStats(EventLoopStats_t* Stats)
+{
+  *Stats = gStats;
+}
+
+//---------------------------------------------------------------------------//
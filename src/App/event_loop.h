@@ -0,0 +1,44 @@
+/**
+ * @file event_loop.h
+ * @author Mohamed Hassanin
+ * @brief Sleep between the main loop iterations until an interrupt
+ * brings some work, with per-source wake counters and CPU load
+ * measurement.
+ * @version 0.1
+ * @date 2021-12-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef enum {
+  EVENT_SRC_USB,    // OTG_FS port and URB state changes
+  EVENT_SRC_SOF,    // USB start of frame ticks
+  EVENT_SRC_REFILL, // audio DMA half/full transfers
+  EVENT_SRC_UART,   // received bluetooth commands
+  EVENT_SRC_NUM,
+} EventSrc_t;
+
+typedef struct {
+  uint32_t Wakes[EVENT_SRC_NUM]; // events served per source
+  uint32_t OtherWakes;           // wake-ups with no event (SysTick, ...)
+  uint16_t CpuLoad;              // busy time of the last second in 0.1%
+} EventLoopStats_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void EventLoop_Init(void);
+void EventLoop_Notify(EventSrc_t Src);
+void EventLoop_Sleep(void);
+void EventLoop_GetStats(EventLoopStats_t* Stats);
+
+#endif
+//---------------------------------------------------------------------------//
@@ -0,0 +1,1008 @@
+/**
+ * @file flac.c
+ * @author Mohamed Hassanin
+ * @brief Streaming FLAC decoder to the 16-bit stereo stream of the
+ * player. The file is read FLAC_INPUT_SIZE bytes at a time through the
+ * player callbacks, a frame may span many reads: the input is checked
+ * once per FLAC_CHUNK samples for the bytes they take at most. The bits
+ * are read 32 at a time with a byte reversed word load, the Rice codes
+ * take a CLZ for their unary part. The decoded block is kept in CCM RAM,
+ * 36 KB for the largest block of the subset. A seek bisects the file
+ * between the SEEKTABLE points around the target, or the whole file
+ * without one, syncing on a frame header at each probe, then the frames
+ * from the last probe before the target are decoded.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/flac.h"
+
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "../App/dither.h" // samples wider than 16 bits
+
+//---------------------------------------------------------------------------//
+//defines
+#define FLAC_INPUT_SIZE 4096
+// samples decoded between two checks of the input, and the bytes they take
+// at most: 32 bits of unary and 30 bits of Rice parameter, or 32 raw bits
+#define FLAC_CHUNK 32
+#define FLAC_CHUNK_BYTES (FLAC_CHUNK * 8 + 8)
+// zeros after the input, a corrupt frame reads into them before it's caught
+#define FLAC_INPUT_GUARD FLAC_CHUNK_BYTES
+#define FLAC_HEADER_MAX 16
+// a subframe header with 32 warm-up samples and coefficients
+#define FLAC_SUBFRAME_BYTES 200
+#define FLAC_MAX_ORDER 32
+#define FLAC_SEEK_POINTS 64
+#define FLAC_SEEK_POINT_SIZE 18
+#define FLAC_SEEK_PLACEHOLDER 0xFFFFFFFF
+// the bisection stops that close to the target, a block away from it or
+// after that many probes
+#define FLAC_SEEK_LINEAR 8192
+#define FLAC_SEEK_PROBES 24
+#define FLAC_BLOCK_STREAMINFO 0
+#define FLAC_BLOCK_SEEKTABLE 3
+#define CRC8_POLY 0x07
+#define CRC16_POLY 0x8005
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  uint32_t First;     // sample number of the frame
+  uint16_t BlockSize;
+  uint8_t Assignment; // channel assignment
+  uint8_t Bps;
+  uint8_t Size;       // bytes of the header
+} FlacHeader_t;
+
+typedef struct {
+  uint32_t Frame;
+  uint32_t Ofs;
+} FlacPoint_t;
+
+typedef enum {
+  FLAC_FRAME_OK,
+  FLAC_FRAME_END,
+  FLAC_FRAME_FAILED, // the file couldn't be read
+} FlacFrame_t;
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static FlacInfo_t gInfo;
+static uint32_t gFileSize;
+static uint32_t gFirstFrameOfs;
+static FlacPoint_t gPoints[FLAC_SEEK_POINTS];
+static uint16_t gPointsNum = 0;
+
+// input, gIn[0] is the byte gInOfs of the file
+static uint8_t gIn[FLAC_INPUT_SIZE + FLAC_INPUT_GUARD] __ALIGNED(4);
+static uint32_t gInLen = 0;
+static uint32_t gInOfs = 0;
+static uint32_t gBitPos = 0;
+static bool gIsInEnd = false;
+static bool gIsInFailed = false;
+
+// the CRC-16 of the frame being decoded covers the input up to gCrcByte
+static bool gIsInFrame = false;
+static uint32_t gCrcByte;
+static uint16_t gCrc16;
+static uint16_t gCrc16Table[256];
+static bool gIsCrcBuilt = false;
+
+// the decoded frame, not accessed by the DMA
+static int32_t gSamples[2][FLAC_MAX_BLOCK] __attribute__((section(".ccmbss")));
+static uint32_t gFrameFirst = 0;
+static uint32_t gFrameLen = 0;
+static uint32_t gFramePos = 0;
+// the last frame header found, a retry after a failed read starts there
+static uint32_t gSyncFirst;
+static uint32_t gSyncOfs;
+static uint32_t gSyncLen = 0;
+
+static bool gIsSeekPending = false;
+static uint32_t gSeekTarget;
+
+static uint32_t gFrames = 0;
+static uint32_t gBadFrames = 0;
+static uint16_t gSeekProbes = 0;
+static uint32_t gIoCycles = 0;
+static uint32_t gCyclesPerFrame10 = 0;
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Get the 32 bits of the input from a bit position, the word load
+ * may be unaligned.
+ */
+static inline uint32_t
+Flac_PeekAt(uint32_t Pos)
+{
+  const uint8_t* Data = &gIn[Pos >> 3];
+  uint32_t Word;
+
+  memcpy(&Word, Data, sizeof(Word));
+  Word = __REV(Word) << (Pos & 7);
+  return Word | ((uint32_t)Data[4] >> (8 - (Pos & 7)));
+}
+
+static inline uint32_t
+Flac_Bits(uint8_t Bits)
+{
+  uint32_t Value;
+
+  if(Bits == 0) return 0;
+  Value = Flac_PeekAt(gBitPos) >> (32 - Bits);
+  gBitPos += Bits;
+  return Value;
+}
+
+static inline int32_t
+Flac_SignedBits(uint8_t Bits)
+{
+  int32_t Value;
+
+  if(Bits == 0) return 0;
+  Value = (int32_t)Flac_PeekAt(gBitPos) >> (32 - Bits);
+  gBitPos += Bits;
+  return Value;
+}
+
+/**
+ * @brief Count the zeros up to the next one, the one is read too.
+ */
+static inline uint32_t
+Flac_Unary(void)
+{
+  uint32_t Zeros = __CLZ(Flac_PeekAt(gBitPos));
+
+  gBitPos += Zeros + 1;
+  return Zeros;
+}
+
+static void
+Flac_Align(void)
+{
+  gBitPos = (gBitPos + 7) & ~7U;
+}
+
+static uint32_t
+Flac_Tell(void)
+{
+  return gInOfs + (gBitPos >> 3);
+}
+
+/**
+ * @brief CRC-8 of a frame header, bitwise as the headers are short.
+ */
+static uint8_t
+Flac_Crc8(const uint8_t* Data, uint8_t Len)
+{
+  uint8_t Crc = 0;
+
+  for(uint8_t i = 0; i < Len; i++)
+    {
+      Crc ^= Data[i];
+      for(uint8_t Bit = 0; Bit < 8; Bit++)
+        {
+          Crc = (Crc & 0x80) ? (uint8_t)((Crc << 1) ^ CRC8_POLY) : (uint8_t)(Crc << 1);
+        }
+    }
+  return Crc;
+}
+
+/**
+ * @brief Add the input up to a byte to the CRC-16 of the frame.
+ */
+static void
+Flac_Crc16(uint32_t End)
+{
+  uint16_t Crc = gCrc16;
+
+  for(uint32_t i = gCrcByte; i < End; i++)
+    {
+      Crc = (uint16_t)(Crc << 8) ^ gCrc16Table[(Crc >> 8) ^ gIn[i]];
+    }
+  gCrc16 = Crc;
+  gCrcByte = End;
+}
+
+static void
+Flac_BuildCrc16(void)
+{
+  uint16_t Crc;
+
+  for(uint16_t i = 0; i < 256; i++)
+    {
+      Crc = (uint16_t)(i << 8);
+      for(uint8_t Bit = 0; Bit < 8; Bit++)
+        {
+          Crc = (Crc & 0x8000) ? (uint16_t)((Crc << 1) ^ CRC16_POLY) : (uint16_t)(Crc << 1);
+        }
+      gCrc16Table[i] = Crc;
+    }
+  gIsCrcBuilt = true;
+}
+
+/**
+ * @brief Move the bytes not read yet to the start of the input and read
+ * the file after them.
+ */
+static void
+Flac_Refill(void)
+{
+  uint32_t Start = DWT->CYCCNT;
+  uint32_t Byte = gBitPos >> 3;
+  uint32_t Len = 0;
+
+  if(Byte > gInLen) Byte = gInLen;
+  if(gIsInFrame) Flac_Crc16(Byte);
+
+  memmove(gIn, &gIn[Byte], gInLen - Byte);
+  gInLen -= Byte;
+  gInOfs += Byte;
+  gBitPos -= Byte * 8;
+  gCrcByte = 0;
+
+  if(!Flac_ReadCallback(&gIn[gInLen], FLAC_INPUT_SIZE - gInLen, &Len))
+    {
+      gIsInFailed = true;
+      Len = 0;
+    }
+  else if(Len == 0)
+    {
+      gIsInEnd = true;
+    }
+  gInLen += Len;
+  memset(&gIn[gInLen], 0, FLAC_INPUT_GUARD);
+  gIoCycles += DWT->CYCCNT - Start;
+}
+
+/**
+ * @brief Make sure the next bytes are in the input, unless the file ends
+ * before.
+ */
+static inline void
+Flac_Ensure(uint32_t Bytes)
+{
+  if(gInLen < (gBitPos >> 3) + Bytes && !gIsInEnd && !gIsInFailed)
+    {
+      Flac_Refill();
+    }
+}
+
+/**
+ * @brief Move the input to a byte of the file, the file is read again
+ * unless the byte is in the input.
+ */
+static void
+Flac_SeekInput(uint32_t Ofs)
+{
+  gIsInFrame = false;
+  if(!gIsInFailed && Ofs >= gInOfs && Ofs < gInOfs + gInLen)
+    {
+      gBitPos = (Ofs - gInOfs) * 8;
+      return;
+    }
+
+  gIsInFailed = !Flac_SeekCallback(Ofs);
+  gIsInEnd = false;
+  gInOfs = Ofs;
+  gInLen = 0;
+  gBitPos = 0;
+  memset(gIn, 0, FLAC_INPUT_GUARD);
+}
+
+/**
+ * @brief Check the STREAMINFO of a file, the player takes blocks up to
+ * FLAC_MAX_BLOCK of one or two channels of up to 24 bits.
+ *
+ * @param Head the first FLAC_PROBE_SIZE bytes of the file
+ * @return false if it isn't a FLAC file the player takes
+ */
+bool
+Flac_Probe(const uint8_t* Head, FlacInfo_t* Info)
+{
+  const uint8_t* Block = &Head[8];
+
+  if(memcmp(Head, "fLaC", 4) || (Head[4] & 0x7F) != FLAC_BLOCK_STREAMINFO ||
+      Head[5] != 0 || Head[6] != 0 || Head[7] != 34)
+    {
+      return false;
+    }
+
+  Info->MinBlock = (uint16_t)((Block[0] << 8) | Block[1]);
+  Info->MaxBlock = (uint16_t)((Block[2] << 8) | Block[3]);
+  Info->SampleRate = ((uint32_t)Block[10] << 12) | ((uint32_t)Block[11] << 4) |
+      (Block[12] >> 4);
+  Info->Channels = ((Block[12] >> 1) & 0x07) + 1;
+  Info->BitsPerSample = (((Block[12] & 0x01) << 4) | (Block[13] >> 4)) + 1;
+  Info->TotalFrames = ((uint32_t)Block[14] << 24) | ((uint32_t)Block[15] << 16) |
+      ((uint32_t)Block[16] << 8) | Block[17];
+
+  // an unknown length can't be played, nor one over 2^30 frames
+  return Info->MinBlock >= 16 && Info->MaxBlock >= Info->MinBlock &&
+      Info->MaxBlock <= FLAC_MAX_BLOCK && Info->SampleRate != 0 &&
+      Info->Channels <= 2 && Info->BitsPerSample >= 4 &&
+      Info->BitsPerSample <= 24 && (Block[13] & 0x0F) == 0 &&
+      Info->TotalFrames != 0 && Info->TotalFrames < (1UL << 30);
+}
+
+/**
+ * @brief Parse a frame header, it must match the STREAMINFO.
+ */
+static bool
+Flac_ParseHeader(const uint8_t* Data, FlacHeader_t* Header)
+{
+  static const uint8_t Sizes[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+  uint8_t Code = Data[2] >> 4;
+  uint8_t Rate = Data[2] & 0x0F;
+  uint8_t Len = 5;
+  uint32_t Number = Data[4];
+  uint32_t Ones;
+  uint8_t Channels;
+
+  if(Data[0] != 0xFF || (Data[1] & 0xFE) != 0xF8 || Code == 0 || Rate == 15 ||
+      (Data[3] & 0x01))
+    {
+      return false;
+    }
+  Header->Assignment = Data[3] >> 4;
+  Header->Bps = Sizes[(Data[3] >> 1) & 0x07];
+  if(((Data[3] >> 1) & 0x07) == 0) Header->Bps = gInfo.BitsPerSample;
+  if(Header->Assignment > 10 || Header->Bps != gInfo.BitsPerSample) return false;
+  Channels = (Header->Assignment < 8) ? Header->Assignment + 1 : 2;
+  if(Channels != gInfo.Channels) return false;
+
+  // the frame or sample number, UTF-8 coded
+  if(Number & 0x80)
+    {
+      Ones = __CLZ(~(Number << 24));
+      if(Ones < 2 || Ones > 7) return false;
+      Number &= 0x7F >> Ones;
+      while(--Ones)
+        {
+          if((Data[Len] & 0xC0) != 0x80) return false;
+          Number = (Number << 6) | (Data[Len++] & 0x3F);
+        }
+    }
+
+  if(Code == 1) Header->BlockSize = 192;
+  else if(Code <= 5) Header->BlockSize = 576 << (Code - 2);
+  else if(Code == 6) Header->BlockSize = Data[Len++] + 1;
+  else if(Code == 7)
+    {
+      Header->BlockSize = (uint16_t)(((Data[Len] << 8) | Data[Len + 1]) + 1);
+      Len += 2;
+    }
+  else Header->BlockSize = 256 << (Code - 8);
+
+  if(Rate == 12) Len++;
+  else if(Rate > 12) Len += 2;
+
+  if(Header->BlockSize == 0 || Header->BlockSize > gInfo.MaxBlock ||
+      Flac_Crc8(Data, Len) != Data[Len])
+    {
+      return false;
+    }
+  Header->Size = Len + 1;
+  // a fixed blocksize stream counts the frames
+  Header->First = (Data[1] & 0x01) ? Number : Number * gInfo.MaxBlock;
+  return true;
+}
+
+/**
+ * @brief Find the next frame header, the input is left at it.
+ *
+ * @param Limit file offset the header must start before
+ * @return false at the limit, the end of the file or a read failure
+ */
+static bool
+Flac_Sync(uint32_t Limit, FlacHeader_t* Header)
+{
+  const uint8_t* Next;
+  uint32_t Byte;
+
+  Flac_Align();
+  for(;;)
+    {
+      Flac_Ensure(FLAC_HEADER_MAX);
+      Byte = gBitPos >> 3;
+      if(Byte >= gInLen || gIsInFailed || gInOfs + Byte >= Limit) return false;
+      if(gIn[Byte] == 0xFF && Flac_ParseHeader(&gIn[Byte], Header)) return true;
+
+      Next = memchr(&gIn[Byte + 1], 0xFF, gInLen - Byte - 1);
+      gBitPos = Next ? (uint32_t)(Next - gIn) * 8 : gInLen * 8;
+    }
+}
+
+/**
+ * @brief Read samples of a given size, verbatim or escaped residuals.
+ */
+static bool
+Flac_ReadRaw(int32_t* Out, uint32_t Count, uint8_t Bits)
+{
+  uint32_t Chunk;
+
+  while(Count)
+    {
+      Chunk = (Count < FLAC_CHUNK) ? Count : FLAC_CHUNK;
+      Flac_Ensure(FLAC_CHUNK_BYTES);
+      for(uint32_t i = 0; i < Chunk; i++) *Out++ = Flac_SignedBits(Bits);
+      if(gBitPos > gInLen * 8) return false;
+      Count -= Chunk;
+    }
+  return true;
+}
+
+/**
+ * @brief Read Rice coded residuals, the bit position is kept in a
+ * register over a chunk as the output may alias it.
+ */
+static bool
+Flac_ReadRice(int32_t* Out, uint32_t Count, uint8_t Param)
+{
+  uint32_t Chunk;
+  uint32_t Pos;
+  uint32_t End;
+  uint32_t Word;
+  uint32_t Zeros;
+  uint32_t Value;
+
+  while(Count)
+    {
+      Chunk = (Count < FLAC_CHUNK) ? Count : FLAC_CHUNK;
+      Flac_Ensure(FLAC_CHUNK_BYTES);
+      Pos = gBitPos;
+      End = gInLen * 8;
+
+      for(uint32_t i = 0; i < Chunk; i++)
+        {
+          Word = Flac_PeekAt(Pos);
+          Zeros = 0;
+          while(Word == 0)
+            {
+              Zeros += 32;
+              Pos += 32;
+              // a long run eats the budget of the chunk, keep it ahead
+              if(Pos + FLAC_CHUNK_BYTES * 8 > End && !gIsInEnd && !gIsInFailed)
+                {
+                  gBitPos = Pos;
+                  Flac_Refill();
+                  Pos = gBitPos;
+                  End = gInLen * 8;
+                }
+              if(Pos > End) return false;
+              Word = Flac_PeekAt(Pos);
+            }
+          Zeros += __CLZ(Word);
+          Pos += __CLZ(Word) + 1;
+
+          Value = Zeros << Param;
+          if(Param) Value |= Flac_PeekAt(Pos) >> (32 - Param);
+          Pos += Param;
+          *Out++ = (int32_t)(Value >> 1) ^ -(int32_t)(Value & 1);
+        }
+
+      gBitPos = Pos;
+      if(Pos > End) return false;
+      Count -= Chunk;
+    }
+  return true;
+}
+
+/**
+ * @brief Read the residual of a subframe after its warm-up samples.
+ */
+static bool
+Flac_ReadResidual(int32_t* Out, uint32_t Block, uint32_t Order)
+{
+  uint8_t ParamBits;
+  uint8_t Escape;
+  uint8_t Param;
+  uint8_t PartOrder;
+  uint32_t PartLen;
+  uint32_t i = Order;
+  uint32_t End;
+  bool IsOk;
+
+  ParamBits = Flac_Bits(2);
+  if(ParamBits > 1) return false;
+  ParamBits += 4;
+  Escape = (1 << ParamBits) - 1;
+  PartOrder = Flac_Bits(4);
+  PartLen = Block >> PartOrder;
+  if((PartLen << PartOrder) != Block || PartLen < Order) return false;
+
+  for(uint32_t Part = 0; Part < (1UL << PartOrder); Part++)
+    {
+      End = (Part + 1) * PartLen;
+      Flac_Ensure(2);
+      Param = Flac_Bits(ParamBits);
+      if(Param == Escape)
+        {
+          IsOk = Flac_ReadRaw(&Out[i], End - i, Flac_Bits(5));
+        }
+      else
+        {
+          IsOk = Flac_ReadRice(&Out[i], End - i, Param);
+        }
+      if(!IsOk) return false;
+      i = End;
+    }
+  return true;
+}
+
+static void
+Flac_RestoreFixed(int32_t* Out, uint32_t Block, uint32_t Order)
+{
+  switch(Order)
+  {
+    case 1:
+      for(uint32_t i = 1; i < Block; i++) Out[i] += Out[i - 1];
+      break;
+    case 2:
+      for(uint32_t i = 2; i < Block; i++) Out[i] += 2 * Out[i - 1] - Out[i - 2];
+      break;
+    case 3:
+      for(uint32_t i = 3; i < Block; i++)
+        {
+          Out[i] += 3 * (Out[i - 1] - Out[i - 2]) + Out[i - 3];
+        }
+      break;
+    case 4:
+      for(uint32_t i = 4; i < Block; i++)
+        {
+          Out[i] += 4 * (Out[i - 1] + Out[i - 3]) - 6 * Out[i - 2] - Out[i - 4];
+        }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Add the linear prediction to the residual, the sum is 64 bits
+ * wide when the samples and the coefficients may overflow 32 bits.
+ */
+static void
+Flac_RestoreLpc(int32_t* Out, uint32_t Block, const int32_t* Coefs,
+                uint32_t Order, uint8_t Shift, bool IsWide)
+{
+  int32_t Sum;
+  int64_t WideSum;
+
+  if(IsWide)
+    {
+      for(uint32_t i = Order; i < Block; i++)
+        {
+          WideSum = 0;
+          for(uint32_t j = 0; j < Order; j++) WideSum += (int64_t)Coefs[j] * Out[i - 1 - j];
+          Out[i] += (int32_t)(WideSum >> Shift);
+        }
+      return;
+    }
+
+  for(uint32_t i = Order; i < Block; i++)
+    {
+      Sum = 0;
+      for(uint32_t j = 0; j < Order; j++) Sum += Coefs[j] * Out[i - 1 - j];
+      Out[i] += Sum >> Shift;
+    }
+}
+
+/**
+ * @brief Decode a subframe into a channel of the block.
+ */
+static bool
+Flac_DecodeSubframe(int32_t* Out, uint32_t Block, uint8_t Bps)
+{
+  int32_t Coefs[FLAC_MAX_ORDER];
+  uint8_t Type;
+  uint8_t Wasted = 0;
+  uint8_t Precision;
+  int32_t Shift;
+  uint32_t Order;
+  int32_t Value;
+
+  Flac_Ensure(FLAC_SUBFRAME_BYTES);
+  if(Flac_Bits(1)) return false;
+  Type = Flac_Bits(6);
+  if(Flac_Bits(1))
+    {
+      Wasted = Flac_Unary() + 1;
+      if(Wasted >= Bps) return false;
+      Bps -= Wasted;
+    }
+
+  if(Type == 0)
+    {
+      Value = Flac_SignedBits(Bps);
+      for(uint32_t i = 0; i < Block; i++) Out[i] = Value;
+    }
+  else if(Type == 1)
+    {
+      if(!Flac_ReadRaw(Out, Block, Bps)) return false;
+    }
+  else if(Type >= 8 && Type <= 12)
+    {
+      Order = Type - 8;
+      if(Order > Block) return false;
+      for(uint32_t i = 0; i < Order; i++) Out[i] = Flac_SignedBits(Bps);
+      if(!Flac_ReadResidual(Out, Block, Order)) return false;
+      Flac_RestoreFixed(Out, Block, Order);
+    }
+  else if(Type >= 32)
+    {
+      Order = (Type & 0x1F) + 1;
+      if(Order > Block) return false;
+      for(uint32_t i = 0; i < Order; i++) Out[i] = Flac_SignedBits(Bps);
+      Precision = Flac_Bits(4) + 1;
+      Shift = Flac_SignedBits(5);
+      if(Precision > 15 || Shift < 0) return false;
+      for(uint32_t i = 0; i < Order; i++) Coefs[i] = Flac_SignedBits(Precision);
+      if(!Flac_ReadResidual(Out, Block, Order)) return false;
+      Flac_RestoreLpc(Out, Block, Coefs, Order, (uint8_t)Shift,
+                      Bps + Precision + (31 - __CLZ(Order)) > 32);
+    }
+  else
+    {
+      return false;
+    }
+
+  if(Wasted)
+    {
+      for(uint32_t i = 0; i < Block; i++) Out[i] = (int32_t)((uint32_t)Out[i] << Wasted);
+    }
+  return true;
+}
+
+/**
+ * @brief Decode the subframes of a frame after its header, check its
+ * CRC-16 and undo the stereo decorrelation.
+ */
+static bool
+Flac_DecodeFrame(const FlacHeader_t* Header)
+{
+  uint32_t Block = Header->BlockSize;
+  int32_t* Left = gSamples[0];
+  int32_t* Right = gSamples[1];
+  uint8_t Side = 0xFF; // the side channel takes a bit more
+  int32_t Mid;
+
+  if(Header->Assignment == 8 || Header->Assignment == 10) Side = 1;
+  if(Header->Assignment == 9) Side = 0;
+
+  for(uint8_t Ch = 0; Ch < gInfo.Channels; Ch++)
+    {
+      if(!Flac_DecodeSubframe(gSamples[Ch], Block, Header->Bps + (Ch == Side)))
+        {
+          return false;
+        }
+    }
+
+  Flac_Align();
+  Flac_Ensure(2);
+  if(gBitPos > gInLen * 8) return false;
+  Flac_Crc16(gBitPos >> 3);
+  if(Flac_Bits(16) != gCrc16) return false;
+
+  switch(Header->Assignment)
+  {
+    case 8:
+      for(uint32_t i = 0; i < Block; i++) Right[i] = Left[i] - Right[i];
+      break;
+    case 9:
+      for(uint32_t i = 0; i < Block; i++) Left[i] += Right[i];
+      break;
+    case 10:
+      for(uint32_t i = 0; i < Block; i++)
+        {
+          Mid = (int32_t)((uint32_t)Left[i] << 1) | (Right[i] & 1);
+          Left[i] = (Mid + Right[i]) >> 1;
+          Right[i] = (Mid - Right[i]) >> 1;
+        }
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+/**
+ * @brief Decode the next frame, a corrupt one is played as silence and
+ * the decoding goes on from the next frame header.
+ */
+static FlacFrame_t
+Flac_NextFrame(void)
+{
+  FlacHeader_t Header;
+  bool IsOk;
+
+  gFrameLen = 0;
+  gFramePos = 0;
+  if(!Flac_Sync(UINT32_MAX, &Header))
+    {
+      return gIsInFailed ? FLAC_FRAME_FAILED : FLAC_FRAME_END;
+    }
+
+  gSyncFirst = Header.First;
+  gSyncOfs = Flac_Tell();
+  gSyncLen = Header.BlockSize;
+  gIsInFrame = true;
+  gCrcByte = gBitPos >> 3;
+  gCrc16 = 0;
+  gBitPos += Header.Size * 8;
+  IsOk = Flac_DecodeFrame(&Header);
+  gIsInFrame = false;
+  if(gIsInFailed) return FLAC_FRAME_FAILED;
+
+  if(!IsOk)
+    {
+      gBadFrames++;
+      memset(gSamples[0], 0, Header.BlockSize * sizeof(int32_t));
+      memset(gSamples[1], 0, Header.BlockSize * sizeof(int32_t));
+      if(gBitPos > gInLen * 8) gBitPos = gInLen * 8;
+    }
+  gFrames++;
+  gFrameFirst = Header.First;
+  gFrameLen = Header.BlockSize;
+  return FLAC_FRAME_OK;
+}
+
+/**
+ * @brief Keep the SEEKTABLE points in order, one every so many when the
+ * table is larger than FLAC_SEEK_POINTS. The offsets are from the first
+ * frame for now.
+ */
+static void
+Flac_ReadSeekTable(uint32_t Points)
+{
+  uint32_t Step = (Points + FLAC_SEEK_POINTS - 1) / FLAC_SEEK_POINTS;
+  uint32_t SampleHigh;
+  uint32_t Sample;
+  uint32_t OfsHigh;
+  uint32_t Ofs;
+
+  for(uint32_t i = 0; i < Points && !gIsInFailed; i++)
+    {
+      Flac_Ensure(FLAC_SEEK_POINT_SIZE);
+      SampleHigh = Flac_Bits(32);
+      Sample = Flac_Bits(32);
+      OfsHigh = Flac_Bits(32);
+      Ofs = Flac_Bits(32);
+      Flac_Bits(16);
+
+      if(i % Step || SampleHigh || OfsHigh || Sample == FLAC_SEEK_PLACEHOLDER ||
+          Sample >= gInfo.TotalFrames || gPointsNum == FLAC_SEEK_POINTS ||
+          (gPointsNum && Sample <= gPoints[gPointsNum - 1].Frame))
+        {
+          continue;
+        }
+      gPoints[gPointsNum].Frame = Sample;
+      gPoints[gPointsNum].Ofs = Ofs;
+      gPointsNum++;
+    }
+}
+
+/**
+ * @brief Read the metadata of the file, the first frame is next.
+ *
+ * @param FileSize bytes, the end of the last frame
+ * @return false if it isn't a FLAC file the player takes or it can't be
+ * read
+ */
+bool
+Flac_Open(uint32_t FileSize)
+{
+  uint32_t Ofs = 4;
+  uint32_t Header;
+
+  if(!gIsCrcBuilt) Flac_BuildCrc16();
+  gFileSize = FileSize;
+  gPointsNum = 0;
+  gFrameLen = 0;
+  gFramePos = 0;
+  gSyncLen = 0;
+  gIsSeekPending = false;
+  gFrames = 0;
+  gBadFrames = 0;
+  gSeekProbes = 0;
+  gCyclesPerFrame10 = 0;
+
+  gIsInFailed = true; // the input is read again
+  Flac_SeekInput(0);
+  Flac_Ensure(FLAC_PROBE_SIZE);
+  if(gInLen < FLAC_PROBE_SIZE || !Flac_Probe(gIn, &gInfo)) return false;
+
+  do
+    {
+      Flac_SeekInput(Ofs);
+      Flac_Ensure(4);
+      Header = Flac_Bits(32);
+      if((Header & 0x7F000000) == ((uint32_t)FLAC_BLOCK_SEEKTABLE << 24))
+        {
+          Flac_ReadSeekTable((Header & 0xFFFFFF) / FLAC_SEEK_POINT_SIZE);
+        }
+      Ofs += 4 + (Header & 0xFFFFFF);
+      if(gIsInFailed || Ofs >= FileSize) return false;
+    }
+  while(!(Header & 0x80000000));
+
+  gFirstFrameOfs = Ofs;
+  for(uint16_t i = 0; i < gPointsNum; i++) gPoints[i].Ofs += Ofs;
+  Flac_SeekInput(Ofs);
+  return !gIsInFailed;
+}
+
+/**
+ * @brief Move the decoding to a frame, it's done by the next read.
+ */
+void
+Flac_Seek(uint32_t Frame)
+{
+  gSeekTarget = Frame;
+  gIsSeekPending = true;
+}
+
+/**
+ * @brief Find the frame of a sample by bisection between the SEEKTABLE
+ * points around it, then decode the frames up to it.
+ */
+static bool
+Flac_Locate(uint32_t Target)
+{
+  FlacPoint_t Lo = { 0, gFirstFrameOfs };
+  FlacPoint_t Hi = { gInfo.TotalFrames, gFileSize };
+  FlacHeader_t Header;
+  FlacFrame_t Result;
+  uint32_t Guess;
+  uint32_t Bytes;
+
+  // still in the decoded frame, e.g. the read-ahead of the stretch
+  if(!gIsInFailed && gFrameLen && Target >= gFrameFirst &&
+      Target < gFrameFirst + gFrameLen)
+    {
+      gFramePos = Target - gFrameFirst;
+      return true;
+    }
+
+  for(uint16_t i = 0; i < gPointsNum; i++)
+    {
+      if(gPoints[i].Frame > Target)
+        {
+          Hi = gPoints[i];
+          break;
+        }
+      Lo = gPoints[i];
+    }
+  if(gSyncLen && Target >= gSyncFirst && gSyncFirst >= Lo.Frame && gSyncOfs < Hi.Ofs)
+    {
+      Lo.Frame = gSyncFirst;
+      Lo.Ofs = gSyncOfs;
+      // in the last frame found, the bisection is skipped
+      if(Target < gSyncFirst + gSyncLen) Hi = Lo;
+    }
+
+  gSeekProbes = 0;
+  while(Hi.Ofs - Lo.Ofs > FLAC_SEEK_LINEAR && Hi.Frame - Lo.Frame > gInfo.MaxBlock &&
+      gSeekProbes < FLAC_SEEK_PROBES)
+    {
+      // interpolated a block early, so the probes land on both sides
+      Bytes = (uint32_t)((uint64_t)(Hi.Ofs - Lo.Ofs) * gInfo.MaxBlock / (Hi.Frame - Lo.Frame));
+      Guess = Lo.Ofs + (uint32_t)((uint64_t)(Target - Lo.Frame) *
+          (Hi.Ofs - Lo.Ofs) / (Hi.Frame - Lo.Frame));
+      Guess = (Guess > Lo.Ofs + Bytes) ? Guess - Bytes : Lo.Ofs + 1;
+      gSeekProbes++;
+
+      Flac_SeekInput(Guess);
+      if(!Flac_Sync(Hi.Ofs, &Header))
+        {
+          if(gIsInFailed) return false;
+          Hi.Ofs = Guess; // no frame starts after the guess
+        }
+      else if(Header.First <= Target)
+        {
+          Lo.Frame = Header.First;
+          Lo.Ofs = Flac_Tell();
+        }
+      else
+        {
+          Hi.Frame = Header.First;
+          Hi.Ofs = Flac_Tell();
+        }
+    }
+
+  Flac_SeekInput(Lo.Ofs);
+  do
+    {
+      Result = Flac_NextFrame();
+      if(Result == FLAC_FRAME_FAILED) return false;
+    }
+  while(Result == FLAC_FRAME_OK && gFrameFirst + gFrameLen <= Target);
+
+  if(Result == FLAC_FRAME_OK && Target > gFrameFirst) gFramePos = Target - gFrameFirst;
+  return true;
+}
+
+/**
+ * @brief Decode the next frames of the stream, wider samples are
+ * requantized to 16 bits.
+ *
+ * @param Made frames decoded, less than Frames at the end of the file
+ * @return false when the file couldn't be read
+ */
+bool
+Flac_Read(int16_t* Samples, uint32_t Frames, uint32_t* Made)
+{
+  uint32_t Start = DWT->CYCCNT;
+  const int32_t* Left;
+  const int32_t* Right;
+  int8_t Shift = gInfo.BitsPerSample - 16;
+  uint32_t Count;
+
+  *Made = 0;
+  gIoCycles = 0;
+  if(gIsSeekPending)
+    {
+      if(!Flac_Locate(gSeekTarget)) return false;
+      gIsSeekPending = false;
+    }
+
+  while(*Made < Frames)
+    {
+      if(gFramePos >= gFrameLen)
+        {
+          FlacFrame_t Result = Flac_NextFrame();
+
+          if(Result == FLAC_FRAME_FAILED) return false;
+          if(Result == FLAC_FRAME_END) break;
+        }
+
+      Count = gFrameLen - gFramePos;
+      if(Count > Frames - *Made) Count = Frames - *Made;
+      Left = &gSamples[0][gFramePos];
+      Right = &gSamples[gInfo.Channels - 1][gFramePos];
+      if(Shift > 0)
+        {
+          Dither_Requantize(Samples, Left, Right, gInfo.BitsPerSample, Count);
+          Samples += 2 * Count;
+        }
+      else
+        {
+          for(uint32_t i = 0; i < Count; i++)
+            {
+              *Samples++ = (int16_t)((uint32_t)Left[i] << -Shift);
+              *Samples++ = (int16_t)((uint32_t)Right[i] << -Shift);
+            }
+        }
+      gFramePos += Count;
+      *Made += Count;
+    }
+
+  if(*Made) gCyclesPerFrame10 = (DWT->CYCCNT - Start - gIoCycles) * 10 / *Made;
+  return true;
+}
+
+/**
+ * @brief Get the decoding counters of the file.
+ */
+void
+Flac_GetStats(FlacStats_t* Stats)
+{
+  Stats->Frames = gFrames;
+  Stats->BadFrames = gBadFrames;
+  Stats->SeekPoints = gPointsNum;
+  Stats->SeekProbes = gSeekProbes;
+  Stats->CyclesPerFrame10 = gCyclesPerFrame10;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,58 @@
+/**
+ * @file flac.h
+ * @author Mohamed Hassanin
+ * @brief Streaming FLAC decoder to the 16-bit stereo stream of the
+ * player, with a fixed working set.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef FLAC_H_
+#define FLAC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+// the largest block of the streamable subset up to 48 kHz
+#define FLAC_MAX_BLOCK 4608
+// "fLaC", the STREAMINFO block header and the block
+#define FLAC_PROBE_SIZE 42
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  uint32_t SampleRate;
+  uint8_t Channels;
+  uint8_t BitsPerSample;
+  uint16_t MinBlock;
+  uint16_t MaxBlock;
+  uint32_t TotalFrames;
+} FlacInfo_t;
+
+typedef struct {
+  uint32_t Frames;       // FLAC frames decoded
+  uint32_t BadFrames;    // played as silence, CRC or syntax error
+  uint16_t SeekPoints;   // kept from the SEEKTABLE
+  uint16_t SeekProbes;   // frame syncs of the last seek
+  uint32_t CyclesPerFrame10; // measured per output frame, x10
+} FlacStats_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+bool Flac_Probe(const uint8_t* Head, FlacInfo_t* Info);
+bool Flac_Open(uint32_t FileSize);
+void Flac_Seek(uint32_t Frame);
+bool Flac_Read(int16_t* Samples, uint32_t Frames, uint32_t* Made);
+void Flac_GetStats(FlacStats_t* Stats);
+
+// implemented by the player, the bytes of the file being decoded
+bool Flac_ReadCallback(uint8_t* Buf, uint32_t Len, uint32_t* ReadLen);
+bool Flac_SeekCallback(uint32_t Ofs);
+
+#endif
+//---------------------------------------------------------------------------//
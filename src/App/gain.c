@@ -0,0 +1,124 @@
+/**
+ * @file gain.c
+ * @author Mohamed Hassanin
+ * @brief Sample domain gain of the stereo stream, with linear ramps
+ * between the levels so mutes and pauses don't click. A frame is a 32-bit
+ * word holding the left sample in its low half and the right one in its
+ * high half, both channels are scaled by the DSP multiply instructions.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/gain.h"
+
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define GAIN_Q15_MAX 0x7FFF
+// the gain is kept in Q30 so the ramp steps are fine enough
+#define GAIN_FRAC_SHIFT 15
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static uint32_t gGain = (uint32_t)GAIN_UNITY << GAIN_FRAC_SHIFT;
+static int32_t gStep = 0;
+static uint32_t gRampLeft = 0;
+static uint16_t gTarget = GAIN_UNITY;
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Scale both channels of a frame by a Q15 gain below 1.0. SMUAD
+ * with one half of the gain operand zero is a single 16x16 multiply.
+ */
+static inline uint32_t
+Gain_ScaleFrame(uint32_t Frame, uint32_t Gain)
+{
+  int32_t Left = (int32_t)__SMUAD(Frame, Gain);
+  int32_t Right = (int32_t)__SMUAD(Frame, Gain << 16);
+
+  // the products are Q30, the right one lands in the high half shifted
+  return __PKHBT(Left >> 15, Right << 1, 0);
+}
+
+/**
+ * @brief Move the gain to a Q15 target over a number of frames, from the
+ * gain reached so far. 0 frames jumps to it.
+ */
+void
+Gain_Ramp(uint16_t Target, uint32_t Frames)
+{
+  if(Target > GAIN_UNITY) Target = GAIN_UNITY;
+
+  gTarget = Target;
+  if(Frames == 0)
+    {
+      gGain = (uint32_t)Target << GAIN_FRAC_SHIFT;
+      gRampLeft = 0;
+      return;
+    }
+  gStep = (((int32_t)Target << GAIN_FRAC_SHIFT) - (int32_t)gGain) / (int32_t)Frames;
+  gRampLeft = Frames;
+}
+
+/**
+ * @brief Get the Q15 gain reached so far.
+ */
+uint16_t
+Gain_Get(void)
+{
+  return (uint16_t)(gGain >> GAIN_FRAC_SHIFT);
+}
+
+/**
+ * @brief Check the gain settled at 0, the processed frames are silent.
+ */
+bool
+Gain_IsSilent(void)
+{
+  return gRampLeft == 0 && gTarget == 0;
+}
+
+/**
+ * @brief Apply the gain to interleaved stereo samples, the buffer must be
+ * word aligned. A settled unity gain leaves them untouched.
+ */
+void
+Gain_Process(int16_t* Samples, uint32_t Frames)
+{
+  uint32_t* Frame = (uint32_t*)Samples;
+  uint32_t Gain;
+
+  if(gRampLeft == 0)
+    {
+      if(gTarget == GAIN_UNITY) return;
+      if(gTarget == 0)
+        {
+          memset(Samples, 0, Frames * sizeof(uint32_t));
+          return;
+        }
+    }
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      if(gRampLeft)
+        {
+          gGain += gStep;
+          if(--gRampLeft == 0) gGain = (uint32_t)gTarget << GAIN_FRAC_SHIFT;
+        }
+      Gain = gGain >> GAIN_FRAC_SHIFT;
+      if(Gain > GAIN_Q15_MAX) Gain = GAIN_Q15_MAX;
+      Frame[i] = Gain_ScaleFrame(Frame[i], Gain);
+    }
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,31 @@
+/**
+ * @file gain.h
+ * @author Mohamed Hassanin
+ * @brief Sample domain gain of the stereo stream, with linear ramps
+ * between the levels so mutes and pauses don't click.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef GAIN_H_
+#define GAIN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define GAIN_UNITY 0x8000 // Q15 1.0, the samples are left untouched
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void Gain_Ramp(uint16_t Target, uint32_t Frames);
+uint16_t Gain_Get(void);
+bool Gain_IsSilent(void);
+void Gain_Process(int16_t* Samples, uint32_t Frames);
+
+#endif
+//---------------------------------------------------------------------------//
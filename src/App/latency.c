@@ -0,0 +1,142 @@
+/**
+ * @file latency.c
+ * @author Mohamed Hassanin
+ * @brief Command latency histograms, from the reception of a command to
+ * each stage of its execution. The time base is the DWT cycle counter
+ * started by the event loop.
+ * @version 0.1
+ * @date 2021-12-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/latency.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define FIRST_BUCKET_US 64
+#define NO_CMD 0xFF
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static LatencyHist_t gHists[LATENCY_CMD_NUM];
+
+// the command being measured, its stages are counted once each
+static uint8_t gCmd = NO_CMD;
+static uint32_t gRxCycles;
+static uint8_t gMarked;
+static uint8_t gExpected; // stages marked after the command returns
+static bool gIsEnded;
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Get the time stamp of an event, in CPU cycles.
+ */
+uint32_t
+Latency_Now(void)
+{
+  return DWT->CYCCNT;
+}
+
+/**
+ * @brief Start measuring a command that was received at RxCycles and
+ * count its dispatch. The stages a previous command didn't reach are
+ * dropped.
+ */
+void
+Latency_Begin(uint8_t Cmd, uint32_t RxCycles)
+{
+  if(Cmd >= LATENCY_CMD_NUM) Cmd = NO_CMD;
+
+  __disable_irq();
+  gCmd = Cmd;
+  gRxCycles = RxCycles;
+  gMarked = 0;
+  gExpected = 0;
+  gIsEnded = false;
+  __enable_irq();
+
+  Latency_Mark(LATENCY_STAGE_DISPATCH);
+}
+
+/**
+ * @brief Count a stage of the command being measured, the first mark of
+ * a stage wins. It's called from the audio DMA interrupt too.
+ */
+void
+Latency_Mark(LatencyStage_t Stage)
+{
+  uint32_t Us;
+  uint8_t Bucket = 0;
+  uint16_t* Count;
+
+  __disable_irq();
+  if(gCmd != NO_CMD && !(gMarked & (1 << Stage)))
+    {
+      gMarked |= 1 << Stage;
+      Us = (DWT->CYCCNT - gRxCycles) / (SystemCoreClock / 1000000);
+      while(Bucket < LATENCY_BUCKETS - 1 &&
+          Us >= ((uint32_t)FIRST_BUCKET_US << (2 * Bucket)))
+        {
+          Bucket++;
+        }
+      Count = &gHists[gCmd].Counts[Stage][Bucket];
+      if(*Count < UINT16_MAX) (*Count)++;
+
+      if(gIsEnded && !(gExpected & ~gMarked)) gCmd = NO_CMD;
+    }
+  __enable_irq();
+}
+
+/**
+ * @brief Keep the measurement open after the command returns until a
+ * stage is marked, for the stages done later by an interrupt.
+ */
+void
+Latency_Expect(LatencyStage_t Stage)
+{
+  __disable_irq();
+  gExpected |= 1 << Stage;
+  __enable_irq();
+}
+
+/**
+ * @brief The command returned, the stages marked from now on belong to
+ * other activity (e.g. the next track at the end of a file) unless they
+ * are expected.
+ */
+void
+Latency_End(void)
+{
+  __disable_irq();
+  gIsEnded = true;
+  if(!(gExpected & ~gMarked)) gCmd = NO_CMD;
+  __enable_irq();
+}
+
+/**
+ * @brief Get the histograms of a command.
+ */
+void
+Latency_GetHist(uint8_t Cmd, LatencyHist_t* Hist)
+{
+  if(Cmd >= LATENCY_CMD_NUM)
+    {
+      memset(Hist, 0, sizeof(LatencyHist_t));
+      return;
+    }
+
+  __disable_irq();
+  *Hist = gHists[Cmd];
+  __enable_irq();
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,49 @@
+/**
+ * @file latency.h
+ * @author Mohamed Hassanin
+ * @brief Command latency histograms, from the reception of a command to
+ * each stage of its execution.
+ * @version 0.1
+ * @date 2021-12-09
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define LATENCY_CMD_NUM 16
+// bucket i counts the latencies below 64us << 2i, the last one the rest
+#define LATENCY_BUCKETS 8
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef enum {
+  LATENCY_STAGE_DISPATCH, // taken out of the queue by the main loop
+  LATENCY_STAGE_FILE,     // file opened and first buffer read
+  LATENCY_STAGE_ACTION,   // command done, codec and I2S included
+  LATENCY_STAGE_AUDIO,    // first new sample reached the DMA
+  LATENCY_STAGE_NUM,
+} LatencyStage_t;
+
+typedef struct {
+  uint16_t Counts[LATENCY_STAGE_NUM][LATENCY_BUCKETS];
+} LatencyHist_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+uint32_t Latency_Now(void);
+void Latency_Begin(uint8_t Cmd, uint32_t RxCycles);
+void Latency_Mark(LatencyStage_t Stage);
+void Latency_Expect(LatencyStage_t Stage);
+void Latency_End(void);
+void Latency_GetHist(uint8_t Cmd, LatencyHist_t* Hist);
+
+#endif
+//---------------------------------------------------------------------------//
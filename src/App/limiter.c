@@ -0,0 +1,362 @@
+/**
+ * @file limiter.c
+ * @author Mohamed Hassanin
+ * @brief Stereo-linked look-ahead limiter of the stream, with an optional
+ * compressor. The frames are scaled by the makeup gain into a fixed delay
+ * line, the loudest channel of each frame enters a sliding maximum over
+ * the delay kept in a monotonic deque. The gain computer works in the log2
+ * domain with lookup tables. Its gain drops at once and recovers with the
+ * release, then a moving average over the delay turns the drop into a
+ * ramp that ends when the peak leaves the delay line.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/limiter.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+// look-ahead in frames, a power of 2: 2.9 ms at 44.1 kHz
+#define LIMITER_DELAY 128
+#define LIMITER_DELAY_SHIFT 7
+// the window of the maximum is the delay and the frame coming in
+#define LIMITER_DEQUE_SIZE (2 * LIMITER_DELAY)
+// log2 values are Q10, a dB is 1024 / 6.0206 of them
+#define LIMITER_LOG2_ONE 1024
+#define LIMITER_DB10_TO_LOG2(_DB10_) ((int32_t)(_DB10_) * 1024 * 10 / 602)
+#define LIMITER_FULL_SCALE_BITS 15
+// the table truncates the mantissa, a step up keeps the peaks below the ceiling
+#define LIMITER_LOG2_STEP 23
+#define LIMITER_CEILING_MIN_DB10 (-120)
+#define LIMITER_THRESHOLD_MIN_DB10 (-400)
+#define LIMITER_RELEASE_MAX_MS 2000
+
+//---------------------------------------------------------------------------//
+//variable definitions
+
+// log2(1 + i / 64) in Q10
+static const uint16_t gLog2Lut[64] = {
+  0, 23, 45, 68, 90, 111, 132, 153, 174, 194, 214, 234, 254, 273, 292, 311,
+  330, 348, 366, 384, 402, 419, 436, 454, 470, 487, 504, 520, 536, 552, 568, 584,
+  599, 614, 629, 644, 659, 674, 689, 703, 717, 731, 745, 759, 773, 787, 800, 813,
+  827, 840, 853, 866, 879, 891, 904, 916, 929, 941, 953, 965, 977, 989, 1001, 1012,
+};
+// 2^(i / 64) in Q16
+static const uint32_t gExp2Lut[64] = {
+  65536, 66250, 66971, 67700, 68438, 69183, 69936, 70698, 71468, 72246, 73032,
+  73828, 74632, 75444, 76266, 77096, 77936, 78785, 79642, 80510, 81386, 82273,
+  83169, 84074, 84990, 85915, 86851, 87796, 88752, 89719, 90696, 91684, 92682,
+  93691, 94711, 95743, 96785, 97839, 98905, 99982, 101070, 102171, 103283,
+  104408, 105545, 106694, 107856, 109031, 110218, 111418, 112631, 113858,
+  115098, 116351, 117618, 118899, 120194, 121502, 122825, 124163, 125515,
+  126882, 128263, 129660,
+};
+
+// settings
+static uint32_t gRate = 0;
+static int16_t gCeilingDb10 = LIMITER_CEILING_DB10;
+static int16_t gBoostDb10 = 0;
+static int32_t gCeiling = LIMITER_DB10_TO_LOG2(LIMITER_CEILING_DB10);
+static bool gIsCompressing = false;
+static int16_t gThresholdDb10 = 0;
+static int32_t gThreshold = 0;
+static uint8_t gRatio10 = 10;
+static uint16_t gReleaseMs = LIMITER_RELEASE_MS;
+static uint32_t gRelease = 0; // Q15 share of the gap recovered per frame
+static uint32_t gMakeup = LIMITER_UNITY;
+
+// delay line of the made up frames
+static int32_t gDelay[LIMITER_DELAY][2];
+// sliding maximum, the deque holds decreasing peaks and their frame counts
+static uint32_t gDequePeak[LIMITER_DEQUE_SIZE];
+static uint32_t gDequeFrame[LIMITER_DEQUE_SIZE];
+static uint8_t gDequeFront = 0;
+static uint16_t gDequeSize = 0;
+// gain smoothing, the release follower and the moving average over it
+static uint32_t gFollower = LIMITER_UNITY;
+static uint32_t gBox[LIMITER_DELAY];
+static uint32_t gBoxSum = LIMITER_UNITY * LIMITER_DELAY;
+static uint32_t gFrame = 0;
+// the gain computer runs again only when the maximum changes
+static uint32_t gLastPeak = 0;
+static uint32_t gLastTarget = LIMITER_UNITY;
+
+// metering
+static uint32_t gGain = LIMITER_UNITY;
+static uint32_t gMinGain = LIMITER_UNITY;
+static uint32_t gLimitedFrames = 0;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static int32_t Limiter_Log2(uint32_t Peak);
+static uint32_t Limiter_Exp2(int32_t Log2);
+static uint32_t Limiter_Target(uint32_t Peak);
+static void Limiter_UpdateRelease(void);
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+void
+Limiter_SetRate(uint32_t Rate)
+{
+  gRate = Rate;
+  Limiter_UpdateRelease();
+}
+
+/**
+ * @brief Empty the delay line and recover the gain, for a new stream.
+ */
+void
+Limiter_Reset(void)
+{
+  memset(gDelay, 0, sizeof(gDelay));
+  gDequeSize = 0;
+  gFollower = LIMITER_UNITY;
+  for(uint32_t i = 0; i < LIMITER_DELAY; i++) gBox[i] = LIMITER_UNITY;
+  gBoxSum = LIMITER_UNITY * LIMITER_DELAY;
+  gLastPeak = 0;
+  gLastTarget = LIMITER_UNITY;
+  gGain = LIMITER_UNITY;
+}
+
+/**
+ * @brief Set the highest level of the output, in 0.1 dBFS.
+ */
+bool
+Limiter_SetCeiling(int16_t Db10)
+{
+  if(Db10 > 0 || Db10 < LIMITER_CEILING_MIN_DB10) return false;
+  gCeilingDb10 = Db10;
+  gCeiling = LIMITER_DB10_TO_LOG2(Db10 - gBoostDb10);
+  gLastPeak = 0;
+  return true;
+}
+
+/**
+ * @brief Set the gain added after the stream, by the codec volume, the
+ * ceiling is lowered by it.
+ */
+void
+Limiter_SetBoost(int16_t Db10)
+{
+  if(Db10 < 0) Db10 = 0;
+  gBoostDb10 = Db10;
+  gCeiling = LIMITER_DB10_TO_LOG2(gCeilingDb10 - Db10);
+  gLastPeak = 0;
+}
+
+/**
+ * @brief Compress the levels above a threshold by a ratio, the limiter
+ * still holds the ceiling.
+ */
+bool
+Limiter_SetCompressor(bool IsOn, int16_t ThresholdDb10, uint8_t Ratio10)
+{
+  if(IsOn && (ThresholdDb10 > 0 || ThresholdDb10 < LIMITER_THRESHOLD_MIN_DB10 ||
+      Ratio10 < 10))
+    {
+      return false;
+    }
+  gIsCompressing = IsOn;
+  if(IsOn)
+    {
+      gThresholdDb10 = ThresholdDb10;
+      gThreshold = LIMITER_DB10_TO_LOG2(ThresholdDb10);
+      gRatio10 = Ratio10;
+    }
+  gLastPeak = 0;
+  return true;
+}
+
+bool
+Limiter_SetRelease(uint16_t Ms)
+{
+  if(Ms == 0 || Ms > LIMITER_RELEASE_MAX_MS) return false;
+  gReleaseMs = Ms;
+  Limiter_UpdateRelease();
+  return true;
+}
+
+/**
+ * @brief Set the Q16 gain the input is scaled by before the limiting, it
+ * gives back the headroom taken by the EQ.
+ */
+void
+Limiter_SetMakeup(uint32_t Makeup)
+{
+  gMakeup = Makeup;
+}
+
+/**
+ * @brief Limit a block of interleaved stereo samples in place, the output
+ * is the input of LIMITER_DELAY frames earlier.
+ */
+void
+Limiter_Process(int16_t* Samples, uint32_t Frames)
+{
+  uint8_t Pos;
+  uint8_t Back;
+  int32_t Left;
+  int32_t Right;
+  uint32_t Peak;
+  uint32_t Target;
+  uint32_t Gain = gGain;
+
+  for(uint32_t i = 0; i < Frames; i++, gFrame++)
+    {
+      Pos = gFrame & (LIMITER_DELAY - 1);
+      Left = (int32_t)(((int64_t)Samples[2 * i] * gMakeup) >> 16);
+      Right = (int32_t)(((int64_t)Samples[2 * i + 1] * gMakeup) >> 16);
+
+      // sliding maximum of the linked peak over the delay and this frame,
+      // each follower gain of the average below then saw the frame going
+      // out. The frame that left the window goes before the push, so at
+      // most LIMITER_DELAY + 1 peaks are held.
+      Peak = (uint32_t)((Left < 0) ? -Left : Left);
+      if((uint32_t)((Right < 0) ? -Right : Right) > Peak)
+        {
+          Peak = (uint32_t)((Right < 0) ? -Right : Right);
+        }
+      if(gDequeSize && gFrame - gDequeFrame[gDequeFront] > LIMITER_DELAY)
+        {
+          gDequeFront = (gDequeFront + 1) & (LIMITER_DEQUE_SIZE - 1);
+          gDequeSize--;
+        }
+      while(gDequeSize &&
+          gDequePeak[(gDequeFront + gDequeSize - 1) & (LIMITER_DEQUE_SIZE - 1)] <= Peak)
+        {
+          gDequeSize--;
+        }
+      Back = (gDequeFront + gDequeSize) & (LIMITER_DEQUE_SIZE - 1);
+      gDequePeak[Back] = Peak;
+      gDequeFrame[Back] = gFrame;
+      gDequeSize++;
+
+      // the gain drops at once and recovers with the release
+      Target = Limiter_Target(gDequePeak[gDequeFront]);
+      if(Target <= gFollower)
+        {
+          gFollower = Target;
+        }
+      else
+        {
+          gFollower += (((Target - gFollower) * gRelease) >> 15) + 1;
+          if(gFollower > Target) gFollower = Target;
+        }
+
+      // moving average over the delay, the ramp reaches the follower gain
+      // when the peak leaves the delay line
+      gBoxSum += gFollower - gBox[Pos];
+      gBox[Pos] = gFollower;
+      Gain = gBoxSum >> LIMITER_DELAY_SHIFT;
+
+      Samples[2 * i] = (int16_t)__SSAT((int32_t)(((int64_t)gDelay[Pos][0] * Gain) >> 16), 16);
+      Samples[2 * i + 1] = (int16_t)__SSAT((int32_t)(((int64_t)gDelay[Pos][1] * Gain) >> 16), 16);
+      gDelay[Pos][0] = Left;
+      gDelay[Pos][1] = Right;
+
+      if(Gain < LIMITER_UNITY) gLimitedFrames++;
+      if(Gain < gMinGain) gMinGain = Gain;
+    }
+  gGain = Gain;
+}
+
+/**
+ * @brief Get the settings and the gain reduction meter, the deepest
+ * reduction is held until this read.
+ */
+void
+Limiter_GetStats(LimiterStats_t* Stats)
+{
+  Stats->CeilingDb10 = gCeilingDb10;
+  Stats->BoostDb10 = gBoostDb10;
+  Stats->IsCompressing = gIsCompressing;
+  Stats->ThresholdDb10 = gThresholdDb10;
+  Stats->Ratio10 = gRatio10;
+  Stats->ReleaseMs = gReleaseMs;
+  Stats->Gain = gGain;
+  Stats->MinGain = gMinGain;
+  Stats->LimitedFrames = gLimitedFrames;
+  gMinGain = gGain;
+}
+
+/**
+ * @brief Get the level of a peak relative to the full scale, Q10 log2,
+ * rounded up.
+ */
+static int32_t
+Limiter_Log2(uint32_t Peak)
+{
+  uint8_t Lz = __CLZ(Peak);
+  uint32_t Index = ((Peak << Lz) >> 25) & 63;
+
+  return ((int32_t)(31 - Lz - LIMITER_FULL_SCALE_BITS) << 10) + gLog2Lut[Index] +
+      LIMITER_LOG2_STEP;
+}
+
+/**
+ * @brief Get the Q16 gain of a Q10 log2 value, 0 or below.
+ */
+static uint32_t
+Limiter_Exp2(int32_t Log2)
+{
+  uint32_t Neg = (uint32_t)-Log2;
+  uint32_t Shift = (Neg + LIMITER_LOG2_ONE - 1) >> 10;
+  uint32_t Frac = (Shift << 10) - Neg;
+
+  if(Shift >= 16) return 0;
+  return gExp2Lut[Frac >> 4] >> Shift;
+}
+
+/**
+ * @brief The gain computer, the gain a peak needs to stay below the
+ * ceiling and, when compressing, to follow the ratio above the threshold.
+ */
+static uint32_t
+Limiter_Target(uint32_t Peak)
+{
+  int32_t Level;
+  int32_t Reduction = 0;
+  int32_t Compression;
+
+  if(Peak == gLastPeak) return gLastTarget;
+  gLastPeak = Peak;
+  if(Peak == 0)
+    {
+      gLastTarget = LIMITER_UNITY;
+      return gLastTarget;
+    }
+
+  Level = Limiter_Log2(Peak);
+  if(Level > gCeiling) Reduction = gCeiling - Level;
+  if(gIsCompressing && Level > gThreshold)
+    {
+      Compression = -(Level - gThreshold) * (gRatio10 - 10) / gRatio10;
+      if(Compression < Reduction) Reduction = Compression;
+    }
+  gLastTarget = Limiter_Exp2(Reduction);
+  return gLastTarget;
+}
+
+/**
+ * @brief Compute the share of the gain gap recovered per frame from the
+ * release time, 1 - exp(-1 / (release * rate)).
+ */
+static void
+Limiter_UpdateRelease(void)
+{
+  if(gRate == 0) return;
+  gRelease = (uint32_t)(32768.0f * (1.0f - expf(-1000.0f / ((float)gReleaseMs * gRate))));
+}
+
+//---------------------------------------------------------------------------//
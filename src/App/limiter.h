@@ -0,0 +1,52 @@
+/**
+ * @file limiter.h
+ * @author Mohamed Hassanin
+ * @brief Stereo-linked look-ahead limiter of the stream, with an optional
+ * compressor, so the EQ boost and the codec volume boost don't clip.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef LIMITER_H_
+#define LIMITER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define LIMITER_CEILING_DB10 (-3) // -0.3 dBFS
+#define LIMITER_RELEASE_MS 50
+#define LIMITER_UNITY 0x10000 // Q16 1.0
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  int16_t CeilingDb10;
+  int16_t BoostDb10;     // of the codec volume, taken off the ceiling
+  bool IsCompressing;
+  int16_t ThresholdDb10; // compressor
+  uint8_t Ratio10;       // compressor, x10
+  uint16_t ReleaseMs;
+  uint32_t Gain;         // Q16, the gain reduction being applied
+  uint32_t MinGain;      // Q16, the deepest reduction since the last read
+  uint32_t LimitedFrames; // frames played with a reduction
+} LimiterStats_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void Limiter_SetRate(uint32_t Rate);
+void Limiter_Reset(void);
+bool Limiter_SetCeiling(int16_t Db10);
+void Limiter_SetBoost(int16_t Db10);
+bool Limiter_SetCompressor(bool IsOn, int16_t ThresholdDb10, uint8_t Ratio10);
+bool Limiter_SetRelease(uint16_t Ms);
+void Limiter_SetMakeup(uint32_t Makeup);
+void Limiter_Process(int16_t* Samples, uint32_t Frames);
+void Limiter_GetStats(LimiterStats_t* Stats);
+
+#endif
+//---------------------------------------------------------------------------//
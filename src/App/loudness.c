@@ -0,0 +1,245 @@
+/**
+ * @file loudness.c
+ * @author Mohamed Hassanin
+ * @brief Integrated loudness of a track after ITU-R BS.1770. The stereo
+ * samples are decimated by 2 with the mean of each pair, then K-weighted
+ * by the pre-filter shelf and the RLB high-pass designed for the halved
+ * rate. The power of 400 ms blocks overlapped by 75% is gated at -70 LUFS
+ * and 10 LU below the mean of the blocks above it. The blocks are kept
+ * in a histogram of their loudness holding their summed power, so a track
+ * of any length takes the same memory and the gates only round their
+ * thresholds. The analysis keeps its state between the calls, a track is
+ * measured a chunk at a time.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/loudness.h"
+
+#include <math.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define LOUDNESS_PI 3.14159265f
+#define LOUDNESS_DECIMATION 2
+// a block is 4 steps of 100 ms
+#define LOUDNESS_STEPS_PER_BLOCK 4
+#define LOUDNESS_STEPS_PER_S 10
+#define LOUDNESS_OFFSET (-0.691f)
+#define LOUDNESS_ABS_GATE (-70.0f)
+#define LOUDNESS_REL_GATE (-10.0f)
+// histogram of the block loudness, from the absolute gate up
+#define LOUDNESS_BIN_DB 0.5f
+#define LOUDNESS_BINS 150
+#define LOUDNESS_FULL_SCALE 32768.0f
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  float B[3];
+  float A[2]; // a1, a2
+  float X[2][2]; // by channel, x[n-1] and x[n-2]
+  float Y[2][2];
+} LoudnessBiquad_t;
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static LoudnessBiquad_t gShelf;
+static LoudnessBiquad_t gHighPass;
+
+static uint32_t gStepSamples = 0; // decimated frames of a step
+static uint32_t gStepLeft = 0;
+static float gStepPower = 0.0f;
+static float gSteps[LOUDNESS_STEPS_PER_BLOCK];
+static uint32_t gStepsNum = 0;
+
+static float gBinPower[LOUDNESS_BINS];
+static uint32_t gBinBlocks[LOUDNESS_BINS];
+static int32_t gPeak = 0;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static float Loudness_Filter(LoudnessBiquad_t* Biquad, uint8_t Ch, float In);
+static void Loudness_EndStep(void);
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Start the measure of a track, the K-weighting is designed for the
+ * decimated rate after the coefficients of libebur128.
+ */
+void
+Loudness_Begin(uint32_t Rate)
+{
+  float Fs = (float)Rate / LOUDNESS_DECIMATION;
+  float K;
+  float Q;
+  float Vh;
+  float Vb;
+  float A0;
+
+  memset(&gShelf, 0, sizeof(gShelf));
+  memset(&gHighPass, 0, sizeof(gHighPass));
+
+  // pre-filter, a high shelf of +4 dB around 1.7 kHz
+  K = tanf(LOUDNESS_PI * 1681.974450955533f / Fs);
+  Q = 0.7071752369554196f;
+  Vh = powf(10.0f, 3.999843853973347f / 20.0f);
+  Vb = powf(Vh, 0.4996667741545416f);
+  A0 = 1.0f + K / Q + K * K;
+  gShelf.B[0] = (Vh + Vb * K / Q + K * K) / A0;
+  gShelf.B[1] = 2.0f * (K * K - Vh) / A0;
+  gShelf.B[2] = (Vh - Vb * K / Q + K * K) / A0;
+  gShelf.A[0] = 2.0f * (K * K - 1.0f) / A0;
+  gShelf.A[1] = (1.0f - K / Q + K * K) / A0;
+
+  // RLB weighting, a high-pass at 38 Hz
+  K = tanf(LOUDNESS_PI * 38.13547087602444f / Fs);
+  Q = 0.5003270373238773f;
+  A0 = 1.0f + K / Q + K * K;
+  gHighPass.B[0] = 1.0f;
+  gHighPass.B[1] = -2.0f;
+  gHighPass.B[2] = 1.0f;
+  gHighPass.A[0] = 2.0f * (K * K - 1.0f) / A0;
+  gHighPass.A[1] = (1.0f - K / Q + K * K) / A0;
+
+  gStepSamples = (uint32_t)Fs / LOUDNESS_STEPS_PER_S;
+  gStepLeft = gStepSamples;
+  gStepPower = 0.0f;
+  gStepsNum = 0;
+  memset(gBinPower, 0, sizeof(gBinPower));
+  memset(gBinBlocks, 0, sizeof(gBinBlocks));
+  gPeak = 0;
+}
+
+/**
+ * @brief Measure interleaved stereo samples, an odd frame at the end of a
+ * chunk is left out of the decimation.
+ */
+void
+Loudness_Process(const int16_t* Samples, uint32_t Frames)
+{
+  int32_t In[2][LOUDNESS_DECIMATION];
+  float Out;
+
+  for(uint32_t i = 0; i + LOUDNESS_DECIMATION <= Frames; i += LOUDNESS_DECIMATION)
+    {
+      for(uint8_t j = 0; j < LOUDNESS_DECIMATION; j++)
+        {
+          In[0][j] = Samples[2 * (i + j)];
+          In[1][j] = Samples[2 * (i + j) + 1];
+          if(In[0][j] > gPeak) gPeak = In[0][j];
+          if(-In[0][j] > gPeak) gPeak = -In[0][j];
+          if(In[1][j] > gPeak) gPeak = In[1][j];
+          if(-In[1][j] > gPeak) gPeak = -In[1][j];
+        }
+
+      for(uint8_t Ch = 0; Ch < 2; Ch++)
+        {
+          Out = (In[Ch][0] + In[Ch][1]) * (0.5f / LOUDNESS_FULL_SCALE);
+          Out = Loudness_Filter(&gShelf, Ch, Out);
+          Out = Loudness_Filter(&gHighPass, Ch, Out);
+          gStepPower += Out * Out;
+        }
+
+      if(--gStepLeft == 0) Loudness_EndStep();
+    }
+}
+
+/**
+ * @brief End the measure of a track.
+ *
+ * @param LufsDb10 the integrated loudness, in 0.1 LUFS
+ * @param PeakDb10 the sample peak, in 0.1 dBFS
+ * @return false when no block was above the gates, a silent track
+ */
+bool
+Loudness_End(int16_t* LufsDb10, int16_t* PeakDb10)
+{
+  float Power = 0.0f;
+  uint32_t Blocks = 0;
+  float Gate;
+  uint32_t First;
+
+  *PeakDb10 = (gPeak > 0) ?
+      (int16_t)lrintf(200.0f * log10f(gPeak / LOUDNESS_FULL_SCALE)) : INT16_MIN;
+
+  for(uint32_t i = 0; i < LOUDNESS_BINS; i++)
+    {
+      Power += gBinPower[i];
+      Blocks += gBinBlocks[i];
+    }
+  if(Blocks == 0) return false;
+
+  // the relative gate, from the mean of the blocks above the absolute one
+  Gate = LOUDNESS_OFFSET + 10.0f * log10f(Power / Blocks) + LOUDNESS_REL_GATE;
+  First = (Gate > LOUDNESS_ABS_GATE) ?
+      (uint32_t)((Gate - LOUDNESS_ABS_GATE) / LOUDNESS_BIN_DB) : 0;
+  Power = 0.0f;
+  Blocks = 0;
+  for(uint32_t i = First; i < LOUDNESS_BINS; i++)
+    {
+      Power += gBinPower[i];
+      Blocks += gBinBlocks[i];
+    }
+  if(Blocks == 0) return false;
+
+  *LufsDb10 = (int16_t)lrintf(10.0f * (LOUDNESS_OFFSET + 10.0f * log10f(Power / Blocks)));
+  return true;
+}
+
+/**
+ * @brief Run a channel through a direct form I biquad.
+ */
+static float
+Loudness_Filter(LoudnessBiquad_t* Biquad, uint8_t Ch, float In)
+{
+  float* X = Biquad->X[Ch];
+  float* Y = Biquad->Y[Ch];
+  float Out = Biquad->B[0] * In + Biquad->B[1] * X[0] + Biquad->B[2] * X[1] -
+      Biquad->A[0] * Y[0] - Biquad->A[1] * Y[1];
+
+  X[1] = X[0];
+  X[0] = In;
+  Y[1] = Y[0];
+  Y[0] = Out;
+  return Out;
+}
+
+/**
+ * @brief Close a 100 ms step, each step ends a block of the last four and
+ * the block goes to the bin of its loudness.
+ */
+static void
+Loudness_EndStep(void)
+{
+  float Power = 0.0f;
+  float Lufs;
+  int32_t Bin;
+
+  gSteps[gStepsNum % LOUDNESS_STEPS_PER_BLOCK] = gStepPower / gStepSamples;
+  gStepsNum++;
+  gStepPower = 0.0f;
+  gStepLeft = gStepSamples;
+  if(gStepsNum < LOUDNESS_STEPS_PER_BLOCK) return;
+
+  for(uint8_t i = 0; i < LOUDNESS_STEPS_PER_BLOCK; i++) Power += gSteps[i];
+  Power /= LOUDNESS_STEPS_PER_BLOCK;
+  if(Power <= 0.0f) return;
+
+  Lufs = LOUDNESS_OFFSET + 10.0f * log10f(Power);
+  if(Lufs < LOUDNESS_ABS_GATE) return;
+  Bin = (int32_t)((Lufs - LOUDNESS_ABS_GATE) / LOUDNESS_BIN_DB);
+  if(Bin >= LOUDNESS_BINS) Bin = LOUDNESS_BINS - 1;
+  gBinPower[Bin] += Power;
+  gBinBlocks[Bin]++;
+}
+
+//---------------------------------------------------------------------------//
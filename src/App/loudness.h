@@ -0,0 +1,30 @@
+/**
+ * @file loudness.h
+ * @author Mohamed Hassanin
+ * @brief Integrated loudness of a track after ITU-R BS.1770, K-weighted
+ * and gated, for the loudness normalization of the playback.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef LOUDNESS_H_
+#define LOUDNESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define LOUDNESS_TARGET_DB10 (-180) // -18 LUFS, the ReplayGain 2 reference
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void Loudness_Begin(uint32_t Rate);
+void Loudness_Process(const int16_t* Samples, uint32_t Frames);
+bool Loudness_End(int16_t* LufsDb10, int16_t* PeakDb10);
+
+#endif
+//---------------------------------------------------------------------------//
@@ -0,0 +1,231 @@
+/**
+ * @file meter.c
+ * @author Mohamed Hassanin
+ * @brief Peak and RMS level meter of the stream being played. Each block
+ * is read in place, a frame per word: the dual 16-bit subtract and select
+ * keep the highest and the lowest sample of both channels and the dual
+ * MAC sums their squares. The levels are converted to dB once a block.
+ * The peak falls at METER_FALL_DB_S on the VU bar of the four LEDs, the
+ * held peak waits METER_HOLD_MS before it falls too.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/meter.h"
+
+#include <math.h>
+
+#include "main.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define METER_FALL_DB_S 20.0f
+#define METER_HOLD_MS 1500
+#define METER_FULL_SCALE 32768.0f
+#define METER_LEDS_NUM 4
+#define METER_LEDS (GREEN_LED_Pin | ORANGE_LED_Pin | BLUE_RED_Pin | RED_LED_Pin)
+
+//---------------------------------------------------------------------------//
+//variable definitions
+
+// the LEDs of the bar from the bottom and the level each one lights at
+static const uint16_t gLeds[METER_LEDS_NUM] = {
+  GREEN_LED_Pin, ORANGE_LED_Pin, BLUE_RED_Pin, RED_LED_Pin,
+};
+static const int16_t gLedDb10[METER_LEDS_NUM] = {-400, -200, -90, -10};
+
+static uint32_t gRate = 0;
+
+static int16_t gPeakDb10[2] = {METER_FLOOR_DB10, METER_FLOOR_DB10};
+static int16_t gRmsDb10 = METER_FLOOR_DB10;
+static float gLevel = METER_FLOOR_DB10;
+static float gHold = METER_FLOOR_DB10;
+static uint32_t gHoldFrames = 0;
+static int16_t gMaxDb10 = METER_FLOOR_DB10;
+static uint32_t gClips = 0;
+static uint32_t gCyclesPerBlock = 0;
+static uint16_t gBlockFrames = 0;
+
+// the bar owns the LEDs while the stream plays, the mount state LED is
+// given back after
+static bool gIsBarOn = true;
+static bool gIsBarShown = false;
+static GPIO_PinState gMountLed;
+static uint16_t gBarLeds = 0;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static int16_t Meter_Db10(float Ratio);
+static void Meter_ShowBar(void);
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+void
+Meter_SetRate(uint32_t Rate)
+{
+  gRate = Rate;
+}
+
+/**
+ * @brief Measure a block of interleaved stereo samples, the buffer must be
+ * word aligned. It's called on each processed half buffer.
+ */
+void
+Meter_Process(const int16_t* Samples, uint32_t Frames)
+{
+  uint32_t Start = DWT->CYCCNT;
+  const uint32_t* Frame = (const uint32_t*)Samples;
+  uint32_t Max = 0x80008000; // -32768 in both halves
+  uint32_t Min = 0x7FFF7FFF;
+  uint64_t Squares = 0;
+  int32_t Peak[2];
+  int16_t Loudest;
+  float Fall;
+
+  if(Frames == 0) return;
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      __SSUB16(Frame[i], Max);
+      Max = __SEL(Frame[i], Max);
+      __SSUB16(Min, Frame[i]);
+      Min = __SEL(Frame[i], Min);
+      Squares = __SMLALD(Frame[i], Frame[i], Squares);
+    }
+
+  Peak[0] = (int16_t)Max;
+  if(-(int16_t)Min > Peak[0]) Peak[0] = -(int16_t)Min;
+  Peak[1] = (int16_t)(Max >> 16);
+  if(-(int16_t)(Min >> 16) > Peak[1]) Peak[1] = -(int16_t)(Min >> 16);
+
+  gPeakDb10[0] = Meter_Db10(Peak[0] / METER_FULL_SCALE);
+  gPeakDb10[1] = Meter_Db10(Peak[1] / METER_FULL_SCALE);
+  gRmsDb10 = Meter_Db10(sqrtf((float)Squares / (2 * Frames)) / METER_FULL_SCALE);
+  if(Peak[0] >= INT16_MAX || Peak[1] >= INT16_MAX) gClips++;
+
+  // the peak falls from where it was unless the block is louder
+  Fall = gRate ? METER_FALL_DB_S * 10.0f * Frames / gRate : 0.0f;
+  Loudest = (gPeakDb10[0] > gPeakDb10[1]) ? gPeakDb10[0] : gPeakDb10[1];
+  gLevel = (gLevel - Fall > Loudest) ? gLevel - Fall : Loudest;
+  if(Loudest >= gHold)
+    {
+      gHold = Loudest;
+      gHoldFrames = 0;
+    }
+  else if(gRate && (gHoldFrames += Frames) >= gRate / 1000 * METER_HOLD_MS)
+    {
+      gHold = (gHold - Fall > Loudest) ? gHold - Fall : Loudest;
+    }
+  if(Loudest > gMaxDb10) gMaxDb10 = Loudest;
+
+  Meter_ShowBar();
+  gBlockFrames = (uint16_t)Frames;
+  gCyclesPerBlock = DWT->CYCCNT - Start;
+}
+
+/**
+ * @brief The stream stopped, give the LEDs back to the mount state and let
+ * the levels fall to the floor.
+ */
+void
+Meter_Release(void)
+{
+  gPeakDb10[0] = METER_FLOOR_DB10;
+  gPeakDb10[1] = METER_FLOOR_DB10;
+  gRmsDb10 = METER_FLOOR_DB10;
+  gLevel = METER_FLOOR_DB10;
+  gHold = METER_FLOOR_DB10;
+  if(!gIsBarShown) return;
+
+  HAL_GPIO_WritePin(GPIOD, METER_LEDS, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(GREEN_LED_GPIO_Port, GREEN_LED_Pin, gMountLed);
+  gIsBarShown = false;
+  gBarLeds = 0;
+}
+
+/**
+ * @brief Turn the VU bar on or off, the LEDs only show the mount state
+ * when it's off.
+ */
+void
+Meter_SetBar(bool IsOn)
+{
+  if(!IsOn) Meter_Release();
+  gIsBarOn = IsOn;
+}
+
+/**
+ * @brief Get the levels, the highest peak is held until this read.
+ */
+void
+Meter_GetStats(MeterStats_t* Stats)
+{
+  Stats->PeakDb10[0] = gPeakDb10[0];
+  Stats->PeakDb10[1] = gPeakDb10[1];
+  Stats->RmsDb10 = gRmsDb10;
+  Stats->LevelDb10 = (int16_t)gLevel;
+  Stats->HoldDb10 = (int16_t)gHold;
+  Stats->MaxDb10 = gMaxDb10;
+  Stats->Clips = gClips;
+  Stats->CyclesPerBlock = gCyclesPerBlock;
+  Stats->BlockFrames = gBlockFrames;
+  Stats->IsBarOn = gIsBarOn;
+  gMaxDb10 = METER_FLOOR_DB10;
+}
+
+/**
+ * @brief Convert an amplitude relative to the full scale to 0.1 dB.
+ */
+static int16_t
+Meter_Db10(float Ratio)
+{
+  float Db10;
+
+  if(Ratio <= 0.0f) return METER_FLOOR_DB10;
+  Db10 = 200.0f * log10f(Ratio);
+  return (Db10 < METER_FLOOR_DB10) ? METER_FLOOR_DB10 : (int16_t)lrintf(Db10);
+}
+
+/**
+ * @brief Light the LEDs below the level, the top one at the held peak. The
+ * pins are only written when the bar changes.
+ */
+static void
+Meter_ShowBar(void)
+{
+  uint16_t Leds = 0;
+
+  if(!gIsBarOn) return;
+  if(!gIsBarShown)
+    {
+      gMountLed = HAL_GPIO_ReadPin(GREEN_LED_GPIO_Port, GREEN_LED_Pin);
+      gIsBarShown = true;
+      gBarLeds = 0xFFFF;
+    }
+
+  for(uint8_t i = 0; i < METER_LEDS_NUM; i++)
+    {
+      if(gLevel >= gLedDb10[i]) Leds |= gLeds[i];
+    }
+  for(uint8_t i = METER_LEDS_NUM; i > 0; i--)
+    {
+      if(gHold >= gLedDb10[i - 1])
+        {
+          Leds |= gLeds[i - 1];
+          break;
+        }
+    }
+
+  if(Leds == gBarLeds) return;
+  if(Leds) HAL_GPIO_WritePin(GPIOD, Leds, GPIO_PIN_SET);
+  if(Leds != METER_LEDS) HAL_GPIO_WritePin(GPIOD, METER_LEDS & ~Leds, GPIO_PIN_RESET);
+  gBarLeds = Leds;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,46 @@
+/**
+ * @file meter.h
+ * @author Mohamed Hassanin
+ * @brief Peak and RMS level meter of the stream being played, with a peak
+ * hold and a VU bar on the board LEDs.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef METER_H_
+#define METER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define METER_FLOOR_DB10 (-960)
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  int16_t PeakDb10[2];    // of the last block, by channel
+  int16_t RmsDb10;        // of the last block, both channels
+  int16_t LevelDb10;      // the peak with its decay, shown by the bar
+  int16_t HoldDb10;       // the held peak
+  int16_t MaxDb10;        // the highest peak since the last read
+  uint32_t Clips;         // blocks that reached the full scale
+  uint32_t CyclesPerBlock; // of the last block
+  uint16_t BlockFrames;
+  bool IsBarOn;
+} MeterStats_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+void Meter_SetRate(uint32_t Rate);
+void Meter_Process(const int16_t* Samples, uint32_t Frames);
+void Meter_Release(void);
+void Meter_SetBar(bool IsOn);
+void Meter_GetStats(MeterStats_t* Stats);
+
+#endif
+//---------------------------------------------------------------------------//
@@ -0,0 +1,408 @@
+/**
+ * @file stretch.c
+ * @author Mohamed Hassanin
+ * @brief Time-stretch of the stereo stream by WSOLA. The output is built
+ * from segments of the input taken every STRETCH_HOP frames times the
+ * speed, each cross-faded over STRETCH_HOP frames into the natural
+ * continuation of the previous one. The segment start is moved by up to
+ * STRETCH_SEEK frames to where it's the most alike to that continuation,
+ * so the pitch periods line up. The likeness is a normalized correlation
+ * of the mono signal taken every STRETCH_DECIMATION frames, searched
+ * every STRETCH_DECIMATION frames first then refined around the best.
+ * The input is read ahead into a ring by the player, as much as the next
+ * half buffer takes at the speed.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/stretch.h"
+
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+// output frames per segment and overlap, 11.6 ms at 44.1 kHz
+#define STRETCH_HOP 256
+#define STRETCH_HOP_SHIFT 8
+// the segment start is searched this far around its nominal position
+#define STRETCH_SEEK 128
+#define STRETCH_DECIMATION 4
+#define STRETCH_TAPS (STRETCH_HOP / STRETCH_DECIMATION)
+#define STRETCH_SPAN ((STRETCH_HOP + 2 * STRETCH_SEEK) / STRETCH_DECIMATION)
+// input frames, a power of 2. It holds the oldest frame a step may use
+// up to the read-ahead of a half at the maximum speed
+#define STRETCH_RING 2048
+#define STRETCH_RING_MASK (STRETCH_RING - 1)
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static uint16_t gSpeed = STRETCH_UNITY;
+
+// input, by frame count since the reset
+static int16_t gRing[STRETCH_RING][2];
+static uint32_t gWritten = 0;
+static bool gIsEnded = false;
+static uint32_t gEnd = 0; // frames of the file, once it ended
+
+// the nominal start of the next segment and the continuation of the last
+static uint32_t gNominal = 0;
+static uint32_t gNominalRem = 0; // in 1/STRETCH_UNITY frame
+static uint32_t gNext = 0;
+static bool gIsPrimed = false;
+
+// frames of the last step not taken by the DMA yet
+static int16_t gOut[STRETCH_HOP][2];
+static uint16_t gOutPos = STRETCH_HOP;
+
+// the correlation of a step, the continuation and the search span
+static int16_t gRef[STRETCH_TAPS];
+static int16_t gMono[STRETCH_SPAN];
+
+static uint32_t gSteps = 0;
+static uint32_t gCyclesPerFrame10 = 0;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static uint32_t Stretch_Hop(void);
+static uint32_t Stretch_Oldest(void);
+static int16_t Stretch_Mono(uint32_t Frame);
+static float Stretch_Score(const int16_t* Ref, const int16_t* Cand);
+static uint32_t Stretch_Low(void);
+static uint32_t Stretch_Search(uint32_t Low);
+static bool Stretch_Step(void);
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Set the playback speed, x100. The running stretch goes on at the
+ * new speed from its next segment.
+ */
+bool
+Stretch_SetSpeed(uint16_t Speed)
+{
+  if(Speed < STRETCH_SPEED_MIN || Speed > STRETCH_SPEED_MAX) return false;
+  gSpeed = Speed;
+  return true;
+}
+
+uint16_t
+Stretch_GetSpeed(void)
+{
+  return gSpeed;
+}
+
+/**
+ * @brief Drop the input and the output, the next input is the start of
+ * a new stream. The speed is kept.
+ */
+void
+Stretch_Reset(void)
+{
+  gWritten = 0;
+  gIsEnded = false;
+  gEnd = 0;
+  gNominal = 0;
+  gNominalRem = 0;
+  gNext = 0;
+  gIsPrimed = false;
+  gOutPos = STRETCH_HOP;
+}
+
+/**
+ * @brief Get where the next input frames go in the ring, up to the read
+ * ahead of OutFrames at the speed. The ring may wrap, so the space is
+ * asked again after a commit.
+ *
+ * @return the frames to be read to Buf, 0 when the read ahead is there
+ */
+uint32_t
+Stretch_GetSpace(int16_t** Buf, uint32_t OutFrames)
+{
+  uint32_t Out = STRETCH_HOP - gOutPos;
+  uint32_t Steps = 0;
+  uint32_t Target;
+  uint32_t Space;
+  uint32_t Contig;
+
+  if(gIsEnded) return 0;
+
+  // a step takes input up to its nominal start plus the search and the
+  // overlap, a segment of a slower speed may reach a hop past that
+  if(OutFrames > Out) Steps = (OutFrames - Out + STRETCH_HOP - 1) / STRETCH_HOP;
+  Target = gNominal + 1 + STRETCH_SEEK + 2 * STRETCH_HOP;
+  if(Steps > 1) Target += (Steps - 1) * Stretch_Hop();
+  if(Target <= gWritten) return 0;
+
+  Space = STRETCH_RING - (gWritten - Stretch_Oldest());
+  if(Space > Target - gWritten) Space = Target - gWritten;
+  Contig = STRETCH_RING - (gWritten & STRETCH_RING_MASK);
+  if(Space > Contig) Space = Contig;
+
+  *Buf = gRing[gWritten & STRETCH_RING_MASK];
+  return Space;
+}
+
+/**
+ * @brief Count the frames read to the space.
+ */
+void
+Stretch_Commit(uint32_t Frames)
+{
+  gWritten += Frames;
+}
+
+/**
+ * @brief Mark the end of the input, the segments past it are taken from
+ * silence until the last frame was played.
+ */
+void
+Stretch_End(void)
+{
+  if(gIsEnded) return;
+  gIsEnded = true;
+  gEnd = gWritten;
+}
+
+/**
+ * @brief Check the input ended and all of it was played.
+ */
+bool
+Stretch_IsDrained(void)
+{
+  return gIsEnded && gOutPos == STRETCH_HOP && (!gIsPrimed || gNext >= gEnd);
+}
+
+/**
+ * @brief Get the input frames read ahead of the next segment, they go
+ * back to the file when the stretch stops.
+ */
+uint32_t
+Stretch_GetBuffered(void)
+{
+  uint32_t Last = gIsEnded ? gEnd : gWritten;
+
+  return (Last > gNominal) ? Last - gNominal : 0;
+}
+
+/**
+ * @brief Stretch the input into interleaved stereo samples.
+ *
+ * @return the frames made, fewer than Frames when the input runs short
+ */
+uint32_t
+Stretch_Process(int16_t* Samples, uint32_t Frames)
+{
+  uint32_t Start = DWT->CYCCNT;
+  uint32_t Made = 0;
+  uint32_t Len;
+
+  while(Made < Frames)
+    {
+      if(gOutPos == STRETCH_HOP && !Stretch_Step()) break;
+      Len = STRETCH_HOP - gOutPos;
+      if(Len > Frames - Made) Len = Frames - Made;
+      memcpy(&Samples[2 * Made], gOut[gOutPos], Len * sizeof(gOut[0]));
+      gOutPos += Len;
+      Made += Len;
+    }
+
+  if(Made) gCyclesPerFrame10 = (DWT->CYCCNT - Start) * 10 / Made;
+  return Made;
+}
+
+void
+Stretch_GetStats(StretchStats_t* Stats)
+{
+  Stats->Speed = gSpeed;
+  Stats->ReadAhead = (uint16_t)(STRETCH_SEEK + 2 * STRETCH_HOP + Stretch_Hop());
+  Stats->Buffered = (uint16_t)Stretch_GetBuffered();
+  Stats->Steps = gSteps;
+  Stats->CyclesPerFrame10 = gCyclesPerFrame10;
+}
+
+/**
+ * @brief Get the input hop of a segment at the speed.
+ */
+static uint32_t
+Stretch_Hop(void)
+{
+  return ((uint32_t)STRETCH_HOP * gSpeed + STRETCH_UNITY - 1) / STRETCH_UNITY;
+}
+
+/**
+ * @brief Get the first candidate start of the next segment.
+ */
+static uint32_t
+Stretch_Low(void)
+{
+  return (gNominal > STRETCH_SEEK) ? gNominal - STRETCH_SEEK : 0;
+}
+
+/**
+ * @brief Get the oldest input frame the next step may use.
+ */
+static uint32_t
+Stretch_Oldest(void)
+{
+  uint32_t Oldest = Stretch_Low();
+
+  if(gIsPrimed && gNext < Oldest) Oldest = gNext;
+  return Oldest;
+}
+
+static int16_t
+Stretch_Mono(uint32_t Frame)
+{
+  const int16_t* In = gRing[Frame & STRETCH_RING_MASK];
+
+  return (int16_t)((In[0] + In[1]) >> 1);
+}
+
+/**
+ * @brief Correlate a candidate to the reference, normalized by the energy
+ * of the candidate. The sign is kept so opposite phases score low.
+ */
+static float
+Stretch_Score(const int16_t* Ref, const int16_t* Cand)
+{
+  int64_t Corr = 0;
+  int64_t Energy = 1;
+
+  for(uint32_t i = 0; i < STRETCH_TAPS; i++)
+    {
+      Corr += Ref[i] * Cand[i];
+      Energy += Cand[i] * Cand[i];
+    }
+  return (float)Corr * (float)((Corr < 0) ? -Corr : Corr) / (float)Energy;
+}
+
+/**
+ * @brief Find the segment start from Low on that lines up best with the
+ * continuation of the last segment.
+ */
+static uint32_t
+Stretch_Search(uint32_t Low)
+{
+  uint32_t Best = 0;
+  uint32_t Coarse;
+  uint32_t First;
+  uint32_t Last;
+  int16_t Cand[STRETCH_TAPS];
+  float Score;
+  float BestScore;
+
+  for(uint32_t i = 0; i < STRETCH_TAPS; i++)
+    {
+      gRef[i] = Stretch_Mono(gNext + i * STRETCH_DECIMATION);
+    }
+  for(uint32_t i = 0; i < STRETCH_SPAN; i++)
+    {
+      gMono[i] = Stretch_Mono(Low + i * STRETCH_DECIMATION);
+    }
+
+  // coarse, candidates a decimation apart share the decimated span
+  BestScore = Stretch_Score(gRef, &gMono[0]);
+  for(uint32_t i = 1; i + STRETCH_TAPS <= STRETCH_SPAN; i++)
+    {
+      Score = Stretch_Score(gRef, &gMono[i]);
+      if(Score > BestScore)
+        {
+          BestScore = Score;
+          Best = i;
+        }
+    }
+
+  // refine between the neighbours of the best one
+  Coarse = Low + Best * STRETCH_DECIMATION;
+  First = (Coarse > Low + STRETCH_DECIMATION - 1) ? Coarse - STRETCH_DECIMATION + 1 : Low;
+  Last = Coarse + STRETCH_DECIMATION - 1;
+  if(Last > Low + 2 * STRETCH_SEEK) Last = Low + 2 * STRETCH_SEEK;
+  Best = Coarse;
+  for(uint32_t Pos = First; Pos <= Last; Pos++)
+    {
+      if(Pos == Coarse) continue;
+      for(uint32_t i = 0; i < STRETCH_TAPS; i++)
+        {
+          Cand[i] = Stretch_Mono(Pos + i * STRETCH_DECIMATION);
+        }
+      Score = Stretch_Score(gRef, Cand);
+      if(Score > BestScore)
+        {
+          BestScore = Score;
+          Best = Pos;
+        }
+    }
+  return Best;
+}
+
+/**
+ * @brief Add the next segment to the output, when its input is there.
+ * The last segment fades out over its continuation while the new one
+ * fades in.
+ */
+static bool
+Stretch_Step(void)
+{
+  uint32_t Low = Stretch_Low();
+  uint32_t Needed = Low + 2 * STRETCH_SEEK + STRETCH_HOP;
+  uint32_t Pos;
+  const int16_t* Old;
+  const int16_t* New;
+
+  if(!gIsPrimed) Needed = STRETCH_HOP;
+  if(gIsPrimed && gNext + STRETCH_HOP > Needed) Needed = gNext + STRETCH_HOP;
+  if(Needed > gWritten)
+    {
+      if(!gIsEnded || (gIsPrimed && gNext >= gEnd) || (!gIsPrimed && gEnd == 0))
+        {
+          return false;
+        }
+      // past the end the segments are taken from silence
+      for(; gWritten < Needed; gWritten++)
+        {
+          gRing[gWritten & STRETCH_RING_MASK][0] = 0;
+          gRing[gWritten & STRETCH_RING_MASK][1] = 0;
+        }
+    }
+
+  if(!gIsPrimed)
+    {
+      // the first segment has nothing to fade from
+      for(uint32_t i = 0; i < STRETCH_HOP; i++)
+        {
+          gOut[i][0] = gRing[i & STRETCH_RING_MASK][0];
+          gOut[i][1] = gRing[i & STRETCH_RING_MASK][1];
+        }
+      Pos = 0;
+      gIsPrimed = true;
+    }
+  else
+    {
+      Pos = Stretch_Search(Low);
+      for(uint32_t i = 0; i < STRETCH_HOP; i++)
+        {
+          Old = gRing[(gNext + i) & STRETCH_RING_MASK];
+          New = gRing[(Pos + i) & STRETCH_RING_MASK];
+          gOut[i][0] = (int16_t)((Old[0] * (int32_t)(STRETCH_HOP - i) + New[0] * (int32_t)i) >> STRETCH_HOP_SHIFT);
+          gOut[i][1] = (int16_t)((Old[1] * (int32_t)(STRETCH_HOP - i) + New[1] * (int32_t)i) >> STRETCH_HOP_SHIFT);
+        }
+    }
+
+  gNext = Pos + STRETCH_HOP;
+  gNominalRem += (uint32_t)STRETCH_HOP * gSpeed;
+  gNominal += gNominalRem / STRETCH_UNITY;
+  gNominalRem %= STRETCH_UNITY;
+  gOutPos = 0;
+  gSteps++;
+  return true;
+}
+
+//---------------------------------------------------------------------------//
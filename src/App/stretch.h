@@ -0,0 +1,49 @@
+/**
+ * @file stretch.h
+ * @author Mohamed Hassanin
+ * @brief Time-stretch of the stereo stream by WSOLA, the playback speed
+ * changes and the pitch doesn't.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef STRETCH_H_
+#define STRETCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define STRETCH_UNITY 100 // speed x100
+#define STRETCH_SPEED_MIN 50
+#define STRETCH_SPEED_MAX 200
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  uint16_t Speed;            // x100
+  uint16_t ReadAhead;        // input frames a half buffer takes at the speed
+  uint16_t Buffered;         // input frames read and not played yet
+  uint32_t Steps;            // overlaps added
+  uint32_t CyclesPerFrame10; // measured per output frame, x10
+} StretchStats_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+bool Stretch_SetSpeed(uint16_t Speed);
+uint16_t Stretch_GetSpeed(void);
+void Stretch_Reset(void);
+uint32_t Stretch_GetSpace(int16_t** Buf, uint32_t OutFrames);
+void Stretch_Commit(uint32_t Frames);
+void Stretch_End(void);
+bool Stretch_IsDrained(void);
+uint32_t Stretch_GetBuffered(void);
+uint32_t Stretch_Process(int16_t* Samples, uint32_t Frames);
+void Stretch_GetStats(StretchStats_t* Stats);
+
+#endif
+//---------------------------------------------------------------------------//
@@ -0,0 +1,378 @@
+/**
+ * @file wav_decode.c
+ * @author Mohamed Hassanin
+ * @brief Decoders of the WAV sample formats to the 16-bit stereo stream
+ * of the player, mono is played on both channels. G.711 samples are
+ * expanded by a 256 entry table each. IMA ADPCM is decoded a frame at a
+ * time so a block can be decoded in parts, its step difference and next
+ * index are tables by step index and nibble, the only arithmetic left is
+ * the predictor update.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+//---------------------------------------------------------------------------//
+//includes
+#include "../App/wav_decode.h"
+
+#include <string.h>
+
+#include "stm32f4xx_hal.h"
+
+//---------------------------------------------------------------------------//
+//defines
+// frames of the blocks given to PCM and G.711, 11.6 ms at 44.1 kHz
+#define WAV_DECODE_FRAMES 512
+#define IMA_STEPS 89
+#define IMA_HEADER_SIZE 4 // per channel: predictor (16), step index, 0
+#define IMA_GROUP_SIZE 4  // per channel: 8 samples
+#define IMA_GROUP_FRAMES 8
+
+//---------------------------------------------------------------------------//
+//variable definitions
+static const uint16_t gImaStep[IMA_STEPS] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+  45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+  209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724,
+  796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272,
+  2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132,
+  7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500,
+  20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t gImaIndexStep[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+// built on the first use, by step index and magnitude of the nibble
+static uint16_t gImaDiff[IMA_STEPS][8];
+static uint8_t gImaNext[IMA_STEPS][8];
+static int16_t gAlaw[256];
+static int16_t gMulaw[256];
+static bool gIsBuilt = false;
+
+//---------------------------------------------------------------------------//
+//Function definitions
+
+/**
+ * @brief Build the decoding tables, the IMA ADPCM difference is the
+ * reference sum of shifted steps so the decode is bit-exact.
+ */
+static void
+WavDecode_Build(void)
+{
+  uint16_t Step;
+  int16_t Next;
+  int16_t Magnitude;
+  uint8_t Segment;
+  uint8_t a;
+  uint8_t u;
+
+  for(uint8_t Index = 0; Index < IMA_STEPS; Index++)
+    {
+      Step = gImaStep[Index];
+      for(uint8_t Nibble = 0; Nibble < 8; Nibble++)
+        {
+          gImaDiff[Index][Nibble] = (Step >> 3) + ((Nibble & 4) ? Step : 0) +
+              ((Nibble & 2) ? Step >> 1 : 0) + ((Nibble & 1) ? Step >> 2 : 0);
+          Next = Index + gImaIndexStep[Nibble];
+          gImaNext[Index][Nibble] = (Next < 0) ? 0 :
+              (Next >= IMA_STEPS) ? IMA_STEPS - 1 : (uint8_t)Next;
+        }
+    }
+
+  // ITU-T G.711, 13-bit A-law and 14-bit u-law scaled to 16 bits
+  for(uint16_t Code = 0; Code < 256; Code++)
+    {
+      a = (uint8_t)Code ^ 0x55;
+      Segment = (a & 0x70) >> 4;
+      Magnitude = (a & 0x0F) << 4;
+      Magnitude += (Segment == 0) ? 8 : 0x108;
+      if(Segment > 1) Magnitude <<= Segment - 1;
+      gAlaw[Code] = (a & 0x80) ? Magnitude : -Magnitude;
+
+      u = ~(uint8_t)Code;
+      Magnitude = (((u & 0x0F) << 3) + 0x84) << ((u & 0x70) >> 4);
+      gMulaw[Code] = (u & 0x80) ? 0x84 - Magnitude : Magnitude - 0x84;
+    }
+  gIsBuilt = true;
+}
+
+static uint16_t
+WavDecode_GetU16(const uint8_t* Data)
+{
+  return (uint16_t)(Data[0] | (Data[1] << 8));
+}
+
+/**
+ * @brief Get the format of a file from its fmt chunk, the sub-format of
+ * an extensible one is its format tag.
+ *
+ * @param Len bytes of the chunk read, up to WAV_DECODE_FMT_SIZE
+ * @return false for a truncated chunk
+ */
+bool
+WavDecode_ParseFmt(WavFormat_t* Format, const uint8_t* Fmt, uint32_t Len)
+{
+  if(Len < 16) return false;
+
+  Format->Tag = WavDecode_GetU16(&Fmt[0]);
+  Format->Channels = WavDecode_GetU16(&Fmt[2]);
+  Format->SampleRate = WavDecode_GetU16(&Fmt[4]) |
+      ((uint32_t)WavDecode_GetU16(&Fmt[6]) << 16);
+  Format->BlockAlign = WavDecode_GetU16(&Fmt[12]);
+  Format->BitsPerSample = WavDecode_GetU16(&Fmt[14]);
+  Format->SamplesPerBlock = 0;
+
+  if(Len >= 20 && WavDecode_GetU16(&Fmt[16]) >= 2 &&
+      Format->Tag == WAV_FORMAT_IMA_ADPCM)
+    {
+      Format->SamplesPerBlock = WavDecode_GetU16(&Fmt[18]);
+    }
+  if(Format->Tag == WAV_FORMAT_EXTENSIBLE)
+    {
+      if(Len < WAV_DECODE_FMT_SIZE) return false;
+      Format->Tag = WavDecode_GetU16(&Fmt[24]);
+    }
+  return true;
+}
+
+/**
+ * @brief Check if the samples of a format are the player stream already,
+ * 16-bit stereo PCM is streamed without a decoder.
+ */
+bool
+WavDecode_IsNative(const WavFormat_t* Format)
+{
+  return Format->Tag == WAV_FORMAT_PCM && Format->Channels == 2 &&
+      Format->BitsPerSample == 16;
+}
+
+/**
+ * @brief Set a decoder up for a format, no block is loaded.
+ *
+ * @return false for a format that isn't supported
+ */
+bool
+WavDecode_Init(WavDecoder_t* Decoder, const WavFormat_t* Format)
+{
+  uint16_t GroupSize = IMA_GROUP_SIZE * Format->Channels;
+  uint16_t Frames;
+
+  if(!gIsBuilt) WavDecode_Build();
+  if(Format->Channels < 1 || Format->Channels > 2 || Format->SampleRate == 0)
+    {
+      return false;
+    }
+
+  memset(Decoder, 0, sizeof(WavDecoder_t));
+  Decoder->Tag = Format->Tag;
+  Decoder->Channels = (uint8_t)Format->Channels;
+  Decoder->BlockFrames = WAV_DECODE_FRAMES;
+
+  switch(Format->Tag)
+  {
+    case WAV_FORMAT_PCM:
+      if(Format->BitsPerSample != 16) return false;
+      Decoder->BlockBytes = WAV_DECODE_FRAMES * 2 * Format->Channels;
+      return true;
+    case WAV_FORMAT_ALAW:
+    case WAV_FORMAT_MULAW:
+      if(Format->BitsPerSample != 8) return false;
+      Decoder->BlockBytes = WAV_DECODE_FRAMES * Format->Channels;
+      return true;
+    case WAV_FORMAT_IMA_ADPCM:
+      if(Format->BitsPerSample != 4 || Format->BlockAlign <= GroupSize ||
+          Format->BlockAlign > WAV_DECODE_MAX_BLOCK ||
+          Format->BlockAlign % GroupSize)
+        {
+          return false;
+        }
+      // the header sample and 8 frames a group of each channel
+      Frames = 1 + (Format->BlockAlign / GroupSize - 1) * IMA_GROUP_FRAMES;
+      if(Format->SamplesPerBlock && Format->SamplesPerBlock < Frames)
+        {
+          Frames = Format->SamplesPerBlock;
+        }
+      Decoder->BlockBytes = Format->BlockAlign;
+      Decoder->BlockFrames = Frames;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Get the frames in the first Len bytes of a block, a partial IMA
+ * ADPCM group isn't decoded.
+ */
+static uint32_t
+WavDecode_BlockFrames(const WavDecoder_t* Decoder, uint32_t Len)
+{
+  uint32_t GroupSize = IMA_GROUP_SIZE * Decoder->Channels;
+  uint32_t Frames;
+
+  switch(Decoder->Tag)
+  {
+    case WAV_FORMAT_PCM:
+      return Len / (2 * Decoder->Channels);
+    case WAV_FORMAT_IMA_ADPCM:
+      if(Len < GroupSize) return 0;
+      Frames = 1 + (Len / GroupSize - 1) * IMA_GROUP_FRAMES;
+      return (Frames < Decoder->BlockFrames) ? Frames : Decoder->BlockFrames;
+    default:
+      return Len / Decoder->Channels;
+  }
+}
+
+/**
+ * @brief Get the frames the data of a file decodes to.
+ */
+uint32_t
+WavDecode_GetFrames(const WavDecoder_t* Decoder, uint32_t DataSize)
+{
+  return (DataSize / Decoder->BlockBytes) * Decoder->BlockFrames +
+      WavDecode_BlockFrames(Decoder, DataSize % Decoder->BlockBytes);
+}
+
+/**
+ * @brief Load the next block, the last one of the data may be shorter.
+ * A NULL block unloads the decoder.
+ */
+void
+WavDecode_Load(WavDecoder_t* Decoder, const uint8_t* Block, uint32_t Len)
+{
+  Decoder->Block = Block;
+  Decoder->Frame = 0;
+  Decoder->Frames = Block ? (uint16_t)WavDecode_BlockFrames(Decoder, Len) : 0;
+
+  if(Decoder->Tag != WAV_FORMAT_IMA_ADPCM || Decoder->Frames == 0) return;
+
+  for(uint8_t Ch = 0; Ch < Decoder->Channels; Ch++)
+    {
+      const uint8_t* Header = &Block[IMA_HEADER_SIZE * Ch];
+
+      Decoder->Predictor[Ch] = (int16_t)WavDecode_GetU16(Header);
+      Decoder->Index[Ch] = (Header[2] < IMA_STEPS) ? Header[2] : IMA_STEPS - 1;
+    }
+}
+
+static void
+WavDecode_RunIma(WavDecoder_t* Decoder, int16_t* Samples, uint32_t Frames)
+{
+  const uint8_t Channels = Decoder->Channels;
+  const uint32_t GroupSize = IMA_GROUP_SIZE * Channels;
+  int32_t Predictor[2] = { Decoder->Predictor[0], Decoder->Predictor[1] };
+  uint8_t Index[2] = { Decoder->Index[0], Decoder->Index[1] };
+  uint32_t Frame = Decoder->Frame;
+  uint32_t End = Frame + Frames;
+  const uint8_t* Data;
+  uint32_t Shift;
+  uint8_t Nibble;
+  int32_t Diff;
+
+  for(; Frame < End; Frame++)
+    {
+      // the frame 0 is the header sample, then a group of 4 bytes of each
+      // channel holds 8 samples, the low nibble first
+      if(Frame)
+        {
+          uint32_t k = Frame - 1;
+
+          Data = &Decoder->Block[GroupSize * (1 + k / IMA_GROUP_FRAMES) +
+                                 (k % IMA_GROUP_FRAMES) / 2];
+          Shift = (k & 1) << 2;
+          for(uint8_t Ch = 0; Ch < Channels; Ch++)
+            {
+              Nibble = (Data[IMA_GROUP_SIZE * Ch] >> Shift) & 0x0F;
+              Diff = gImaDiff[Index[Ch]][Nibble & 7];
+              Predictor[Ch] = __SSAT(Predictor[Ch] + ((Nibble & 8) ? -Diff : Diff), 16);
+              Index[Ch] = gImaNext[Index[Ch]][Nibble & 7];
+            }
+        }
+      if(Samples)
+        {
+          Samples[0] = (int16_t)Predictor[0];
+          Samples[1] = (int16_t)Predictor[Channels - 1];
+          Samples += 2;
+        }
+    }
+
+  Decoder->Frame = (uint16_t)End;
+  Decoder->Predictor[0] = Predictor[0];
+  Decoder->Predictor[1] = Predictor[1];
+  Decoder->Index[0] = Index[0];
+  Decoder->Index[1] = Index[1];
+}
+
+static void
+WavDecode_RunG711(const WavDecoder_t* Decoder, int16_t* Samples, uint32_t Frames)
+{
+  const int16_t* Table = (Decoder->Tag == WAV_FORMAT_ALAW) ? gAlaw : gMulaw;
+  const uint8_t* Data = &Decoder->Block[Decoder->Frame * Decoder->Channels];
+
+  if(Decoder->Channels == 2)
+    {
+      for(uint32_t i = 0; i < 2 * Frames; i++) Samples[i] = Table[Data[i]];
+      return;
+    }
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      Samples[2 * i] = Samples[2 * i + 1] = Table[Data[i]];
+    }
+}
+
+static void
+WavDecode_RunPcm(const WavDecoder_t* Decoder, int16_t* Samples, uint32_t Frames)
+{
+  const uint8_t* Data = &Decoder->Block[Decoder->Frame * 2 * Decoder->Channels];
+
+  if(Decoder->Channels == 2)
+    {
+      memcpy(Samples, Data, Frames * 4);
+      return;
+    }
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      Samples[2 * i] = Samples[2 * i + 1] = (int16_t)WavDecode_GetU16(&Data[2 * i]);
+    }
+}
+
+/**
+ * @brief Decode the next frames of the loaded block.
+ *
+ * @param Samples stereo output, NULL skips the frames
+ * @param Frames frames wanted
+ * @return frames decoded, less than wanted at the end of the block
+ */
+uint32_t
+WavDecode_Run(WavDecoder_t* Decoder, int16_t* Samples, uint32_t Frames)
+{
+  if(Frames > (uint32_t)(Decoder->Frames - Decoder->Frame))
+    {
+      Frames = Decoder->Frames - Decoder->Frame;
+    }
+
+  if(Decoder->Tag == WAV_FORMAT_IMA_ADPCM)
+    {
+      // the predictor goes through the skipped frames too
+      WavDecode_RunIma(Decoder, Samples, Frames);
+      return Frames;
+    }
+
+  if(Samples)
+    {
+      if(Decoder->Tag == WAV_FORMAT_PCM)
+        {
+          WavDecode_RunPcm(Decoder, Samples, Frames);
+        }
+      else
+        {
+          WavDecode_RunG711(Decoder, Samples, Frames);
+        }
+    }
+  Decoder->Frame += Frames;
+  return Frames;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,73 @@
+/**
+ * @file wav_decode.h
+ * @author Mohamed Hassanin
+ * @brief Decoders of the WAV sample formats to the 16-bit stereo stream
+ * of the player: 16-bit PCM, G.711 A-law and u-law and IMA ADPCM.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef WAV_DECODE_H_
+#define WAV_DECODE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_ALAW 0x0006
+#define WAV_FORMAT_MULAW 0x0007
+#define WAV_FORMAT_IMA_ADPCM 0x0011
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE // the format is in the sub-format GUID
+// a block is read whole, IMA ADPCM files with larger blocks are refused
+#define WAV_DECODE_MAX_BLOCK 2048
+// the bytes of the fmt chunk the decoders use
+#define WAV_DECODE_FMT_SIZE 26
+#define WAV_CHUNK_ID(a, b, c, d) \
+  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  uint16_t Tag;             // WAV_FORMAT_x
+  uint16_t Channels;
+  uint32_t SampleRate;
+  uint16_t BlockAlign;      // bytes
+  uint16_t BitsPerSample;
+  uint16_t SamplesPerBlock; // IMA ADPCM, frames per block
+  uint32_t FactFrames;      // frames of the fact chunk, 0 without one
+  uint32_t DataOfs;         // file offset of the samples
+  uint32_t DataSize;        // bytes, as the data chunk says
+} WavFormat_t;
+
+// A decoder reads its data a block at a time, the block is the unit of
+// seeking: a frame is reached by loading its block and skipping the
+// frames before it. G.711 and PCM have no block of their own, they are
+// given one of WAV_DECODE_FRAMES frames.
+typedef struct {
+  uint16_t Tag;
+  uint8_t Channels;
+  uint16_t BlockBytes;  // bytes of a whole block
+  uint16_t BlockFrames; // frames of a whole block
+  const uint8_t* Block; // the loaded block, owned by the caller
+  uint16_t Frame;       // next frame of the loaded block
+  uint16_t Frames;      // frames of the loaded block
+  int32_t Predictor[2]; // IMA ADPCM state per channel
+  uint8_t Index[2];
+} WavDecoder_t;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+bool WavDecode_ParseFmt(WavFormat_t* Format, const uint8_t* Fmt, uint32_t Len);
+bool WavDecode_Init(WavDecoder_t* Decoder, const WavFormat_t* Format);
+bool WavDecode_IsNative(const WavFormat_t* Format);
+uint32_t WavDecode_GetFrames(const WavDecoder_t* Decoder, uint32_t DataSize);
+void WavDecode_Load(WavDecoder_t* Decoder, const uint8_t* Block, uint32_t Len);
+uint32_t WavDecode_Run(WavDecoder_t* Decoder, int16_t* Samples, uint32_t Frames);
+
+#endif
+//---------------------------------------------------------------------------//
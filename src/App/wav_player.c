@@ -15,25 +15,78 @@
 //includes
 #include "../App/wav_player.h"
 
+#include <ctype.h>
+#include <math.h>
+#include <string.h>
+
 #include "fatfs.h" // to deal with files
+#include "diskio.h" // raw sector access for contiguous files
 
 #include "../Modules/CS43L22/CS43L22.h" //to control the audio codec
 #include "../Modules/I2s/I2s.h" //to change I2S clock
+#include "../App/latency.h" // command latency stages
+#include "../App/gain.h" // fades of the mutes and pauses
+#include "../App/eq.h" // parametric equalizer
+#include "../App/limiter.h" // keeps the EQ and volume boosts from clipping
+#include "../App/stretch.h" // playback speed
+#include "../App/meter.h" // level meter and LED VU bar
+#include "../App/loudness.h" // loudness normalization
+#include "../App/wav_decode.h" // compressed and non-stereo formats
+#include "../App/flac.h" // FLAC files
+#include "../App/dither.h" // requantization of the FLAC files
 
 //---------------------------------------------------------------------------//
 //defines
 #define DMA_BUFFER_SIZE  4096
+// Fast-seek cluster link map size in DWORDs (2 per fragment + 2 header items)
+#define CLUSTER_MAP_SIZE 64
+// Per-volume track catalogue limits
+#define CATALOGUE_MAX_TRACKS 64
+#define CATALOGUE_NAMES_SIZE WAV_PLAYER_LIST_MAX_SIZE
+#define TRACK_UNKNOWN 0xFFFF
+// "N:/" + file name
+#define TRACK_PATH_SIZE (_MAX_LFN + 4)
+// Refill read error handling
+#define REFILL_MAX_RETRIES 3
+#define REFILL_FIRST_BACKOFF_MS 1
+#define FRAME_SIZE (SAMPLE_SIZE * 2) // 16-bit stereo
+#define CONCEAL_FADE_FRAMES 128
+// a pause keeps the codec running that long before its standby
+#define CODEC_STANDBY_DELAY_MS 10000
+// a fade out is played once the half it ended in and the next one
+// were refilled after it, it's safe to stop the DMA on the refill after
+#define FADED_HALVES 3
+// the stream offsets are those of the samples of a 16-bit stereo PCM file
+// with a 44 bytes header, the other files are mapped to them
+#define STREAM_DATA_OFS 44
+// codec volumes from 231 up boost by 0.5 dB a step, up to +12 dB
+#define CODEC_VOL_0DB 231
+#define CODEC_VOL_STEP_DB10 5
+// the loudness of a track is measured a decoder block at a time,
+// decoded this many frames at a time
+#define SCAN_DECODE_FRAMES 256
+#define LOUDNESS_UNKNOWN INT16_MIN
+#define LOUDNESS_FAILED (INT16_MIN + 1) // unreadable or silent
 
 //---------------------------------------------------------------------------//
 //typedefs
 typedef struct
 {
-  uint32_t RiffMarker;
-  uint32_t FileSize;
-  uint32_t Reserved1[4];
-  uint32_t SampleRate;
-  uint32_t Reserved2[4];
-} WavHeader_t;
+  uint32_t Id;
+  uint32_t Size;
+} WavChunk_t;
+
+// The WAV files of a volume, names are stored '\n' terminated in one
+// string so the catalogue is also the list sent to the user.
+typedef struct
+{
+  bool IsBuilt;
+  uint16_t TracksNum;
+  uint16_t NameOfs[CATALOGUE_MAX_TRACKS];
+  char Names[CATALOGUE_NAMES_SIZE];
+  int16_t LufsDb10[CATALOGUE_MAX_TRACKS]; // LOUDNESS_UNKNOWN until measured
+  int16_t PeakDb10[CATALOGUE_MAX_TRACKS];
+} Catalogue_t;
 
 typedef enum
 {
@@ -61,28 +114,91 @@ typedef enum
   PLAYER_EVENT_STOP,
   PLAYER_EVENT_RESUME,
   PLAYER_EVENT_PAUSE,
+  PLAYER_EVENT_DISCONNECT,
 } PlayerEvent_t;
 
 //---------------------------------------------------------------------------//
 //variable definitions
 static FIL gWavFile;
-static uint32_t gFileLength;
-static uint32_t gFileRemainingSize = 0;
+static FSIZE_t gFileLength;
+static FSIZE_t gFileRemainingSize = 0;
 static uint32_t gSamplingFreq;
-static uint8_t gAudioBuffer[DMA_BUFFER_SIZE];
+static WavFormat_t gFormat;
+static uint8_t gAudioBuffer[DMA_BUFFER_SIZE] __ALIGNED(4);
 static UINT gFileReadBytesLen = 0;
-static uint8_t gFilesNames[DMA_BUFFER_SIZE];
+static volatile DmaState_t gDmaState = DMA_STATE_FULL_TRANSFER;
+// DMA events waiting for a refill by the main loop
+static volatile uint8_t gPendingDmaEvents = 0;
+static volatile uint32_t gUnderruns = 0;
+// a seek reaches the DMA at the half boundary after its first refill
+static bool gIsSeekPending = false;
+static volatile bool gIsSeekRefilled = false;
+static DWORD gClusterMap[CLUSTER_MAP_SIZE];
+
+// raw-sector streaming of contiguous files
+static bool gIsRawStream = false;
+static DWORD gRawFirstSector;
+static FSIZE_t gRawPos;
+static DWORD gRawCachedSector;
+static uint8_t gRawSectorBuf[_MAX_SS];
 
 static WavPlayerConfig_t gConfig;
 
-static DIR gDir;
-static FILINFO gFileInfo;
+// decoding of the files that aren't 16-bit stereo PCM, the stream
+// position is kept as the file is read a block at a time
+static bool gIsDecoding = false;
+static WavDecoder_t gDecoder;
+static FSIZE_t gStreamPos;
+static uint16_t gDecodeSkip; // frames of the next block before the position
+static uint8_t gDecodeBlock[WAV_DECODE_MAX_BLOCK] __ALIGNED(4);
+static bool gIsFlac = false;
+
+// refill read errors
+static WavPlayerReadStats_t gReadStats;
+static uint16_t gConcealDecayShift = 0;
+
+// track selection
+static Catalogue_t gCatalogues[_VOLUMES];
+static uint8_t gVolume = 0;
+static uint16_t gTrack = TRACK_UNKNOWN;
+static TCHAR gTrackPath[TRACK_PATH_SIZE];
 
 static volatile PlayerState_t gPlayerState = PLAYER_STATE_IDLE;
-//---------------------------------------------------------------------------//
-//variable declarations
-extern I2C_HandleTypeDef hi2c1;
 
+// playback snapshot taken when the USB drive is disconnected
+static bool gIsSnapshotValid = false;
+static bool gSnapshotWasPlaying;
+static TCHAR gSnapshotPath[TRACK_PATH_SIZE];
+static uint8_t gSnapshotVolume;
+static FSIZE_t gSnapshotSize;
+static DWORD gSnapshotCluster;
+static FSIZE_t gSnapshotPos;
+static uint32_t gConnectTick;
+static uint32_t gReconnectLatency;
+static uint32_t gPauseTick;
+
+// the fades, the codec and the DMA go quiet once the gain reached 0
+static bool gIsI2sRunning = false;
+static bool gIsCodecMuted = false;
+static bool gIsRewindPending = false; // a stop waiting for its fade
+static uint8_t gSilentHalves = 0;
+static bool gIsTrackStarting = false; // no refill since the track start
+
+// the refills go through the time-stretch at speeds other than 1x
+static bool gIsStretching = false;
+
+// loudness normalization, the catalogue is measured in the background
+static bool gIsNormalizing = false;
+static uint16_t gTrackGain = GAIN_UNITY; // the audible level of the track
+static FIL gScanFile;
+static bool gIsScanOpen = false;
+static uint8_t gScanVolume;
+static uint16_t gScanTrack = TRACK_UNKNOWN;
+static FSIZE_t gScanPos;
+static FSIZE_t gScanEnd; // file offset of the end of the samples
+static WavDecoder_t gScanDecoder;
+static uint8_t gScanBuf[WAV_DECODE_MAX_BLOCK] __ALIGNED(4);
+static int16_t gScanSamples[SCAN_DECODE_FRAMES * 2];
 //---------------------------------------------------------------------------//
 //Function declarations
 static void WavPlayer_DmaUpdate(DmaEvent_t);
@@ -90,6 +206,36 @@ static PlayerState_t WavPlayer_PlayerUpdate(PlayerEvent_t);
 
 inline static void WavPlayer_StartAudioCodec(void);
 inline static void WavPlayer_StopAudioCodec(void);
+static void WavPlayer_MapClusters(void);
+static bool WavPlayer_ReadHeader(FIL* File, WavFormat_t* Format);
+static void WavPlayer_SeekFile(FSIZE_t Ofs);
+static FRESULT WavPlayer_ReadFile(uint8_t* Buf, UINT Len, UINT* ReadLen);
+static FSIZE_t WavPlayer_TellFile(void);
+static void WavPlayer_SeekSamples(FSIZE_t Ofs);
+static FRESULT WavPlayer_ReadSamples(uint8_t* Buf, UINT Len, UINT* ReadLen);
+static FRESULT WavPlayer_Decode(uint8_t* Buf, UINT Len, UINT* ReadLen);
+static FSIZE_t WavPlayer_TellSamples(void);
+static FSIZE_t WavPlayer_TellStream(void);
+static bool WavPlayer_OpenAudioFile(const char* FilePath, FSIZE_t DataOfs);
+static bool WavPlayer_IsAudioFile(const FILINFO* Info);
+static Catalogue_t* WavPlayer_GetCatalogue(void);
+static uint16_t WavPlayer_LocateTrack(void);
+static bool WavPlayer_PlayTrack(uint16_t Track);
+static void WavPlayer_TrackPath(uint16_t Track, TCHAR* Path);
+static uint16_t WavPlayer_TrackGain(void);
+static void WavPlayer_Scan(void);
+static void WavPlayer_EndScan(int16_t LufsDb10, int16_t PeakDb10);
+static void WavPlayer_SuspendScan(void);
+static void WavPlayer_RefillHalf(uint8_t* Half, const uint8_t* OtherHalf);
+static bool WavPlayer_ReopenFile(void);
+static bool WavPlayer_ReadRetry(uint8_t* Buf, UINT Len, uint32_t Start, UINT* Filled);
+static void WavPlayer_StretchHalf(uint8_t* Half, const uint8_t* OtherHalf, uint32_t Start);
+static bool WavPlayer_CountRefill(void);
+static void WavPlayer_Conceal(uint8_t* Half, UINT Filled, const uint8_t* OtherHalf);
+static void WavPlayer_ProcessHalf(uint8_t* Half);
+static void WavPlayer_RampGain(void);
+static void WavPlayer_Quiet(void);
+static int16_t WavPlayer_VolumeBoost(uint8_t Vol);
 //---------------------------------------------------------------------------//
 //Function definitions
 
@@ -97,6 +243,7 @@ void
 WavPlayer_Init(WavPlayerConfig_t* Config)
 {
   gConfig = *Config;
+  Limiter_SetBoost(WavPlayer_VolumeBoost(gConfig.Vol));
 }
 
 static void 
@@ -112,8 +259,9 @@ WavPlayer_StartAudioCodec(void)
   CS43L22Config_t config = {0};
   config.Muted = gConfig.Muted;
   config.Vol = gConfig.Vol;
-  config.i2ch = hi2c1;
+  config.i2ch = gConfig.i2ch;
   CS43L22_Init(&config);
+  gIsCodecMuted = gConfig.Muted;
 }
 
 inline static void 
@@ -123,86 +271,520 @@ WavPlayer_StopAudioCodec(void)
 }
 
 
-bool
-WavPlayer_Next(void)
+/**
+ * @brief Check a directory entry is a file the player can open, told
+ * by its extension: .wav or .flac.
+ */
+static bool
+WavPlayer_IsAudioFile(const FILINFO* Info)
+{
+  static const char* const Known[] = {".wav", ".flac"};
+  const char* Ext = strrchr(Info->fname, '.');
+  uint8_t i;
+
+  if((Info->fattrib & AM_DIR) || Ext == NULL) return false;
+  for(uint8_t k = 0; k < sizeof(Known) / sizeof(Known[0]); k++)
+    {
+      i = 0;
+      while(Ext[i] && tolower((unsigned char)Ext[i]) == Known[k][i]) i++;
+      if(Ext[i] == '\0' && Known[k][i] == '\0') return true;
+    }
+  return false;
+}
+
+/**
+ * @brief Get the catalogue of the active volume, it's built on its first
+ * use so mounting many LUNs doesn't slow down the startup.
+ */
+static Catalogue_t*
+WavPlayer_GetCatalogue(void)
 {
+  Catalogue_t* Cat = &gCatalogues[gVolume];
   FRESULT fr;
-  FILINFO PrevFileInfo;
-  DIR PrevFileDir;
-  TCHAR CurrFileName[13];
+  DIR dj;
+  FILINFO fno;
+  uint16_t NamesIdx = 0;
+  uint16_t NameLen;
 
-  if(gPlayerState == PLAYER_STATE_IDLE) return false;
+  if(Cat->IsBuilt) return Cat;
+
+  Cat->TracksNum = 0;
+  fr = f_findfirst(&dj, &fno, FATFS_GetVolumePath(gVolume), "*");
 
-  strcpy(CurrFileName, gFileInfo.fname);
+  while (fr == FR_OK && fno.fname[0] && Cat->TracksNum < CATALOGUE_MAX_TRACKS)
+    {
+      if(!WavPlayer_IsAudioFile(&fno))
+        {
+          fr = f_findnext(&dj, &fno);
+          continue;
+        }
+      NameLen = strlen(fno.fname);
+      if(NamesIdx + NameLen + 1 >= CATALOGUE_NAMES_SIZE) break;
 
-  f_closedir(&gDir);
-  f_findfirst(&gDir, &gFileInfo, "", "*.wav");
-  f_findnext(&gDir, &gFileInfo);
+      Cat->LufsDb10[Cat->TracksNum] = LOUDNESS_UNKNOWN;
+      Cat->NameOfs[Cat->TracksNum++] = NamesIdx;
+      memcpy(&Cat->Names[NamesIdx], fno.fname, NameLen);
+      NamesIdx += NameLen;
+      Cat->Names[NamesIdx++] = '\n';
 
-  f_findfirst(&PrevFileDir, &PrevFileInfo, "", "*.wav");
+      fr = f_findnext(&dj, &fno);
+    }
+  Cat->Names[NamesIdx] = '\0';
 
-  do {
-    if (strcmp(PrevFileInfo.fname, CurrFileName) == 0)
-      {
-        f_closedir(&PrevFileDir);
-        WavPlayer_PlayAudioFile(gFileInfo.fname);
-        return true;
-      }
+  f_closedir(&dj);
 
-    fr = f_findnext(&gDir, &gFileInfo);
-    if(!gFileInfo.fname[0])
-      {
-        f_rewinddir(&gDir);
-        fr = f_findnext(&gDir, &gFileInfo);
-      }
+  Cat->IsBuilt = true;
+  return Cat;
+}
 
-    fr = f_findnext(&PrevFileDir, &PrevFileInfo);
+/**
+ * @brief Find the index of the playing file in the catalogue of the
+ * active volume.
+ *
+ * @return the track index, TRACK_UNKNOWN if it's not in the catalogue
+ */
+static uint16_t
+WavPlayer_LocateTrack(void)
+{
+  Catalogue_t* Cat;
+  const char* Name;
+  const char* CatName;
 
-  } while(fr == FR_OK && PrevFileInfo.fname[0]); // While the previous pointer is not rewinded
+  if(gTrack != TRACK_UNKNOWN) return gTrack;
 
-  return false;
+  Cat = WavPlayer_GetCatalogue();
+  Name = &gTrackPath[strlen(FATFS_GetVolumePath(gVolume))];
+
+  for(uint16_t Track = 0; Track < Cat->TracksNum; Track++)
+    {
+      CatName = &Cat->Names[Cat->NameOfs[Track]];
+      uint16_t i = 0;
+      // FAT names are case insensitive
+      while(CatName[i] != '\n' && toupper((unsigned char)CatName[i]) == toupper((unsigned char)Name[i])) i++;
+      if(CatName[i] == '\n' && Name[i] == '\0')
+        {
+          gTrack = Track;
+          break;
+        }
+    }
+
+  return gTrack;
+}
+
+/**
+ * @brief Build the path of a track of the active volume catalogue.
+ */
+static void
+WavPlayer_TrackPath(uint16_t Track, TCHAR* Path)
+{
+  Catalogue_t* Cat = WavPlayer_GetCatalogue();
+  const char* Name = &Cat->Names[Cat->NameOfs[Track]];
+
+  strcpy(Path, FATFS_GetVolumePath(gVolume));
+  Path = &Path[strlen(Path)];
+  while(*Name != '\n') *Path++ = *Name++;
+  *Path = '\0';
+}
+
+/**
+ * @brief Play a track of the active volume catalogue.
+ */
+static bool
+WavPlayer_PlayTrack(uint16_t Track)
+{
+  Catalogue_t* Cat = WavPlayer_GetCatalogue();
+
+  if(Track >= Cat->TracksNum) return false;
+
+  WavPlayer_TrackPath(Track, gTrackPath);
+  if(!WavPlayer_OpenAudioFile(gTrackPath, STREAM_DATA_OFS)) return false;
+
+  gTrack = Track;
+  return true;
+}
+
+bool
+WavPlayer_Next(void)
+{
+  Catalogue_t* Cat;
+  uint16_t Track;
+
+  if(gPlayerState == PLAYER_STATE_IDLE) return false;
+
+  Cat = WavPlayer_GetCatalogue();
+  if(Cat->TracksNum == 0) return false;
+
+  // an unknown track restarts from the top of the catalogue
+  Track = WavPlayer_LocateTrack();
+  Track = (Track == TRACK_UNKNOWN) ? 0 : (Track + 1) % Cat->TracksNum;
+
+  return WavPlayer_PlayTrack(Track);
 }
 
 bool
 WavPlayer_Previous(void)
 {
-  FRESULT fr;
-  FILINFO NextFileInfo;
-  DIR NextFileDir;
-  TCHAR	CurrFileName[13];
+  Catalogue_t* Cat;
+  uint16_t Track;
 
   if(gPlayerState == PLAYER_STATE_IDLE) return false;
 
-  strcpy(CurrFileName, gFileInfo.fname);
+  Cat = WavPlayer_GetCatalogue();
+  if(Cat->TracksNum == 0) return false;
 
-  f_closedir(&gDir);
-  f_findfirst(&gDir, &gFileInfo, "", "*.wav");
+  Track = WavPlayer_LocateTrack();
+  Track = (Track == TRACK_UNKNOWN) ? 0 : (Track + Cat->TracksNum - 1) % Cat->TracksNum;
 
-  f_findfirst(&NextFileDir, &NextFileInfo, "", "*.wav");
-  f_findnext(&NextFileDir, &NextFileInfo);
+  return WavPlayer_PlayTrack(Track);
+}
+
+/**
+ * @brief Switch to another LUN of the drive and load its first audio
+ * file, keeping the play/pause state.
+ *
+ * @param Vol the volume (LUN) number
+ * @return true in case of success
+ * @return false in case of failure
+ */
+bool
+WavPlayer_SwitchVolume(uint8_t Vol)
+{
+  uint8_t PrevVolume = gVolume;
+  PlayerState_t PrevState = gPlayerState;
+
+  if(gPlayerState == PLAYER_STATE_IDLE) return false;
+  if(Vol >= FATFS_GetVolumesNum()) return false;
+
+  gVolume = Vol;
+  if(!WavPlayer_PlayTrack(0))
+    {
+      gVolume = PrevVolume;
+      return false;
+    }
+
+  // the new track starts playing, it's left as the last one was
+  if(PrevState == PLAYER_STATE_READY)
+    {
+      WavPlayer_Stop();
+    }
+  else if(PrevState == PLAYER_STATE_PAUSED)
+    {
+      WavPlayer_Pause();
+    }
 
-  do {
-    if (strcmp(NextFileInfo.fname, CurrFileName) == 0)
-      {
-        f_closedir(&NextFileDir);
-        WavPlayer_PlayAudioFile(gFileInfo.fname);
-        return true;
-      }
+  return true;
+}
 
-  fr = f_findnext(&NextFileDir, &NextFileInfo);
-  if(!NextFileInfo.fname[0])
+/**
+ * @brief Read the format of a file from its chunks, the file is left at
+ * the start of the samples.
+ *
+ * @return false if it isn't a WAV file or a chunk is missing
+ */
+static bool
+WavPlayer_ReadHeader(FIL* File, WavFormat_t* Format)
+{
+  WavChunk_t Chunk;
+  uint32_t Form;
+  uint8_t Fmt[WAV_DECODE_FMT_SIZE];
+  FSIZE_t Ofs;
+  UINT Len;
+  bool IsFmt = false;
+
+  memset(Format, 0, sizeof(WavFormat_t));
+  if(f_read(File, &Chunk, sizeof(Chunk), &Len) != FR_OK || Len != sizeof(Chunk) ||
+      Chunk.Id != WAV_CHUNK_ID('R', 'I', 'F', 'F') ||
+      f_read(File, &Form, sizeof(Form), &Len) != FR_OK || Len != sizeof(Form) ||
+      Form != WAV_CHUNK_ID('W', 'A', 'V', 'E'))
     {
-      f_rewinddir(&NextFileDir);
-      fr = f_findnext(&NextFileDir, &NextFileInfo);
+      return false;
     }
 
-  fr = f_findnext(&gDir, &gFileInfo);
+  Ofs = f_tell(File);
+  while(f_read(File, &Chunk, sizeof(Chunk), &Len) == FR_OK && Len == sizeof(Chunk))
+    {
+      Ofs += sizeof(Chunk);
+      if(Chunk.Id == WAV_CHUNK_ID('d', 'a', 't', 'a'))
+        {
+          Format->DataOfs = (uint32_t)Ofs;
+          Format->DataSize = Chunk.Size;
+          return IsFmt;
+        }
 
-  } while(fr == FR_OK && gFileInfo.fname[0]); // While the previous pointer is not rewinded
+      if(Chunk.Id == WAV_CHUNK_ID('f', 'm', 't', ' '))
+        {
+          Len = (Chunk.Size < sizeof(Fmt)) ? Chunk.Size : sizeof(Fmt);
+          if(f_read(File, Fmt, Len, &Len) != FR_OK) return false;
+          IsFmt = WavDecode_ParseFmt(Format, Fmt, Len);
+        }
+      else if(Chunk.Id == WAV_CHUNK_ID('f', 'a', 'c', 't') && Chunk.Size >= 4)
+        {
+          if(f_read(File, &Format->FactFrames, 4, &Len) != FR_OK) return false;
+        }
 
+      // the chunks are padded to an even size
+      Ofs += Chunk.Size + (Chunk.Size & 1);
+      if(Ofs >= f_size(File) || f_lseek(File, Ofs) != FR_OK) return false;
+    }
   return false;
 }
 
+/**
+ * @brief Prepare the opened file for streaming without FAT lookups.
+ * A file flagged NoFatChain on exFAT is contiguous and FatFs generates
+ * its chain arithmetically, any other file gets a cluster link map built
+ * with one FAT walk, so the refills never touch the FAT. When the file is
+ * a single cluster run, the refills bypass FatFs and read raw sectors.
+ */
+static void
+WavPlayer_MapClusters(void)
+{
+  FATFS* fs = gWavFile.obj.fs;
+  DWORD FirstCluster = 0;
+
+  gWavFile.cltbl = NULL;
+  gIsRawStream = false;
+
+#if _FS_EXFAT
+  if (fs->fs_type == FS_EXFAT && gWavFile.obj.stat == 2)
+    {
+      FirstCluster = gWavFile.obj.sclust;
+    }
+  else
+#endif
+    {
+      gClusterMap[0] = CLUSTER_MAP_SIZE;
+      gWavFile.cltbl = gClusterMap;
+      if (f_lseek(&gWavFile, CREATE_LINKMAP) != FR_OK)
+        {
+          // too fragmented for the map, follow the chain on the FAT
+          gWavFile.cltbl = NULL;
+        }
+      else if (gClusterMap[0] == 4)
+        {
+          // a single fragment: {size, length, first cluster, 0}
+          FirstCluster = gClusterMap[2];
+        }
+    }
+
+  if (FirstCluster >= 2 && FirstCluster < fs->n_fatent)
+    {
+      gRawFirstSector = fs->database + (FirstCluster - 2) * fs->csize;
+      gRawCachedSector = 0;
+      gIsRawStream = true;
+    }
+}
+
+/**
+ * @brief Move the file read to a byte offset of the file.
+ */
+static void
+WavPlayer_SeekFile(FSIZE_t Ofs)
+{
+  f_lseek(&gWavFile, Ofs);
+  gRawPos = Ofs;
+}
+
+/**
+ * @brief Get the byte offset of the next byte to be read from the file.
+ */
+static FSIZE_t
+WavPlayer_TellFile(void)
+{
+  return gIsRawStream ? gRawPos : f_tell(&gWavFile);
+}
+
+/**
+ * @brief Move the stream to a stream offset. A decoded file is moved to
+ * the block of the frame, the frames before it are skipped when the
+ * block is decoded.
+ */
+static void
+WavPlayer_SeekSamples(FSIZE_t Ofs)
+{
+  FSIZE_t Frame = (Ofs > STREAM_DATA_OFS) ? (Ofs - STREAM_DATA_OFS) / FRAME_SIZE : 0;
+
+  if(!gIsDecoding)
+    {
+      WavPlayer_SeekFile(gFormat.DataOfs + Frame * FRAME_SIZE);
+      return;
+    }
+
+  gStreamPos = STREAM_DATA_OFS + Frame * FRAME_SIZE;
+  if(gIsFlac)
+    {
+      Flac_Seek((uint32_t)Frame);
+      return;
+    }
+
+  WavPlayer_SeekFile(gFormat.DataOfs +
+                     (Frame / gDecoder.BlockFrames) * gDecoder.BlockBytes);
+  gDecodeSkip = (uint16_t)(Frame % gDecoder.BlockFrames);
+  WavDecode_Load(&gDecoder, NULL, 0);
+}
+
+/**
+ * @brief Get the stream offset of the next sample to be read.
+ */
+static FSIZE_t
+WavPlayer_TellSamples(void)
+{
+  if(gIsDecoding) return gStreamPos;
+  return WavPlayer_TellFile() - gFormat.DataOfs + STREAM_DATA_OFS;
+}
+
+/**
+ * @brief Get the byte offset of the next sample to reach the DMA buffer,
+ * the time-stretch holds the samples it read ahead.
+ */
+static FSIZE_t
+WavPlayer_TellStream(void)
+{
+  FSIZE_t Pos = WavPlayer_TellSamples();
+  FSIZE_t Buffered = gIsStretching ? (FSIZE_t)Stretch_GetBuffered() * FRAME_SIZE : 0;
+
+  return (Pos > Buffered) ? Pos - Buffered : 0;
+}
+
+/**
+ * @brief Read the next samples of the stream, up to the end of the data.
+ */
+static FRESULT
+WavPlayer_ReadSamples(uint8_t* Buf, UINT Len, UINT* ReadLen)
+{
+  FSIZE_t End = STREAM_DATA_OFS + gFileLength;
+  FSIZE_t Pos = WavPlayer_TellSamples();
+
+  if(Len > End - Pos) Len = (Pos < End) ? (UINT)(End - Pos) : 0;
+  if(gIsDecoding) return WavPlayer_Decode(Buf, Len, ReadLen);
+  return WavPlayer_ReadFile(Buf, Len, ReadLen);
+}
+
+/**
+ * @brief Decode the next samples of the stream, the file is read a block
+ * at a time. A failed read leaves the position at the last frame decoded.
+ */
+static FRESULT
+WavPlayer_Decode(uint8_t* Buf, UINT Len, UINT* ReadLen)
+{
+  uint32_t Frames = Len / FRAME_SIZE;
+  uint32_t Count;
+  UINT BlockLen;
+  FRESULT fr;
+
+  *ReadLen = 0;
+  if(gIsFlac)
+    {
+      bool IsRead = Flac_Read((int16_t*)Buf, Frames, &Count);
+
+      gStreamPos += Count * FRAME_SIZE;
+      *ReadLen = Count * FRAME_SIZE;
+      return IsRead ? FR_OK : FR_DISK_ERR;
+    }
+
+  while(Frames)
+    {
+      if(gDecoder.Frame >= gDecoder.Frames)
+        {
+          fr = WavPlayer_ReadFile(gDecodeBlock, gDecoder.BlockBytes, &BlockLen);
+          if(fr != FR_OK) return fr;
+          WavDecode_Load(&gDecoder, gDecodeBlock, BlockLen);
+          WavDecode_Run(&gDecoder, NULL, gDecodeSkip);
+          gDecodeSkip = 0;
+          if(gDecoder.Frame >= gDecoder.Frames) break; // end of file
+        }
+
+      Count = WavDecode_Run(&gDecoder, (int16_t*)Buf, Frames);
+      Buf += Count * FRAME_SIZE;
+      Frames -= Count;
+      gStreamPos += Count * FRAME_SIZE;
+      *ReadLen += Count * FRAME_SIZE;
+    }
+  return FR_OK;
+}
+
+/**
+ * @brief Read the next bytes of the file. A contiguous file is read with
+ * disk_read at computed sectors, whole sectors straight into the buffer and
+ * partial ones through a one sector cache. Fragmented files use f_read.
+ */
+static FRESULT
+WavPlayer_ReadFile(uint8_t* Buf, UINT Len, UINT* ReadLen)
+{
+  BYTE Drv;
+  DWORD Sector;
+  UINT Ofs;
+  UINT Count;
+
+  if (!gIsRawStream)
+    {
+      return f_read(&gWavFile, Buf, Len, ReadLen);
+    }
+
+  Drv = gWavFile.obj.fs->drv;
+
+  *ReadLen = 0;
+  if (Len > f_size(&gWavFile) - gRawPos)
+    {
+      Len = (UINT)(f_size(&gWavFile) - gRawPos);
+    }
+
+  while (Len)
+    {
+      Sector = gRawFirstSector + (DWORD)(gRawPos / _MAX_SS);
+      Ofs = (UINT)(gRawPos % _MAX_SS);
+
+      if (Ofs == 0 && Len >= _MAX_SS)
+        {
+          Count = Len / _MAX_SS;
+          if (disk_read(Drv, Buf, Sector, Count) != RES_OK) return FR_DISK_ERR;
+          Count *= _MAX_SS;
+        }
+      else
+        {
+          if (gRawCachedSector != Sector)
+            {
+              gRawCachedSector = 0;
+              if (disk_read(Drv, gRawSectorBuf, Sector, 1) != RES_OK) return FR_DISK_ERR;
+              gRawCachedSector = Sector;
+            }
+          Count = _MAX_SS - Ofs;
+          if (Count > Len) Count = Len;
+          memcpy(Buf, &gRawSectorBuf[Ofs], Count);
+        }
+
+      Buf += Count;
+      Len -= Count;
+      gRawPos += Count;
+      *ReadLen += Count;
+    }
+
+  return FR_OK;
+}
+
+/**
+ * @brief Give the FLAC decoder the next bytes of the playing file.
+ */
+bool
+Flac_ReadCallback(uint8_t* Buf, uint32_t Len, uint32_t* ReadLen)
+{
+  UINT Read;
+  FRESULT fr = WavPlayer_ReadFile(Buf, Len, &Read);
+
+  *ReadLen = Read;
+  return fr == FR_OK;
+}
+
+/**
+ * @brief Move the playing file for the FLAC decoder.
+ */
+bool
+Flac_SeekCallback(uint32_t Ofs)
+{
+  WavPlayer_SeekFile(Ofs);
+  return true;
+}
+
 /**
  * @brief Read a file given its path
  * 
@@ -213,33 +795,134 @@ WavPlayer_Previous(void)
 bool 
 WavPlayer_PlayAudioFile(const char* FilePath)
 {
+  TCHAR Path[TRACK_PATH_SIZE];
+
   if(gPlayerState == PLAYER_STATE_IDLE) return false;
-  
-  WavHeader_t wavHeader;
+
+  // file names are given relative to the active volume
+  strcpy(Path, FATFS_GetVolumePath(gVolume));
+  strncat(Path, FilePath, TRACK_PATH_SIZE - strlen(Path) - 1);
+  return WavPlayer_OpenAudioFile(Path, STREAM_DATA_OFS);
+}
+
+/**
+ * @brief Open a file and start streaming it from a byte offset
+ * of the file.
+ *
+ * @param FilePath
+ * @param DataOfs offset of the first sample to play
+ * @return true in case of success
+ * @return false in case of failure
+ */
+static bool
+WavPlayer_OpenAudioFile(const char* FilePath, FSIZE_t DataOfs)
+{
+  WavFormat_t Format;
+  WavDecoder_t Decoder;
+  FlacInfo_t Info;
+  uint8_t Head[FLAC_PROBE_SIZE];
+  UINT HeadLen;
+  bool IsFlac = false;
   FIL TobePlayed;
+  FSIZE_t Size;
+
+  // the file lock has room for the playing file and the new one only
+  WavPlayer_SuspendScan();
   if(f_open(&TobePlayed, FilePath, FA_READ) != FR_OK)
     {
       return false;
     }
+  if(!WavPlayer_ReadHeader(&TobePlayed, &Format) ||
+      !WavDecode_Init(&Decoder, &Format))
+    {
+      // not a WAV file, the decoder reads the offsets as 32 bits
+      IsFlac = f_size(&TobePlayed) <= 0xFFFFFFFF &&
+               f_lseek(&TobePlayed, 0) == FR_OK &&
+               f_read(&TobePlayed, Head, FLAC_PROBE_SIZE, &HeadLen) == FR_OK &&
+               HeadLen == FLAC_PROBE_SIZE && Flac_Probe(Head, &Info);
+      if(!IsFlac)
+        {
+          f_close(&TobePlayed);
+          return false;
+        }
+    }
 
-  WavPlayer_StopAudioCodec();
+  // the codec keeps its configuration over a track change, it's powered
+  // down while MCLK still runs
+  CS43L22_Standby();
+  CS43L22_Sync();
   I2s_StopTransfer();
+  gIsI2sRunning = false;
+  gIsRewindPending = false;
   f_close(&gWavFile);
     
   memcpy(&gWavFile, &TobePlayed, sizeof(FIL));
-  strcpy(gFileInfo.fname, FilePath);
+  if(FilePath != gTrackPath) strcpy(gTrackPath, FilePath);
+  gTrack = TRACK_UNKNOWN;
   WavPlayer_Reset();
 
-  f_read(&gWavFile, &wavHeader, sizeof(wavHeader), &gFileReadBytesLen);
-  gFileLength = wavHeader.FileSize;
-  gSamplingFreq = wavHeader.SampleRate;
+  gIsFlac = IsFlac;
+  if (gIsFlac)
+    {
+      gIsDecoding = true;
+      gSamplingFreq = Info.SampleRate;
+      gFileLength = (FSIZE_t)Info.TotalFrames * FRAME_SIZE;
+    }
+  else
+    {
+      gFormat = Format;
+      gDecoder = Decoder;
+      gIsDecoding = !WavDecode_IsNative(&Format);
+      gSamplingFreq = Format.SampleRate;
+
+      // The data size saturates at 4 GB, trust the directory entry then.
+      // A recording cut short is shorter than its data chunk says.
+      Size = f_size(&gWavFile) - Format.DataOfs;
+      if (f_size(&gWavFile) <= 0xFFFFFFFF && Format.DataSize < Size)
+        {
+          Size = Format.DataSize;
+        }
+      if (gIsDecoding)
+        {
+          Size = WavDecode_GetFrames(&gDecoder, (uint32_t)Size);
+          if (Format.FactFrames && Format.FactFrames < Size) Size = Format.FactFrames;
+          Size *= FRAME_SIZE;
+        }
+      gFileLength = Size & ~(FSIZE_t)(FRAME_SIZE - 1);
+    }
 
-  f_lseek(&gWavFile, sizeof(WavHeader_t));
-  f_read (&gWavFile, &gAudioBuffer[0], DMA_BUFFER_SIZE, &gFileReadBytesLen);
-  gFileRemainingSize = gFileLength - gFileReadBytesLen;
+  WavPlayer_MapClusters();
+  // a FLAC file whose metadata can't be read plays as an empty track
+  if (gIsFlac && !Flac_Open((uint32_t)f_size(&gWavFile))) gFileLength = 0;
+
+  WavPlayer_SeekSamples(DataOfs);
+  WavPlayer_ReadSamples(&gAudioBuffer[0], DMA_BUFFER_SIZE, &gFileReadBytesLen);
+  memset(&gAudioBuffer[gFileReadBytesLen], 0, DMA_BUFFER_SIZE - gFileReadBytesLen);
+  gFileRemainingSize = gFileLength - (DataOfs - STREAM_DATA_OFS) - gFileReadBytesLen;
+  Latency_Mark(LATENCY_STAGE_FILE);
+  gIsSeekPending = false;
+  gIsSeekRefilled = false;
+
+  // a track starts at the level it's played at, not from a fade
+  Eq_SetRate(gSamplingFreq);
+  Limiter_SetRate(gSamplingFreq);
+  Limiter_Reset();
+  Dither_SetRate(gSamplingFreq);
+  Dither_Reset();
+  Stretch_Reset();
+  Meter_SetRate(gSamplingFreq);
+  gTrackGain = WavPlayer_TrackGain();
+  Gain_Ramp(gConfig.Muted ? 0 : gTrackGain, 0);
+  WavPlayer_ProcessHalf(&gAudioBuffer[0]);
+  WavPlayer_ProcessHalf(&gAudioBuffer[DMA_BUFFER_SIZE/2]);
 
   I2s_Init(gSamplingFreq);
+  gDmaState = DMA_STATE_FULL_TRANSFER;
+  gPendingDmaEvents = 0;
   I2s_StartNewTransfer((uint16_t *)&gAudioBuffer[0], DMA_BUFFER_SIZE);
+  gIsI2sRunning = true;
+  gIsTrackStarting = true;
+  Latency_Mark(LATENCY_STAGE_AUDIO);
   WavPlayer_StartAudioCodec();
 
   WavPlayer_Resume();
@@ -251,9 +934,38 @@ void
 WavPlayer_SetVolume(uint8_t Vol)
 {
   gConfig.Vol = Vol;
+  Limiter_SetBoost(WavPlayer_VolumeBoost(Vol));
   CS43L22_SetVolume(Vol);
 }
 
+/**
+ * @brief Set the playback speed, x100, the pitch is kept. It's heard from
+ * the next refill on.
+ *
+ * @return false for a speed out of [STRETCH_SPEED_MIN, STRETCH_SPEED_MAX]
+ */
+bool
+WavPlayer_SetSpeed(uint16_t Speed)
+{
+  FSIZE_t Back;
+
+  if(!Stretch_SetSpeed(Speed)) return false;
+
+  if(Speed == STRETCH_UNITY && gIsStretching)
+    {
+      // the read ahead goes back to the file
+      Back = (FSIZE_t)Stretch_GetBuffered() * FRAME_SIZE;
+      WavPlayer_SeekSamples(WavPlayer_TellSamples() - Back);
+      gFileRemainingSize += Back;
+    }
+  else if(Speed != STRETCH_UNITY && !gIsStretching)
+    {
+      Stretch_Reset();
+    }
+  gIsStretching = (Speed != STRETCH_UNITY);
+  return true;
+}
+
 /**
  * @brief Open the root directory and choose the first 
  * audio file.
@@ -263,33 +975,52 @@ void
 WavPlayer_ChooseTheFirstAudioFile(void)
 {
   FRESULT fr;
+  DIR dj;
+  FILINFO fno;
 
   if(gPlayerState != PLAYER_STATE_IDLE) return;
 
-  /* Search for a wav file to play */
-  fr = f_findfirst(&gDir, &gFileInfo, "", "*.wav");
+  /* Search for a file to play, the catalogue is built later on */
+  gVolume = 0;
+  fr = f_findfirst(&dj, &fno, FATFS_GetVolumePath(gVolume), "*");
+  while (fr == FR_OK && fno.fname[0] && !WavPlayer_IsAudioFile(&fno))
+    {
+      fr = f_findnext(&dj, &fno);
+    }
+  f_closedir(&dj);
 
-  if (fr == FR_OK && gFileInfo.fname[0])
+  if (fr == FR_OK && fno.fname[0])
     {
       WavPlayer_PlayerUpdate(PLAYER_EVENT_FILE_IS_CHOSEN);
-      WavPlayer_PlayAudioFile(gFileInfo.fname);
+      WavPlayer_PlayAudioFile(fno.fname);
       WavPlayer_Pause();
     }
 }
 
 
+/**
+ * @brief Fade the samples out, the codec outputs are turned off once the
+ * fade was played.
+ */
 void
 WavPlayer_Mute(void)
 {
   gConfig.Muted = true;
-  CS43L22_Mute();
-}
+  WavPlayer_RampGain();
+  if(!gIsI2sRunning)
+    {
+      CS43L22_Mute();
+      gIsCodecMuted = true;
+    }
+}
 
 void
 WavPlayer_Unmute(void)
 {
   gConfig.Muted = false;
   CS43L22_Unmute();
+  gIsCodecMuted = false;
+  WavPlayer_RampGain();
 }
 
 void
@@ -298,27 +1029,35 @@ WavPlayer_Stop(void)
   if (gPlayerState != PLAYER_STATE_PLAYING && 
   gPlayerState != PLAYER_STATE_PAUSED) return;
 
-  CS43L22_Stop();
-  I2s_Pause();
-
-  WavPlayer_Reset();
-
-  f_lseek(&gWavFile, sizeof(WavHeader_t));
-  f_read (&gWavFile, &gAudioBuffer[0], DMA_BUFFER_SIZE, &gFileReadBytesLen);
-  gFileRemainingSize = gFileLength - gFileReadBytesLen;
-
   WavPlayer_PlayerUpdate(PLAYER_EVENT_STOP);
+
+  // the codec is stopped and the file rewound after the fade out, a
+  // track that just started is stopped at once
+  gIsRewindPending = true;
+  if(gIsI2sRunning && !gIsTrackStarting)
+    {
+      WavPlayer_RampGain();
+    }
+  else
+    {
+      WavPlayer_Quiet();
+    }
 }
 
 void
 WavPlayer_Pause(void)
 {
   if (gPlayerState != PLAYER_STATE_PLAYING) return;
- 
-  CS43L22_Stop();
-  I2s_Pause();
 
+  // the codec and the DMA are paused after the fade out
   WavPlayer_PlayerUpdate(PLAYER_EVENT_PAUSE);
+  if(gIsTrackStarting)
+    {
+      // a track opened paused, its start is kept for the resume
+      WavPlayer_Quiet();
+      return;
+    }
+  WavPlayer_RampGain();
 }
 
 void
@@ -327,57 +1066,799 @@ WavPlayer_Resume(void)
   if (gPlayerState != PLAYER_STATE_PAUSED &&
   gPlayerState != PLAYER_STATE_READY) return;
 
-  WavPlayer_StartAudioCodec();
-  I2s_Resume();
+  // a stop still fading out is done first, the track starts over
+  if(gIsRewindPending) WavPlayer_Quiet();
+
+  if(CS43L22_GetPowerState() == CS43L22_POWER_OFF)
+    {
+      WavPlayer_StartAudioCodec();
+    }
+  else
+    {
+      CS43L22_Start();
+    }
+  if(!gIsI2sRunning)
+    {
+      I2s_Resume();
+      gIsI2sRunning = true;
+    }
+  Latency_Mark(LATENCY_STAGE_AUDIO);
     
   WavPlayer_PlayerUpdate(PLAYER_EVENT_RESUME);
+  WavPlayer_RampGain();
+}
+
+/**
+ * @brief Ramp the gain to the level of the player state, it's silent
+ * unless playing unmuted. The gain jumps when the DMA is stopped.
+ */
+static void
+WavPlayer_RampGain(void)
+{
+  bool IsAudible = (gPlayerState == PLAYER_STATE_PLAYING && !gConfig.Muted);
+  uint32_t Frames = 0;
+
+  if(gIsI2sRunning) Frames = (uint32_t)gConfig.RampMs * gSamplingFreq / 1000;
+  Gain_Ramp(IsAudible ? gTrackGain : 0, Frames);
+}
+
+/**
+ * @brief Pause the DMA and bring the codec to the player state once a
+ * fade out was played, a stop rewinds the file too.
+ */
+static void
+WavPlayer_Quiet(void)
+{
+  if(gPlayerState == PLAYER_STATE_PAUSED)
+    {
+      CS43L22_HotPause();
+      gPauseTick = HAL_GetTick();
+    }
+  else
+    {
+      CS43L22_Stop();
+    }
+  I2s_Pause();
+  gIsI2sRunning = false;
+  Meter_Release();
+
+  if(gIsRewindPending)
+    {
+      gIsRewindPending = false;
+      WavPlayer_Reset();
+
+      WavPlayer_SeekSamples(STREAM_DATA_OFS);
+      WavPlayer_ReadSamples(&gAudioBuffer[0], DMA_BUFFER_SIZE, &gFileReadBytesLen);
+      memset(&gAudioBuffer[gFileReadBytesLen], 0, DMA_BUFFER_SIZE - gFileReadBytesLen);
+      gFileRemainingSize = gFileLength - gFileReadBytesLen;
+      // the rewound buffer is played unprocessed, like a track start
+      Limiter_Reset();
+      Stretch_Reset();
+      Gain_Ramp(gConfig.Muted ? 0 : gTrackGain, 0);
+      gIsTrackStarting = true;
+    }
+}
+
+/**
+ * @brief Silence the player and snapshot the track and the position
+ * of the half buffer being played, the drive is gone so the file and
+ * directory objects are stale from now on.
+ */
+void
+WavPlayer_OnDisconnect(void)
+{
+  FSIZE_t Pos;
+
+  if(gPlayerState == PLAYER_STATE_IDLE) return;
+
+  // the codec is powered down while MCLK still runs
+  WavPlayer_StopAudioCodec();
+  CS43L22_Sync();
+  I2s_StopTransfer();
+  gIsI2sRunning = false;
+  gIsRewindPending = false;
+  Meter_Release();
+  // the scanned file is stale, the drive takes its lock with it
+  gIsScanOpen = false;
+  gScanTrack = TRACK_UNKNOWN;
+
+  // the DMA plays the half read before the last refill
+  Pos = WavPlayer_TellStream();
+  Pos = (Pos > STREAM_DATA_OFS + DMA_BUFFER_SIZE) ? Pos - DMA_BUFFER_SIZE : STREAM_DATA_OFS;
+
+  strcpy(gSnapshotPath, gTrackPath);
+  gSnapshotVolume = gVolume;
+  gSnapshotSize = f_size(&gWavFile);
+  gSnapshotCluster = gWavFile.obj.sclust;
+  gSnapshotPos = Pos & ~(FSIZE_t)(SAMPLE_SIZE * 2 - 1);
+  gSnapshotWasPlaying = (gPlayerState == PLAYER_STATE_PLAYING);
+  gIsSnapshotValid = true;
+
+  gIsRawStream = false;
+  for(uint8_t Vol = 0; Vol < _VOLUMES; Vol++)
+    {
+      gCatalogues[Vol].IsBuilt = false;
+    }
+  WavPlayer_PlayerUpdate(PLAYER_EVENT_DISCONNECT);
+}
+
+/**
+ * @brief Mark the start of a drive re-enumeration for the
+ * reconnect-to-audio latency.
+ */
+void
+WavPlayer_OnConnect(void)
+{
+  gConnectTick = HAL_GetTick();
+}
+
+/**
+ * @brief Resume the snapshot track at the saved position once the drive
+ * is mounted again. The track must still be the same file (same size and
+ * first cluster), otherwise the first audio file is chosen.
+ */
+void
+WavPlayer_Reconnect(void)
+{
+  FIL Snapshot;
+  bool IsSameFile;
+
+  if(gPlayerState != PLAYER_STATE_IDLE) return;
+
+  if(gIsSnapshotValid)
+    {
+      gIsSnapshotValid = false;
+
+      if(gSnapshotVolume < FATFS_GetVolumesNum() &&
+          f_open(&Snapshot, gSnapshotPath, FA_READ) == FR_OK)
+        {
+          IsSameFile = f_size(&Snapshot) == gSnapshotSize &&
+              Snapshot.obj.sclust == gSnapshotCluster;
+          f_close(&Snapshot);
+
+          if(IsSameFile)
+            {
+              WavPlayer_PlayerUpdate(PLAYER_EVENT_FILE_IS_CHOSEN);
+              gVolume = gSnapshotVolume;
+              gTrack = TRACK_UNKNOWN;
+              if(WavPlayer_OpenAudioFile(gSnapshotPath, gSnapshotPos))
+                {
+                  gReconnectLatency = HAL_GetTick() - gConnectTick;
+                  if(!gSnapshotWasPlaying)
+                    {
+                      WavPlayer_Pause();
+                    }
+                  return;
+                }
+              WavPlayer_PlayerUpdate(PLAYER_EVENT_DISCONNECT);
+            }
+        }
+    }
+
+  WavPlayer_ChooseTheFirstAudioFile();
+}
+
+/**
+ * @brief Move the playback to a time of the current file, the state
+ * (playing, paused) is kept.
+ *
+ * @param Ms time from the start of the file
+ * @return false if there is no file or the time is past its end
+ */
+bool
+WavPlayer_Seek(uint32_t Ms)
+{
+  FSIZE_t Ofs;
+
+  if(gPlayerState == PLAYER_STATE_IDLE || gSamplingFreq == 0) return false;
+
+  Ofs = ((FSIZE_t)Ms * gSamplingFreq / 1000) * FRAME_SIZE;
+  if(Ofs >= gFileLength) return false;
+
+  // the refills continue from here, the buffered samples play out first
+  WavPlayer_SeekSamples(STREAM_DATA_OFS + Ofs);
+  gFileRemainingSize = gFileLength - Ofs;
+  Stretch_Reset();
+  gIsSeekPending = true;
+  Latency_Expect(LATENCY_STAGE_AUDIO);
+  return true;
+}
+
+/**
+ * @brief Get the state of the player and the position being played.
+ */
+void
+WavPlayer_GetStatus(WavPlayerStatus_t* Status)
+{
+  FSIZE_t Pos = WavPlayer_TellStream();
+
+  Status->State = (WavPlayerState_t)gPlayerState;
+  Status->Vol = gConfig.Vol;
+  Status->Muted = gConfig.Muted;
+  Status->Drive = gVolume;
+  Status->Track = gTrack;
+  Status->SampleRate = gSamplingFreq;
+  Status->PosMs = 0;
+  Status->BufferFill = 0;
+  Status->Underruns = gUnderruns;
+
+  // the DMA plays the half read before the last refill
+  if(gPlayerState != PLAYER_STATE_IDLE && gSamplingFreq &&
+      Pos > STREAM_DATA_OFS + DMA_BUFFER_SIZE)
+    {
+      Pos -= STREAM_DATA_OFS + DMA_BUFFER_SIZE;
+      Status->PosMs = (uint32_t)((Pos / FRAME_SIZE) * 1000 / gSamplingFreq);
+    }
+
+  if(gPlayerState == PLAYER_STATE_PLAYING || gPlayerState == PLAYER_STATE_PAUSED)
+    {
+      uint32_t ReadPos = DMA_BUFFER_SIZE - I2s_GetRemaining();
+      // the half after the one being played, it waits for a refill or not
+      DmaEvent_t NextHalf = (ReadPos < DMA_BUFFER_SIZE / 2) ?
+          DMA_EVENT_FULL_TRANSFER : DMA_EVENT_HALF_TRANSFER;
+
+      Status->BufferFill = DMA_BUFFER_SIZE / 2 - ReadPos % (DMA_BUFFER_SIZE / 2);
+      if(!(gPendingDmaEvents & (1 << NextHalf)))
+        {
+          Status->BufferFill += DMA_BUFFER_SIZE / 2;
+        }
+    }
+}
+
+/**
+ * @brief Get the time from the last drive connection until the audio
+ * was resumed, in ms.
+ */
+uint32_t
+WavPlayer_GetReconnectLatency(void)
+{
+  return gReconnectLatency;
 }
 
 const char*
 WavPlayer_ListAudioFiles(void)
 {
-  /* Search a directory for objects and display it */
-  FRESULT fr;     /* Return value */
-  DIR dj;         /* Directory object */
-  FILINFO fno;    /* File information */
-  uint32_t DmaBufferIdx = 0;
+  return (const char*) WavPlayer_GetCatalogue()->Names;
+}
 
-  fr = f_findfirst(&dj, &fno, "", "*.wav");
+/**
+ * @brief Fill the missing part of a half buffer after a failed refill.
+ * FADE ramps the last good frame down to silence, REPEAT replays the
+ * previous half with a gain halved on every consecutive concealment.
+ *
+ * @param Half the half buffer to be concealed
+ * @param Filled number of good bytes at the start of the half
+ * @param OtherHalf the half being played by the DMA
+ */
+static void
+WavPlayer_Conceal(uint8_t* Half, UINT Filled, const uint8_t* OtherHalf)
+{
+  int16_t* Out = (int16_t*)Half;
+  const int16_t* Prev = (const int16_t*)OtherHalf;
+  const int16_t* Last;
+  int32_t Left;
+  int32_t Right;
+  uint32_t Frame = Filled / FRAME_SIZE;
+  uint32_t FramesNum = (DMA_BUFFER_SIZE / 2) / FRAME_SIZE;
+  uint32_t Ramp;
+
+  gReadStats.Concealments++;
+
+  if(gConfig.Conceal == WAV_PLAYER_CONCEAL_REPEAT && gConcealDecayShift < 16)
+    {
+      gConcealDecayShift++;
+      for(; Frame < FramesNum; Frame++)
+        {
+          Out[2 * Frame] = Prev[2 * Frame] >> gConcealDecayShift;
+          Out[2 * Frame + 1] = Prev[2 * Frame + 1] >> gConcealDecayShift;
+        }
+      return;
+    }
 
-  while (fr == FR_OK && fno.fname[0] && DmaBufferIdx < DMA_BUFFER_SIZE) {
-      memcpy(&gFilesNames[DmaBufferIdx], fno.fname, strlen(fno.fname));
-      DmaBufferIdx += strlen(fno.fname);
-      gFilesNames[DmaBufferIdx] = '\n';
-      DmaBufferIdx++;
+  // fade from the last frame that reached the codec
+  Last = (Frame > 0) ? &Out[2 * (Frame - 1)] : &Prev[2 * (FramesNum - 1)];
+  Left = Last[0];
+  Right = Last[1];
+  for(Ramp = CONCEAL_FADE_FRAMES; Frame < FramesNum; Frame++)
+    {
+      if(Ramp) Ramp--;
+      Out[2 * Frame] = (int16_t)(Left * (int32_t)Ramp / CONCEAL_FADE_FRAMES);
+      Out[2 * Frame + 1] = (int16_t)(Right * (int32_t)Ramp / CONCEAL_FADE_FRAMES);
+    }
+}
 
-      fr = f_findnext(&dj, &fno);
-  }
-  gFilesNames[DmaBufferIdx] = '\0';
+/**
+ * @brief Open the playing file again, with its cluster map. The read
+ * position is left at the start of the file.
+ *
+ * @return false if it couldn't be opened, the next read fails
+ */
+static bool
+WavPlayer_ReopenFile(void)
+{
+  f_close(&gWavFile);
+  if(f_open(&gWavFile, gTrackPath, FA_READ) != FR_OK) return false;
+  WavPlayer_MapClusters();
+  return true;
+}
 
-  f_closedir(&dj);
+/**
+ * @brief Read the next samples of the file. Failed reads are retried with
+ * a doubling back-off as long as the retry still fits before the DMA
+ * reaches the half being refilled.
+ *
+ * @param Start tick the refill started at
+ * @param Filled number of bytes read, less than Len at the end of the file
+ * @return false when the retries ran out
+ */
+static bool
+WavPlayer_ReadRetry(uint8_t* Buf, UINT Len, uint32_t Start, UINT* Filled)
+{
+  uint32_t Budget = 0;
+  uint32_t Backoff = REFILL_FIRST_BACKOFF_MS;
+  uint8_t Retries = 0;
+  UINT ReadLen;
+  FSIZE_t Pos;
+  FRESULT fr;
 
-  return (const char*) gFilesNames;
+  // playing time of the other half, minus a tick for the tick granularity
+  if(gSamplingFreq)
+    {
+      Budget = ((DMA_BUFFER_SIZE / 2) * 1000) / (gSamplingFreq * FRAME_SIZE);
+      Budget = (Budget > 1) ? Budget - 1 : 0;
+    }
+
+  *Filled = 0;
+  while(*Filled < Len)
+    {
+      ReadLen = 0;
+      fr = WavPlayer_ReadSamples(&Buf[*Filled], Len - *Filled, &ReadLen);
+      *Filled += ReadLen;
+
+      if(fr == FR_OK)
+        {
+          if(ReadLen == 0) break; // end of file
+          continue;
+        }
+
+      gReadStats.Errors++;
+      if(Retries >= REFILL_MAX_RETRIES || HAL_GetTick() - Start + Backoff > Budget)
+        {
+          return false;
+        }
+
+      // an aborted f_read fails the file object for good, it's opened
+      // again, the raw sector reads only move back
+      Pos = WavPlayer_TellSamples();
+      if(!gIsRawStream && !WavPlayer_ReopenFile()) return false;
+      WavPlayer_SeekSamples(Pos);
+      HAL_Delay(Backoff);
+      Backoff *= 2;
+      Retries++;
+      gReadStats.Retries++;
+    }
+  return true;
+}
+
+/**
+ * @brief Refill a half of the DMA buffer. The part of the half a failed
+ * read left is concealed, a short read at the end of the file is padded
+ * with silence.
+ *
+ * @param Half the half buffer to be filled
+ * @param OtherHalf the half being played by the DMA
+ */
+static void
+WavPlayer_RefillHalf(uint8_t* Half, const uint8_t* OtherHalf)
+{
+  uint32_t Start = HAL_GetTick();
+  UINT Filled = 0;
+
+  if(gIsStretching)
+    {
+      WavPlayer_StretchHalf(Half, OtherHalf, Start);
+      return;
+    }
+
+  if(!WavPlayer_ReadRetry(Half, DMA_BUFFER_SIZE / 2, Start, &Filled))
+    {
+      WavPlayer_Conceal(Half, Filled, OtherHalf);
+      gFileReadBytesLen = Filled;
+      return;
+    }
+
+  gConcealDecayShift = 0;
+  if(Filled < DMA_BUFFER_SIZE / 2)
+    {
+      memset(&Half[Filled], 0, DMA_BUFFER_SIZE / 2 - Filled);
+    }
+  gFileReadBytesLen = Filled;
+}
+
+/**
+ * @brief Refill a half of the DMA buffer through the time-stretch. The
+ * file is read ahead into the stretch as much as the half takes at the
+ * speed, the reads stop at the end of the data.
+ */
+static void
+WavPlayer_StretchHalf(uint8_t* Half, const uint8_t* OtherHalf, uint32_t Start)
+{
+  const uint32_t Frames = (DMA_BUFFER_SIZE / 2) / FRAME_SIZE;
+  int16_t* Buf;
+  uint32_t Space;
+  uint32_t Made = 0;
+  uint32_t Step;
+  UINT Len;
+  UINT Filled;
+  UINT Read = 0;
+  bool IsOk = true;
+
+  do
+    {
+      while(IsOk && (Space = Stretch_GetSpace(&Buf, Frames - Made)) > 0)
+        {
+          Len = Space * FRAME_SIZE;
+          if(Len > gFileRemainingSize - Read) Len = (UINT)(gFileRemainingSize - Read);
+          IsOk = WavPlayer_ReadRetry((uint8_t*)Buf, Len, Start, &Filled);
+
+          // the ring takes whole frames, a split one is read again
+          if(Filled % FRAME_SIZE)
+            {
+              WavPlayer_SeekSamples(WavPlayer_TellSamples() - Filled % FRAME_SIZE);
+              Filled -= Filled % FRAME_SIZE;
+            }
+          Stretch_Commit(Filled / FRAME_SIZE);
+          Read += Filled;
+          if(IsOk && Filled < Space * FRAME_SIZE) Stretch_End();
+        }
+      Step = Stretch_Process((int16_t*)&Half[Made * FRAME_SIZE], Frames - Made);
+      Made += Step;
+    }
+  while(IsOk && Step && Made < Frames);
+
+  gFileReadBytesLen = Read;
+  if(Made < Frames && !IsOk)
+    {
+      WavPlayer_Conceal(Half, Made * FRAME_SIZE, OtherHalf);
+      return;
+    }
+
+  gConcealDecayShift = 0;
+  if(Made < Frames)
+    {
+      memset(&Half[Made * FRAME_SIZE], 0, (Frames - Made) * FRAME_SIZE);
+    }
+}
+
+/**
+ * @brief Count the bytes of the last refill against the rest of the file.
+ *
+ * @return true once the refills reached the end of the data, the stretch
+ * plays out what it read ahead first
+ */
+static bool
+WavPlayer_CountRefill(void)
+{
+  if(gIsStretching)
+    {
+      gFileRemainingSize -= (gFileReadBytesLen < gFileRemainingSize) ?
+          gFileReadBytesLen : gFileRemainingSize;
+      return gFileRemainingSize == 0 && Stretch_IsDrained();
+    }
+
+  if(gFileRemainingSize > (DMA_BUFFER_SIZE / 2))
+    {
+      gFileRemainingSize -= gFileReadBytesLen;
+      return false;
+    }
+  gFileRemainingSize = 0;
+  return true;
+}
+
+/**
+ * @brief Process a refilled half before the DMA plays it, the half is
+ * counted when the gain ended it silent.
+ */
+static void
+WavPlayer_ProcessHalf(uint8_t* Half)
+{
+  Eq_Process((int16_t*)Half, (DMA_BUFFER_SIZE / 2) / FRAME_SIZE);
+  Limiter_SetMakeup(Eq_GetMakeup());
+  Limiter_Process((int16_t*)Half, (DMA_BUFFER_SIZE / 2) / FRAME_SIZE);
+  Gain_Process((int16_t*)Half, (DMA_BUFFER_SIZE / 2) / FRAME_SIZE);
+  Meter_Process((int16_t*)Half, (DMA_BUFFER_SIZE / 2) / FRAME_SIZE);
+  gIsTrackStarting = false;
+  if(!Gain_IsSilent())
+    {
+      gSilentHalves = 0;
+    }
+  else if(gSilentHalves < FADED_HALVES)
+    {
+      gSilentHalves++;
+    }
+}
+
+/**
+ * @brief Refill the DMA halves released since the last call. The refills
+ * run in the main loop, with the commands, so FatFs and the USB host are
+ * never entered from two contexts.
+ */
+void
+WavPlayer_Update(void)
+{
+  uint8_t Events;
+  bool IsRefilled = false;
+
+  __disable_irq();
+  Events = gPendingDmaEvents;
+  gPendingDmaEvents = 0;
+  __enable_irq();
+
+  // serve the events in the order the DMA state machine expects them
+  for(uint8_t i = 0; i < 2 && Events; i++)
+    {
+      DmaEvent_t Event = (gDmaState == DMA_STATE_FULL_TRANSFER) ?
+          DMA_EVENT_HALF_TRANSFER : DMA_EVENT_FULL_TRANSFER;
+      if(!(Events & (1 << Event))) break;
+      Events &= ~(1 << Event);
+      WavPlayer_DmaUpdate(Event);
+      IsRefilled = true;
+
+      // the seeked samples are in the buffer, the DMA reaches them next
+      if(gIsSeekPending)
+        {
+          gIsSeekPending = false;
+          gIsSeekRefilled = true;
+        }
+    }
+
+  // a fade out reached the codec
+  if(gSilentHalves >= FADED_HALVES)
+    {
+      if(gIsI2sRunning && gPlayerState != PLAYER_STATE_PLAYING) WavPlayer_Quiet();
+      if(gConfig.Muted && !gIsCodecMuted)
+        {
+          CS43L22_Mute();
+          gIsCodecMuted = true;
+        }
+    }
+
+  // a long pause powers the codec down
+  if(gPlayerState == PLAYER_STATE_PAUSED &&
+      CS43L22_GetPowerState() == CS43L22_POWER_HOT_PAUSE &&
+      HAL_GetTick() - gPauseTick >= CODEC_STANDBY_DELAY_MS)
+    {
+      CS43L22_Standby();
+    }
+
+  // the loudness is measured right after a refill, the next one is a
+  // half buffer away
+  if(!gIsI2sRunning || IsRefilled) WavPlayer_Scan();
+}
+
+/**
+ * @brief Turn the loudness normalization on or off. The tracks of the
+ * catalogue are measured in the background while it's on, the playing
+ * track moves to its level at once when it was measured.
+ */
+void
+WavPlayer_SetNormalize(bool IsOn)
+{
+  gIsNormalizing = IsOn;
+  if(!IsOn)
+    {
+      WavPlayer_SuspendScan();
+      gScanTrack = TRACK_UNKNOWN;
+    }
+  if(gPlayerState == PLAYER_STATE_IDLE) return;
+
+  gTrackGain = WavPlayer_TrackGain();
+  WavPlayer_RampGain();
+}
+
+/**
+ * @brief Get the progress of the loudness measure and the level of the
+ * playing track.
+ */
+void
+WavPlayer_GetLoudness(WavPlayerLoudness_t* Loudness)
+{
+  Catalogue_t* Cat;
+  uint16_t Track;
+
+  memset(Loudness, 0, sizeof(WavPlayerLoudness_t));
+  Loudness->IsOn = gIsNormalizing;
+  Loudness->Scanning = gScanTrack;
+  Loudness->LufsDb10 = LOUDNESS_UNKNOWN;
+  Loudness->Gain = gTrackGain;
+  if(gPlayerState == PLAYER_STATE_IDLE) return;
+
+  Cat = WavPlayer_GetCatalogue();
+  Loudness->Tracks = Cat->TracksNum;
+  for(uint16_t i = 0; i < Cat->TracksNum; i++)
+    {
+      if(Cat->LufsDb10[i] != LOUDNESS_UNKNOWN) Loudness->Measured++;
+    }
+  if(gScanTrack != TRACK_UNKNOWN && gScanEnd)
+    {
+      Loudness->Progress = (uint8_t)(gScanPos * 100 / gScanEnd);
+    }
+
+  Track = WavPlayer_LocateTrack();
+  if(Track != TRACK_UNKNOWN && Cat->LufsDb10[Track] != LOUDNESS_FAILED)
+    {
+      Loudness->LufsDb10 = Cat->LufsDb10[Track];
+      Loudness->PeakDb10 = Cat->PeakDb10[Track];
+    }
+}
+
+/**
+ * @brief Get the Q15 gain that brings the playing track to the target
+ * loudness. The gain stage doesn't go above unity, the quiet tracks are
+ * left as they are.
+ */
+static uint16_t
+WavPlayer_TrackGain(void)
+{
+  Catalogue_t* Cat;
+  uint16_t Track;
+  int32_t Db10;
+
+  if(!gIsNormalizing) return GAIN_UNITY;
+
+  Track = WavPlayer_LocateTrack();
+  Cat = WavPlayer_GetCatalogue();
+  if(Track == TRACK_UNKNOWN || Cat->LufsDb10[Track] == LOUDNESS_UNKNOWN ||
+      Cat->LufsDb10[Track] == LOUDNESS_FAILED)
+    {
+      return GAIN_UNITY;
+    }
+
+  Db10 = LOUDNESS_TARGET_DB10 - Cat->LufsDb10[Track];
+  if(Db10 >= 0) return GAIN_UNITY;
+  return (uint16_t)lrintf(GAIN_UNITY * powf(10.0f, Db10 / 200.0f));
+}
+
+/**
+ * @brief Measure the loudness of the catalogue a chunk at a time, from
+ * the first track not measured yet. A call opens the file or reads one
+ * chunk, so it takes about as long as a refill read. The file is closed
+ * when a track is opened for playing and the measure resumes from the
+ * same position.
+ */
+static void
+WavPlayer_Scan(void)
+{
+  Catalogue_t* Cat;
+  WavFormat_t Format;
+  TCHAR Path[TRACK_PATH_SIZE];
+  UINT Len = 0;
+  uint32_t Frames;
+  int16_t Lufs;
+  int16_t Peak;
+
+  if(!gIsNormalizing || gPlayerState == PLAYER_STATE_IDLE) return;
+
+  Cat = WavPlayer_GetCatalogue();
+  if(gScanTrack != TRACK_UNKNOWN && gScanVolume != gVolume)
+    {
+      // the drive was switched, its catalogue goes first
+      WavPlayer_SuspendScan();
+      gScanTrack = TRACK_UNKNOWN;
+    }
+
+  if(gScanTrack == TRACK_UNKNOWN)
+    {
+      for(uint16_t Track = 0; Track < Cat->TracksNum; Track++)
+        {
+          if(Cat->LufsDb10[Track] == LOUDNESS_UNKNOWN)
+            {
+              gScanTrack = Track;
+              break;
+            }
+        }
+      if(gScanTrack == TRACK_UNKNOWN) return;
+      gScanVolume = gVolume;
+      gScanPos = 0;
+    }
+
+  if(!gIsScanOpen)
+    {
+      WavPlayer_TrackPath(gScanTrack, Path);
+      if(f_open(&gScanFile, Path, FA_READ) != FR_OK)
+        {
+          WavPlayer_EndScan(LOUDNESS_FAILED, 0);
+          return;
+        }
+      gIsScanOpen = true;
+
+      if(gScanPos == 0)
+        {
+          if(!WavPlayer_ReadHeader(&gScanFile, &Format) ||
+              !WavDecode_Init(&gScanDecoder, &Format))
+            {
+              WavPlayer_EndScan(LOUDNESS_FAILED, 0);
+              return;
+            }
+          Loudness_Begin(Format.SampleRate);
+          gScanPos = Format.DataOfs;
+          gScanEnd = f_size(&gScanFile);
+          if(Format.DataSize < gScanEnd - gScanPos) gScanEnd = gScanPos + Format.DataSize;
+        }
+      else if(f_lseek(&gScanFile, gScanPos) != FR_OK)
+        {
+          WavPlayer_EndScan(LOUDNESS_FAILED, 0);
+        }
+      return;
+    }
+
+  Len = gScanDecoder.BlockBytes;
+  if(Len > gScanEnd - gScanPos) Len = (UINT)(gScanEnd - gScanPos);
+  if(f_read(&gScanFile, gScanBuf, Len, &Len) != FR_OK)
+    {
+      WavPlayer_EndScan(LOUDNESS_FAILED, 0);
+      return;
+    }
+  WavDecode_Load(&gScanDecoder, gScanBuf, Len);
+  while((Frames = WavDecode_Run(&gScanDecoder, gScanSamples, SCAN_DECODE_FRAMES)) > 0)
+    {
+      Loudness_Process(gScanSamples, Frames);
+    }
+  gScanPos += Len;
+  if(Len == gScanDecoder.BlockBytes && gScanPos < gScanEnd) return;
+
+  if(!Loudness_End(&Lufs, &Peak)) Lufs = LOUDNESS_FAILED;
+  WavPlayer_EndScan(Lufs, Peak);
+}
+
+/**
+ * @brief Store the loudness of the track being measured and close it.
+ */
+static void
+WavPlayer_EndScan(int16_t LufsDb10, int16_t PeakDb10)
+{
+  Catalogue_t* Cat = WavPlayer_GetCatalogue();
+
+  WavPlayer_SuspendScan();
+  Cat->LufsDb10[gScanTrack] = LufsDb10;
+  Cat->PeakDb10[gScanTrack] = PeakDb10;
+  gScanTrack = TRACK_UNKNOWN;
+}
+
+/**
+ * @brief Close the file being measured, the measure keeps its position.
+ */
+static void
+WavPlayer_SuspendScan(void)
+{
+  if(!gIsScanOpen) return;
+  f_close(&gScanFile);
+  gIsScanOpen = false;
+}
+
+/**
+ * @brief Get the read error counters of the refill path.
+ */
+void
+WavPlayer_GetReadStats(WavPlayerReadStats_t* Stats)
+{
+  *Stats = gReadStats;
 }
 
 static void 
 WavPlayer_DmaUpdate(DmaEvent_t event)
 {
-  static volatile DmaState_t gDmaState = DMA_STATE_FULL_TRANSFER;
-  FRESULT fr;
   switch(gDmaState)
   {
     case DMA_STATE_HALF_TRANSFER:
       if (event != DMA_EVENT_FULL_TRANSFER) return;
-      gFileReadBytesLen = 0;
-      fr = f_read (&gWavFile, &gAudioBuffer[DMA_BUFFER_SIZE/2], DMA_BUFFER_SIZE/2, &gFileReadBytesLen);
+      WavPlayer_RefillHalf(&gAudioBuffer[DMA_BUFFER_SIZE/2], &gAudioBuffer[0]);
+      WavPlayer_ProcessHalf(&gAudioBuffer[DMA_BUFFER_SIZE/2]);
 
-      if(gFileRemainingSize > (DMA_BUFFER_SIZE / 2))
-        {
-          gFileRemainingSize -= gFileReadBytesLen;
-        }
-      else
+      // a fade out to a pause or a stop may run into the end of the
+      // file, the next track waits for the resume
+      if(WavPlayer_CountRefill() && gPlayerState == PLAYER_STATE_PLAYING)
         {
-          gFileRemainingSize = 0;
           WavPlayer_Next();
         }
       gDmaState = DMA_STATE_FULL_TRANSFER;
@@ -385,15 +1866,12 @@ WavPlayer_DmaUpdate(DmaEvent_t event)
 
     case DMA_STATE_FULL_TRANSFER:
       if (event != DMA_EVENT_HALF_TRANSFER) return;
-      gFileReadBytesLen = 0;
-      fr = f_read (&gWavFile, &gAudioBuffer[0], DMA_BUFFER_SIZE/2, &gFileReadBytesLen);
-      if(gFileRemainingSize > (DMA_BUFFER_SIZE / 2))
-        {
-          gFileRemainingSize -= gFileReadBytesLen;
-        }
-      else
+      WavPlayer_RefillHalf(&gAudioBuffer[0], &gAudioBuffer[DMA_BUFFER_SIZE/2]);
+      WavPlayer_ProcessHalf(&gAudioBuffer[0]);
+      // a fade out to a pause or a stop may run into the end of the
+      // file, the next track waits for the resume
+      if(WavPlayer_CountRefill() && gPlayerState == PLAYER_STATE_PLAYING)
         {
-          gFileRemainingSize = 0;
           WavPlayer_Next();
         }
       gDmaState = DMA_STATE_HALF_TRANSFER;
@@ -415,16 +1893,19 @@ WavPlayer_PlayerUpdate(PlayerEvent_t event)
 
     case PLAYER_STATE_READY:
       if(event == PLAYER_EVENT_RESUME) gPlayerState = PLAYER_STATE_PLAYING;
+      else if(event == PLAYER_EVENT_DISCONNECT) gPlayerState = PLAYER_STATE_IDLE;
     break;
 
     case PLAYER_STATE_PLAYING:
       if(event == PLAYER_EVENT_STOP) gPlayerState = PLAYER_STATE_READY;
       else if(event == PLAYER_EVENT_PAUSE) gPlayerState = PLAYER_STATE_PAUSED;
+      else if(event == PLAYER_EVENT_DISCONNECT) gPlayerState = PLAYER_STATE_IDLE;
     break;
 
     case PLAYER_STATE_PAUSED:
       if(event == PLAYER_EVENT_RESUME) gPlayerState = PLAYER_STATE_PLAYING;
       else if(event == PLAYER_EVENT_STOP) gPlayerState = PLAYER_STATE_READY;
+      else if(event == PLAYER_EVENT_DISCONNECT) gPlayerState = PLAYER_STATE_IDLE;
     break;
 
     default:
@@ -440,7 +1921,14 @@ WavPlayer_PlayerUpdate(PlayerEvent_t event)
 void
 I2s_HalfTransferCallback(void)
 {
-  WavPlayer_DmaUpdate(DMA_EVENT_HALF_TRANSFER);
+  // the DMA goes on to the second half before it was refilled
+  if(gPendingDmaEvents & (1 << DMA_EVENT_FULL_TRANSFER)) gUnderruns++;
+  gPendingDmaEvents |= 1 << DMA_EVENT_HALF_TRANSFER;
+  if(gIsSeekRefilled)
+    {
+      gIsSeekRefilled = false;
+      Latency_Mark(LATENCY_STAGE_AUDIO);
+    }
 }
 
 /**
@@ -449,7 +1937,23 @@ I2s_HalfTransferCallback(void)
 void
 I2s_FullTransferCallback(void)
 {
-  WavPlayer_DmaUpdate(DMA_EVENT_FULL_TRANSFER);
+  // the DMA goes on to the first half before it was refilled
+  if(gPendingDmaEvents & (1 << DMA_EVENT_HALF_TRANSFER)) gUnderruns++;
+  gPendingDmaEvents |= 1 << DMA_EVENT_FULL_TRANSFER;
+  if(gIsSeekRefilled)
+    {
+      gIsSeekRefilled = false;
+      Latency_Mark(LATENCY_STAGE_AUDIO);
+    }
+}
+
+/**
+ * @brief Get the gain the codec adds to the stream at a volume, in 0.1 dB.
+ */
+static int16_t
+WavPlayer_VolumeBoost(uint8_t Vol)
+{
+  return (Vol >= CODEC_VOL_0DB) ? (int16_t)((Vol - CODEC_VOL_0DB) * CODEC_VOL_STEP_DB10) : 0;
 }
 
 //---------------------------------------------------------------------------//
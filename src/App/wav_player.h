@@ -18,25 +18,75 @@
 #include <stdint.h>
 #include "stm32f4xx_hal.h"
 
+//---------------------------------------------------------------------------//
+//defines
+#define WAV_PLAYER_LIST_MAX_SIZE 2048 // the longest track list
+
 //---------------------------------------------------------------------------//
 //typedefs
+typedef enum {
+  WAV_PLAYER_CONCEAL_FADE,   // fade the last good frame to silence
+  WAV_PLAYER_CONCEAL_REPEAT, // repeat the previous buffer with decay
+} WavPlayerConceal_t;
+
 typedef struct {
   bool Muted;
   uint8_t Vol;
-  I2C_HandleTypeDef i2ch;
+  I2C_HandleTypeDef* i2ch;
+  WavPlayerConceal_t Conceal;
+  uint16_t RampMs; // fade time of the mutes, pauses and stops, 0 jumps
 } WavPlayerConfig_t;
 
+typedef enum {
+  WAV_PLAYER_STATE_IDLE,    // no drive or no audio file
+  WAV_PLAYER_STATE_READY,   // stopped at the start of the file
+  WAV_PLAYER_STATE_PLAYING,
+  WAV_PLAYER_STATE_PAUSED,
+} WavPlayerState_t;
+
+typedef struct {
+  WavPlayerState_t State;
+  uint8_t Vol;
+  bool Muted;
+  uint8_t Drive;
+  uint16_t Track;      // index in the drive catalogue, 0xFFFF if unknown
+  uint32_t SampleRate;
+  uint32_t PosMs;      // position of the samples being played
+  uint16_t BufferFill; // bytes queued ahead of the DMA
+  uint32_t Underruns;  // halves played again as their refill was late
+} WavPlayerStatus_t;
+
+typedef struct {
+  uint32_t Errors;       // failed refill reads
+  uint32_t Retries;      // retried refill reads
+  uint32_t Concealments; // half buffers concealed after a missed deadline
+} WavPlayerReadStats_t;
+
+typedef struct {
+  bool IsOn;
+  uint16_t Tracks;   // in the catalogue of the active drive
+  uint16_t Measured; // tracks measured or failed
+  uint16_t Scanning; // track being measured, 0xFFFF if none
+  uint8_t Progress;  // of the track being measured, in %
+  int16_t LufsDb10;  // of the playing track, INT16_MIN if unknown
+  int16_t PeakDb10;  // of the playing track, in 0.1 dBFS
+  uint16_t Gain;     // Q15, applied to the playing track
+} WavPlayerLoudness_t;
+
 //---------------------------------------------------------------------------//
 //functions prototypes
 
 // init functions
 void WavPlayer_Init(WavPlayerConfig_t* Config);
 void WavPlayer_ChooseTheFirstAudioFile(void);
+void WavPlayer_Update(void);
 
 // player control
 bool WavPlayer_PlayAudioFile(const char* filePath);
 bool WavPlayer_Next(void);
 bool WavPlayer_Previous(void);
+bool WavPlayer_SwitchVolume(uint8_t Vol);
+bool WavPlayer_Seek(uint32_t Ms);
 
 void WavPlayer_Stop(void);
 void WavPlayer_Pause(void);
@@ -44,12 +94,25 @@ void WavPlayer_Resume(void);
 
 // Sound control
 void WavPlayer_SetVolume(uint8_t Vol);
+bool WavPlayer_SetSpeed(uint16_t Speed);
+void WavPlayer_SetNormalize(bool IsOn);
+void WavPlayer_GetLoudness(WavPlayerLoudness_t* Loudness);
 void WavPlayer_Mute(void);
 void WavPlayer_Unmute(void);
 
 // Audio files control
 const char* WavPlayer_ListAudioFiles(void);
 
+// Diagnostics
+void WavPlayer_GetStatus(WavPlayerStatus_t* Status);
+void WavPlayer_GetReadStats(WavPlayerReadStats_t* Stats);
+
+// USB drive connection
+void WavPlayer_OnConnect(void);
+void WavPlayer_OnDisconnect(void);
+void WavPlayer_Reconnect(void);
+uint32_t WavPlayer_GetReconnectLatency(void);
+
 
 
 
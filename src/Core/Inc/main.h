@@ -55,9 +55,13 @@ void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
 void App_Init(void);
+void App_Connect(void);
+void App_Disconnect(void);
 /* USER CODE END EFP */
 
 /* Private defines -----------------------------------------------------------*/
+#define HC05_KEY_Pin GPIO_PIN_8
+#define HC05_KEY_GPIO_Port GPIOD
 #define GREEN_LED_Pin GPIO_PIN_12
 #define GREEN_LED_GPIO_Port GPIOD
 #define ORANGE_LED_Pin GPIO_PIN_13
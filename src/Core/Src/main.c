@@ -26,8 +26,10 @@
 /* USER CODE BEGIN Includes */
 #include "../../Modules/CS43L22/CS43L22.h"
 #include "../../Modules/hc-05/hc-05.h"
+#include "../../Modules/hc-05/hc-05_baud.h"
 #include "../../Modules/I2s/I2s.h"
 #include "../../App/wav_player.h"
+#include "../../App/event_loop.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -81,7 +83,7 @@ void MX_USB_HOST_Process(void);
 int main(void)
 {
   /* USER CODE BEGIN 1 */
-
+  WavPlayerStatus_t Status;
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -109,7 +111,7 @@ int main(void)
   MX_USB_HOST_Init();
   MX_UART4_Init();
   /* USER CODE BEGIN 2 */
-
+  EventLoop_Init();
   /* USER CODE END 2 */
 
   /* Infinite loop */
@@ -120,6 +122,18 @@ int main(void)
     MX_USB_HOST_Process();
 
     /* USER CODE BEGIN 3 */
+    WavPlayer_Update();
+    HC05_Update();
+
+    // the erase of a full rate store stalls the flash, it waits for a pause
+    WavPlayer_GetStatus(&Status);
+    if(Status.State != WAV_PLAYER_STATE_PLAYING)
+    {
+      HC05_FlushBaudStore();
+    }
+
+    // sleep until the USB, the audio DMA or the UART bring some work
+    EventLoop_Sleep();
   }
   /* USER CODE END 3 */
 }
@@ -263,6 +277,9 @@ static void MX_UART4_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN UART4_Init 2 */
+  // raise the link speed, blocking, so before the idle line interrupt
+  HC05_NegotiateBaud(&huart4);
+
   //enable idle line interrupt
   __HAL_UART_ENABLE_IT(&huart4, UART_IT_IDLE);
   /* USER CODE END UART4_Init 2 */
@@ -311,8 +328,8 @@ static void MX_GPIO_Init(void)
   HAL_GPIO_WritePin(GPIOC, GPIO_PIN_0, GPIO_PIN_RESET);
 
   /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(GPIOD, GREEN_LED_Pin|ORANGE_LED_Pin|RED_LED_Pin|BLUE_RED_Pin
-                          |GPIO_PIN_4, GPIO_PIN_RESET);
+  HAL_GPIO_WritePin(GPIOD, HC05_KEY_Pin|GREEN_LED_Pin|ORANGE_LED_Pin|RED_LED_Pin
+                          |BLUE_RED_Pin|GPIO_PIN_4, GPIO_PIN_RESET);
 
   /*Configure GPIO pin : PC0 */
   GPIO_InitStruct.Pin = GPIO_PIN_0;
@@ -321,10 +338,10 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
 
-  /*Configure GPIO pins : GREEN_LED_Pin ORANGE_LED_Pin RED_LED_Pin BLUE_RED_Pin
-                           PD4 */
-  GPIO_InitStruct.Pin = GREEN_LED_Pin|ORANGE_LED_Pin|RED_LED_Pin|BLUE_RED_Pin
-                          |GPIO_PIN_4;
+  /*Configure GPIO pins : HC05_KEY_Pin GREEN_LED_Pin ORANGE_LED_Pin RED_LED_Pin
+                           BLUE_RED_Pin PD4 */
+  GPIO_InitStruct.Pin = HC05_KEY_Pin|GREEN_LED_Pin|ORANGE_LED_Pin|RED_LED_Pin
+                          |BLUE_RED_Pin|GPIO_PIN_4;
   GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
@@ -342,7 +359,8 @@ App_Init(void)
       WavPlayerConfig_t Config = {0};
       Config.Muted = false;
       Config.Vol = 180;
-      Config.i2ch = hi2c1;
+      Config.i2ch = &hi2c1;
+      Config.RampMs = 20;
       WavPlayer_Init(&Config);
 
       I2s_SetHandle(&hi2s3);
@@ -353,6 +371,22 @@ App_Init(void)
 
       isInitialized = 1;
     }
+  else
+    {
+      WavPlayer_Reconnect();
+    }
+}
+
+void
+App_Connect(void)
+{
+  WavPlayer_OnConnect();
+}
+
+void
+App_Disconnect(void)
+{
+  WavPlayer_OnDisconnect();
 }
 
 /* USER CODE END 4 */
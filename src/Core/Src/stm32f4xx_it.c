@@ -23,6 +23,8 @@
 #include "stm32f4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "../../Modules/hc-05/hc-05.h"
+#include "../../App/event_loop.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -60,6 +62,7 @@ extern HCD_HandleTypeDef hhcd_USB_OTG_FS;
 extern DMA_HandleTypeDef hdma_spi3_tx;
 extern DMA_HandleTypeDef hdma_uart4_rx;
 extern DMA_HandleTypeDef hdma_uart4_tx;
+extern I2C_HandleTypeDef hi2c1;
 extern UART_HandleTypeDef huart4;
 /* USER CODE BEGIN EV */
 
@@ -209,7 +212,7 @@ void SysTick_Handler(void)
 void DMA1_Stream2_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream2_IRQn 0 */
-
+  EventLoop_Notify(EVENT_SRC_UART);
   /* USER CODE END DMA1_Stream2_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_uart4_rx);
   /* USER CODE BEGIN DMA1_Stream2_IRQn 1 */
@@ -223,7 +226,7 @@ void DMA1_Stream2_IRQHandler(void)
 void DMA1_Stream4_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream4_IRQn 0 */
-
+  EventLoop_Notify(EVENT_SRC_UART);
   /* USER CODE END DMA1_Stream4_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_uart4_tx);
   /* USER CODE BEGIN DMA1_Stream4_IRQn 1 */
@@ -237,7 +240,7 @@ void DMA1_Stream4_IRQHandler(void)
 void DMA1_Stream5_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA1_Stream5_IRQn 0 */
-
+  EventLoop_Notify(EVENT_SRC_REFILL);
   /* USER CODE END DMA1_Stream5_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_spi3_tx);
   /* USER CODE BEGIN DMA1_Stream5_IRQn 1 */
@@ -245,6 +248,34 @@ void DMA1_Stream5_IRQHandler(void)
   /* USER CODE END DMA1_Stream5_IRQn 1 */
 }
 
+/**
+  * @brief This function handles I2C1 event interrupt.
+  */
+void I2C1_EV_IRQHandler(void)
+{
+  /* USER CODE BEGIN I2C1_EV_IRQn 0 */
+
+  /* USER CODE END I2C1_EV_IRQn 0 */
+  HAL_I2C_EV_IRQHandler(&hi2c1);
+  /* USER CODE BEGIN I2C1_EV_IRQn 1 */
+
+  /* USER CODE END I2C1_EV_IRQn 1 */
+}
+
+/**
+  * @brief This function handles I2C1 error interrupt.
+  */
+void I2C1_ER_IRQHandler(void)
+{
+  /* USER CODE BEGIN I2C1_ER_IRQn 0 */
+
+  /* USER CODE END I2C1_ER_IRQn 0 */
+  HAL_I2C_ER_IRQHandler(&hi2c1);
+  /* USER CODE BEGIN I2C1_ER_IRQn 1 */
+
+  /* USER CODE END I2C1_ER_IRQn 1 */
+}
+
 /**
   * @brief This function handles UART4 global interrupt.
   */
@@ -253,8 +284,8 @@ void UART4_IRQHandler(void)
   /* USER CODE BEGIN UART4_IRQn 0 */
   if(__HAL_UART_GET_FLAG(&huart4, UART_FLAG_IDLE))
     {
-      __HAL_UART_CLEAR_FLAG(&huart4, UART_FLAG_IDLE);
-      HAL_UART_AbortReceive(&huart4);
+      __HAL_UART_CLEAR_IDLEFLAG(&huart4);
+      EventLoop_Notify(EVENT_SRC_UART);
       Uart_IDLE_IRQHandler(&huart4);
     }
   /* USER CODE END UART4_IRQn 0 */
@@ -270,7 +301,15 @@ void UART4_IRQHandler(void)
 void OTG_FS_IRQHandler(void)
 {
   /* USER CODE BEGIN OTG_FS_IRQn 0 */
-
+  uint32_t gintsts = USB_OTG_FS->GINTSTS & USB_OTG_FS->GINTMSK;
+  if(gintsts & USB_OTG_GINTSTS_SOF)
+    {
+      EventLoop_Notify(EVENT_SRC_SOF);
+    }
+  if(gintsts & ~USB_OTG_GINTSTS_SOF)
+    {
+      EventLoop_Notify(EVENT_SRC_USB);
+    }
   /* USER CODE END OTG_FS_IRQn 0 */
   HAL_HCD_IRQHandler(&hhcd_USB_OTG_FS);
   /* USER CODE BEGIN OTG_FS_IRQn 1 */
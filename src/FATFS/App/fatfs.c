@@ -24,7 +24,13 @@ FATFS USBHFatFS;    /* File system object for USBH logical drive */
 FIL USBHFile;       /* File object for USBH */
 
 /* USER CODE BEGIN Variables */
+#if _VOLUMES != MAX_SUPPORTED_LUN
+#error "one FatFs volume is needed for each supported LUN"
+#endif
 
+char USBHLunPath[_VOLUMES - 1][4];  /* Logical drive paths of LUN 1 and up */
+FATFS USBHLunFatFS[_VOLUMES - 1];   /* File system objects of LUN 1 and up */
+static uint8_t gVolumesNum = 0;     /* Number of registered volumes */
 /* USER CODE END Variables */
 
 void MX_FATFS_Init(void)
@@ -34,6 +40,10 @@ void MX_FATFS_Init(void)
 
   /* USER CODE BEGIN Init */
   /* additional user code for init */
+  for (uint8_t lun = 1; lun < _VOLUMES; lun++)
+  {
+    FATFS_LinkDriverEx(&USBH_Driver, USBHLunPath[lun - 1], lun);
+  }
   /* USER CODE END Init */
 }
 
@@ -50,7 +60,75 @@ DWORD get_fattime(void)
 }
 
 /* USER CODE BEGIN Application */
+/**
+  * @brief  Register a file system object for every LUN of the drive. The
+  *         volumes are mounted on their first access (delayed mount).
+  * @param  LunsNum: Number of LUNs reported by the drive
+  * @retval Number of registered volumes
+  */
+uint8_t FATFS_MountVolumes(uint8_t LunsNum)
+{
+  gVolumesNum = 0;
+  if (LunsNum > _VOLUMES)
+  {
+    LunsNum = _VOLUMES;
+  }
+
+  while (gVolumesNum < LunsNum)
+  {
+    if (f_mount(FATFS_GetVolume(gVolumesNum), FATFS_GetVolumePath(gVolumesNum), 0) != FR_OK)
+    {
+      break;
+    }
+    gVolumesNum++;
+  }
+
+  return gVolumesNum;
+}
+
+/**
+  * @brief  Unregister the file system objects of all LUNs
+  * @param  None
+  * @retval None
+  */
+void FATFS_UnmountVolumes(void)
+{
+  for (uint8_t vol = 0; vol < _VOLUMES; vol++)
+  {
+    f_mount(NULL, FATFS_GetVolumePath(vol), 0);
+  }
+  gVolumesNum = 0;
+}
 
+/**
+  * @brief  Gets the number of registered volumes
+  * @param  None
+  * @retval Number of volumes
+  */
+uint8_t FATFS_GetVolumesNum(void)
+{
+  return gVolumesNum;
+}
+
+/**
+  * @brief  Gets the logical drive path of a LUN
+  * @param  Vol: LUN number
+  * @retval Drive path ("N:/")
+  */
+const TCHAR* FATFS_GetVolumePath(uint8_t Vol)
+{
+  return (Vol == 0) ? USBHPath : USBHLunPath[Vol - 1];
+}
+
+/**
+  * @brief  Gets the file system object of a LUN
+  * @param  Vol: LUN number
+  * @retval File system object
+  */
+FATFS* FATFS_GetVolume(uint8_t Vol)
+{
+  return (Vol == 0) ? &USBHFatFS : &USBHLunFatFS[Vol - 1];
+}
 /* USER CODE END Application */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -39,7 +39,11 @@ extern FIL USBHFile; /* File object for USBH */
 void MX_FATFS_Init(void);
 
 /* USER CODE BEGIN Prototypes */
-
+uint8_t FATFS_MountVolumes(uint8_t LunsNum);
+void FATFS_UnmountVolumes(void);
+uint8_t FATFS_GetVolumesNum(void);
+const TCHAR* FATFS_GetVolumePath(uint8_t Vol);
+FATFS* FATFS_GetVolume(uint8_t Vol);
 /* USER CODE END Prototypes */
 #ifdef __cplusplus
 }
@@ -14,24 +14,66 @@
 #include "../../Modules/CS43L22/CS43L22.h"
 
 #include "../../Modules/CS43L22/CS43L22_MemMap.h"
+#include "../../Modules/I2cQueue/I2cQueue.h"
+
+#include <string.h>
 
 //defines
 #define CS43L22_I2C_ADDR 0x94
-#define CS43L22_I2C_TIMEOUT_MS 100
+#define CS43L22_REG_NUM 0x35
+#define CS43L22_MAP_INCR 0x80 // auto-increment the register address
+// clean registers a burst may rewrite to join two dirty ones, an I2C
+// transaction costs the start, the address and the MAP bytes
+#define CS43L22_BURST_MAX_GAP 3
 
 // Min => -102 dB => 25, Max => +12 dB => 24
 #define REARRANGE_VOL(volume) (((volume) >= 231 && (volume) <= 255) ? (volume - 231) : (volume + 25))
 
 
 //variable definitions
-static I2C_HandleTypeDef gI2cx;
+static I2C_HandleTypeDef* gI2cx;
 extern I2S_HandleTypeDef hi2s3;
 
+// power-on values of the writable registers, 0 for the others
+static const uint8_t gRegDefaults[CS43L22_REG_NUM] = {
+  [CS43L22_POWER_CTL1_R] = 0x01,
+  [CS43L22_POWER_CTL2_R] = 0x05,
+  [CS43L22_CLOCKING_CTL_R] = 0xA0,
+  [CS43L22_PASSTHROUGH_A_SELECT_R] = 0x81,
+  [CS43L22_PASSTHROUGH_B_SELECT_R] = 0x81,
+  [CS43L22_ANALOG_ZC_AND_SR_SETTINGS_R] = 0xA5,
+  [CS43L22_PLAYBACK_CTL1_R] = 0x60,
+  [CS43L22_MISC_CTL_R] = 0x02,
+  [CS43L22_TONE_CTL_R] = 0x88,
+  [CS43L22_LIMIT_CTL2_RELEASE_RATE_R] = 0x7F,
+  [CS43L22_LIMITER_ATTACK_RATE_R] = 0xC0,
+  [CS43L22_CHARGE_PUMP_FREQ_R] = 0x50,
+};
+
+// shadow of the register file, the codec is only written, never read
+static uint8_t gRegs[CS43L22_REG_NUM];
+static uint64_t gDirtyRegs = 0;
+static uint32_t gI2cTransactions = 0;
+static uint32_t gLastTicket = 0;
+
+static CS43L22PowerState_t gPowerState = CS43L22_POWER_OFF;
+static CS43L22Wake_t gLastWake;
+static uint32_t gWakeStart;
+static uint32_t gWakeTransactions;
+
 //functions prototypes
 static void CS43L22_PowerDown(void);
 static void CS43L22_PowerUp(void);
-static void CS43L22_I2CWriteReg(uint8_t Reg, uint8_t Val);
-static uint8_t CS43L22_I2CReadReg(uint8_t Reg);
+static void CS43L22_MuteOutputs(void);
+static void CS43L22_UnmuteOutputs(void);
+static void CS43L22_WakeBegin(void);
+static void CS43L22_WakeEnd(void);
+static void CS43L22_WakeDone(void);
+static void CS43L22_I2CWriteRegs(uint8_t Reg, const uint8_t* Vals, uint8_t Num);
+static bool CS43L22_IsWritable(uint8_t Reg);
+static void CS43L22_SetReg(uint8_t Reg, uint8_t Val);
+static void CS43L22_SetBits(uint8_t Reg, uint8_t Set, uint8_t Clear);
+static void CS43L22_Flush(void);
 
 static void CS43L22_EnableLeftHP(void);
 static void CS43L22_EnableRightHP(void);
@@ -46,17 +88,28 @@ static void CS43L22_I2SInterface(void);
 
 static void CS43L22_PullUpReset(void);
 static void CS43L22_PullDownReset(void);
+static void CS43L22_SetResetPin(void);
+static void CS43L22_ClearResetPin(void);
 
 //functions definitions
 void CS43L22_Init(CS43L22Config_t* Config)
 {
-  //register i2c handle
+  //register i2c handle, the writes are queued and sent by its interrupts
   gI2cx = Config->i2ch;
+  I2cQueue_Init(gI2cx);
 
-  CS43L22_PullUpReset();
+  CS43L22_WakeBegin();
+  // out of standby only the registers that differ are written
+  if(gPowerState == CS43L22_POWER_OFF)
+    {
+      CS43L22_PullUpReset();
+      gPowerState = CS43L22_POWER_STANDBY;
+    }
 
   CS43L22_PowerDown(); //power down for configuration
+  CS43L22_Flush();
 
+  // the rest of the configuration goes out in bursts
   CS43L22_EnableLeftHP();
   CS43L22_EnableRightHP();
   CS43L22_DisableLeftSPK();
@@ -65,6 +118,9 @@ void CS43L22_Init(CS43L22Config_t* Config)
   CS43L22_AutoDetectClock();
 
   CS43L22_I2SInterface();
+  // volume and mute changes ramp in 1/8 dB steps on zero crossings
+  CS43L22_SetReg(CS43L22_MISC_CTL_R, (1 << CS43L22_MISC_CTL_DIGSFT_Pos) |
+                 (1 << CS43L22_MISC_CTL_DIGZC_Pos));
   if(Config->Muted)
     {
       CS43L22_Mute();
@@ -74,32 +130,161 @@ void CS43L22_Init(CS43L22Config_t* Config)
       CS43L22_Unmute();
     }
   CS43L22_SetVolume(Config->Vol);
+  CS43L22_UnmuteOutputs();
+  CS43L22_Flush();
+
   CS43L22_PowerUp();
+  CS43L22_Flush();
+  gPowerState = CS43L22_POWER_ON;
+  CS43L22_WakeEnd();
 }
 
+/**
+ * @brief Resume from the hot pause or the standby, the codec keeps its
+ * configuration there so it only takes the power and mute registers.
+ */
 void
 CS43L22_Start(void)
 {
+  if(gPowerState == CS43L22_POWER_ON || gPowerState == CS43L22_POWER_OFF) return;
+
+  CS43L22_WakeBegin();
+  CS43L22_UnmuteOutputs();
   CS43L22_PowerUp();
+  CS43L22_Flush();
+  gPowerState = CS43L22_POWER_ON;
+  CS43L22_WakeEnd();
 }
 
+/**
+ * @brief Mute the headphones and keep the codec running, for short pauses.
+ */
+void
+CS43L22_HotPause(void)
+{
+  if(gPowerState != CS43L22_POWER_ON) return;
+
+  CS43L22_MuteOutputs();
+  CS43L22_Flush();
+  gPowerState = CS43L22_POWER_HOT_PAUSE;
+}
+
+/**
+ * @brief Power the codec down and keep it out of reset, its registers
+ * are kept. The outputs are muted first against the pop, MCLK has to run
+ * until the write is done (see CS43L22_Sync).
+ */
+void
+CS43L22_Standby(void)
+{
+  if(gPowerState == CS43L22_POWER_STANDBY || gPowerState == CS43L22_POWER_OFF) return;
+
+  CS43L22_MuteOutputs();
+  CS43L22_PowerDown();
+  CS43L22_Flush();
+  gPowerState = CS43L22_POWER_STANDBY;
+}
+
+/**
+ * @brief Power the codec down and hold it in reset, it's configured
+ * from scratch by the next CS43L22_Init.
+ */
 void
 CS43L22_Stop(void)
 {
-  CS43L22_Mute();
-  CS43L22_I2CWriteReg(CS43L22_MISC_CTL_R, 0); // disable softramp
+  if(gPowerState == CS43L22_POWER_OFF) return;
+
+  // the soft ramp stays on, the outputs ramp down before the power down
+  CS43L22_DisableLeftHP();
+  CS43L22_DisableRightHP();
+  CS43L22_Flush();
   CS43L22_PowerDown();
+  CS43L22_Flush();
   CS43L22_PullDownReset();
+  gPowerState = CS43L22_POWER_OFF;
+}
+
+/**
+ * @brief Wait for the queued writes to be on the bus.
+ */
+void
+CS43L22_Sync(void)
+{
+  I2cQueue_Wait(gLastTicket);
+}
+
+CS43L22PowerState_t
+CS43L22_GetPowerState(void)
+{
+  return gPowerState;
+}
+
+/**
+ * @brief Get the cost of the last resume, Us is 0 until it's over.
+ */
+void
+CS43L22_GetLastWake(CS43L22Wake_t* Wake)
+{
+  __disable_irq();
+  *Wake = gLastWake;
+  __enable_irq();
+}
+
+static void
+CS43L22_WakeBegin(void)
+{
+  gWakeStart = DWT->CYCCNT;
+  gWakeTransactions = gI2cTransactions;
+  gLastWake.From = gPowerState;
+}
+
+static void
+CS43L22_WakeEnd(void)
+{
+  __disable_irq();
+  gLastWake.Writes = gI2cTransactions - gWakeTransactions;
+  gLastWake.Us = 0;
+  __enable_irq();
+  gLastTicket = I2cQueue_Call(CS43L22_WakeDone);
+}
+
+/**
+ * @brief Called from the I2C interrupt after the last write of a resume.
+ */
+static void
+CS43L22_WakeDone(void)
+{
+  gLastWake.Us = (DWT->CYCCNT - gWakeStart) / (SystemCoreClock / 1000000);
+  if(gLastWake.Us == 0) gLastWake.Us = 1;
 }
 
+/**
+ * @brief The reset pin moves in the I2C queue, after the writes queued
+ * before it.
+ */
 static void 
 CS43L22_PullUpReset(void)
 {
-	HAL_GPIO_WritePin(GPIOD, GPIO_PIN_4, GPIO_PIN_SET);
+  gLastTicket = I2cQueue_Call(CS43L22_SetResetPin);
+  // the codec is out of reset with its power-on register values
+  memcpy(gRegs, gRegDefaults, CS43L22_REG_NUM);
+  gDirtyRegs = 0;
 }
 
 static void
 CS43L22_PullDownReset(void)
+{
+  gLastTicket = I2cQueue_Call(CS43L22_ClearResetPin);
+}
+
+static void
+CS43L22_SetResetPin(void)
+{
+	HAL_GPIO_WritePin(GPIOD, GPIO_PIN_4, GPIO_PIN_SET);
+}
+
+static void
+CS43L22_ClearResetPin(void)
 {
 	HAL_GPIO_WritePin(GPIOD, GPIO_PIN_4, GPIO_PIN_RESET);
 }
@@ -107,8 +292,9 @@ CS43L22_PullDownReset(void)
 void 
 CS43L22_SetVolume(uint8_t volume)
 {
-  CS43L22_I2CWriteReg(CS43L22_MASTER_A_VOL_R, REARRANGE_VOL(volume));
-  CS43L22_I2CWriteReg(CS43L22_MASTER_B_VOL_R, REARRANGE_VOL(volume));
+  CS43L22_SetReg(CS43L22_MASTER_A_VOL_R, REARRANGE_VOL(volume));
+  CS43L22_SetReg(CS43L22_MASTER_B_VOL_R, REARRANGE_VOL(volume));
+  CS43L22_Flush();
 }
 
 void 
@@ -116,6 +302,7 @@ CS43L22_Mute()
 {
   CS43L22_DisableLeftHP();
   CS43L22_DisableRightHP();
+  CS43L22_Flush();
 }
 
 void 
@@ -123,80 +310,90 @@ CS43L22_Unmute()
 {
   CS43L22_EnableLeftHP();
   CS43L22_EnableRightHP();
+  CS43L22_Flush();
+}
+
+/**
+ * @brief Get the number of I2C transactions queued for the codec.
+ */
+uint32_t
+CS43L22_GetI2cTransactions(void)
+{
+  return gI2cTransactions;
 }
 
 static void 
 CS43L22_PowerDown(void)
 {
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL1_R, CS43L22_POWER_CTL1_POWERED_DOWN_Val);
+  CS43L22_SetReg(CS43L22_POWER_CTL1_R, CS43L22_POWER_CTL1_POWERED_DOWN_Val);
 }
 
 static void 
 CS43L22_PowerUp(void)
 {
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL1_R, CS43L22_POWER_CTL1_POWERED_UP_Val);
+  CS43L22_SetReg(CS43L22_POWER_CTL1_R, CS43L22_POWER_CTL1_POWERED_UP_Val);
+}
+
+static void
+CS43L22_MuteOutputs(void)
+{
+  CS43L22_SetBits(CS43L22_PLAYBACK_CTL2_R, (1 << CS43L22_PLAYBACK_CTL2_HPBMUTE_Pos) |
+                  (1 << CS43L22_PLAYBACK_CTL2_HPAMUTE_Pos), 0);
+}
+
+static void
+CS43L22_UnmuteOutputs(void)
+{
+  CS43L22_SetBits(CS43L22_PLAYBACK_CTL2_R, 0, (1 << CS43L22_PLAYBACK_CTL2_HPBMUTE_Pos) |
+                  (1 << CS43L22_PLAYBACK_CTL2_HPAMUTE_Pos));
 }
 
 static void 
 CS43L22_EnableLeftHP(void)
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_POWER_CTL2_R);
-  Val |= 1 << CS43L22_POWER_CTL2_HPA1_Pos;
-  Val &= ~(1 << CS43L22_POWER_CTL2_HPA0_Pos);
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL2_R, Val);
+  CS43L22_SetBits(CS43L22_POWER_CTL2_R, 1 << CS43L22_POWER_CTL2_HPA1_Pos,
+                  1 << CS43L22_POWER_CTL2_HPA0_Pos);
 }
 
 static void 
 CS43L22_EnableRightHP(void)
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_POWER_CTL2_R);
-  Val |= 1 << CS43L22_POWER_CTL2_HPB1_Pos;
-  Val &= ~(1 << CS43L22_POWER_CTL2_HPB0_Pos);
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL2_R, Val);
+  CS43L22_SetBits(CS43L22_POWER_CTL2_R, 1 << CS43L22_POWER_CTL2_HPB1_Pos,
+                  1 << CS43L22_POWER_CTL2_HPB0_Pos);
 }
 
 static void 
 CS43L22_DisableLeftHP(void)
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_POWER_CTL2_R);
-  Val |= 1 << CS43L22_POWER_CTL2_HPA1_Pos;
-  Val |= 1 << CS43L22_POWER_CTL2_HPA0_Pos;
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL2_R, Val);
+  CS43L22_SetBits(CS43L22_POWER_CTL2_R, (1 << CS43L22_POWER_CTL2_HPA1_Pos) | (1 << CS43L22_POWER_CTL2_HPA0_Pos),
+                  0);
 }
 
 static void 
 CS43L22_DisableRightHP(void)
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_POWER_CTL2_R);
-  Val |= 1 << CS43L22_POWER_CTL2_HPB1_Pos;
-  Val |= 1 << CS43L22_POWER_CTL2_HPB0_Pos;
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL2_R, Val);
+  CS43L22_SetBits(CS43L22_POWER_CTL2_R, (1 << CS43L22_POWER_CTL2_HPB1_Pos) | (1 << CS43L22_POWER_CTL2_HPB0_Pos),
+                  0);
 }
 
 static void 
 CS43L22_DisableLeftSPK(void)
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_POWER_CTL2_R);
-  Val |= 1 << CS43L22_POWER_CTL2_SPKA1_Pos;
-  Val |= 1 << CS43L22_POWER_CTL2_SPKA0_Pos;
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL2_R, Val);
+  CS43L22_SetBits(CS43L22_POWER_CTL2_R, (1 << CS43L22_POWER_CTL2_SPKA1_Pos) | (1 << CS43L22_POWER_CTL2_SPKA0_Pos),
+                  0);
 }
 
 static void 
 CS43L22_DisableRightSPK(void)
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_POWER_CTL2_R);
-  Val |= 1 << CS43L22_POWER_CTL2_SPKB1_Pos;
-  Val |= 1 << CS43L22_POWER_CTL2_SPKB0_Pos;
-	CS43L22_I2CWriteReg(CS43L22_POWER_CTL2_R, Val);
+  CS43L22_SetBits(CS43L22_POWER_CTL2_R, (1 << CS43L22_POWER_CTL2_SPKB1_Pos) | (1 << CS43L22_POWER_CTL2_SPKB0_Pos),
+                  0);
 }
 
 static void 
 CS43L22_AutoDetectClock()
 {
-  uint8_t Val = CS43L22_I2CReadReg(CS43L22_CLOCKING_CTL_R);
-  Val |= 1 << CS43L22_CLOCKING_CTL_AUTO_Pos;
-	CS43L22_I2CWriteReg(CS43L22_CLOCKING_CTL_R, Val);
+  CS43L22_SetBits(CS43L22_CLOCKING_CTL_R, 1 << CS43L22_CLOCKING_CTL_AUTO_Pos, 0);
 }
 
 static void 
@@ -210,25 +407,98 @@ CS43L22_I2SInterface()
   Val |= (1 << CS43L22_INTERFACE_CTL1_DACDIF0_Pos); // I2S, up to 24-bit data
   Val |= (1 << CS43L22_INTERFACE_CTL1_AWL1_Pos); // 16-bit audio sample word length
   Val |= (1 << CS43L22_INTERFACE_CTL1_AWL0_Pos); // 16-bit audio sample word length
-	CS43L22_I2CWriteReg(CS43L22_INTERFACE_CTL1_R, Val);
+  CS43L22_SetReg(CS43L22_INTERFACE_CTL1_R, Val);
 }
 
-static void 
-CS43L22_I2CWriteReg(uint8_t Reg, uint8_t Val)
+/**
+ * @brief Stage a register value in the shadow, it's written by the next
+ * flush if it changed.
+ */
+static void
+CS43L22_SetReg(uint8_t Reg, uint8_t Val)
+{
+  if(gRegs[Reg] == Val) return;
+  gRegs[Reg] = Val;
+  gDirtyRegs |= 1ULL << Reg;
+}
+
+static void
+CS43L22_SetBits(uint8_t Reg, uint8_t Set, uint8_t Clear)
+{
+  CS43L22_SetReg(Reg, (uint8_t)((gRegs[Reg] | Set) & ~Clear));
+}
+
+/**
+ * @brief Check a register may be written, the reserved and read-only
+ * ones split the bursts.
+ */
+static bool
+CS43L22_IsWritable(uint8_t Reg)
 {
-  uint8_t data[2];
-	data[0] = Reg;
-	data[1] = Val;
-	HAL_I2C_Master_Transmit(&gI2cx, CS43L22_I2C_ADDR, data, 2, CS43L22_I2C_TIMEOUT_MS);
+  return (Reg >= CS43L22_POWER_CTL1_R && Reg <= CS43L22_PASSTHROUGH_GANG_CTL_R &&
+          Reg != 0x03 && Reg != 0x0B) ||
+      (Reg >= CS43L22_PLAYBACK_CTL1_R && Reg <= CS43L22_PLAYBACK_CTL2_R) ||
+      Reg == CS43L22_PASSTHROUGH_A_VOL_R || Reg == CS43L22_PASSTHROUGH_B_VOL_R ||
+      (Reg >= CS43L22_PCMA_VOL_R && Reg <= CS43L22_LIMITER_ATTACK_RATE_R) ||
+      Reg == CS43L22_BATTERY_COMPENSATION_R || Reg == CS43L22_CHARGE_PUMP_FREQ_R;
 }
 
-static uint8_t 
-CS43L22_I2CReadReg(uint8_t Reg)
+/**
+ * @brief Write the changed registers of the shadow, each run of them in one
+ * auto-increment burst. A few clean registers between two dirty ones are
+ * rewritten with their shadow values rather than starting a new transaction.
+ * Nothing is written in reset, the shadow is reset with the codec.
+ */
+static void
+CS43L22_Flush(void)
+{
+  uint8_t Reg = 0;
+  uint8_t First;
+  uint8_t Last;
+  uint8_t Gap;
+
+  if(gPowerState == CS43L22_POWER_OFF) return;
+
+  while(gDirtyRegs)
+    {
+      while(!(gDirtyRegs & (1ULL << Reg))) Reg++;
+
+      // extend the burst over the writable registers up to the last dirty
+      // one that is close enough
+      First = Reg;
+      Last = Reg;
+      Gap = 0;
+      for(Reg = First + 1; Reg < CS43L22_REG_NUM && CS43L22_IsWritable(Reg); Reg++)
+        {
+          if(gDirtyRegs & (1ULL << Reg))
+            {
+              Last = Reg;
+              Gap = 0;
+            }
+          else if(++Gap > CS43L22_BURST_MAX_GAP)
+            {
+              break;
+            }
+        }
+
+      CS43L22_I2CWriteRegs(First, &gRegs[First], Last - First + 1);
+      gDirtyRegs &= ~(((1ULL << (Last - First + 1)) - 1) << First);
+      Reg = Last + 1;
+    }
+}
+
+/**
+ * @brief Queue a write of consecutive registers, it returns before the
+ * transaction is on the bus.
+ */
+static void 
+CS43L22_I2CWriteRegs(uint8_t Reg, const uint8_t* Vals, uint8_t Num)
 {
-  uint8_t data;
-	HAL_I2C_Master_Transmit(&gI2cx, CS43L22_I2C_ADDR, &Reg, 1, CS43L22_I2C_TIMEOUT_MS);
-	HAL_I2C_Master_Receive(&gI2cx, CS43L22_I2C_ADDR, &data, 1, CS43L22_I2C_TIMEOUT_MS);
-  return data;
+  uint8_t data[CS43L22_REG_NUM + 1];
+	data[0] = (Num > 1) ? (Reg | CS43L22_MAP_INCR) : Reg;
+  memcpy(&data[1], Vals, Num);
+	gLastTicket = I2cQueue_Write(CS43L22_I2C_ADDR, data, Num + 1, NULL);
+  gI2cTransactions++;
 }
 
 //---------------------------------------------------------------------------//
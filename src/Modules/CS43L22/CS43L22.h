@@ -18,10 +18,25 @@
 #include "stm32f4xx_hal.h"
 
 //---------------------------------------------------------------------------//
+// power states, from the cheapest to the slowest to resume
+typedef enum {
+  CS43L22_POWER_ON,
+  CS43L22_POWER_HOT_PAUSE, // running with the headphones muted
+  CS43L22_POWER_STANDBY,   // powered down, the registers are kept
+  CS43L22_POWER_OFF,       // held in reset, it needs a CS43L22_Init
+} CS43L22PowerState_t;
+
+// the last move to CS43L22_POWER_ON
+typedef struct {
+  CS43L22PowerState_t From;
+  uint32_t Writes; // I2C transactions
+  uint32_t Us;     // until the last one was on the bus
+} CS43L22Wake_t;
+
 typedef struct {
   bool Muted;
   uint8_t Vol;
-  I2C_HandleTypeDef i2ch;
+  I2C_HandleTypeDef* i2ch;
 } CS43L22Config_t;
 
 //---------------------------------------------------------------------------//
@@ -31,7 +46,13 @@ void CS43L22_SetVolume(uint8_t volume);
 void CS43L22_Mute();
 void CS43L22_Unmute();
 void CS43L22_Start(void);
+void CS43L22_HotPause(void);
+void CS43L22_Standby(void);
 void CS43L22_Stop(void);
+void CS43L22_Sync(void);
+CS43L22PowerState_t CS43L22_GetPowerState(void);
+void CS43L22_GetLastWake(CS43L22Wake_t* Wake);
+uint32_t CS43L22_GetI2cTransactions(void);
 
 #endif
 //---------------------------------------------------------------------------//
@@ -74,6 +74,9 @@
 #define CS43L22_PLAYBACK_CTL2_HPBMUTE_Pos 0x7
 #define CS43L22_PLAYBACK_CTL2_HPAMUTE_Pos 0x6
 
+#define CS43L22_MISC_CTL_DIGSFT_Pos 0x1
+#define CS43L22_MISC_CTL_DIGZC_Pos 0x0
+
 
 #endif
 //---------------------------------------------------------------------------//
\ No newline at end of file
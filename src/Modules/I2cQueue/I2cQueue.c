@@ -0,0 +1,220 @@
+/**
+ * @file I2cQueue.c
+ * @author Mohamed Hassanin Mohamed
+ * @brief A queue of I2C master writes run in the background by the I2C
+ * interrupts, so the callers don't wait for the bus. An operation is a
+ * write transaction or a plain call, the calls keep things like a reset
+ * pin in order with the writes around them.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "../../Modules/I2cQueue/I2cQueue.h"
+
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+//defines
+#define I2C_QUEUE_MASK (I2C_QUEUE_SIZE - 1)
+// a full queue waits for the bus that long before dropping the operation
+#define I2C_QUEUE_FULL_TIMEOUT_MS 100
+
+//---------------------------------------------------------------------------//
+//typedefs
+typedef struct {
+  uint16_t DevAddr;
+  uint8_t Len; // 0 for a call
+  uint8_t Data[I2C_QUEUE_DATA_MAX];
+  I2cQueueDone_t Done;
+} I2cOp_t;
+
+//---------------------------------------------------------------------------//
+//variables definitions
+static I2C_HandleTypeDef* gHandle;
+static I2cOp_t gOps[I2C_QUEUE_SIZE];
+// written by the callers only
+static volatile uint32_t gHead = 0;
+// written by the interrupt, or by the caller that started the queue
+static volatile uint32_t gTail = 0;
+static volatile bool gIsBusy = false;
+static volatile uint32_t gErrors = 0;
+
+//---------------------------------------------------------------------------//
+//functions prototypes
+static void I2cQueue_Run(void);
+static void I2cQueue_Complete(void);
+
+//---------------------------------------------------------------------------//
+// functions definitions
+
+/**
+ * @brief Set the I2C peripheral the queue runs on, its event and error
+ * interrupts must be enabled.
+ */
+void
+I2cQueue_Init(I2C_HandleTypeDef* Handle)
+{
+  gHandle = Handle;
+}
+
+/**
+ * @brief Queue a write transaction, the data is copied.
+ *
+ * @param Done called when the write is over, may be NULL
+ * @return a ticket for I2cQueue_IsDone
+ */
+uint32_t
+I2cQueue_Write(uint16_t DevAddr, const uint8_t* Data, uint8_t Len,
+               I2cQueueDone_t Done)
+{
+  uint32_t Start = HAL_GetTick();
+  I2cOp_t* Op;
+  bool IsIdle;
+
+  if(Len > I2C_QUEUE_DATA_MAX)
+    {
+      gErrors++;
+      return gHead;
+    }
+
+  while(gHead - gTail == I2C_QUEUE_SIZE)
+    {
+      if(HAL_GetTick() - Start > I2C_QUEUE_FULL_TIMEOUT_MS)
+        {
+          // the bus is stuck, drop the operation
+          gErrors++;
+          return gHead;
+        }
+    }
+
+  Op = &gOps[gHead & I2C_QUEUE_MASK];
+  Op->DevAddr = DevAddr;
+  Op->Len = Len;
+  if(Len) memcpy(Op->Data, Data, Len);
+  Op->Done = Done;
+
+  __disable_irq();
+  gHead++;
+  IsIdle = !gIsBusy;
+  gIsBusy = true;
+  __enable_irq();
+
+  // the HAL starts the transfer with the interrupts on, the queue is
+  // already marked busy so nothing else starts one
+  if(IsIdle) I2cQueue_Run();
+
+  return gHead;
+}
+
+/**
+ * @brief Queue a call after the operations already queued.
+ *
+ * @return a ticket for I2cQueue_IsDone
+ */
+uint32_t
+I2cQueue_Call(I2cQueueDone_t Done)
+{
+  return I2cQueue_Write(0, NULL, 0, Done);
+}
+
+/**
+ * @brief Check the operation of a ticket and the ones before it are over
+ */
+bool
+I2cQueue_IsDone(uint32_t Ticket)
+{
+  return (int32_t)(gTail - Ticket) >= 0;
+}
+
+/**
+ * @brief Wait for the operation of a ticket, for the rare callers that
+ * need the codec in a given state before going on.
+ */
+void
+I2cQueue_Wait(uint32_t Ticket)
+{
+  while(!I2cQueue_IsDone(Ticket));
+}
+
+/**
+ * @brief Get the number of failed or dropped operations.
+ */
+uint32_t
+I2cQueue_GetErrors(void)
+{
+  return gErrors;
+}
+
+/**
+ * @brief Start the next write, the calls before it are done on the way.
+ * It runs from the interrupt, or from a caller that found the queue idle
+ * and marked it busy.
+ */
+static void
+I2cQueue_Run(void)
+{
+  I2cOp_t* Op;
+  uint32_t Primask;
+
+  for(;;)
+    {
+      // a write queued between the last check and the release would
+      // find the queue busy and never run
+      Primask = __get_PRIMASK();
+      __disable_irq();
+      if(gTail == gHead)
+        {
+          gIsBusy = false;
+          __set_PRIMASK(Primask);
+          return;
+        }
+      __set_PRIMASK(Primask);
+
+      Op = &gOps[gTail & I2C_QUEUE_MASK];
+      if(Op->Len)
+        {
+          if(HAL_OK == HAL_I2C_Master_Transmit_IT(gHandle, Op->DevAddr,
+                                                  Op->Data, Op->Len))
+            {
+              return;
+            }
+          gErrors++;
+        }
+      if(Op->Done) Op->Done();
+      gTail++;
+    }
+}
+
+/**
+ * @brief Finish the running write and start the next one.
+ */
+static void
+I2cQueue_Complete(void)
+{
+  I2cOp_t* Op = &gOps[gTail & I2C_QUEUE_MASK];
+
+  if(Op->Done) Op->Done();
+  gTail++;
+  I2cQueue_Run();
+}
+
+void
+HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef* hi2c)
+{
+  if(hi2c != gHandle) return;
+  I2cQueue_Complete();
+}
+
+void
+HAL_I2C_ErrorCallback(I2C_HandleTypeDef* hi2c)
+{
+  if(hi2c != gHandle) return;
+  // a NACK or a lost arbitration, the write is given up
+  gErrors++;
+  I2cQueue_Complete();
+}
+
+//---------------------------------------------------------------------------//
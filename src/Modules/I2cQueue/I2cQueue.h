@@ -0,0 +1,40 @@
+/**
+ * @file I2cQueue.h
+ * @author Mohamed Hassanin Mohamed
+ * @brief A queue of I2C master writes run in the background by the I2C
+ * interrupts, so the callers don't wait for the bus.
+ * @version 0.1
+ * @date 2021-12-11
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+#ifndef I2C_QUEUE_H
+#define I2C_QUEUE_H
+
+#include "stm32f4xx_hal.h"
+#include "stdbool.h"
+
+//---------------------------------------------------------------------------//
+//defines
+#define I2C_QUEUE_SIZE 16 // a power of 2
+#define I2C_QUEUE_DATA_MAX 56
+
+//---------------------------------------------------------------------------//
+//typedefs
+
+// called from the I2C interrupt when an operation is over
+typedef void (*I2cQueueDone_t)(void);
+
+//---------------------------------------------------------------------------//
+//prototypes
+
+void I2cQueue_Init(I2C_HandleTypeDef* Handle);
+uint32_t I2cQueue_Write(uint16_t DevAddr, const uint8_t* Data, uint8_t Len,
+                        I2cQueueDone_t Done);
+uint32_t I2cQueue_Call(I2cQueueDone_t Done);
+bool I2cQueue_IsDone(uint32_t Ticket);
+void I2cQueue_Wait(uint32_t Ticket);
+uint32_t I2cQueue_GetErrors(void);
+
+#endif
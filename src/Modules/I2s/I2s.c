@@ -129,6 +129,15 @@ I2s_StopTransfer(void)
   HAL_I2S_DMAStop(hAudioI2S);
 }
 
+/**
+ * @brief Get the bytes left until the DMA wraps to the buffer start
+ */
+uint32_t
+I2s_GetRemaining(void)
+{
+  return __HAL_DMA_GET_COUNTER(hAudioI2S->hdmatx) * SAMPLE_SIZE;
+}
+
 /**
  * @brief DMA Callback for an event when it completed the transmission fully
  * 
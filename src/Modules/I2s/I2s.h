@@ -32,6 +32,7 @@ void I2s_Pause(void);
 void I2s_Resume(void);
 void I2s_SetVolume(uint8_t volume);
 void I2s_StopTransfer(void);
+uint32_t I2s_GetRemaining(void);
 
 void I2s_HalfTransferCallback(void);
 void I2s_FullTransferCallback(void);
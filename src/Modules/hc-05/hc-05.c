@@ -13,29 +13,127 @@
 ******************************************************************************/
 #include "../../Modules/hc-05/hc-05.h"
 
+#include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
+#include "../../Modules/hc-05/hc-05_frame.h"
 #include "../../App/wav_player.h"
+#include "../../App/event_loop.h"
+#include "../../App/latency.h"
+#include "../../Modules/CS43L22/CS43L22.h"
+#include "../../App/eq.h"
+#include "../../App/limiter.h"
+#include "../../App/stretch.h"
+#include "../../App/meter.h"
+#include "../../App/dither.h"
 
 /******************************************************************************
 * Definitions
 ******************************************************************************/
 #define DATA_MAX_SIZE 50
+#define INFO_MAX_SIZE 256
+#define RX_RING_SIZE 256
+#define TX_RING_SIZE 4096 // power of 2
+#define TX_RING_MASK (TX_RING_SIZE - 1)
+// room a command needs before it runs, its longest reply is the track list
+#define TX_REPLY_MAX_SIZE (WAV_PLAYER_LIST_MAX_SIZE + INFO_MAX_SIZE)
+#define CMD_QUEUE_SIZE 4 // power of 2
+#define CMD_QUEUE_MASK (CMD_QUEUE_SIZE - 1)
+// reply payload of a binary frame, a STATUS operation takes the most
+#define FRAME_REPLY_MAX_SIZE 128
+// prints a level in 0.1 dB as dB
+#define DB10_FMT "%s%d.%d"
+#define DB10_ABS(_DB10_) (((_DB10_) < 0) ? -(_DB10_) : (_DB10_))
+#define DB10_ARGS(_DB10_) ((_DB10_) < 0) ? "-" : "", DB10_ABS(_DB10_) / 10, DB10_ABS(_DB10_) % 10
+#define FRAME_OP_REPLY_MAX_SIZE (2 + HC05_FRAME_STATUS_SIZE)
+#define TELEMETRY_MIN_PERIOD_MS 100
+#define TELEMETRY_FRAME_SIZE (2 + HC05_FRAME_TELEMETRY_SIZE + HC05_FRAME_OVERHEAD)
+// a binary frame whose next bytes come later is dropped, the longest one
+// skipped, 260 bytes, takes 271 ms at 9600 baud
+#define FRAME_RX_TIMEOUT_MS 500
+
+/******************************************************************************
+* Typedefs
+******************************************************************************/
+typedef struct
+{
+  uint32_t RxCycles; // time stamp of the IRQ that framed it
+  uint8_t Len;
+  uint8_t Data[DATA_MAX_SIZE + 1]; // null terminated
+} Cmd_t;
 
 /******************************************************************************
 * Module Variable Definitions
 ******************************************************************************/
 static UART_HandleTypeDef* gUartHandle;
-static bool gIsReceived = false;
-static uint8_t gDataLen;
-static uint8_t gData[DATA_MAX_SIZE];
+static char gInfo[INFO_MAX_SIZE];
+
+// circular DMA receive ring, framed in the UART and DMA IRQs
+static uint8_t gRxRing[RX_RING_SIZE];
+static uint16_t gRxPos = 0; // next ring byte to frame
+static uint8_t gLine[DATA_MAX_SIZE];
+static uint8_t gLineLen = 0;
+static bool gIsLineTooLong = false;
+static bool gIsBinary = false; // collecting a binary frame
+static uint16_t gRxSkip = 0; // bytes left of a too long binary frame
+static uint32_t gFrameTick; // time of the last bytes of the binary frame
+static volatile uint32_t gRxOverruns = 0; // receptions broken by the UART
+static volatile uint32_t gRxTooLong = 0; // frames longer than DATA_MAX_SIZE
+static uint32_t gBadFrames = 0; // binary frames cut short or with a wrong CRC
+static uint32_t gRxCycles; // time stamp of the current receive IRQ
+
+// transmit ring, written by the main loop and sent by chained DMA transfers
+static uint8_t gTxRing[TX_RING_SIZE];
+static volatile uint32_t gTxHead = 0;
+static volatile uint32_t gTxTail = 0;
+static volatile uint32_t gTxLen = 0; // bytes of the transfer in progress
+static volatile bool gIsTxBusy = false;
+
+// single-producer (UART IRQ) single-consumer (main loop) command queue,
+// each index is written by one side only
+static Cmd_t gCmdQueue[CMD_QUEUE_SIZE];
+static volatile uint32_t gCmdHead = 0;
+static volatile uint32_t gCmdTail = 0;
+static volatile uint32_t gCmdDropped = 0;
+static Cmd_t gCmd;
+
+// telemetry push, 0 period when off
+static uint16_t gTelemetryPeriod = 0;
+static uint32_t gTelemetryTick;
+static uint8_t gTelemetrySeq = 0;
+
+// commands with latency histograms, the binary operations count as the
+// ASCII command they match, 'k' is the binary seek and 't' the telemetry
+static const char gLatencyCmds[LATENCY_CMD_NUM] = "><cprsmuvdlikth";
 
 /******************************************************************************
 * Functions prototypes
 ******************************************************************************/
-static HAL_StatusTypeDef HC05_Print(const char* Data);
 static bool atoi (const char* Data, uint8_t* Num);
+static const char* HC05_FormatInfo(void);
+static bool HC05_PushCommand(const uint8_t* Data, uint8_t Len);
+static bool HC05_PopCommand(Cmd_t* Cmd);
+static void HC05_Execute(uint8_t* Data);
+static void HC05_ExecuteFrame(const uint8_t* Frame, uint8_t Size);
+static HC05Result_t HC05_ExecuteOp(uint8_t Op, const uint8_t* Args,
+                                   uint8_t* Reply, uint8_t* ReplyLen);
+static void HC05_PushTelemetry(void);
+static uint8_t HC05_LatencyCmd(const Cmd_t* Cmd);
+static const char* HC05_FormatLatency(char Cmd);
+static bool HC05_SetEq(const char* Args);
+static const char* HC05_FormatEq(void);
+static bool HC05_SetLimiter(const char* Args);
+static const char* HC05_FormatLimiter(void);
+static const char* HC05_FormatSpeed(void);
+static const char* HC05_FormatMeter(void);
+static const char* HC05_FormatLoudness(void);
+static const char* HC05_FormatDither(void);
+static void HC05_StartReceive(void);
+static void HC05_DrainRx(void);
+static void HC05_EndFrame(void);
+static void HC05_StartTx(void);
 /******************************************************************************
 * Functions definitions
 ******************************************************************************/
@@ -49,9 +147,121 @@ HC05_Init(UART_HandleTypeDef* UartHandle)
 {
   //register the handle
   gUartHandle = UartHandle;
-  // Start DMA receive
-  if(HAL_OK != HAL_UART_Receive_DMA(gUartHandle, gData, DATA_MAX_SIZE))
+  HC05_StartReceive();
+}
+
+/**
+ * @brief Start the circular DMA receive into the ring, it runs forever
+ * unless a receive error aborts it.
+ */
+static void
+HC05_StartReceive(void)
+{
+  gRxPos = 0;
+  gLineLen = 0;
+  gIsLineTooLong = false;
+  gIsBinary = false;
+  gRxSkip = 0;
+  if(HAL_OK != HAL_UART_Receive_DMA(gUartHandle, gRxRing, RX_RING_SIZE))
+    {
+    }
+}
+
+/**
+ * @brief Finish the ASCII frame being collected and queue it. Empty frames
+ * are ignored and too long ones are counted and dropped. A binary frame
+ * ends by its length, so it continues after an idle line.
+ */
+static void
+HC05_EndFrame(void)
+{
+  if(gIsBinary) return;
+
+  if(gIsLineTooLong)
     {
+      gRxTooLong++;
+    }
+  else if(gLineLen > 0)
+    {
+      HC05_PushCommand(gLine, gLineLen);
+    }
+  gLineLen = 0;
+  gIsLineTooLong = false;
+}
+
+/**
+ * @brief Frame the bytes the DMA wrote since the last call. A carriage
+ * return or a line feed ends a command, so a burst may hold many commands.
+ * A sync byte at the start of a frame begins a binary frame instead, it
+ * ends by its length. A binary frame the sender gave up on is dropped when
+ * new bytes come after a timeout, they start a frame of their own.
+ */
+static void
+HC05_DrainRx(void)
+{
+  uint16_t Pos = RX_RING_SIZE - __HAL_DMA_GET_COUNTER(gUartHandle->hdmarx);
+  uint32_t Tick = HAL_GetTick();
+
+  if(Pos == RX_RING_SIZE) Pos = 0;
+  if(gRxPos == Pos) return;
+
+  if(gIsBinary && Tick - gFrameTick > FRAME_RX_TIMEOUT_MS)
+    {
+      if(gRxSkip == 0) gBadFrames++;
+      gIsBinary = false;
+      gRxSkip = 0;
+      gLineLen = 0;
+    }
+  gFrameTick = Tick;
+
+  while(gRxPos != Pos)
+    {
+      uint8_t Byte = gRxRing[gRxPos];
+      gRxPos = (gRxPos + 1) % RX_RING_SIZE;
+
+      if(gRxSkip > 0)
+        {
+          if(--gRxSkip == 0) gIsBinary = false;
+          continue;
+        }
+
+      if(gLineLen == 0 && !gIsLineTooLong && Byte == HC05_FRAME_SYNC)
+        {
+          gIsBinary = true;
+        }
+
+      if(gIsBinary)
+        {
+          gLine[gLineLen++] = Byte;
+          if(gLineLen < 2) continue;
+
+          if(gLine[1] + HC05_FRAME_OVERHEAD > DATA_MAX_SIZE)
+            {
+              // skip the rest of it by its length, the next frame may
+              // follow without a line ending
+              gRxTooLong++;
+              gRxSkip = gLine[1] + HC05_FRAME_OVERHEAD - gLineLen;
+              gLineLen = 0;
+            }
+          else if(gLineLen == gLine[1] + HC05_FRAME_OVERHEAD)
+            {
+              HC05_PushCommand(gLine, gLineLen);
+              gIsBinary = false;
+              gLineLen = 0;
+            }
+        }
+      else if(Byte == '\r' || Byte == '\n')
+        {
+          HC05_EndFrame();
+        }
+      else if(gIsLineTooLong || gLineLen == DATA_MAX_SIZE)
+        {
+          gIsLineTooLong = true;
+        }
+      else
+        {
+          gLine[gLineLen++] = Byte;
+        }
     }
 }
 
@@ -68,15 +278,253 @@ UpCase(char* Data)
    }
 }
 
+/**
+ * @brief Queue a received command, called from the UART IRQ only.
+ * 
+ * @return false if the queue is full and the command is dropped
+ */
+static bool
+HC05_PushCommand(const uint8_t* Data, uint8_t Len)
+{
+  uint32_t Head = gCmdHead;
+
+  if(Head - gCmdTail == CMD_QUEUE_SIZE)
+    {
+      gCmdDropped++;
+      return false;
+    }
+
+  gCmdQueue[Head & CMD_QUEUE_MASK].RxCycles = gRxCycles;
+  gCmdQueue[Head & CMD_QUEUE_MASK].Len = Len;
+  memcpy(gCmdQueue[Head & CMD_QUEUE_MASK].Data, Data, Len);
+  gCmdQueue[Head & CMD_QUEUE_MASK].Data[Len] = '\0';
+  // publish the slot content before the new head
+  __DMB();
+  gCmdHead = Head + 1;
+  return true;
+}
+
+/**
+ * @brief Take the oldest queued command, called from the main loop only.
+ * 
+ * @return false if the queue is empty
+ */
+static bool
+HC05_PopCommand(Cmd_t* Cmd)
+{
+  uint32_t Tail = gCmdTail;
+
+  if(Tail == gCmdHead) return false;
+
+  // read the slot content after seeing the new head
+  __DMB();
+  *Cmd = gCmdQueue[Tail & CMD_QUEUE_MASK];
+  // release the slot after copying it
+  __DMB();
+  gCmdTail = Tail + 1;
+  return true;
+}
+
+/**
+ * @brief Execute the queued commands, called from the main loop.
+ * 
+ */
 void
 HC05_Update(void)
 {
-  if(!gIsReceived) return;
-  gIsReceived = false;
+  // a transfer the HAL refused to start is retried, the queued bytes
+  // would otherwise wait for a completion that never comes
+  if(!gIsTxBusy && gTxHead != gTxTail)
+    {
+      __disable_irq();
+      if(!gIsTxBusy)
+        {
+          HC05_StartTx();
+        }
+      __enable_irq();
+    }
+
+  // back-pressure, the commands wait in the queue until their reply fits
+  while(HC05_GetTxFree() >= TX_REPLY_MAX_SIZE && HC05_PopCommand(&gCmd))
+    {
+      Latency_Begin(HC05_LatencyCmd(&gCmd), gCmd.RxCycles);
+      if(gCmd.Data[0] == HC05_FRAME_SYNC)
+        {
+          HC05_ExecuteFrame(gCmd.Data, gCmd.Len);
+        }
+      else
+        {
+          HC05_Execute(gCmd.Data);
+        }
+      Latency_Mark(LATENCY_STAGE_ACTION);
+      Latency_End();
+    }
+
+  HC05_PushTelemetry();
+}
+
+/**
+ * @brief Send a telemetry frame when its period is over. A frame is sent
+ * only if the room for the longest command reply stays free, otherwise it
+ * is skipped, so the telemetry never delays a reply.
+ */
+static void
+HC05_PushTelemetry(void)
+{
+  static uint8_t Data[2 + HC05_FRAME_TELEMETRY_SIZE];
+  static uint8_t Out[TELEMETRY_FRAME_SIZE];
+  WavPlayerStatus_t Status;
+  EventLoopStats_t Stats;
+  uint32_t Now = HAL_GetTick();
+
+  if(gTelemetryPeriod == 0 || Now - gTelemetryTick < gTelemetryPeriod) return;
+  gTelemetryTick = Now;
+
+  if(HC05_GetTxFree() < TX_REPLY_MAX_SIZE + TELEMETRY_FRAME_SIZE) return;
+
+  WavPlayer_GetStatus(&Status);
+  EventLoop_GetStats(&Stats);
+
+  Data[0] = HC05_OP_TELEMETRY;
+  Data[1] = HC05_RESULT_OK;
+  Data[2] = (uint8_t)Status.State;
+  HC05Frame_PutU32(&Data[3], Status.PosMs);
+  HC05Frame_PutU16(&Data[7], Status.BufferFill);
+  HC05Frame_PutU32(&Data[9], Status.SampleRate);
+  HC05Frame_PutU32(&Data[13], Status.Underruns);
+  HC05Frame_PutU16(&Data[17], Stats.CpuLoad);
+
+  HC05_Write(Out, HC05Frame_Encode(Out, gTelemetrySeq++, Data, sizeof(Data)));
+}
+
+/**
+ * @brief Execute the batch of operations of a binary frame and reply with
+ * a binary frame carrying the same sequence number. A corrupted frame is
+ * counted and not answered, the host retries on its own timeout.
+ */
+static void
+HC05_ExecuteFrame(const uint8_t* Frame, uint8_t Size)
+{
+  static uint8_t Reply[FRAME_REPLY_MAX_SIZE];
+  static uint8_t Out[FRAME_REPLY_MAX_SIZE + HC05_FRAME_OVERHEAD];
+  const uint8_t* Ops;
+  uint8_t Len;
+  uint8_t Seq;
+  uint8_t ReplyLen = 0;
+  uint8_t OpReplyLen;
+  uint8_t ArgSize;
+  HC05Result_t Result;
+
+  if(!HC05Frame_Decode(Frame, Size, &Seq, &Ops, &Len))
+    {
+      gBadFrames++;
+      return;
+    }
+
+  for(uint8_t i = 0; i < Len; i += ArgSize)
+    {
+      uint8_t Op = Ops[i++];
+
+      // the host sees the missing results and sends the rest again
+      if(ReplyLen + FRAME_OP_REPLY_MAX_SIZE > FRAME_REPLY_MAX_SIZE) break;
+
+      ArgSize = HC05Frame_ArgSize(Op);
+      OpReplyLen = 0;
+      if(ArgSize == HC05_FRAME_ARG_UNKNOWN || i + ArgSize > Len)
+        {
+          Result = HC05_RESULT_BAD_OP;
+        }
+      else
+        {
+          Result = HC05_ExecuteOp(Op, &Ops[i], &Reply[ReplyLen + 2], &OpReplyLen);
+        }
+
+      Reply[ReplyLen] = Op;
+      Reply[ReplyLen + 1] = Result;
+      ReplyLen += 2 + OpReplyLen;
+      if(Result != HC05_RESULT_OK) break;
+    }
+
+  HC05_Write(Out, HC05Frame_Encode(Out, Seq, Reply, ReplyLen));
+}
+
+/**
+ * @brief Execute one operation of a binary frame
+ *
+ * @param Args the operation arguments, HC05Frame_ArgSize bytes
+ * @param Reply output of the operation reply data
+ * @param ReplyLen output of the reply data size
+ */
+static HC05Result_t
+HC05_ExecuteOp(uint8_t Op, const uint8_t* Args, uint8_t* Reply, uint8_t* ReplyLen)
+{
+  WavPlayerStatus_t Status;
+
+  switch(Op)
+  {
+    case HC05_OP_PLAY:
+      WavPlayer_Resume();
+      break;
+    case HC05_OP_PAUSE:
+      WavPlayer_Pause();
+      break;
+    case HC05_OP_STOP:
+      WavPlayer_Stop();
+      break;
+    case HC05_OP_NEXT:
+      if(!WavPlayer_Next()) return HC05_RESULT_FAILED;
+      break;
+    case HC05_OP_PREVIOUS:
+      if(!WavPlayer_Previous()) return HC05_RESULT_FAILED;
+      break;
+    case HC05_OP_MUTE:
+      WavPlayer_Mute();
+      break;
+    case HC05_OP_UNMUTE:
+      WavPlayer_Unmute();
+      break;
+    case HC05_OP_VOLUME:
+      WavPlayer_SetVolume(Args[0]);
+      break;
+    case HC05_OP_DRIVE:
+      if(!WavPlayer_SwitchVolume(Args[0])) return HC05_RESULT_FAILED;
+      break;
+    case HC05_OP_SEEK:
+      if(!WavPlayer_Seek(HC05Frame_GetU32(Args))) return HC05_RESULT_FAILED;
+      break;
+    case HC05_OP_STATUS:
+      WavPlayer_GetStatus(&Status);
+      Reply[0] = (uint8_t)Status.State;
+      Reply[1] = Status.Vol;
+      Reply[2] = Status.Muted;
+      Reply[3] = Status.Drive;
+      HC05Frame_PutU16(&Reply[4], Status.Track);
+      HC05Frame_PutU32(&Reply[6], Status.SampleRate);
+      HC05Frame_PutU32(&Reply[10], Status.PosMs);
+      *ReplyLen = HC05_FRAME_STATUS_SIZE;
+      break;
+    case HC05_OP_TELEMETRY:
+      gTelemetryPeriod = HC05Frame_GetU16(Args);
+      if(gTelemetryPeriod != 0 && gTelemetryPeriod < TELEMETRY_MIN_PERIOD_MS)
+        {
+          gTelemetryPeriod = TELEMETRY_MIN_PERIOD_MS;
+        }
+      gTelemetryTick = HAL_GetTick();
+      break;
+    default:
+      return HC05_RESULT_BAD_OP;
+  }
+  return HC05_RESULT_OK;
+}
 
+static void
+HC05_Execute(uint8_t* Data)
+{
   uint8_t Vol;
+  uint8_t Drive;
+  uint8_t Speed;
 
-  char FirstChar = (char)gData[0];
+  char FirstChar = (char)Data[0];
   switch(FirstChar)
   {
     case '>':
@@ -96,17 +544,98 @@ HC05_Update(void)
     case 'l':
       HC05_Print(WavPlayer_ListAudioFiles());
       return;
+    case 'i':
+      HC05_Print(HC05_FormatInfo());
+      return;
+    case 'h':
+      HC05_Print(HC05_FormatLatency((char)Data[strlen((char*)Data) > 2 ? 2 : 1]));
+      return;
+    case 'e':
+      if(strlen((char*)Data) <= 2)
+        {
+          HC05_Print(HC05_FormatEq());
+          return;
+        }
+      if(!HC05_SetEq((const char*)&Data[2]))
+        {
+          HC05_Print("[ERROR] invalid band or over the EQ budget.\n");
+          return;
+        }
+      break;
+    case 'g':
+      if(strlen((char*)Data) <= 2)
+        {
+          HC05_Print(HC05_FormatLimiter());
+          return;
+        }
+      if(!HC05_SetLimiter((const char*)&Data[2]))
+        {
+          HC05_Print("[ERROR] invalid limiter setting.\n");
+          return;
+        }
+      break;
+    case 'a':
+      if(strlen((char*)Data) <= 2)
+        {
+          HC05_Print(HC05_FormatMeter());
+          return;
+        }
+      if(Data[2] != '0' && Data[2] != '1')
+        {
+          HC05_Print("[ERROR] the VU bar is 0 (off) or 1 (on).\n");
+          return;
+        }
+      Meter_SetBar(Data[2] == '1');
+      break;
+    case 'n':
+      if(strlen((char*)Data) <= 2)
+        {
+          HC05_Print(HC05_FormatLoudness());
+          return;
+        }
+      if(Data[2] != '0' && Data[2] != '1')
+        {
+          HC05_Print("[ERROR] the normalization is 0 (off) or 1 (on).\n");
+          return;
+        }
+      WavPlayer_SetNormalize(Data[2] == '1');
+      break;
+    case 'q':
+      if(strlen((char*)Data) <= 2)
+        {
+          HC05_Print(HC05_FormatDither());
+          return;
+        }
+      if(Data[2] != '0' && Data[2] != '1')
+        {
+          HC05_Print("[ERROR] the noise shaping is 0 (off) or 1 (on).\n");
+          return;
+        }
+      Dither_SetShaping(Data[2] == '1');
+      break;
+    case 'x':
+      if(strlen((char*)Data) <= 2)
+        {
+          HC05_Print(HC05_FormatSpeed());
+          return;
+        }
+      if(!atoi((const char*)&Data[2], &Speed) || !WavPlayer_SetSpeed(Speed))
+        {
+          HC05_Print("[ERROR] invalid speed, speed range is [50-200].\n");
+          return;
+        }
+      break;
     case 'c':
-      if(strlen((char*)gData) > 2)
+      if(strlen((char*)Data) > 2)
 	{
-	  UpCase((char*)&gData[2]);
+	  UpCase((char*)&Data[2]);
 	}
       else
 	{
 	  HC05_Print("[ERROR] No file name.\n");
 	  return;
 	}
-      if(!WavPlayer_PlayAudioFile((const char*)&gData[2]))
+      if(!WavPlayer_PlayAudioFile((const char*)&Data[2]))
 	{
 	  HC05_Print("[ERROR] couldn't open the file.\n");
 	  return;
@@ -128,13 +657,20 @@ HC05_Update(void)
       WavPlayer_Unmute();
       break;
     case 'v':
-      if(!atoi((const char*)&gData[2], &Vol))
+      if(!atoi((const char*)&Data[2], &Vol))
         {
           HC05_Print("[ERROR] invalid volume value, volume range is [0-255].\n");
           return;
         }
       WavPlayer_SetVolume(Vol);
       break;
+    case 'd':
+      if(!atoi((const char*)&Data[2], &Drive) || !WavPlayer_SwitchVolume(Drive))
+        {
+          HC05_Print("[ERROR] invalid drive number.\n");
+          return;
+        }
+      break;
     default:
       HC05_Print("[ERROR] undefined command.\n");
       return;
@@ -175,10 +711,401 @@ atoi (const char* Data, uint8_t* Num)
   return true;
 }
 
-static HAL_StatusTypeDef
+/**
+ * @brief Format the main loop wake counters, the CPU load, the
+ * receive error counters and the codec power state with the cost of
+ * its last resume
+ * 
+ * @return the info line
+ */
+static const char*
+HC05_FormatInfo(void)
+{
+  // by CS43L22PowerState_t
+  static const char PowerStates[] = "ohsx";
+  EventLoopStats_t Stats;
+  CS43L22Wake_t Wake;
+
+  EventLoop_GetStats(&Stats);
+  CS43L22_GetLastWake(&Wake);
+  snprintf(gInfo, INFO_MAX_SIZE,
+           "wakes usb:%" PRIu32 " sof:%" PRIu32 " refill:%" PRIu32
+           " uart:%" PRIu32 " other:%" PRIu32 " cpu:%u.%u%%"
+           " dropped:%" PRIu32 " overrun:%" PRIu32 " long:%" PRIu32
+           " bad:%" PRIu32 " codec:%c wake:%c/%" PRIu32 "/%" PRIu32 "us\n",
+           Stats.Wakes[EVENT_SRC_USB], Stats.Wakes[EVENT_SRC_SOF],
+           Stats.Wakes[EVENT_SRC_REFILL], Stats.Wakes[EVENT_SRC_UART],
+           Stats.OtherWakes, Stats.CpuLoad / 10, Stats.CpuLoad % 10,
+           gCmdDropped, gRxOverruns, gRxTooLong, gBadFrames,
+           PowerStates[CS43L22_GetPowerState()], PowerStates[Wake.From],
+           Wake.Writes, Wake.Us);
+  return gInfo;
+}
+
+/**
+ * @brief Set an EQ band from "<band> <type> [<freq> <gain> <q>] [l|r]",
+ * the type is o(ff), p(eak), l(ow shelf) or h(igh shelf), the gain is in
+ * 0.1 dB and the q x100. Both channels are set unless one is named.
+ */
+static bool
+HC05_SetEq(const char* Args)
+{
+  static const char Types[] = "oplh"; // by EqBandType_t
+  unsigned int Band;
+  char Type;
+  unsigned int Freq = 0;
+  int Gain = 0;
+  unsigned int Q = 0;
+  char Channel = '\0';
+  const char* Found;
+  EqBand_t Params;
+  uint8_t Channels = EQ_CHANNEL_BOTH;
+  int Num;
+
+  Num = sscanf(Args, "%u %c %u %d %u %c", &Band, &Type, &Freq, &Gain, &Q, &Channel);
+  if(Num < 2 || Band >= EQ_BANDS) return false;
+
+  Found = strchr(Types, Type);
+  if(Found == NULL || Type == '\0') return false;
+  Params.Type = (EqBandType_t)(Found - Types);
+  if(Params.Type == EQ_BAND_OFF)
+    {
+      // "o" may be followed by the channel
+      if(Num >= 3) return false;
+      sscanf(Args, "%*u %*c %c", &Channel);
+    }
+  else if(Num < 5 || Freq > UINT16_MAX || Q > UINT16_MAX)
+    {
+      return false;
+    }
+  Params.Freq = (uint16_t)Freq;
+  Params.GainDb10 = (int16_t)Gain;
+  Params.Q100 = (uint16_t)Q;
+
+  if(Channel == 'l') Channels = EQ_CHANNEL_LEFT;
+  else if(Channel == 'r') Channels = EQ_CHANNEL_RIGHT;
+  else if(Channel != '\0') return false;
+
+  return Eq_SetBand(Channels, (uint8_t)Band, &Params);
+}
+
+/**
+ * @brief Format the EQ load: the biquads run per channel, the budget at
+ * the current rate and the measured cycles per frame
+ *
+ * @return the EQ line
+ */
+static const char*
+HC05_FormatEq(void)
+{
+  EqStats_t Stats;
+
+  Eq_GetStats(&Stats);
+  snprintf(gInfo, INFO_MAX_SIZE,
+           "eq stages:%u/%u max:%u bypassed:%u cycles:%" PRIu32 ".%" PRIu32 "/frame"
+           " %" PRIu32 ".%" PRIu32 "/stage headroom:" DB10_FMT "dB\n",
+           Stats.Stages[0], Stats.Stages[1], Stats.MaxStages, Stats.Bypassed,
+           Stats.CyclesPerFrame10 / 10, Stats.CyclesPerFrame10 % 10,
+           Stats.StageCycles10 / 10, Stats.StageCycles10 % 10,
+           DB10_ARGS(Stats.HeadroomDb10));
+  return gInfo;
+}
+
+/**
+ * @brief Set the limiter from "l <ceiling>", "c <threshold> <ratio>",
+ * "c o" or "r <release>", the levels are in 0.1 dBFS, the ratio x10 and
+ * the release in ms.
+ */
+static bool
+HC05_SetLimiter(const char* Args)
+{
+  char Setting;
+  int Value = 0;
+  unsigned int Ratio = 0;
+  char Off = '\0';
+  int Num;
+
+  Num = sscanf(Args, "%c %d %u", &Setting, &Value, &Ratio);
+  if(Num < 1) return false;
+
+  switch(Setting)
+  {
+    case 'l':
+      return Num == 2 && Limiter_SetCeiling((int16_t)Value);
+    case 'c':
+      if(Num == 1 && sscanf(Args, "%*c %c", &Off) == 1 && Off == 'o')
+        {
+          return Limiter_SetCompressor(false, 0, 0);
+        }
+      return Num == 3 && Ratio <= UINT8_MAX &&
+          Limiter_SetCompressor(true, (int16_t)Value, (uint8_t)Ratio);
+    case 'r':
+      return Num == 2 && Value > 0 && Limiter_SetRelease((uint16_t)Value);
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Format the limiter: the gain reduction now and its deepest since
+ * the last query, the frames limited, the ceiling and the compressor
+ *
+ * @return the limiter line
+ */
+static const char*
+HC05_FormatLimiter(void)
+{
+  LimiterStats_t Stats;
+  int Gr;
+  int MaxGr;
+  int Len;
+
+  Limiter_GetStats(&Stats);
+  Gr = (int)lrintf(200.0f * log10f((float)Stats.Gain / LIMITER_UNITY));
+  MaxGr = (Stats.MinGain == 0) ? -999 :
+      (int)lrintf(200.0f * log10f((float)Stats.MinGain / LIMITER_UNITY));
+
+  Len = snprintf(gInfo, INFO_MAX_SIZE,
+                 "lim gr:" DB10_FMT "dB max:" DB10_FMT "dB frames:%" PRIu32
+                 " ceil:" DB10_FMT "dB boost:" DB10_FMT "dB rel:%ums",
+                 DB10_ARGS(Gr), DB10_ARGS(MaxGr), Stats.LimitedFrames,
+                 DB10_ARGS(Stats.CeilingDb10), DB10_ARGS(Stats.BoostDb10),
+                 Stats.ReleaseMs);
+  if(Stats.IsCompressing)
+    {
+      snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, " comp:" DB10_FMT "dB %u.%u:1\n",
+               DB10_ARGS(Stats.ThresholdDb10), Stats.Ratio10 / 10, Stats.Ratio10 % 10);
+    }
+  else
+    {
+      snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, " comp:off\n");
+    }
+  return gInfo;
+}
+
+/**
+ * @brief Format the level meter: the peaks of the last block, its RMS, the
+ * bar level, the held peak and the highest since the last query
+ *
+ * @return the meter line
+ */
+static const char*
+HC05_FormatMeter(void)
+{
+  MeterStats_t Stats;
+
+  Meter_GetStats(&Stats);
+  snprintf(gInfo, INFO_MAX_SIZE,
+           "level peak:" DB10_FMT "/" DB10_FMT "dB rms:" DB10_FMT "dB bar:" DB10_FMT
+           "dB hold:" DB10_FMT "dB max:" DB10_FMT "dB clips:%" PRIu32
+           " cycles:%" PRIu32 "/%u frames vu:%s\n",
+           DB10_ARGS(Stats.PeakDb10[0]), DB10_ARGS(Stats.PeakDb10[1]),
+           DB10_ARGS(Stats.RmsDb10), DB10_ARGS(Stats.LevelDb10),
+           DB10_ARGS(Stats.HoldDb10), DB10_ARGS(Stats.MaxDb10), Stats.Clips,
+           Stats.CyclesPerBlock, Stats.BlockFrames, Stats.IsBarOn ? "on" : "off");
+  return gInfo;
+}
+
+/**
+ * @brief Format the loudness normalization: the tracks measured, the one
+ * being measured and the loudness and gain of the playing track
+ *
+ * @return the normalization line
+ */
+static const char*
+HC05_FormatLoudness(void)
+{
+  WavPlayerLoudness_t Loudness;
+  int Gain;
+  int Len;
+
+  WavPlayer_GetLoudness(&Loudness);
+  Gain = (int)lrintf(200.0f * log10f((float)Loudness.Gain / 0x8000));
+  Len = snprintf(gInfo, INFO_MAX_SIZE, "norm:%s measured:%u/%u",
+                 Loudness.IsOn ? "on" : "off", Loudness.Measured, Loudness.Tracks);
+  if(Loudness.Scanning != 0xFFFF)
+    {
+      Len += snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, " scan:%u %u%%",
+                      Loudness.Scanning, Loudness.Progress);
+    }
+  if(Loudness.LufsDb10 != INT16_MIN)
+    {
+      Len += snprintf(&gInfo[Len], INFO_MAX_SIZE - Len,
+                      " track:" DB10_FMT "LUFS peak:" DB10_FMT "dB",
+                      DB10_ARGS(Loudness.LufsDb10), DB10_ARGS(Loudness.PeakDb10));
+    }
+  snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, " gain:" DB10_FMT "dB\n", DB10_ARGS(Gain));
+  return gInfo;
+}
+
+/**
+ * @brief Format the requantization of the sources over 16 bits: the
+ * noise shaping is applied from 44.1 kHz up
+ *
+ * @return the dither line
+ */
+static const char*
+HC05_FormatDither(void)
+{
+  snprintf(gInfo, INFO_MAX_SIZE, "dither:tpdf shaping:%s\n", Dither_IsShaping() ? "on" : "off");
+  return gInfo;
+}
+
+/**
+ * @brief Format the time-stretch: the speed, the read ahead it takes, the
+ * segments added and the measured cycles per output frame
+ *
+ * @return the speed line
+ */
+static const char*
+HC05_FormatSpeed(void)
+{
+  StretchStats_t Stats;
+
+  Stretch_GetStats(&Stats);
+  snprintf(gInfo, INFO_MAX_SIZE,
+           "speed:%u.%02ux readahead:%u buffered:%u steps:%" PRIu32
+           " cycles:%" PRIu32 ".%" PRIu32 "/frame\n",
+           Stats.Speed / 100, Stats.Speed % 100, Stats.ReadAhead, Stats.Buffered,
+           Stats.Steps, Stats.CyclesPerFrame10 / 10, Stats.CyclesPerFrame10 % 10);
+  return gInfo;
+}
+
+/**
+ * @brief Get the index of the latency histograms of a command
+ * 
+ * @return LATENCY_CMD_NUM for a command without histograms
+ */
+static uint8_t
+HC05_LatencyCmd(const Cmd_t* Cmd)
+{
+  // ASCII command of each binary operation, by opcode
+  static const char OpCmds[] = "?rps><muvdkit";
+  char Key = (char)Cmd->Data[0];
+  const char* Found;
+
+  if(Cmd->Data[0] == HC05_FRAME_SYNC)
+    {
+      // a batch counts as its first operation
+      Key = '?';
+      if(Cmd->Len > HC05_FRAME_OVERHEAD && Cmd->Data[3] < sizeof(OpCmds) - 1)
+        {
+          Key = OpCmds[Cmd->Data[3]];
+        }
+    }
+
+  Found = (Key != '\0') ? strchr(gLatencyCmds, Key) : NULL;
+  return Found ? (uint8_t)(Found - gLatencyCmds) : LATENCY_CMD_NUM;
+}
+
+/**
+ * @brief Format the latency histograms of a command, the buckets of the
+ * dispatch, file, action and audio stages
+ * 
+ * @return the histograms line
+ */
+static const char*
+HC05_FormatLatency(char Cmd)
+{
+  static const char* Stages[LATENCY_STAGE_NUM] = {"disp", "file", "act", "audio"};
+  const char* Found = (Cmd != '\0') ? strchr(gLatencyCmds, Cmd) : NULL;
+  LatencyHist_t Hist;
+  int Len;
+
+  if(Found == NULL) return "[ERROR] undefined command.\n";
+
+  Latency_GetHist((uint8_t)(Found - gLatencyCmds), &Hist);
+  Len = snprintf(gInfo, INFO_MAX_SIZE, "%c", Cmd);
+  for(uint8_t Stage = 0; Stage < LATENCY_STAGE_NUM; Stage++)
+    {
+      Len += snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, " %s:", Stages[Stage]);
+      for(uint8_t Bucket = 0; Bucket < LATENCY_BUCKETS; Bucket++)
+        {
+          Len += snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, Bucket ? ",%u" : "%u",
+                          Hist.Counts[Stage][Bucket]);
+        }
+    }
+  snprintf(&gInfo[Len], INFO_MAX_SIZE - Len, "\n");
+  return gInfo;
+}
+
+/**
+ * @brief Get the free space of the transmit ring.
+ * 
+ * @return the number of bytes HC05_Print accepts now
+ */
+uint32_t
+HC05_GetTxFree(void)
+{
+  return TX_RING_SIZE - (gTxHead - gTxTail);
+}
+
+/**
+ * @brief Queue a text message for transmission
+ * 
+ * @return HAL_BUSY if the message doesn't fit, nothing is queued then
+ */
+HAL_StatusTypeDef
 HC05_Print(const char* Data)
 { 
-  return HAL_UART_Transmit_DMA(gUartHandle, (uint8_t*)Data, strlen(Data));
+  return HC05_Write((const uint8_t*)Data, strlen(Data));
+}
+
+/**
+ * @brief Queue bytes for transmission, called from the main loop only.
+ * The bytes are copied, so the caller may reuse its buffer. Messages queued
+ * while a transfer is in progress are sent together by the next one.
+ * 
+ * @return HAL_BUSY if the bytes don't fit, nothing is queued then
+ */
+HAL_StatusTypeDef
+HC05_Write(const uint8_t* Data, uint32_t Len)
+{ 
+  uint32_t Head = gTxHead;
+  uint32_t Ofs = Head & TX_RING_MASK;
+  uint32_t FirstLen;
+
+  if(Len > HC05_GetTxFree()) return HAL_BUSY;
+
+  FirstLen = (Len < TX_RING_SIZE - Ofs) ? Len : TX_RING_SIZE - Ofs;
+  memcpy(&gTxRing[Ofs], Data, FirstLen);
+  memcpy(gTxRing, &Data[FirstLen], Len - FirstLen);
+  gTxHead = Head + Len;
+
+  __disable_irq();
+  if(!gIsTxBusy)
+    {
+      HC05_StartTx();
+    }
+  __enable_irq();
+  return HAL_OK;
+}
+
+/**
+ * @brief Send the queued bytes up to the end of the ring in one DMA
+ * transfer, called with the UART interrupts masked.
+ */
+static void
+HC05_StartTx(void)
+{
+  uint32_t Tail = gTxTail;
+  uint32_t Ofs = Tail & TX_RING_MASK;
+  uint32_t Len = gTxHead - Tail;
+
+  if(Len == 0)
+    {
+      gIsTxBusy = false;
+      return;
+    }
+
+  if(Len > TX_RING_SIZE - Ofs) Len = TX_RING_SIZE - Ofs;
+
+  gTxLen = Len;
+  gIsTxBusy = true;
+  if(HAL_OK != HAL_UART_Transmit_DMA(gUartHandle, &gTxRing[Ofs], Len))
+    {
+      gIsTxBusy = false;
+    }
 }
 
 /******************************************************************************
@@ -193,16 +1120,87 @@ HC05_Print(const char* Data)
 void 
 Uart_IDLE_IRQHandler(UART_HandleTypeDef *huart)
 {
-  gIsReceived = true;
-  gDataLen = DATA_MAX_SIZE - huart->hdmarx->Instance->NDTR;
-  //null terminate
-  gData[gDataLen] = '\0';
+  if(huart != gUartHandle) return;
+
+  gRxCycles = Latency_Now();
+
+  // the line went idle, a command without a line ending is complete too.
+  // the main loop executes it, keep the IRQ short
+  HC05_DrainRx();
+  HC05_EndFrame();
+}
+
+/**
+ * @brief DMA Callback for an event when the first half of the ring is full
+ * 
+ * @param huart UART peripheral handle
+ */
+void
+HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart)
+{
+  if(huart != gUartHandle) return;
+  gRxCycles = Latency_Now();
+  HC05_DrainRx();
+}
+
+/**
+ * @brief DMA Callback for an event when the ring wrapped around
+ * 
+ * @param huart UART peripheral handle
+ */
+void
+HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if(huart != gUartHandle) return;
+  gRxCycles = Latency_Now();
+  HC05_DrainRx();
+}
+
+/**
+ * @brief Callback for an event when a transfer is sent, it chains the next
+ * 
+ * @param huart UART peripheral handle
+ */
+void
+HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if(huart != gUartHandle) return;
+
+  gTxTail += gTxLen;
+  gTxLen = 0;
+  HC05_StartTx();
+}
+
+/**
+ * @brief Callback for a UART or DMA error, the HAL aborts the transfers
+ * it hit
+ * 
+ * @param huart UART peripheral handle
+ */
+void
+HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  if(huart != gUartHandle) return;
+
+  if(huart->ErrorCode & HAL_UART_ERROR_ORE)
+    {
+      gRxOverruns++;
+    }
 
-  HC05_Update();
+  // an aborted transfer never completes, it's sent again from its start
+  if(gIsTxBusy && huart->gState == HAL_UART_STATE_READY)
+    {
+      gTxLen = 0;
+      gIsTxBusy = false;
+      HC05_StartTx();
+    }
 
-  // Start another DMA receive transfer
-  if(HAL_OK != HAL_UART_Receive_DMA(gUartHandle, gData, DATA_MAX_SIZE))
+  // the commands received whole are queued, the partial frame is lost,
+  // start over with an empty ring
+  if(huart->RxState == HAL_UART_STATE_READY)
     {
+      HC05_DrainRx();
+      HC05_StartReceive();
     }
 }
 /***************************** END OF FILE ***********************************/
@@ -26,6 +26,10 @@ extern "C" {
 #endif
 
 void HC05_Init(UART_HandleTypeDef* UartHandle);
+void HC05_Update(void);
+uint32_t HC05_GetTxFree(void);
+HAL_StatusTypeDef HC05_Print(const char* Data);
+HAL_StatusTypeDef HC05_Write(const uint8_t* Data, uint32_t Len);
 void Uart_IDLE_IRQHandler(UART_HandleTypeDef *huart);
 
 #ifdef __cplusplus
@@ -0,0 +1,333 @@
+/**
+ * @file hc-05_baud.c
+ * @author Mohamed Hassanin Mohamed
+ * @brief Raise the HC-05 link speed through its AT mode at startup. The
+ * KEY pin held high puts the running module in AT mode at its data rate,
+ * AT+UART changes the rate and AT+RESET applies it. The achieved rate is
+ * kept in the last flash sector, later boots check the module still
+ * answers at it. A module that doesn't answer in AT mode on a few boots in
+ * a row is recorded too, the next boots don't send it AT commands but
+ * every NO_AT_REPROBE_BOOTS boots, in case KEY was wired since.
+ * @version 0.1
+ * @date 2021-12-10
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "../../Modules/hc-05/hc-05_baud.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "main.h"
+
+/******************************************************************************
+* Definitions
+******************************************************************************/
+#define DEFAULT_BAUD 9600 // the HC-05 factory rate
+#define AT_LINE_SIZE 32
+#define AT_TIMEOUT_MS 100
+#define AT_PROBE_TRIES 2
+#define KEY_SETTLE_MS 50
+#define MODULE_BOOT_MS 1000
+#define NO_AT_FAILURES 3 // boots in a row without an answer before AT is given up
+#define NO_AT_REPROBE_BOOTS 10 // boots without AT before the module is probed again
+
+// flash sector 11, left out of the FLASH region of the linker script
+#define STORE_SECTOR FLASH_SECTOR_11
+#define STORE_ADDR 0x080E0000UL
+#define STORE_SIZE (128 * 1024)
+#define STORE_ERASED 0xFFFFFFFFUL
+// a record is one word, the tag in the top nibble, a count of boots in the
+// next one and the rate below them
+#define STORE_TAG_RATE 0xB0000000UL // the module answered at the rate
+#define STORE_TAG_NO_AT 0xC0000000UL // it didn't answer, data at the rate
+#define STORE_TAG_FAILED 0xD0000000UL // it didn't answer, negotiated again
+#define STORE_TAG_MASK 0xF0000000UL
+#define STORE_COUNT_SHIFT 24
+#define STORE_COUNT_MASK 0x0F000000UL
+#define STORE_RATE_MASK 0x00FFFFFFUL
+
+/******************************************************************************
+* Module Variable Definitions
+******************************************************************************/
+// rates tried by the negotiation, fastest first
+static const uint32_t gRates[] = {460800, 230400, 115200, DEFAULT_BAUD};
+
+// the record a full store couldn't take, saved after the erase
+static uint32_t gPendingRecord = STORE_ERASED;
+
+/******************************************************************************
+* Functions prototypes
+******************************************************************************/
+static void HC05_SetBaud(UART_HandleTypeDef* UartHandle, uint32_t Baud);
+static bool HC05_SendAt(UART_HandleTypeDef* UartHandle, const char* Cmd);
+static bool HC05_ProbeAt(UART_HandleTypeDef* UartHandle);
+static uint32_t HC05_FindBaud(UART_HandleTypeDef* UartHandle);
+static bool HC05_ChangeBaud(UART_HandleTypeDef* UartHandle, uint32_t Baud);
+static uint32_t HC05_LoadRecord(void);
+static void HC05_SaveRecord(uint32_t Record);
+static bool HC05_EraseStore(void);
+
+/******************************************************************************
+* Functions definitions
+******************************************************************************/
+
+/**
+ * @brief Bring the module and UART4 to the fastest rate both accept. It
+ * blocks, so it runs before the UART interrupts are enabled.
+ *
+ * @return the rate in use, the factory rate if the module doesn't answer
+ */
+uint32_t
+HC05_NegotiateBaud(UART_HandleTypeDef* UartHandle)
+{
+  uint32_t Record = HC05_LoadRecord();
+  uint32_t Tag = Record & STORE_TAG_MASK;
+  uint32_t Count = (Record & STORE_COUNT_MASK) >> STORE_COUNT_SHIFT;
+  uint32_t Baud = Record & STORE_RATE_MASK;
+
+  if(Tag == STORE_TAG_NO_AT && Count + 1 < NO_AT_REPROBE_BOOTS)
+    {
+      // AT commands would reach a connected phone as data
+      HC05_SaveRecord(STORE_TAG_NO_AT | ((Count + 1) << STORE_COUNT_SHIFT) | Baud);
+      HC05_SetBaud(UartHandle, Baud);
+      return Baud;
+    }
+
+  HAL_GPIO_WritePin(HC05_KEY_GPIO_Port, HC05_KEY_Pin, GPIO_PIN_SET);
+  HAL_Delay(KEY_SETTLE_MS);
+
+  if(Tag == STORE_TAG_RATE)
+    {
+      HC05_SetBaud(UartHandle, Baud);
+      if(HC05_ProbeAt(UartHandle))
+        {
+          HAL_GPIO_WritePin(HC05_KEY_GPIO_Port, HC05_KEY_Pin, GPIO_PIN_RESET);
+          return Baud;
+        }
+      // the module was reset or replaced, negotiate again, the new record
+      // replaces this one
+    }
+
+  Baud = HC05_FindBaud(UartHandle);
+  for(uint8_t i = 0; Baud != 0 && gRates[i] > Baud; i++)
+    {
+      if(HC05_ChangeBaud(UartHandle, gRates[i]))
+        {
+          Baud = gRates[i];
+          break;
+        }
+      // the module may have taken the rate or not, look for it again
+      Baud = HC05_FindBaud(UartHandle);
+    }
+
+  HAL_GPIO_WritePin(HC05_KEY_GPIO_Port, HC05_KEY_Pin, GPIO_PIN_RESET);
+
+  if(Baud == 0)
+    {
+      // no answer (KEY not wired?), stay at the factory rate. The probe is
+      // skipped on the next boots once it failed on a few in a row, a
+      // module just slow to boot once isn't given up
+      Count = (Tag == STORE_TAG_FAILED) ? Count + 1 : 1;
+      if(Tag == STORE_TAG_NO_AT || Count >= NO_AT_FAILURES)
+        {
+          Record = STORE_TAG_NO_AT;
+        }
+      else
+        {
+          Record = STORE_TAG_FAILED | (Count << STORE_COUNT_SHIFT);
+        }
+      HC05_SetBaud(UartHandle, DEFAULT_BAUD);
+      HC05_SaveRecord(Record | DEFAULT_BAUD);
+      return DEFAULT_BAUD;
+    }
+
+  HC05_SaveRecord(STORE_TAG_RATE | Baud);
+  return Baud;
+}
+
+/**
+ * @brief Erase a full store and save the record it couldn't take. The
+ * erase stalls the flash for 1 to 2 s, so it's left to the main loop while
+ * no track plays.
+ */
+void
+HC05_FlushBaudStore(void)
+{
+  uint32_t Record = gPendingRecord;
+
+  if(Record == STORE_ERASED) return;
+
+  // a failed erase isn't tried again before the next boot
+  gPendingRecord = STORE_ERASED;
+  if(HC05_EraseStore()) HC05_SaveRecord(Record);
+}
+
+static void
+HC05_SetBaud(UART_HandleTypeDef* UartHandle, uint32_t Baud)
+{
+  UartHandle->Init.BaudRate = Baud;
+  if (HAL_UART_Init(UartHandle) != HAL_OK)
+    {
+      Error_Handler();
+    }
+}
+
+/**
+ * @brief Send an AT command and wait for its OK line
+ *
+ * @return false on an error reply or a timeout
+ */
+static bool
+HC05_SendAt(UART_HandleTypeDef* UartHandle, const char* Cmd)
+{
+  char Line[AT_LINE_SIZE];
+  uint8_t Len = 0;
+  uint8_t Byte;
+
+  // drop anything left from the previous rate
+  __HAL_UART_FLUSH_DRREGISTER(UartHandle);
+  __HAL_UART_CLEAR_OREFLAG(UartHandle);
+
+  if(HAL_OK != HAL_UART_Transmit(UartHandle, (uint8_t*)Cmd, strlen(Cmd), AT_TIMEOUT_MS))
+    {
+      return false;
+    }
+
+  while(HAL_OK == HAL_UART_Receive(UartHandle, &Byte, 1, AT_TIMEOUT_MS))
+    {
+      if(Byte == '\n')
+        {
+          Line[Len] = '\0';
+          return strcmp(Line, "OK\r") == 0;
+        }
+      if(Len < AT_LINE_SIZE - 1) Line[Len++] = (char)Byte;
+    }
+  return false;
+}
+
+/**
+ * @brief Check the module answers AT at the current rate
+ */
+static bool
+HC05_ProbeAt(UART_HandleTypeDef* UartHandle)
+{
+  for(uint8_t Try = 0; Try < AT_PROBE_TRIES; Try++)
+    {
+      if(HC05_SendAt(UartHandle, "AT\r\n")) return true;
+    }
+  return false;
+}
+
+/**
+ * @brief Look for the rate the module answers at, the factory one first
+ *
+ * @return the rate, 0 if it doesn't answer at all
+ */
+static uint32_t
+HC05_FindBaud(UART_HandleTypeDef* UartHandle)
+{
+  static const uint32_t Order[] = {DEFAULT_BAUD, 115200, 230400, 460800};
+
+  for(uint8_t i = 0; i < sizeof(Order) / sizeof(Order[0]); i++)
+    {
+      HC05_SetBaud(UartHandle, Order[i]);
+      if(HC05_ProbeAt(UartHandle)) return Order[i];
+    }
+  return 0;
+}
+
+/**
+ * @brief Move the module to a new rate and check it answers there. The
+ * module restarts with KEY low to come back in data mode, not in the
+ * fixed-rate AT mode.
+ */
+static bool
+HC05_ChangeBaud(UART_HandleTypeDef* UartHandle, uint32_t Baud)
+{
+  char Cmd[AT_LINE_SIZE];
+
+  snprintf(Cmd, AT_LINE_SIZE, "AT+UART=%" PRIu32 ",0,0\r\n", Baud);
+  if(!HC05_SendAt(UartHandle, Cmd)) return false;
+  if(!HC05_SendAt(UartHandle, "AT+RESET\r\n")) return false;
+
+  HAL_GPIO_WritePin(HC05_KEY_GPIO_Port, HC05_KEY_Pin, GPIO_PIN_RESET);
+  HC05_SetBaud(UartHandle, Baud);
+  HAL_Delay(MODULE_BOOT_MS);
+  HAL_GPIO_WritePin(HC05_KEY_GPIO_Port, HC05_KEY_Pin, GPIO_PIN_SET);
+  HAL_Delay(KEY_SETTLE_MS);
+
+  return HC05_ProbeAt(UartHandle);
+}
+
+/**
+ * @brief Get the last record saved in the store
+ *
+ * @return the record, STORE_ERASED if none is saved
+ */
+static uint32_t
+HC05_LoadRecord(void)
+{
+  const uint32_t* Record = (const uint32_t*)STORE_ADDR;
+  uint32_t Last = STORE_ERASED;
+
+  for(uint32_t i = 0; i < STORE_SIZE / 4 && Record[i] != STORE_ERASED; i++)
+    {
+      if((Record[i] & STORE_TAG_MASK) == STORE_TAG_RATE ||
+         (Record[i] & STORE_TAG_MASK) == STORE_TAG_NO_AT ||
+         (Record[i] & STORE_TAG_MASK) == STORE_TAG_FAILED)
+        {
+          Last = Record[i];
+        }
+    }
+  return Last;
+}
+
+/**
+ * @brief Append a record to the store. A full store keeps it pending for
+ * HC05_FlushBaudStore.
+ */
+static void
+HC05_SaveRecord(uint32_t Record)
+{
+  const uint32_t* Store = (const uint32_t*)STORE_ADDR;
+  uint32_t i = 0;
+
+  while(i < STORE_SIZE / 4 && Store[i] != STORE_ERASED) i++;
+
+  if(i == STORE_SIZE / 4)
+    {
+      gPendingRecord = Record;
+      return;
+    }
+  HAL_FLASH_Unlock();
+  HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, STORE_ADDR + i * 4, Record);
+  HAL_FLASH_Lock();
+}
+
+/**
+ * @brief Erase the store sector, it takes 1 to 2 s
+ */
+static bool
+HC05_EraseStore(void)
+{
+  FLASH_EraseInitTypeDef Erase = {0};
+  uint32_t SectorError;
+  HAL_StatusTypeDef Status;
+
+  Erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  Erase.Sector = STORE_SECTOR;
+  Erase.NbSectors = 1;
+  Erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+  HAL_FLASH_Unlock();
+  Status = HAL_FLASHEx_Erase(&Erase, &SectorError);
+  HAL_FLASH_Lock();
+  return Status == HAL_OK;
+}
+/***************************** END OF FILE ***********************************/
@@ -0,0 +1,36 @@
+/**
+ * @file hc-05_baud.h
+ * @author Mohamed Hassanin Mohamed
+ * @brief Raise the HC-05 link speed through its AT mode at startup.
+ * @version 0.1
+ * @date 2021-12-10
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef HC05_BAUD_H
+#define HC05_BAUD_H
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <inttypes.h>
+#include "stm32f4xx_hal.h"
+
+/******************************************************************************
+* Function Prototypes
+******************************************************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t HC05_NegotiateBaud(UART_HandleTypeDef* UartHandle);
+void HC05_FlushBaudStore(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/***************************** END OF FILE ***********************************/
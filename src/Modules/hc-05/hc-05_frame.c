@@ -0,0 +1,145 @@
+/**
+ * @file hc-05_frame.c
+ * @author Mohamed Hassanin Mohamed
+ * @brief Binary framing of the bluetooth control protocol.
+ * @version 0.1
+ * @date 2021-12-10
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include "../../Modules/hc-05/hc-05_frame.h"
+
+#include <string.h>
+
+/******************************************************************************
+* Definitions
+******************************************************************************/
+#define CRC16_POLY 0x1021
+#define CRC16_INIT 0xFFFF
+
+/******************************************************************************
+* Functions definitions
+******************************************************************************/
+
+/**
+ * @brief CRC-16/CCITT-FALSE, bitwise as the frames are short
+ */
+uint16_t
+HC05Frame_Crc16(const uint8_t* Data, uint16_t Len)
+{
+  uint16_t Crc = CRC16_INIT;
+
+  for(uint16_t i = 0; i < Len; i++)
+    {
+      Crc ^= (uint16_t)Data[i] << 8;
+      for(uint8_t Bit = 0; Bit < 8; Bit++)
+        {
+          Crc = (Crc & 0x8000) ? (uint16_t)((Crc << 1) ^ CRC16_POLY) : (uint16_t)(Crc << 1);
+        }
+    }
+  return Crc;
+}
+
+/**
+ * @brief Build a frame around a payload
+ *
+ * @param Frame output, Len + HC05_FRAME_OVERHEAD bytes
+ * @return the frame size
+ */
+uint16_t
+HC05Frame_Encode(uint8_t* Frame, uint8_t Seq, const uint8_t* Payload, uint8_t Len)
+{
+  Frame[0] = HC05_FRAME_SYNC;
+  Frame[1] = Len;
+  Frame[2] = Seq;
+  memcpy(&Frame[HC05_FRAME_HEADER_SIZE], Payload, Len);
+  HC05Frame_PutU16(&Frame[HC05_FRAME_HEADER_SIZE + Len],
+                   HC05Frame_Crc16(&Frame[1], Len + 2));
+  return Len + HC05_FRAME_OVERHEAD;
+}
+
+/**
+ * @brief Check a received frame and locate its payload
+ *
+ * @return false if the size or the CRC doesn't match
+ */
+bool
+HC05Frame_Decode(const uint8_t* Frame, uint16_t Size, uint8_t* Seq,
+                 const uint8_t** Payload, uint8_t* Len)
+{
+  uint16_t Crc;
+
+  if(Size < HC05_FRAME_OVERHEAD || Frame[0] != HC05_FRAME_SYNC) return false;
+  if(Size != Frame[1] + HC05_FRAME_OVERHEAD) return false;
+
+  Crc = (uint16_t)(Frame[Size - 2] | (Frame[Size - 1] << 8));
+  if(Crc != HC05Frame_Crc16(&Frame[1], Frame[1] + 2)) return false;
+
+  *Len = Frame[1];
+  *Seq = Frame[2];
+  *Payload = &Frame[HC05_FRAME_HEADER_SIZE];
+  return true;
+}
+
+/**
+ * @brief Get the size of the arguments of a request operation
+ *
+ * @return HC05_FRAME_ARG_UNKNOWN for an unknown opcode
+ */
+uint8_t
+HC05Frame_ArgSize(uint8_t Op)
+{
+  switch(Op)
+  {
+    case HC05_OP_PLAY:
+    case HC05_OP_PAUSE:
+    case HC05_OP_STOP:
+    case HC05_OP_NEXT:
+    case HC05_OP_PREVIOUS:
+    case HC05_OP_MUTE:
+    case HC05_OP_UNMUTE:
+    case HC05_OP_STATUS:
+      return 0;
+    case HC05_OP_VOLUME:
+    case HC05_OP_DRIVE:
+      return 1;
+    case HC05_OP_TELEMETRY:
+      return 2;
+    case HC05_OP_SEEK:
+      return 4;
+    default:
+      return HC05_FRAME_ARG_UNKNOWN;
+  }
+}
+
+void
+HC05Frame_PutU16(uint8_t* Data, uint16_t Value)
+{
+  Data[0] = (uint8_t)Value;
+  Data[1] = (uint8_t)(Value >> 8);
+}
+
+void
+HC05Frame_PutU32(uint8_t* Data, uint32_t Value)
+{
+  HC05Frame_PutU16(Data, (uint16_t)Value);
+  HC05Frame_PutU16(&Data[2], (uint16_t)(Value >> 16));
+}
+
+uint16_t
+HC05Frame_GetU16(const uint8_t* Data)
+{
+  return (uint16_t)(Data[0] | (Data[1] << 8));
+}
+
+uint32_t
+HC05Frame_GetU32(const uint8_t* Data)
+{
+  return (uint32_t)Data[0] | ((uint32_t)Data[1] << 8) |
+      ((uint32_t)Data[2] << 16) | ((uint32_t)Data[3] << 24);
+}
+/***************************** END OF FILE ***********************************/
@@ -0,0 +1,99 @@
+/**
+ * @file hc-05_frame.h
+ * @author Mohamed Hassanin Mohamed
+ * @brief Binary framing of the bluetooth control protocol. It doesn't
+ * depend on the HAL, so a host tool can build it to encode the requests
+ * and decode the replies.
+ * @version 0.1
+ * @date 2021-12-10
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef HC05_FRAME_H
+#define HC05_FRAME_H
+
+/******************************************************************************
+* Includes
+******************************************************************************/
+#include <stdbool.h>
+#include <inttypes.h>
+
+/******************************************************************************
+* Definitions
+******************************************************************************/
+/*
+ * Frame layout, multi-byte fields are little endian:
+ *   SYNC | LEN | SEQ | PAYLOAD[LEN] | CRC16
+ * The CRC-16/CCITT-FALSE covers LEN, SEQ and the payload. A request payload
+ * is a batch of operations, an opcode followed by its arguments each. The
+ * reply echoes SEQ and holds an opcode, a result and the reply data for
+ * each executed operation, the batch stops at the first failure.
+ */
+#define HC05_FRAME_SYNC 0xA5 // never the first char of an ASCII command
+#define HC05_FRAME_HEADER_SIZE 3
+#define HC05_FRAME_CRC_SIZE 2
+#define HC05_FRAME_OVERHEAD (HC05_FRAME_HEADER_SIZE + HC05_FRAME_CRC_SIZE)
+#define HC05_FRAME_ARG_UNKNOWN 0xFF
+
+// STATUS reply data: state, volume, muted, drive, track (16),
+// sample rate (32), position in ms (32)
+#define HC05_FRAME_STATUS_SIZE 14
+// TELEMETRY push data: state, position in ms (32), buffer fill in bytes (16),
+// sample rate (32), underruns (32), CPU load in 0.1% (16)
+#define HC05_FRAME_TELEMETRY_SIZE 17
+
+/******************************************************************************
+* Typedefs
+******************************************************************************/
+typedef enum
+{
+  HC05_OP_PLAY = 0x01,
+  HC05_OP_PAUSE,
+  HC05_OP_STOP,
+  HC05_OP_NEXT,
+  HC05_OP_PREVIOUS,
+  HC05_OP_MUTE,
+  HC05_OP_UNMUTE,
+  HC05_OP_VOLUME, // volume (8)
+  HC05_OP_DRIVE,  // drive number (8)
+  HC05_OP_SEEK,   // time in ms (32)
+  HC05_OP_STATUS, // replies HC05_FRAME_STATUS_SIZE bytes
+  HC05_OP_TELEMETRY, // period in ms (16), 0 stops the push. The pushed
+                     // frames have a result and HC05_FRAME_TELEMETRY_SIZE
+                     // bytes like a reply, SEQ counts them
+} HC05Op_t;
+
+typedef enum
+{
+  HC05_RESULT_OK,
+  HC05_RESULT_FAILED,  // the player refused the operation
+  HC05_RESULT_BAD_OP,  // unknown opcode or truncated arguments
+} HC05Result_t;
+
+/******************************************************************************
+* Function Prototypes
+******************************************************************************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t HC05Frame_Crc16(const uint8_t* Data, uint16_t Len);
+uint16_t HC05Frame_Encode(uint8_t* Frame, uint8_t Seq,
+                          const uint8_t* Payload, uint8_t Len);
+bool HC05Frame_Decode(const uint8_t* Frame, uint16_t Size, uint8_t* Seq,
+                      const uint8_t** Payload, uint8_t* Len);
+uint8_t HC05Frame_ArgSize(uint8_t Op);
+
+void HC05Frame_PutU16(uint8_t* Data, uint16_t Value);
+void HC05Frame_PutU32(uint8_t* Data, uint32_t Value);
+uint16_t HC05Frame_GetU16(const uint8_t* Data);
+uint32_t HC05Frame_GetU32(const uint8_t* Data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/***************************** END OF FILE ***********************************/
@@ -109,14 +109,17 @@ static void USBH_UserProcess  (USBH_HandleTypeDef *phost, uint8_t id)
 
   case HOST_USER_DISCONNECTION:
     Appli_state = APPLICATION_DISCONNECT;
+    //snapshot the playback before the file objects get stale, the level
+    //meter gives the LEDs back there
+    App_Disconnect();
     HAL_GPIO_WritePin(GPIOD, GREEN_LED_Pin, GPIO_PIN_RESET);
-    //unregister any registered filesystem
-    f_mount(NULL, (TCHAR const*)"", 0);
+    //unregister the filesystems of all LUNs
+    FATFS_UnmountVolumes();
   break;
 
   case HOST_USER_CLASS_ACTIVE:
     Appli_state = APPLICATION_READY;
-    if(f_mount(&USBHFatFS, (const TCHAR*)USBHPath, 0) == FR_OK)
+    if(FATFS_MountVolumes(USBH_MSC_GetMaxLUN(phost)) > 0)
       {
 	HAL_GPIO_WritePin(GPIOD, GREEN_LED_Pin, GPIO_PIN_SET);
 	App_Init();
@@ -125,6 +128,7 @@ static void USBH_UserProcess  (USBH_HandleTypeDef *phost, uint8_t id)
 
   case HOST_USER_CONNECTION:
     Appli_state = APPLICATION_START;
+    App_Connect();
   break;
 
   default:
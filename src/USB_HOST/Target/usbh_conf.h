@@ -83,6 +83,9 @@
 /*----------   -----------*/
 #define USBH_MAX_DATA_BUFFER      512U
 
+/*----------   -----------*/
+#define MAX_SUPPORTED_LUN      4U
+
 /*----------   -----------*/
 #define USBH_DEBUG_LEVEL      0U
 
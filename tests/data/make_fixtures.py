@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Make the decoder fixtures of the host tests: files encoded by
+libsndfile (libFLAC for FLAC) and their reference decodes, little endian
+stereo, 16-bit or 32-bit for the 24-bit files. long_rice.flac is written
+here, for the Rice codes longer than the input buffer that no encoder
+makes, and checked by decoding it with libFLAC.
+
+    python3 make_fixtures.py    (needs numpy and soundfile)
+"""
+
+import numpy as np
+import soundfile as sf
+
+
+def signal(rate, seconds, channels, seed):
+    """A sweep with a loud noise burst and a quiet tail, so the coders
+    go through their whole range."""
+    rng = np.random.default_rng(seed)
+    n = int(rate * seconds)
+    t = np.arange(n) / rate
+    sweep = np.sin(2 * np.pi * (50 * t + (rate / 4 - 50) * t * t / (2 * seconds)))
+    x = 0.5 * sweep
+    burst = slice(n // 3, n // 3 + n // 8)
+    x[burst] = np.clip(rng.normal(0, 0.6, n // 8), -1, 1)
+    x[2 * n // 3:] *= 0.01
+    if channels == 1:
+        return x[:, None]
+    return np.stack([x, -0.7 * np.roll(x, 37)], axis=1)
+
+
+def reference(name, path, subtype):
+    """The decode of libsndfile, 24-bit samples in 32 bits."""
+    if subtype == "PCM_24":
+        ref, _ = sf.read(path, dtype="int32", always_2d=True)
+        ref = (ref >> 8).astype("<i4")
+    else:
+        ref, _ = sf.read(path, dtype="int16", always_2d=True)
+        ref = ref.astype("<i2")
+    if ref.shape[1] == 1:
+        ref = np.repeat(ref, 2, axis=1)
+    ref.tofile(f"{name}.raw")
+    return ref
+
+
+def fixture(name, rate, channels, subtype, seed, format="WAV", seconds=0.4):
+    path = f"{name}.{format.lower()}"
+    sf.write(path, signal(rate, seconds, channels, seed), rate,
+             subtype=subtype, format=format)
+    reference(name, path, subtype)
+
+
+class Bits:
+    """An MSB first bit writer."""
+
+    def __init__(self):
+        self.bits = []
+
+    def put(self, value, n):
+        self.bits += [(value >> (n - 1 - i)) & 1 for i in range(n)]
+
+    def rice(self, value, param):
+        u = (value << 1) ^ (value >> 63)  # zigzag
+        self.bits += [0] * (u >> param) + [1]
+        self.put(u & ((1 << param) - 1), param)
+
+    def data(self):
+        self.bits += [0] * (-len(self.bits) % 8)
+        return np.packbits(self.bits).tobytes()
+
+
+def crc(data, bits, poly):
+    value = 0
+    top = 1 << (bits - 1)
+    for byte in data:
+        value ^= byte << (bits - 8)
+        for _ in range(8):
+            value = ((value << 1) ^ poly) if value & top else value << 1
+        value &= (1 << bits) - 1
+    return value
+
+
+def long_rice(name, rate, seconds, seed):
+    """16-bit mono FLAC of quiet noise with spikes, in FIXED order 0
+    subframes of Rice parameter 0: the spike of 30000 is a unary run of
+    7.5 KB, the others a few in a chunk. A SEEKTABLE has a point every
+    other frame."""
+    rng = np.random.default_rng(seed)
+    block = 4096
+    n = int(rate * seconds)
+    x = rng.integers(-3, 4, n)
+    for at in rng.choice(n - 24, 6, replace=False):
+        x[at:at + 24:8] = rng.choice([-1, 1], 3) * rng.integers(500, 4000, 3)
+    x[n // 2] = 30000
+
+    frames = []
+    for first in range(0, n, block):
+        samples = x[first:first + block]
+        b = Bits()
+        b.put(0xFFF8, 16)
+        b.put(12 if len(samples) == block else 7, 4)  # 4096 or 16 bits
+        b.put(9 if rate == 44100 else 0, 4)
+        b.put(0x08, 8)  # mono, 16 bits
+        number = first // block
+        assert number < 128
+        b.put(number, 8)
+        if len(samples) != block:
+            b.put(len(samples) - 1, 16)
+        head = b.data()
+        b.put(crc(head, 8, 0x07), 8)
+        b.put(0x10, 8)  # FIXED order 0
+        b.put(0, 2)  # 4-bit parameters
+        b.put(0, 4)  # one partition
+        b.put(0, 4)
+        for v in samples:
+            b.rice(int(v), 0)
+        frame = b.data()
+        frames.append(frame + crc(frame, 16, 0x8005).to_bytes(2, "big"))
+
+    info = Bits()
+    info.put(block, 16)
+    info.put(block, 16)
+    info.put(min(map(len, frames)), 24)
+    info.put(max(map(len, frames)), 24)
+    info.put(rate, 20)
+    info.put(0, 3)
+    info.put(15, 5)
+    info.put(n, 36)
+    info.put(0, 128)
+    points = b""
+    ofs = 0
+    for i, frame in enumerate(frames):
+        if i % 2 == 0:
+            points += (i * block).to_bytes(8, "big") + ofs.to_bytes(8, "big")
+            points += block.to_bytes(2, "big")
+        ofs += len(frame)
+    head = b"fLaC" + bytes([0, 0, 0, 34]) + info.data()
+    head += bytes([0x83]) + len(points).to_bytes(3, "big") + points
+    with open(f"{name}.flac", "wb") as file:
+        file.write(head + b"".join(frames))
+
+    ref = reference(name, f"{name}.flac", "PCM_16")
+    assert np.array_equal(ref[:, 0], x)
+
+
+fixture("ima_mono", 8000, 1, "IMA_ADPCM", 1)
+fixture("ima_stereo", 22050, 2, "IMA_ADPCM", 2)
+fixture("alaw_mono", 8000, 1, "ALAW", 3)
+fixture("alaw_stereo", 16000, 2, "ALAW", 4)
+fixture("ulaw_mono", 8000, 1, "ULAW", 5)
+fixture("ulaw_stereo", 16000, 2, "ULAW", 6)
+fixture("flac16_stereo", 22050, 2, "PCM_16", 7, "FLAC", 1.0)
+fixture("flac16_mono", 8000, 1, "PCM_16", 8, "FLAC", 1.0)
+fixture("flac24_stereo", 16000, 2, "PCM_24", 9, "FLAC", 0.8)
+long_rice("long_rice", 44100, 0.5, 10)
@@ -0,0 +1,20 @@
+/**
+ * @file audio_stub.h
+ * @brief Host stand-ins of the codec and I2S drivers for the player tests.
+ */
+
+#ifndef AUDIO_STUB_H_
+#define AUDIO_STUB_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_LOG_SIZE 1024
+
+extern char gAudioLog[AUDIO_LOG_SIZE];
+extern bool gIsMclkOn;
+extern uint32_t gCodecWritesWithoutMclk;
+
+void Audio_ClearLog(void);
+
+#endif
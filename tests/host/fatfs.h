@@ -0,0 +1,18 @@
+/**
+ * @file fatfs.h
+ * @brief Host stand-in for the FatFs glue of the USB host, the volumes are
+ * RAM disks mounted by the tests.
+ */
+
+#ifndef HOST_FATFS_H_
+#define HOST_FATFS_H_
+
+#include "ff.h"
+
+uint8_t FATFS_MountVolumes(uint8_t LunsNum);
+void FATFS_UnmountVolumes(void);
+uint8_t FATFS_GetVolumesNum(void);
+const TCHAR* FATFS_GetVolumePath(uint8_t Vol);
+FATFS* FATFS_GetVolume(uint8_t Vol);
+
+#endif
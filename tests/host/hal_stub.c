@@ -0,0 +1,148 @@
+/**
+ * @file hal_stub.c
+ * @brief Host implementation of the HAL functions the application calls.
+ * The tick only moves with HAL_Delay and Host_AdvanceTick, so timeouts are
+ * deterministic. The peripheral functions are weak, a test replaces the
+ * ones it drives.
+ */
+
+#include "stm32f4xx_hal.h"
+#include "host.h"
+
+#include <time.h>
+
+int gTestFailures = 0; // counted by CHECK
+uint32_t SystemCoreClock = 42000000;
+uint32_t gHostPrimask = 0;
+uint32_t gHostGe = 0;
+uint32_t gHostWfiCount = 0;
+uint32_t gHostTick = 0;
+GPIO_TypeDef gHostGpioD;
+CoreDebug_Type gHostCoreDebug;
+static DWT_Type gHostDwt;
+
+DWT_Type*
+Host_Dwt(void)
+{
+  struct timespec Now;
+
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  gHostDwt.CYCCNT = (uint32_t)((uint64_t)Now.tv_sec * 1000000000ULL + (uint64_t)Now.tv_nsec);
+  return &gHostDwt;
+}
+
+uint64_t
+Host_Ns(void)
+{
+  struct timespec Now;
+
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ULL + (uint64_t)Now.tv_nsec;
+}
+
+__attribute__((weak)) void
+Host_Wfi(void)
+{
+  gHostWfiCount++;
+}
+
+void
+Host_AdvanceTick(uint32_t Ms)
+{
+  gHostTick += Ms;
+}
+
+__attribute__((weak)) uint32_t
+HAL_GetTick(void)
+{
+  return gHostTick;
+}
+
+__attribute__((weak)) void
+HAL_Delay(uint32_t Delay)
+{
+  gHostTick += Delay;
+}
+
+__attribute__((weak)) void
+HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if(PinState == GPIO_PIN_SET) GPIOx->Pins |= GPIO_Pin;
+  else GPIOx->Pins &= ~(uint32_t)GPIO_Pin;
+}
+
+__attribute__((weak)) GPIO_PinState
+HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+  return (GPIOx->Pins & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_UART_Init(UART_HandleTypeDef* huart)
+{
+  (void)huart;
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+  (void)huart; (void)pData; (void)Size; (void)Timeout;
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_UART_Receive(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+  (void)huart; (void)pData; (void)Size;
+  gHostTick += Timeout;
+  return HAL_TIMEOUT;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+  (void)huart; (void)pData; (void)Size;
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_UART_Receive_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+  (void)huart; (void)pData; (void)Size;
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint8_t* pData, uint16_t Size)
+{
+  (void)hi2c; (void)DevAddress; (void)pData; (void)Size;
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_FLASH_Unlock(void)
+{
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_FLASH_Lock(void)
+{
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* SectorError)
+{
+  (void)pEraseInit;
+  *SectorError = 0xFFFFFFFFU;
+  return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef
+HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+  (void)TypeProgram; (void)Address; (void)Data;
+  return HAL_OK;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+/**
+ * @file host.h
+ * @brief Helpers of the host tests: the checks, the fake tick and timing.
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+extern int gTestFailures;
+extern uint32_t gHostTick;
+
+#define CHECK(_COND_) \
+  do { \
+    if(!(_COND_)) \
+      { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #_COND_); \
+        gTestFailures++; \
+      } \
+  } while(0)
+
+#define CHECK_EQ(_A_, _B_) \
+  do { \
+    long long _a = (long long)(_A_), _b = (long long)(_B_); \
+    if(_a != _b) \
+      { \
+        printf("%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, __LINE__, \
+               #_A_, #_B_, _a, _b); \
+        gTestFailures++; \
+      } \
+  } while(0)
+
+// the exit status of a test program
+#define TEST_RESULT() \
+  (printf("%s: %s\n", __FILE__, gTestFailures ? "FAILED" : "passed"), gTestFailures != 0)
+
+// a test run as "test_x bench" runs its benchmark instead
+static inline bool
+Host_IsBench(int argc, char** argv)
+{
+  return argc > 1 && strcmp(argv[1], "bench") == 0;
+}
+
+void Host_AdvanceTick(uint32_t Ms);
+uint64_t Host_Ns(void);
+
+#endif
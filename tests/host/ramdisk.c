@@ -0,0 +1,170 @@
+/**
+ * @file ramdisk.c
+ * @brief RAM disks behind the FatFs disk functions and the volume glue of
+ * fatfs.c, a drive per LUN.
+ */
+
+#include "ramdisk.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "diskio.h"
+#include "fatfs.h"
+
+#define RAMDISK_SECTOR 512
+
+typedef struct {
+  uint8_t* Image;
+  uint32_t Sectors;
+  uint32_t GoodReads; // reads left to pass before the failures
+  uint32_t FailReads; // reads left to fail
+  uint32_t Reads;
+} RamDisk_t;
+
+static RamDisk_t gDisks[_VOLUMES];
+static FATFS gFs[_VOLUMES];
+static const TCHAR* const gPaths[_VOLUMES] = {"0:/", "1:/", "2:/", "3:/"};
+static uint8_t gVolumesNum = 0;
+
+bool
+RamDisk_Create(uint8_t Drv, uint32_t Sectors, uint8_t Format, uint32_t ClusterBytes)
+{
+  static uint8_t Work[_MAX_SS * 8];
+
+  RamDisk_Destroy(Drv);
+  gDisks[Drv].Image = calloc(Sectors, RAMDISK_SECTOR);
+  if(gDisks[Drv].Image == NULL) return false;
+  gDisks[Drv].Sectors = Sectors;
+  if(f_mkfs(gPaths[Drv], Format, ClusterBytes, Work, sizeof(Work)) != FR_OK) return false;
+  if(Drv >= gVolumesNum) gVolumesNum = Drv + 1;
+  return f_mount(&gFs[Drv], gPaths[Drv], 1) == FR_OK;
+}
+
+void
+RamDisk_Destroy(uint8_t Drv)
+{
+  f_mount(NULL, gPaths[Drv], 0);
+  free(gDisks[Drv].Image);
+  memset(&gDisks[Drv], 0, sizeof(gDisks[Drv]));
+}
+
+void
+RamDisk_FailReads(uint8_t Drv, uint32_t Count)
+{
+  RamDisk_FailReadsAfter(Drv, 0, Count);
+}
+
+// a fault in the middle of a transfer: After reads pass, Count fail
+void
+RamDisk_FailReadsAfter(uint8_t Drv, uint32_t After, uint32_t Count)
+{
+  gDisks[Drv].GoodReads = After;
+  gDisks[Drv].FailReads = Count;
+}
+
+uint32_t
+RamDisk_GetReads(uint8_t Drv)
+{
+  return gDisks[Drv].Reads;
+}
+
+DSTATUS
+disk_status(BYTE pdrv)
+{
+  return (pdrv < _VOLUMES && gDisks[pdrv].Image) ? 0 : STA_NOINIT;
+}
+
+DSTATUS
+disk_initialize(BYTE pdrv)
+{
+  return disk_status(pdrv);
+}
+
+DRESULT
+disk_read(BYTE pdrv, BYTE* buff, DWORD sector, UINT count)
+{
+  RamDisk_t* Disk = &gDisks[pdrv];
+
+  if(disk_status(pdrv)) return RES_NOTRDY;
+  if(sector + count > Disk->Sectors) return RES_PARERR;
+  Disk->Reads++;
+  if(Disk->GoodReads) Disk->GoodReads--;
+  else if(Disk->FailReads)
+    {
+      Disk->FailReads--;
+      return RES_ERROR;
+    }
+  memcpy(buff, &Disk->Image[sector * RAMDISK_SECTOR], count * RAMDISK_SECTOR);
+  return RES_OK;
+}
+
+DRESULT
+disk_write(BYTE pdrv, const BYTE* buff, DWORD sector, UINT count)
+{
+  RamDisk_t* Disk = &gDisks[pdrv];
+
+  if(disk_status(pdrv)) return RES_NOTRDY;
+  if(sector + count > Disk->Sectors) return RES_PARERR;
+  memcpy(&Disk->Image[sector * RAMDISK_SECTOR], buff, count * RAMDISK_SECTOR);
+  return RES_OK;
+}
+
+DRESULT
+disk_ioctl(BYTE pdrv, BYTE cmd, void* buff)
+{
+  if(disk_status(pdrv)) return RES_NOTRDY;
+  switch(cmd)
+    {
+    case CTRL_SYNC:
+      return RES_OK;
+    case GET_SECTOR_COUNT:
+      *(DWORD*)buff = gDisks[pdrv].Sectors;
+      return RES_OK;
+    case GET_SECTOR_SIZE:
+      *(WORD*)buff = RAMDISK_SECTOR;
+      return RES_OK;
+    case GET_BLOCK_SIZE:
+      *(DWORD*)buff = 1;
+      return RES_OK;
+    default:
+      return RES_PARERR;
+    }
+}
+
+DWORD
+get_fattime(void)
+{
+  return ((DWORD)(2021 - 1980) << 25) | ((DWORD)12 << 21) | ((DWORD)11 << 16);
+}
+
+uint8_t
+FATFS_MountVolumes(uint8_t LunsNum)
+{
+  gVolumesNum = LunsNum;
+  return gVolumesNum;
+}
+
+void
+FATFS_UnmountVolumes(void)
+{
+  gVolumesNum = 0;
+}
+
+uint8_t
+FATFS_GetVolumesNum(void)
+{
+  return gVolumesNum;
+}
+
+const TCHAR*
+FATFS_GetVolumePath(uint8_t Vol)
+{
+  return gPaths[Vol];
+}
+
+FATFS*
+FATFS_GetVolume(uint8_t Vol)
+{
+  return &gFs[Vol];
+}
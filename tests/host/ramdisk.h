@@ -0,0 +1,21 @@
+/**
+ * @file ramdisk.h
+ * @brief RAM disks behind the FatFs disk functions, a volume per drive,
+ * formatted by the tests as the USB drive would be.
+ */
+
+#ifndef RAMDISK_H_
+#define RAMDISK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ff.h"
+
+bool RamDisk_Create(uint8_t Drv, uint32_t Sectors, uint8_t Format, uint32_t ClusterBytes);
+void RamDisk_Destroy(uint8_t Drv);
+void RamDisk_FailReads(uint8_t Drv, uint32_t Count);
+void RamDisk_FailReadsAfter(uint8_t Drv, uint32_t After, uint32_t Count);
+uint32_t RamDisk_GetReads(uint8_t Drv);
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ * @file stm32f4xx_hal.h
+ * @brief Host stand-in for the HAL and the CMSIS intrinsics the application
+ * uses, so the modules build and run on the PC. The DSP intrinsics are
+ * written after their ARM definitions, the GE flags of SSUB16 included.
+ * The peripheral functions are implemented by hal_stub.c.
+ */
+
+#ifndef HOST_STM32F4XX_HAL_H_
+#define HOST_STM32F4XX_HAL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+//compiler
+#define __IO volatile
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __STATIC_INLINE static inline
+#define __UNALIGNED_UINT32_WRITE(addr, val) \
+  do { uint32_t __v = (val); memcpy((void*)(addr), &__v, 4); } while(0)
+#define __UNALIGNED_UINT32_READ(addr) \
+  ({ uint32_t __v; memcpy(&__v, (const void*)(addr), 4); __v; })
+
+//---------------------------------------------------------------------------//
+//core
+extern uint32_t gHostPrimask;
+extern uint32_t gHostGe;
+extern uint32_t gHostWfiCount;
+void Host_Wfi(void);
+
+static inline void __disable_irq(void) { gHostPrimask = 1; }
+static inline void __enable_irq(void) { gHostPrimask = 0; }
+static inline uint32_t __get_PRIMASK(void) { return gHostPrimask; }
+static inline void __set_PRIMASK(uint32_t Primask) { gHostPrimask = Primask; }
+#define __DMB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __DSB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __ISB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __WFI() Host_Wfi()
+
+// the cycle counter counts host nanoseconds
+typedef struct {
+  uint32_t CTRL;
+  uint32_t CYCCNT;
+} DWT_Type;
+typedef struct {
+  uint32_t DEMCR;
+} CoreDebug_Type;
+DWT_Type* Host_Dwt(void);
+extern CoreDebug_Type gHostCoreDebug;
+#define DWT (Host_Dwt())
+#define CoreDebug (&gHostCoreDebug)
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+//---------------------------------------------------------------------------//
+//DSP intrinsics
+#define __SSAT(ARG1, ARG2) Host_Ssat((int32_t)(ARG1), (ARG2))
+#define __USAT(ARG1, ARG2) Host_Usat((int32_t)(ARG1), (ARG2))
+#define __PKHBT(ARG1, ARG2, ARG3) \
+  ((((uint32_t)(ARG1)) & 0x0000FFFFUL) | ((((uint32_t)(ARG2)) << (ARG3)) & 0xFFFF0000UL))
+#define __PKHTB(ARG1, ARG2, ARG3) \
+  ((((uint32_t)(ARG1)) & 0xFFFF0000UL) | ((((uint32_t)(ARG2)) >> (ARG3)) & 0x0000FFFFUL))
+
+static inline int32_t
+Host_Ssat(int32_t Val, uint32_t Sat)
+{
+  const int32_t Max = (int32_t)((1U << (Sat - 1)) - 1);
+  const int32_t Min = -Max - 1;
+  return (Val > Max) ? Max : (Val < Min) ? Min : Val;
+}
+
+static inline uint32_t
+Host_Usat(int32_t Val, uint32_t Sat)
+{
+  const int32_t Max = (int32_t)((1U << Sat) - 1);
+  return (uint32_t)((Val > Max) ? Max : (Val < 0) ? 0 : Val);
+}
+
+static inline int32_t Host_Lo(uint32_t x) { return (int16_t)(x & 0xFFFF); }
+static inline int32_t Host_Hi(uint32_t x) { return (int16_t)(x >> 16); }
+static inline uint32_t
+Host_Pack(int32_t Lo, int32_t Hi)
+{
+  return ((uint32_t)Lo & 0xFFFF) | ((uint32_t)Hi << 16);
+}
+
+static inline uint32_t
+__CLZ(uint32_t x)
+{
+  return x ? (uint32_t)__builtin_clz(x) : 32;
+}
+
+static inline uint32_t
+__REV(uint32_t x)
+{
+  return __builtin_bswap32(x);
+}
+
+static inline uint32_t
+__SSUB16(uint32_t a, uint32_t b)
+{
+  int32_t Lo = Host_Lo(a) - Host_Lo(b);
+  int32_t Hi = Host_Hi(a) - Host_Hi(b);
+  gHostGe = (Lo >= 0 ? 0x3 : 0) | (Hi >= 0 ? 0xC : 0);
+  return Host_Pack(Lo, Hi);
+}
+
+static inline uint32_t
+__SHSUB16(uint32_t a, uint32_t b)
+{
+  return Host_Pack((Host_Lo(a) - Host_Lo(b)) >> 1, (Host_Hi(a) - Host_Hi(b)) >> 1);
+}
+
+static inline uint32_t
+__SEL(uint32_t a, uint32_t b)
+{
+  uint32_t Mask = ((gHostGe & 0x1) ? 0x0000FFFFUL : 0) | ((gHostGe & 0x4) ? 0xFFFF0000UL : 0);
+  return (a & Mask) | (b & ~Mask);
+}
+
+static inline uint32_t
+__SMUAD(uint32_t a, uint32_t b)
+{
+  return (uint32_t)(Host_Lo(a) * Host_Lo(b) + Host_Hi(a) * Host_Hi(b));
+}
+
+static inline uint32_t
+__SMLAD(uint32_t a, uint32_t b, uint32_t Acc)
+{
+  return (uint32_t)(Host_Lo(a) * Host_Lo(b) + Host_Hi(a) * Host_Hi(b) + (int32_t)Acc);
+}
+
+static inline uint64_t
+__SMLALD(uint32_t a, uint32_t b, uint64_t Acc)
+{
+  return (uint64_t)((int64_t)Acc + (int64_t)Host_Lo(a) * Host_Lo(b) +
+                    (int64_t)Host_Hi(a) * Host_Hi(b));
+}
+
+//---------------------------------------------------------------------------//
+//HAL
+extern uint32_t SystemCoreClock;
+typedef enum {
+  HAL_OK = 0x00U,
+  HAL_ERROR = 0x01U,
+  HAL_BUSY = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum {
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+  uint32_t Pins; // the levels written, a bit per pin
+} GPIO_TypeDef;
+extern GPIO_TypeDef gHostGpioD;
+#define GPIOD (&gHostGpioD)
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+typedef struct {
+  uint32_t Counter; // NDTR, items left to transfer
+} DMA_HandleTypeDef;
+#define __HAL_DMA_GET_COUNTER(__HANDLE__) ((__HANDLE__)->Counter)
+
+typedef enum {
+  HAL_UART_STATE_RESET = 0x00U,
+  HAL_UART_STATE_READY = 0x20U,
+  HAL_UART_STATE_BUSY_TX = 0x21U,
+  HAL_UART_STATE_BUSY_RX = 0x22U,
+} HAL_UART_StateTypeDef;
+#define HAL_UART_ERROR_NONE 0x00000000U
+#define HAL_UART_ERROR_ORE 0x00000008U
+#define HAL_UART_ERROR_DMA 0x00000010U
+
+typedef struct {
+  uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct {
+  void* Instance;
+  UART_InitTypeDef Init;
+  DMA_HandleTypeDef* hdmatx;
+  DMA_HandleTypeDef* hdmarx;
+  HAL_UART_StateTypeDef gState;
+  HAL_UART_StateTypeDef RxState;
+  uint32_t ErrorCode;
+} UART_HandleTypeDef;
+#define __HAL_UART_FLUSH_DRREGISTER(__HANDLE__) ((void)(__HANDLE__))
+#define __HAL_UART_CLEAR_OREFLAG(__HANDLE__) ((void)(__HANDLE__))
+
+typedef struct {
+  void* Instance;
+} I2C_HandleTypeDef;
+
+typedef struct {
+  uint32_t Mode;
+  uint32_t Standard;
+  uint32_t DataFormat;
+  uint32_t MCLKOutput;
+  uint32_t AudioFreq;
+  uint32_t CPOL;
+  uint32_t ClockSource;
+} I2S_InitTypeDef;
+
+typedef struct {
+  void* Instance;
+  I2S_InitTypeDef Init;
+  DMA_HandleTypeDef* hdmatx;
+} I2S_HandleTypeDef;
+
+#define FLASH_TYPEERASE_SECTORS 0x00000000U
+#define FLASH_VOLTAGE_RANGE_3 0x00000002U
+#define FLASH_TYPEPROGRAM_WORD 0x00000002U
+#define FLASH_SECTOR_11 11U
+typedef struct {
+  uint32_t TypeErase;
+  uint32_t Banks;
+  uint32_t Sector;
+  uint32_t NbSectors;
+  uint32_t VoltageRange;
+} FLASH_EraseInitTypeDef;
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef* huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* SectorError);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+
+#endif
@@ -0,0 +1,310 @@
+/**
+ * @file test_cs43l22.c
+ * @brief Host tests of the codec register shadow and of the I2C queue,
+ * over a simulated bus: a write stays on it until the test completes it
+ * as the I2C interrupt would, and lands in a model of the codec registers.
+ */
+
+#include "../src/Modules/I2cQueue/I2cQueue.c"
+#include "../src/Modules/CS43L22/CS43L22.c"
+
+#include "host.h"
+
+#define RESET_PIN GPIO_PIN_4
+
+//---------------------------------------------------------------------------//
+//helpers
+typedef struct {
+  uint8_t Regs[CS43L22_REG_NUM]; // the codec's
+  bool IsTransferring;
+  uint8_t Data[I2C_QUEUE_DATA_MAX];
+  uint8_t Len;
+  HAL_StatusTypeDef Status; // returned by the next transfer start
+  bool IsNack; // the next transfer fails on the bus
+  uint32_t Transfers;
+  uint32_t StartsMasked; // transfers started with the interrupts off
+  uint32_t WritesInReset;
+} Bus_t;
+
+static Bus_t gBus;
+static I2C_HandleTypeDef gI2c;
+static I2C_HandleTypeDef gOtherI2c;
+I2S_HandleTypeDef hi2s3;
+static uint32_t gCallOrder[4];
+static uint32_t gCallsNum = 0;
+
+// the reset pin puts the model back to the power-on values
+void
+HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if(PinState == GPIO_PIN_SET) GPIOx->Pins |= GPIO_Pin;
+  else GPIOx->Pins &= ~(uint32_t)GPIO_Pin;
+  if(GPIOx == GPIOD && GPIO_Pin == RESET_PIN && PinState == GPIO_PIN_RESET)
+    {
+      memcpy(gBus.Regs, gRegDefaults, CS43L22_REG_NUM);
+    }
+}
+
+HAL_StatusTypeDef
+HAL_I2C_Master_Transmit_IT(I2C_HandleTypeDef* hi2c, uint16_t DevAddress, uint8_t* pData, uint16_t Size)
+{
+  HAL_StatusTypeDef Status = gBus.Status;
+
+  CHECK(hi2c == &gI2c);
+  CHECK_EQ(DevAddress, CS43L22_I2C_ADDR);
+  CHECK(!gBus.IsTransferring);
+  if(gHostPrimask) gBus.StartsMasked++;
+
+  gBus.Status = HAL_OK;
+  if(Status != HAL_OK) return Status;
+
+  gBus.IsTransferring = true;
+  gBus.Len = (uint8_t)Size;
+  memcpy(gBus.Data, pData, Size);
+  return HAL_OK;
+}
+
+// the interrupt at the end of the transfer on the bus
+static bool
+Bus_Step(void)
+{
+  uint8_t Map;
+
+  if(!gBus.IsTransferring) return false;
+  gBus.IsTransferring = false;
+  gBus.Transfers++;
+
+  if(gBus.IsNack)
+    {
+      gBus.IsNack = false;
+      HAL_I2C_ErrorCallback(&gI2c);
+      return true;
+    }
+
+  if(!(gHostGpioD.Pins & RESET_PIN)) gBus.WritesInReset++;
+  Map = gBus.Data[0];
+  for(uint8_t i = 1; i < gBus.Len; i++)
+    {
+      uint8_t Reg = (Map & CS43L22_MAP_INCR) ? (Map & ~CS43L22_MAP_INCR) + i - 1 : Map;
+
+      CHECK(CS43L22_IsWritable(Reg));
+      gBus.Regs[Reg] = gBus.Data[i];
+    }
+  HAL_I2C_MasterTxCpltCallback(&gI2c);
+  return true;
+}
+
+static uint32_t
+Bus_Run(void)
+{
+  uint32_t Transfers = gBus.Transfers;
+
+  while(Bus_Step());
+  CHECK(I2cQueue_IsDone(gHead));
+  return gBus.Transfers - Transfers;
+}
+
+// the model holds what the shadow says
+static bool
+Bus_MatchesShadow(void)
+{
+  for(uint8_t Reg = 0; Reg < CS43L22_REG_NUM; Reg++)
+    {
+      if(CS43L22_IsWritable(Reg) && gBus.Regs[Reg] != gRegs[Reg]) return false;
+    }
+  return true;
+}
+
+static void
+Call0(void)
+{
+  gCallOrder[gCallsNum++] = 0;
+}
+
+static void
+Call1(void)
+{
+  gCallOrder[gCallsNum++] = 1;
+}
+
+static void
+Init(uint8_t Vol, bool IsMuted)
+{
+  CS43L22Config_t Config = {.Muted = IsMuted, .Vol = Vol, .i2ch = &gI2c};
+
+  CS43L22_Init(&Config);
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// out of reset, the configuration takes 5 transactions: the power down, the
+// outputs, the clocking to the MISC_CTL burst, the volume and the power up
+static void
+TestInitFromReset(void)
+{
+  uint32_t Transactions = CS43L22_GetI2cTransactions();
+  CS43L22Wake_t Wake;
+
+  Init(200, false);
+  CHECK_EQ(CS43L22_GetI2cTransactions() - Transactions, 5);
+  CHECK_EQ(CS43L22_GetPowerState(), CS43L22_POWER_ON);
+  CS43L22_GetLastWake(&Wake);
+  CHECK_EQ(Wake.From, CS43L22_POWER_OFF);
+  CHECK_EQ(Wake.Writes, 5);
+  CHECK_EQ(Wake.Us, 0);
+
+  CHECK_EQ(Bus_Run(), 5);
+  CHECK(gHostGpioD.Pins & RESET_PIN);
+  CHECK_EQ(gBus.WritesInReset, 0);
+  CHECK(Bus_MatchesShadow());
+  CHECK_EQ(gBus.Regs[CS43L22_POWER_CTL1_R], CS43L22_POWER_CTL1_POWERED_UP_Val);
+  CHECK_EQ(gBus.Regs[CS43L22_MASTER_A_VOL_R], REARRANGE_VOL(200));
+  CHECK_EQ(gBus.Regs[CS43L22_MASTER_B_VOL_R], REARRANGE_VOL(200));
+  CS43L22_GetLastWake(&Wake);
+  CHECK(Wake.Us > 0);
+}
+
+// the shadow skips the registers that keep their value
+static void
+TestShadowSkipsCleanRegs(void)
+{
+  uint32_t Transactions = CS43L22_GetI2cTransactions();
+
+  CS43L22_SetVolume(200);
+  CS43L22_Unmute();
+  CHECK_EQ(CS43L22_GetI2cTransactions(), Transactions);
+
+  // both volumes in one burst
+  CS43L22_SetVolume(100);
+  CHECK_EQ(CS43L22_GetI2cTransactions() - Transactions, 1);
+  CHECK_EQ(Bus_Run(), 1);
+  CHECK(Bus_MatchesShadow());
+  CHECK_EQ(gBus.Regs[CS43L22_MASTER_B_VOL_R], REARRANGE_VOL(100));
+}
+
+// the pauses and the resumes take the power and mute registers only
+static void
+TestPauseResume(void)
+{
+  uint32_t Transactions = CS43L22_GetI2cTransactions();
+  CS43L22Wake_t Wake;
+
+  CS43L22_HotPause();
+  CHECK_EQ(CS43L22_GetPowerState(), CS43L22_POWER_HOT_PAUSE);
+  CHECK_EQ(Bus_Run(), 1);
+  CHECK(Bus_MatchesShadow());
+  CS43L22_Start();
+  CHECK_EQ(Bus_Run(), 1);
+  CS43L22_GetLastWake(&Wake);
+  CHECK_EQ(Wake.From, CS43L22_POWER_HOT_PAUSE);
+  CHECK_EQ(Wake.Writes, 1);
+
+  CS43L22_Standby();
+  CHECK_EQ(CS43L22_GetPowerState(), CS43L22_POWER_STANDBY);
+  CHECK_EQ(gBus.Regs[CS43L22_POWER_CTL1_R], CS43L22_POWER_CTL1_POWERED_UP_Val);
+  CHECK_EQ(Bus_Run(), 2);
+  CHECK_EQ(gBus.Regs[CS43L22_POWER_CTL1_R], CS43L22_POWER_CTL1_POWERED_DOWN_Val);
+  CHECK(Bus_MatchesShadow());
+  CS43L22_Start();
+  CHECK_EQ(Bus_Run(), 2);
+  CS43L22_GetLastWake(&Wake);
+  CHECK_EQ(Wake.From, CS43L22_POWER_STANDBY);
+  CHECK_EQ(Wake.Writes, 2);
+  CHECK(Bus_MatchesShadow());
+  CHECK_EQ(CS43L22_GetI2cTransactions() - Transactions, 6);
+}
+
+// the reset pin goes low after the power down is on the bus, the next
+// init writes the whole configuration again
+static void
+TestStopAndInit(void)
+{
+  CS43L22_Stop();
+  CHECK(gHostGpioD.Pins & RESET_PIN);
+  CHECK_EQ(Bus_Run(), 2);
+  CHECK(!(gHostGpioD.Pins & RESET_PIN));
+  CHECK_EQ(gBus.Regs[CS43L22_POWER_CTL1_R], gRegDefaults[CS43L22_POWER_CTL1_R]);
+
+  // nothing reaches a codec in reset
+  CS43L22_SetVolume(10);
+  CHECK_EQ(Bus_Run(), 0);
+
+  Init(10, true);
+  CHECK_EQ(Bus_Run(), 5);
+  CHECK_EQ(gBus.WritesInReset, 0);
+  CHECK(Bus_MatchesShadow());
+}
+
+// the transfers start with the interrupts on, the calls keep their order
+// with the writes around them
+static void
+TestQueueOrder(void)
+{
+  uint32_t Ticket;
+
+  gCallsNum = 0;
+  CS43L22_SetVolume(50);
+  Ticket = I2cQueue_Call(Call0);
+  CS43L22_SetVolume(60);
+  I2cQueue_Call(Call1);
+  CHECK(!I2cQueue_IsDone(Ticket));
+  CHECK_EQ(gCallsNum, 0);
+
+  CHECK(Bus_Step());
+  CHECK(I2cQueue_IsDone(Ticket));
+  CHECK_EQ(gCallsNum, 1);
+  CHECK_EQ(Bus_Run(), 1);
+  CHECK_EQ(gCallsNum, 2);
+  CHECK_EQ(gCallOrder[0], 0);
+  CHECK_EQ(gCallOrder[1], 1);
+  CHECK(!gIsBusy);
+  CHECK_EQ(gBus.StartsMasked, 0);
+  CHECK_EQ(gHostPrimask, 0);
+}
+
+// a refused start or a NACK counts an error, the queue goes on
+static void
+TestQueueErrors(void)
+{
+  uint32_t Errors = I2cQueue_GetErrors();
+  const uint8_t Data[I2C_QUEUE_DATA_MAX + 1] = {CS43L22_MASTER_A_VOL_R, 1};
+
+  gBus.Status = HAL_BUSY;
+  I2cQueue_Write(CS43L22_I2C_ADDR, Data, 2, NULL);
+  CHECK_EQ(I2cQueue_GetErrors(), Errors + 1);
+  CHECK(!gIsBusy);
+
+  gBus.IsNack = true;
+  I2cQueue_Write(CS43L22_I2C_ADDR, Data, 2, NULL);
+  gCallsNum = 0;
+  I2cQueue_Call(Call1);
+  CHECK_EQ(Bus_Run(), 1);
+  CHECK_EQ(I2cQueue_GetErrors(), Errors + 2);
+  CHECK_EQ(gCallsNum, 1);
+
+  // too long to queue
+  I2cQueue_Write(CS43L22_I2C_ADDR, Data, sizeof(Data), NULL);
+  CHECK_EQ(I2cQueue_GetErrors(), Errors + 3);
+  CHECK_EQ(Bus_Run(), 0);
+
+  // another bus's interrupts are left alone
+  I2cQueue_Write(CS43L22_I2C_ADDR, Data, 2, NULL);
+  HAL_I2C_MasterTxCpltCallback(&gOtherI2c);
+  CHECK(!I2cQueue_IsDone(gHead));
+  CHECK_EQ(Bus_Run(), 1);
+  CHECK_EQ(gBus.StartsMasked, 0);
+}
+
+int
+main(void)
+{
+  memcpy(gBus.Regs, gRegDefaults, CS43L22_REG_NUM);
+  TestInitFromReset();
+  TestShadowSkipsCleanRegs();
+  TestPauseResume();
+  TestStopAndInit();
+  TestQueueOrder();
+  TestQueueErrors();
+  return TEST_RESULT();
+}
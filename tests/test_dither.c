@@ -0,0 +1,258 @@
+/**
+ * @file test_dither.c
+ * @brief Host spectral tests of the requantization: the error of a quiet
+ * 24-bit tone taken to 16 bits is a noise with no harmonics of the tone,
+ * the white one of the rounding and the one of the TPDF dither, which
+ * rises to the top of the band being a difference of successive uniform
+ * values. The noise shaping moves it out of the 2 to 5 kHz band to above
+ * 15 kHz by the response of its filter.
+ *   test_dither bench  prints the cost per frame with and without shaping
+ */
+
+#include "../src/App/dither.c"
+
+#include <math.h>
+
+#include "host.h"
+
+#define RATE 44100
+#define BITS 24
+#define DFT_SIZE 4096
+#define DFT_BLOCKS 8
+#define TEST_FRAMES (DFT_SIZE * DFT_BLOCKS)
+#define TONE_BIN 93 // 1001 Hz, on a bin
+#define TONE_PEAK 5.3 // output LSBs
+#define BAND_TOLERANCE_DB 1.0
+
+//---------------------------------------------------------------------------//
+//helpers
+static int32_t gLeft[TEST_FRAMES];
+static int32_t gRight[TEST_FRAMES];
+static int16_t gOut[2 * TEST_FRAMES];
+static double gDiff[TEST_FRAMES]; // of the left channel, in output LSBs
+static double gCos[DFT_SIZE];
+static double gSin[DFT_SIZE];
+
+static void
+MakeTone(void)
+{
+  const double Scale = 1 << (BITS - 16);
+
+  for(uint32_t i = 0; i < DFT_SIZE; i++)
+    {
+      gCos[i] = cos(2.0 * M_PI * i / DFT_SIZE);
+      gSin[i] = sin(2.0 * M_PI * i / DFT_SIZE);
+    }
+  for(uint32_t i = 0; i < TEST_FRAMES; i++)
+    {
+      double x = TONE_PEAK * Scale * gSin[(TONE_BIN * i) % DFT_SIZE];
+
+      gLeft[i] = (int32_t)lrint(x);
+      gRight[i] = (int32_t)lrint(-0.5 * x);
+    }
+}
+
+// requantize the tone in blocks as the FLAC reads do, keep the error
+static void
+Requantize(uint32_t Rate, bool IsShaping)
+{
+  Dither_SetRate(Rate);
+  Dither_SetShaping(IsShaping);
+  for(uint32_t i = 0; i < TEST_FRAMES; i += 512)
+    {
+      Dither_Requantize(&gOut[2 * i], &gLeft[i], &gRight[i], BITS, 512);
+    }
+  for(uint32_t i = 0; i < TEST_FRAMES; i++)
+    {
+      gDiff[i] = gOut[2 * i] - gLeft[i] / (double)(1 << (BITS - 16));
+    }
+}
+
+// power of the error at a bin, averaged over the blocks
+static double
+BinPower(uint32_t Bin)
+{
+  double Power = 0.0;
+
+  for(uint32_t b = 0; b < DFT_BLOCKS; b++)
+    {
+      const double* Error = &gDiff[b * DFT_SIZE];
+      double Re = 0.0;
+      double Im = 0.0;
+
+      for(uint32_t i = 0; i < DFT_SIZE; i++)
+        {
+          Re += Error[i] * gCos[(Bin * i) % DFT_SIZE];
+          Im -= Error[i] * gSin[(Bin * i) % DFT_SIZE];
+        }
+      Power += Re * Re + Im * Im;
+    }
+  return Power / DFT_BLOCKS;
+}
+
+// mean power of the error over a band, in dB
+static double
+BandDb(uint32_t LowHz, uint32_t HighHz)
+{
+  uint32_t Low = LowHz * DFT_SIZE / RATE;
+  uint32_t High = HighHz * DFT_SIZE / RATE;
+  double Power = 0.0;
+
+  for(uint32_t Bin = Low; Bin < High; Bin++) Power += BinPower(Bin);
+  return 10.0 * log10(Power / (High - Low));
+}
+
+// the expected mean power of the error at a bin over a band, in dB: the
+// rounding and the dither of LSB^2/12 each, the dither through 1 - z^-1,
+// all through the shaping filter when it's on
+static double
+ModelDb(uint32_t LowHz, uint32_t HighHz, bool IsShaping)
+{
+  const uint32_t Steps = 1000;
+  double Power = 0.0;
+
+  for(uint32_t s = 0; s < Steps; s++)
+    {
+      double w = 2.0 * M_PI * (LowHz + (HighHz - LowHz) * (s + 0.5) / Steps) / RATE;
+      double Density = (1.0 + 4.0 * sin(w / 2) * sin(w / 2)) / 12.0;
+      double Re = 1.0;
+      double Im = 0.0;
+
+      for(uint8_t k = 0; IsShaping && k < DITHER_TAPS; k++)
+        {
+          double c = -(double)gShape[k] / (1 << DITHER_COEF_SHIFT);
+
+          Re += c * cos(w * (k + 1));
+          Im -= c * sin(w * (k + 1));
+        }
+      Power += Density * (Re * Re + Im * Im);
+    }
+  return 10.0 * log10(DFT_SIZE * Power / Steps);
+}
+
+// each band of the error against the model
+static void
+CheckBands(bool IsShaping)
+{
+  static const uint32_t Bands[][2] = {{100, 2000}, {2000, 5000}, {7000, 10000}, {15000, 20000}};
+
+  for(uint8_t b = 0; b < sizeof(Bands) / sizeof(Bands[0]); b++)
+    {
+      double Measured = BandDb(Bands[b][0], Bands[b][1]);
+      double Expected = ModelDb(Bands[b][0], Bands[b][1], IsShaping);
+
+      if(fabs(Measured - Expected) > BAND_TOLERANCE_DB)
+        {
+          printf("%s: shaping %s: %u-%u Hz at %.1f dB, expected %.1f dB\n", __FILE__,
+                 IsShaping ? "on" : "off", Bands[b][0], Bands[b][1], Measured, Expected);
+          gTestFailures++;
+        }
+    }
+}
+
+static double
+Variance(void)
+{
+  double Sum = 0.0;
+  double Sum2 = 0.0;
+
+  for(uint32_t i = 0; i < TEST_FRAMES; i++)
+    {
+      Sum += gDiff[i];
+      Sum2 += gDiff[i] * gDiff[i];
+    }
+  return Sum2 / TEST_FRAMES - (Sum / TEST_FRAMES) * (Sum / TEST_FRAMES);
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// TPDF on a rounding: the error is LSB^2/12 + LSB^2/6 in the bands of
+// the model, and the harmonics of the tone don't stand out of it
+static void
+TestUnshaped(void)
+{
+  double Floor;
+
+  Requantize(RATE, false);
+  CHECK(!Dither_IsShaping());
+  CHECK(fabs(Variance() - 0.25) < 0.02);
+  CheckBands(false);
+
+  Floor = BandDb(100, 20000);
+  for(uint32_t h = 2; h <= 5; h++)
+    {
+      double Harmonic = 10.0 * log10(BinPower(h * TONE_BIN));
+
+      if(Harmonic > Floor + 6.0)
+        {
+          printf("%s: harmonic %u at %.1f dB over a floor of %.1f dB\n", __FILE__, h,
+                 Harmonic, Floor);
+          gTestFailures++;
+        }
+    }
+}
+
+// the shaped noise is the same through the filter, 2 to 5 kHz well down
+static void
+TestShaped(void)
+{
+  double Unshaped;
+
+  Requantize(RATE, false);
+  Unshaped = BandDb(2000, 5000);
+  Requantize(RATE, true);
+  CHECK(Dither_IsShaping());
+  CheckBands(true);
+  CHECK(BandDb(2000, 5000) < Unshaped - 12.0);
+  CHECK(BandDb(15000, 20000) > BandDb(2000, 5000) + 20.0);
+}
+
+// under 44.1 kHz the shaping stays off
+static void
+TestLowRate(void)
+{
+  Requantize(22050, true);
+  CHECK(!Dither_IsShaping());
+  CHECK(fabs(Variance() - 0.25) < 0.02);
+  Dither_SetShaping(false);
+}
+
+// host cost per frame, with and without the shaping
+static void
+Bench(void)
+{
+  for(uint8_t IsShaping = 0; IsShaping < 2; IsShaping++)
+    {
+      const uint32_t Runs = 100;
+      uint64_t Start;
+      uint64_t Ns;
+
+      Dither_SetRate(RATE);
+      Dither_SetShaping(IsShaping);
+      Start = Host_Ns();
+      for(uint32_t r = 0; r < Runs; r++)
+        {
+          Dither_Requantize(gOut, gLeft, gRight, BITS, TEST_FRAMES);
+        }
+      Ns = Host_Ns() - Start;
+      printf("dither: shaping %-3s %.2f ns per frame on the host\n", IsShaping ? "on" : "off",
+             (double)Ns / ((double)Runs * TEST_FRAMES));
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+  MakeTone();
+  if(Host_IsBench(argc, argv))
+    {
+      Bench();
+      return 0;
+    }
+
+  TestUnshaped();
+  TestShaped();
+  TestLowRate();
+  return TEST_RESULT();
+}
@@ -0,0 +1,309 @@
+/**
+ * @file test_eq.c
+ * @brief Host tests of the equalizer: sine sweeps through the fixed point
+ * biquads against the response of the cookbook filters in double, the
+ * channels kept apart, and the CPU budget of the bands.
+ *   test_eq bench  prints the cost of a biquad per sample
+ */
+
+#include "../src/App/eq.c"
+
+#include <stdlib.h>
+
+#include "host.h"
+
+#define SWEEP_AMPLITUDE 4000 // -18 dBFS, room for the boosts
+#define BLOCK_FRAMES 512
+#define SETTLE_BLOCKS 8
+#define MEASURE_BLOCKS 8
+#define TOLERANCE_DB 0.2
+
+//---------------------------------------------------------------------------//
+//helpers
+static const uint16_t gSweep[] = {30, 60, 125, 250, 500, 1000, 2000, 4000, 8000, 12000, 16000};
+
+static void
+Band(EqBand_t* Params, EqBandType_t Type, uint16_t Freq, int16_t GainDb10, uint16_t Q100)
+{
+  Params->Type = Type;
+  Params->Freq = Freq;
+  Params->GainDb10 = GainDb10;
+  Params->Q100 = Q100;
+}
+
+static void
+ClearBands(void)
+{
+  EqBand_t Off = {0};
+
+  for(uint8_t i = 0; i < EQ_BANDS; i++) CHECK(Eq_SetBand(EQ_CHANNEL_BOTH, i, &Off));
+}
+
+// magnitude in dB of a cookbook biquad, in double
+static double
+IdealDb(const EqBand_t* Params, double Freq, double Rate)
+{
+  double A = pow(10.0, Params->GainDb10 / 400.0);
+  double W0 = 2.0 * M_PI * Params->Freq / Rate;
+  double Cos = cos(W0);
+  double Alpha = sin(W0) * 50.0 / Params->Q100;
+  double Shelf = 2.0 * sqrt(A) * Alpha;
+  double B[3];
+  double D[3];
+  double W = 2.0 * M_PI * Freq / Rate;
+  double NumRe, NumIm, DenRe, DenIm;
+
+  switch(Params->Type)
+  {
+    case EQ_BAND_LOW_SHELF:
+      B[0] = A * ((A + 1) - (A - 1) * Cos + Shelf);
+      B[1] = 2 * A * ((A - 1) - (A + 1) * Cos);
+      B[2] = A * ((A + 1) - (A - 1) * Cos - Shelf);
+      D[0] = (A + 1) + (A - 1) * Cos + Shelf;
+      D[1] = -2 * ((A - 1) + (A + 1) * Cos);
+      D[2] = (A + 1) + (A - 1) * Cos - Shelf;
+      break;
+    case EQ_BAND_HIGH_SHELF:
+      B[0] = A * ((A + 1) + (A - 1) * Cos + Shelf);
+      B[1] = -2 * A * ((A - 1) + (A + 1) * Cos);
+      B[2] = A * ((A + 1) + (A - 1) * Cos - Shelf);
+      D[0] = (A + 1) - (A - 1) * Cos + Shelf;
+      D[1] = 2 * ((A - 1) - (A + 1) * Cos);
+      D[2] = (A + 1) - (A - 1) * Cos - Shelf;
+      break;
+    default:
+      B[0] = 1 + Alpha * A;
+      B[1] = -2 * Cos;
+      B[2] = 1 - Alpha * A;
+      D[0] = 1 + Alpha / A;
+      D[1] = -2 * Cos;
+      D[2] = 1 - Alpha / A;
+      break;
+  }
+
+  NumRe = B[0] + B[1] * cos(W) + B[2] * cos(2 * W);
+  NumIm = -B[1] * sin(W) - B[2] * sin(2 * W);
+  DenRe = D[0] + D[1] * cos(W) + D[2] * cos(2 * W);
+  DenIm = -D[1] * sin(W) - D[2] * sin(2 * W);
+  return 10.0 * log10((NumRe * NumRe + NumIm * NumIm) / (DenRe * DenRe + DenIm * DenIm));
+}
+
+// gain in dB of each channel for a sine on both, the trim given back
+static void
+MeasureDb(double Freq, double Rate, double* Db)
+{
+  static int16_t Samples[2 * BLOCK_FRAMES];
+  double In = 0.0;
+  double Out[EQ_CHANNELS] = {0.0, 0.0};
+  uint32_t n = 0;
+
+  for(uint8_t i = 0; i < EQ_CHANNELS; i++)
+    {
+      for(uint8_t b = 0; b < EQ_BANDS; b++) memset(&gStates[i][b], 0, sizeof(EqState_t));
+    }
+
+  for(uint32_t Block = 0; Block < SETTLE_BLOCKS + MEASURE_BLOCKS; Block++)
+    {
+      for(uint32_t i = 0; i < BLOCK_FRAMES; i++, n++)
+        {
+          int16_t x = (int16_t)lrint(SWEEP_AMPLITUDE * sin(2.0 * M_PI * Freq * n / Rate));
+
+          Samples[2 * i] = x;
+          Samples[2 * i + 1] = x;
+          if(Block >= SETTLE_BLOCKS) In += (double)x * x;
+        }
+      Eq_Process(Samples, BLOCK_FRAMES);
+      if(Block < SETTLE_BLOCKS) continue;
+      for(uint32_t i = 0; i < BLOCK_FRAMES; i++)
+        {
+          Out[0] += (double)Samples[2 * i] * Samples[2 * i];
+          Out[1] += (double)Samples[2 * i + 1] * Samples[2 * i + 1];
+        }
+    }
+
+  for(uint8_t Ch = 0; Ch < EQ_CHANNELS; Ch++)
+    {
+      Db[Ch] = 10.0 * log10(Out[Ch] / In) + 20.0 * log10(Eq_GetMakeup() / (double)EQ_MAKEUP_UNITY);
+    }
+}
+
+// sweep a channel against the cascade of its bands
+static void
+CheckSweep(const EqBand_t* Bands, uint8_t Num, uint8_t Channel, double Rate)
+{
+  double Db[EQ_CHANNELS];
+
+  for(uint8_t i = 0; i < sizeof(gSweep) / sizeof(gSweep[0]); i++)
+    {
+      double Ideal = 0.0;
+
+      if(gSweep[i] * 2.2 > Rate) break;
+      for(uint8_t b = 0; b < Num; b++) Ideal += IdealDb(&Bands[b], gSweep[i], Rate);
+      MeasureDb(gSweep[i], Rate, Db);
+      if(fabs(Db[Channel] - Ideal) > TOLERANCE_DB)
+        {
+          printf("%s: %u Hz at %.0f Hz: %.2f dB, expected %.2f dB\n", __FILE__,
+                 gSweep[i], Rate, Db[Channel], Ideal);
+          gTestFailures++;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// a peak, its center gain and its skirts, at the common rates
+static void
+TestPeak(void)
+{
+  static const uint32_t Rates[] = {22050, 44100, 48000, 96000};
+  EqBand_t Params;
+  double Db[EQ_CHANNELS];
+
+  Band(&Params, EQ_BAND_PEAK, 1000, 60, 141);
+  for(uint8_t r = 0; r < sizeof(Rates) / sizeof(Rates[0]); r++)
+    {
+      Eq_SetRate(Rates[r]);
+      ClearBands();
+      CHECK(Eq_SetBand(EQ_CHANNEL_BOTH, 0, &Params));
+      CheckSweep(&Params, 1, 0, Rates[r]);
+      CheckSweep(&Params, 1, 1, Rates[r]);
+    }
+
+  MeasureDb(1000, 96000, Db);
+  CHECK(fabs(Db[0] - 6.0) < 0.1);
+
+  // a deep narrow cut
+  Band(&Params, EQ_BAND_PEAK, 3000, -120, 400);
+  CHECK(Eq_SetBand(EQ_CHANNEL_BOTH, 0, &Params));
+  CheckSweep(&Params, 1, 0, 96000);
+  MeasureDb(3000, 96000, Db);
+  CHECK(fabs(Db[0] + 12.0) < 0.2);
+}
+
+// the shelves reach their gain away from the corner
+static void
+TestShelves(void)
+{
+  EqBand_t Params[2];
+  double Db[EQ_CHANNELS];
+
+  Eq_SetRate(44100);
+  ClearBands();
+  Band(&Params[0], EQ_BAND_LOW_SHELF, 200, 90, 71);
+  Band(&Params[1], EQ_BAND_HIGH_SHELF, 4000, -60, 71);
+  CHECK(Eq_SetBand(EQ_CHANNEL_BOTH, 0, &Params[0]));
+  CHECK(Eq_SetBand(EQ_CHANNEL_BOTH, 1, &Params[1]));
+  CheckSweep(Params, 2, 0, 44100);
+
+  MeasureDb(30, 44100, Db);
+  CHECK(fabs(Db[0] - 9.0) < 0.3);
+  MeasureDb(16000, 44100, Db);
+  CHECK(fabs(Db[0] + 6.0) < 0.3);
+}
+
+// bands of one channel leave the other flat, a cascade adds up
+static void
+TestChannels(void)
+{
+  EqBand_t Params[4];
+
+  Eq_SetRate(48000);
+  ClearBands();
+  Band(&Params[0], EQ_BAND_LOW_SHELF, 80, 60, 71);
+  Band(&Params[1], EQ_BAND_PEAK, 400, -40, 200);
+  Band(&Params[2], EQ_BAND_PEAK, 2500, 50, 100);
+  Band(&Params[3], EQ_BAND_HIGH_SHELF, 10000, 30, 71);
+  for(uint8_t i = 0; i < 4; i++) CHECK(Eq_SetBand(EQ_CHANNEL_LEFT, i, &Params[i]));
+
+  CheckSweep(Params, 4, 0, 48000);
+  CheckSweep(Params, 0, 1, 48000);
+
+  // the Q15 coefficients can't hold the 80 Hz shelf
+  CHECK(gSets[gActive].Stages[0][0].IsWide);
+  CHECK(!gSets[gActive].Stages[0][2].IsWide);
+}
+
+// the bands past the budget are refused, the cost of a biquad comes from
+// the runs
+static void
+TestBudget(void)
+{
+  EqBand_t Params;
+  EqStats_t Stats;
+  int16_t Samples[2 * BLOCK_FRAMES] = {0};
+  uint8_t Accepted = 0;
+
+  // 42 MHz, 30 % of it over 96 kHz at 24 cycles a biquad
+  gStageCycles10 = EQ_STAGE_CYCLES * 10;
+  gIsStageMeasured = false;
+  Eq_SetRate(96000);
+  ClearBands();
+  CHECK_EQ(Eq_MaxStages(), 5);
+
+  Band(&Params, EQ_BAND_PEAK, 1000, 30, 100);
+  for(uint8_t i = 0; i < EQ_BANDS; i++)
+    {
+      Params.Freq = 200 * (i + 1);
+      if(Eq_SetBand(EQ_CHANNEL_LEFT, i, &Params)) Accepted++;
+    }
+  CHECK_EQ(Accepted, 5);
+  Eq_SetRate(22050);
+  CHECK_EQ(Eq_MaxStages(), EQ_CHANNELS * EQ_BANDS);
+  for(uint8_t i = Accepted; i < EQ_BANDS; i++) CHECK(Eq_SetBand(EQ_CHANNEL_LEFT, i, &Params));
+
+  // the measured cost takes over, the least one is kept
+  Eq_Process(Samples, BLOCK_FRAMES);
+  CHECK(gIsStageMeasured);
+  Eq_GetStats(&Stats);
+  CHECK_EQ(Stats.Stages[0], 8);
+  CHECK_EQ(Stats.StageCycles10, gStageCycles10);
+  CHECK(Stats.StageCycles10 <= Stats.CyclesPerFrame10 / 8 || Stats.StageCycles10 == 1);
+
+  gStageCycles10 = 600;
+  CHECK_EQ(Eq_MaxStages(), 9);
+  Eq_Process(Samples, BLOCK_FRAMES);
+  CHECK(gStageCycles10 < 600);
+  ClearBands();
+}
+
+// host nanoseconds of a biquad per sample, 16 stages over 1 s of audio
+static void
+Bench(void)
+{
+  static int16_t Samples[2 * BLOCK_FRAMES];
+  EqBand_t Params;
+  uint64_t Start;
+  uint64_t Ns;
+  uint32_t Blocks = 48000 / BLOCK_FRAMES;
+
+  Eq_SetRate(22050);
+  for(uint8_t i = 0; i < EQ_BANDS; i++)
+    {
+      Band(&Params, EQ_BAND_PEAK, 100 * (i + 1), 30, 100);
+      Eq_SetBand(EQ_CHANNEL_BOTH, i, &Params);
+    }
+  for(uint32_t i = 0; i < 2 * BLOCK_FRAMES; i++) Samples[i] = (int16_t)(rand() - RAND_MAX / 2);
+
+  Start = Host_Ns();
+  for(uint32_t Block = 0; Block < Blocks; Block++) Eq_Process(Samples, BLOCK_FRAMES);
+  Ns = Host_Ns() - Start;
+  printf("eq: %.2f ns per biquad per sample on the host, %u-cycle estimate on the M4\n",
+         (double)Ns / (Blocks * BLOCK_FRAMES * EQ_CHANNELS * EQ_BANDS), EQ_STAGE_CYCLES);
+}
+
+int
+main(int argc, char** argv)
+{
+  if(Host_IsBench(argc, argv))
+    {
+      Bench();
+      return 0;
+    }
+
+  TestPeak();
+  TestShelves();
+  TestChannels();
+  TestBudget();
+  return TEST_RESULT();
+}
@@ -0,0 +1,316 @@
+/**
+ * @file test_flac.c
+ * @brief Host conformance tests of the FLAC decoder against the decodes of
+ * libFLAC in data/ (made by data/make_fixtures.py): 16-bit mono and
+ * stereo, 24-bit stereo and a file of Rice codes longer than the input
+ * buffer, decoded whole in odd pieces and from seeks, with and without a
+ * SEEKTABLE. The requantizer is replaced here so the 24-bit samples are
+ * compared as decoded.
+ *   test_flac bench  prints the decode cost of each file
+ */
+
+#include "../src/App/flac.c"
+
+#include <stdlib.h>
+
+#include "host.h"
+
+#define FILE_MAX_SIZE 65536
+#define REF_MAX_FRAMES 22050
+#define SEEK_FRAMES 64
+
+//---------------------------------------------------------------------------//
+//helpers
+typedef struct {
+  const char* Name;
+  uint8_t Channels;
+  uint8_t Bits;
+  uint16_t SeekPoints;
+} Fixture_t;
+
+static const Fixture_t gFixtures[] = {
+  {"flac16_stereo", 2, 16, 0},
+  {"flac16_mono", 1, 16, 0},
+  {"flac24_stereo", 2, 24, 0},
+  {"long_rice", 1, 16, 3},
+};
+
+static uint8_t gFile[FILE_MAX_SIZE];
+static uint32_t gFileLen;
+static uint32_t gFileOfs;
+static int32_t gRef[2 * REF_MAX_FRAMES]; // stereo, as decoded
+static uint32_t gRefFrames;
+static int16_t gOut[2 * REF_MAX_FRAMES];
+static int32_t gWide[2 * REF_MAX_FRAMES];
+static int32_t* gWideOut; // where the next requantized frames go
+
+bool
+Flac_ReadCallback(uint8_t* Buf, uint32_t Len, uint32_t* ReadLen)
+{
+  if(Len > gFileLen - gFileOfs) Len = gFileLen - gFileOfs;
+  memcpy(Buf, &gFile[gFileOfs], Len);
+  gFileOfs += Len;
+  *ReadLen = Len;
+  return true;
+}
+
+bool
+Flac_SeekCallback(uint32_t Ofs)
+{
+  if(Ofs > gFileLen) return false;
+  gFileOfs = Ofs;
+  return true;
+}
+
+// keeps the samples wider than 16 bits
+void
+Dither_Requantize(int16_t* Samples, const int32_t* Left, const int32_t* Right,
+                  uint8_t Bits, uint32_t Frames)
+{
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      *Samples++ = (int16_t)(Left[i] >> (Bits - 16));
+      *Samples++ = (int16_t)(Right[i] >> (Bits - 16));
+      *gWideOut++ = Left[i];
+      *gWideOut++ = Right[i];
+    }
+}
+
+static uint32_t
+ReadFile(const char* Name, const char* Ext, void* Buf, uint32_t Size)
+{
+  char Path[64];
+  FILE* File;
+  size_t Len;
+
+  snprintf(Path, sizeof(Path), "data/%s.%s", Name, Ext);
+  File = fopen(Path, "rb");
+  if(File == NULL)
+    {
+      printf("%s: %s is missing\n", __FILE__, Path);
+      gTestFailures++;
+      return 0;
+    }
+  Len = fread(Buf, 1, Size, File);
+  fclose(File);
+  return (uint32_t)Len;
+}
+
+static bool
+Open(const Fixture_t* Fixture)
+{
+  static int16_t Narrow[2 * REF_MAX_FRAMES];
+  uint32_t RefLen;
+
+  gFileLen = ReadFile(Fixture->Name, "flac", gFile, sizeof(gFile));
+  if(Fixture->Bits > 16)
+    {
+      RefLen = ReadFile(Fixture->Name, "raw", gRef, sizeof(gRef));
+      gRefFrames = RefLen / 8;
+    }
+  else
+    {
+      RefLen = ReadFile(Fixture->Name, "raw", Narrow, sizeof(Narrow));
+      gRefFrames = RefLen / 4;
+      for(uint32_t i = 0; i < 2 * gRefFrames; i++) gRef[i] = Narrow[i];
+    }
+  if(gFileLen == 0 || RefLen == 0) return false;
+
+  gFileOfs = 0;
+  CHECK(Flac_Open(gFileLen));
+  return !gIsInFailed;
+}
+
+// decode from the read position on, as the player reads its half buffers
+static uint32_t
+Decode(uint32_t Frames, uint32_t Piece)
+{
+  uint32_t Made = 0;
+  uint32_t Step;
+
+  gWideOut = gWide;
+  while(Made < Frames)
+    {
+      uint32_t Want = (Frames - Made < Piece) ? Frames - Made : Piece;
+
+      CHECK(Flac_Read(&gOut[2 * Made], Want, &Step));
+      if(Step == 0) break;
+      Made += Step;
+    }
+  return Made;
+}
+
+// the frames that differ from the reference
+static uint32_t
+Mismatches(const Fixture_t* Fixture, uint32_t First, uint32_t Frames)
+{
+  uint32_t Count = 0;
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      const int32_t* Ref = &gRef[2 * (First + i)];
+
+      if(Fixture->Bits > 16)
+        {
+          if(gWide[2 * i] != Ref[0] || gWide[2 * i + 1] != Ref[1]) Count++;
+        }
+      else if(gOut[2 * i] != Ref[0] || gOut[2 * i + 1] != Ref[1])
+        {
+          Count++;
+        }
+    }
+  return Count;
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// the STREAMINFO of each file is the one of its reference
+static void
+TestProbe(void)
+{
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      FlacInfo_t Info;
+
+      if(!Open(&gFixtures[f])) continue;
+      CHECK(Flac_Probe(gFile, &Info));
+      CHECK_EQ(Info.Channels, gFixtures[f].Channels);
+      CHECK_EQ(Info.BitsPerSample, gFixtures[f].Bits);
+      CHECK_EQ(Info.TotalFrames, gRefFrames);
+    }
+
+  // not a FLAC file
+  memset(gFile, 0, FLAC_PROBE_SIZE);
+  CHECK(!Flac_Probe(gFile, &(FlacInfo_t){0}));
+}
+
+// each file decodes to the reference, in pieces that don't divide a block
+static void
+TestConformance(void)
+{
+  static const uint32_t Pieces[] = {1, 333, 512, FLAC_MAX_BLOCK};
+
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      for(uint8_t p = 0; p < sizeof(Pieces) / sizeof(Pieces[0]); p++)
+        {
+          FlacStats_t Stats;
+          uint32_t Wrong;
+
+          if(!Open(&gFixtures[f])) break;
+          CHECK_EQ(Decode(REF_MAX_FRAMES, Pieces[p]), gRefFrames);
+          Wrong = Mismatches(&gFixtures[f], 0, gRefFrames);
+          if(Wrong)
+            {
+              printf("%s: %s in pieces of %u: %u of %u frames differ\n", __FILE__,
+                     gFixtures[f].Name, Pieces[p], Wrong, gRefFrames);
+              gTestFailures++;
+            }
+
+          Flac_GetStats(&Stats);
+          CHECK_EQ(Stats.BadFrames, 0);
+          CHECK(Stats.Frames > 0);
+          CHECK_EQ(Stats.SeekPoints, gFixtures[f].SeekPoints);
+        }
+    }
+}
+
+// a seek lands on any frame, forwards and backwards, around the block
+// edges and at the end of the file
+static void
+TestSeek(void)
+{
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      uint32_t Block;
+      uint32_t Targets[14];
+      uint32_t Wrong = 0;
+      FlacStats_t Stats;
+
+      if(!Open(&gFixtures[f])) continue;
+      Block = gInfo.MaxBlock;
+      Targets[0] = gRefFrames / 2;
+      Targets[1] = 0;
+      Targets[2] = 1;
+      Targets[3] = Block - 1;
+      Targets[4] = Block;
+      Targets[5] = Block + 1;
+      Targets[6] = 3 * Block + Block / 2;
+      Targets[7] = Block + 10; // back
+      Targets[8] = gRefFrames - SEEK_FRAMES;
+      Targets[9] = gRefFrames - 1;
+      for(uint8_t i = 10; i < 14; i++) Targets[i] = (uint32_t)rand() % gRefFrames;
+
+      for(uint8_t i = 0; i < 14; i++)
+        {
+          uint32_t Want;
+
+          if(Targets[i] >= gRefFrames) continue;
+          Want = (gRefFrames - Targets[i] < SEEK_FRAMES) ? gRefFrames - Targets[i] : SEEK_FRAMES;
+          Flac_Seek(Targets[i]);
+          CHECK_EQ(Decode(Want, SEEK_FRAMES), Want);
+          Wrong += Mismatches(&gFixtures[f], Targets[i], Want);
+        }
+      if(Wrong)
+        {
+          printf("%s: %s: %u frames after the seeks differ\n", __FILE__, gFixtures[f].Name, Wrong);
+          gTestFailures++;
+        }
+      Flac_GetStats(&Stats);
+      CHECK_EQ(Stats.BadFrames, 0);
+
+      // past the end there's nothing
+      Flac_Seek(gRefFrames);
+      CHECK_EQ(Decode(SEEK_FRAMES, SEEK_FRAMES), 0);
+    }
+}
+
+// host cost of each file, decoded in half buffers of 512 frames, against
+// the cost the stats measure over each read
+static void
+Bench(void)
+{
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      const uint32_t Runs = 100;
+      FlacStats_t Stats;
+      uint64_t Start;
+      uint64_t Ns = 0;
+      uint64_t Measured = 0;
+      uint32_t Made;
+
+      for(uint32_t r = 0; r < Runs; r++)
+        {
+          if(!Open(&gFixtures[f])) return;
+          do
+            {
+              gWideOut = gWide;
+              Start = Host_Ns();
+              Flac_Read(gOut, 512, &Made);
+              Ns += Host_Ns() - Start;
+              Flac_GetStats(&Stats);
+              if(Made) Measured += (uint64_t)Stats.CyclesPerFrame10 * Made;
+            }
+          while(Made);
+        }
+      printf("flac: %-13s %.2f ns per frame on the host, %.2f by the stats\n",
+             gFixtures[f].Name, (double)Ns / ((double)Runs * gRefFrames),
+             Measured / (10.0 * Runs * gRefFrames));
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+  if(Host_IsBench(argc, argv))
+    {
+      Bench();
+      return 0;
+    }
+
+  TestProbe();
+  TestConformance();
+  TestSeek();
+  return TEST_RESULT();
+}
@@ -0,0 +1,423 @@
+/**
+ * @file test_hc05.c
+ * @brief Host tests of the bluetooth command layer: the command queue
+ * between the UART IRQ and the main loop, run from two threads, the
+ * framing of the received bytes, the receive restarted after an error
+ * and the transmit ring: its chained transfers, the back-pressure on the
+ * commands and the recovery of a transfer that failed.
+ */
+
+#include "../src/Modules/hc-05/hc-05.c"
+
+#include <pthread.h>
+
+#include "host.h"
+
+#define STRESS_COMMANDS 1000000
+
+//---------------------------------------------------------------------------//
+//helpers
+static volatile bool gIsStressOver = false;
+static UART_HandleTypeDef gUart;
+static DMA_HandleTypeDef gDmaRx;
+static uint16_t gDmaPos = 0;
+static uint8_t* gTxData = NULL; // the transfer in progress
+static uint16_t gTxSize = 0;
+static uint32_t gTxStarts = 0;
+static uint32_t gTxFailStarts = 0; // starts the HAL refuses
+static uint8_t gSent[4 * TX_RING_SIZE];
+static uint32_t gSentLen = 0;
+
+// the receive restarts at the start of the ring
+HAL_StatusTypeDef
+HAL_UART_Receive_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+  (void)huart; (void)pData;
+  gDmaPos = 0;
+  gDmaRx.Counter = Size;
+  return HAL_OK;
+}
+
+// the transfers are sent when the test completes them
+HAL_StatusTypeDef
+HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size)
+{
+  if(gTxFailStarts)
+    {
+      gTxFailStarts--;
+      return HAL_ERROR;
+    }
+  gTxData = pData;
+  gTxSize = Size;
+  gTxStarts++;
+  huart->gState = HAL_UART_STATE_BUSY_TX;
+  return HAL_OK;
+}
+
+// the transfer in progress went out, the next one is chained
+static void
+CompleteTx(void)
+{
+  memcpy(&gSent[gSentLen], gTxData, gTxSize);
+  gSentLen += gTxSize;
+  gTxData = NULL;
+  gTxSize = 0;
+  gUart.gState = HAL_UART_STATE_READY;
+  HAL_UART_TxCpltCallback(&gUart);
+}
+
+// the bytes of a message, they tell their position in the stream
+static void
+MakeMessage(uint8_t* Data, uint32_t First, uint32_t Len)
+{
+  for(uint32_t i = 0; i < Len; i++) Data[i] = (uint8_t)((First + i) * 7 + 1);
+}
+
+// the DMA writes the bytes to the ring
+static void
+Arrive(const uint8_t* Data, uint16_t Len)
+{
+  for(uint16_t i = 0; i < Len; i++)
+    {
+      gRxRing[gDmaPos] = Data[i];
+      gDmaPos = (gDmaPos + 1) % RX_RING_SIZE;
+    }
+  gDmaRx.Counter = RX_RING_SIZE - gDmaPos;
+}
+
+// then the line goes idle
+static void
+Receive(const uint8_t* Data, uint16_t Len)
+{
+  Arrive(Data, Len);
+  Uart_IDLE_IRQHandler(&gUart);
+}
+
+static uint16_t
+MakeFrame(uint8_t* Frame, uint8_t Seq, uint8_t Len)
+{
+  uint8_t Payload[255];
+
+  for(uint16_t i = 0; i < Len; i++) Payload[i] = (uint8_t)(Seq + i);
+  return HC05Frame_Encode(Frame, Seq, Payload, Len);
+}
+
+// the next queued command is that frame
+static bool
+PopFrame(uint8_t Seq)
+{
+  uint8_t Frame[DATA_MAX_SIZE];
+  uint16_t Size;
+  Cmd_t Cmd;
+
+  if(!HC05_PopCommand(&Cmd) || Cmd.Len < HC05_FRAME_OVERHEAD) return false;
+  Size = MakeFrame(Frame, Seq, Cmd.Len - HC05_FRAME_OVERHEAD);
+  return Cmd.Len == Size && memcmp(Cmd.Data, Frame, Size) == 0;
+}
+
+// the payload of a command tells its sequence number, its length too
+static uint8_t
+CommandLen(uint32_t Seq)
+{
+  return 4 + Seq % (DATA_MAX_SIZE - 4 + 1);
+}
+
+static uint8_t
+CommandByte(uint32_t Seq, uint8_t i)
+{
+  return (uint8_t)(Seq * 31 + i);
+}
+
+// the UART IRQ, a full queue is retried as the next burst would
+static void*
+Producer(void* Arg)
+{
+  uint8_t Data[DATA_MAX_SIZE];
+  (void)Arg;
+
+  for(uint32_t Seq = 0; Seq < STRESS_COMMANDS; Seq++)
+    {
+      uint8_t Len = CommandLen(Seq);
+
+      memcpy(Data, &Seq, sizeof(Seq));
+      for(uint8_t i = sizeof(Seq); i < Len; i++) Data[i] = CommandByte(Seq, i);
+      while(!HC05_PushCommand(Data, Len))
+        {
+          if(gIsStressOver) return NULL;
+          sched_yield();
+        }
+    }
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// every command comes out once, in order and whole
+static void
+TestCommandQueueStress(void)
+{
+  pthread_t Thread;
+  Cmd_t Cmd;
+  uint32_t Expected = 0;
+  uint32_t Torn = 0;
+
+  CHECK(pthread_create(&Thread, NULL, Producer, NULL) == 0);
+  while(Expected < STRESS_COMMANDS)
+    {
+      uint32_t Seq;
+      uint8_t i;
+
+      if(!HC05_PopCommand(&Cmd))
+        {
+          sched_yield();
+          continue;
+        }
+
+      memcpy(&Seq, Cmd.Data, sizeof(Seq));
+      if(Seq != Expected)
+        {
+          CHECK_EQ(Seq, Expected);
+          break;
+        }
+      for(i = sizeof(Seq); i < CommandLen(Seq); i++)
+        {
+          if(Cmd.Data[i] != CommandByte(Seq, i)) break;
+        }
+      if(Cmd.Len != CommandLen(Seq) || i != Cmd.Len || Cmd.Data[Cmd.Len] != '\0') Torn++;
+      Expected++;
+    }
+  gIsStressOver = true;
+  pthread_join(Thread, NULL);
+
+  CHECK_EQ(Torn, 0);
+  CHECK_EQ(Expected, STRESS_COMMANDS);
+  CHECK(!HC05_PopCommand(&Cmd));
+  CHECK_EQ(gCmdHead, gCmdTail);
+}
+
+// a binary frame split by idle lines is queued whole
+static void
+TestBinaryFrameSplit(void)
+{
+  uint8_t Frame[DATA_MAX_SIZE];
+  uint16_t Size = MakeFrame(Frame, 1, 12);
+
+  Receive(Frame, 1);
+  Receive(&Frame[1], 6);
+  Host_AdvanceTick(FRAME_RX_TIMEOUT_MS);
+  Receive(&Frame[7], Size - 7);
+  CHECK(PopFrame(1));
+  CHECK(!HC05_PopCommand(&gCmd));
+}
+
+// the rest of a frame that never came doesn't swallow the next commands
+static void
+TestBinaryFrameTimeout(void)
+{
+  uint8_t Frame[DATA_MAX_SIZE];
+  uint16_t Size = MakeFrame(Frame, 2, 20);
+  uint32_t BadFrames = gBadFrames;
+
+  Receive(Frame, 9);
+  Host_AdvanceTick(FRAME_RX_TIMEOUT_MS + 1);
+  Receive((const uint8_t*)"p\r", 2);
+  CHECK(HC05_PopCommand(&gCmd));
+  CHECK_EQ(gCmd.Len, 1);
+  CHECK_EQ(gCmd.Data[0], 'p');
+  CHECK_EQ(gBadFrames, BadFrames + 1);
+
+  Receive(Frame, 3);
+  Host_AdvanceTick(FRAME_RX_TIMEOUT_MS + 1);
+  Receive(Frame, Size);
+  CHECK(PopFrame(2));
+  CHECK(!HC05_PopCommand(&gCmd));
+  CHECK_EQ(gBadFrames, BadFrames + 2);
+}
+
+// a frame too long to queue is skipped by its length
+static void
+TestBinaryFrameTooLong(void)
+{
+  uint8_t Long[255 + HC05_FRAME_OVERHEAD + DATA_MAX_SIZE];
+  uint8_t Frame[DATA_MAX_SIZE];
+  uint16_t LongSize = MakeFrame(Long, 3, 120);
+  uint16_t Size = MakeFrame(Frame, 4, 2);
+  uint32_t TooLong = gRxTooLong;
+
+  Receive(Long, 60);
+  Receive(&Long[60], LongSize - 60);
+  Receive(Frame, Size);
+  CHECK(PopFrame(4));
+  CHECK_EQ(gRxTooLong, TooLong + 1);
+
+  // one that ends in the burst of the next
+  LongSize = MakeFrame(Long, 5, 255);
+  memcpy(&Long[LongSize], Frame, Size);
+  Receive(Long, 200);
+  Receive(&Long[200], LongSize - 200 + Size);
+  CHECK(PopFrame(4));
+  CHECK(!HC05_PopCommand(&gCmd));
+  CHECK_EQ(gRxTooLong, TooLong + 2);
+}
+
+// an overrun keeps the commands that came whole before it, the one it
+// broke is lost and the next ones come from the start of the ring
+static void
+TestRxErrorKeepsCommands(void)
+{
+  uint32_t Overruns = gRxOverruns;
+
+  Arrive((const uint8_t*)"vo\rp\rvo", 8);
+  gUart.ErrorCode = HAL_UART_ERROR_ORE;
+  gUart.RxState = HAL_UART_STATE_READY;
+  HAL_UART_ErrorCallback(&gUart);
+  gUart.ErrorCode = HAL_UART_ERROR_NONE;
+  CHECK_EQ(gRxOverruns, Overruns + 1);
+  CHECK(HC05_PopCommand(&gCmd));
+  CHECK(strcmp((const char*)gCmd.Data, "vo") == 0);
+  CHECK(HC05_PopCommand(&gCmd));
+  CHECK(strcmp((const char*)gCmd.Data, "p") == 0);
+  CHECK(!HC05_PopCommand(&gCmd));
+
+  CHECK_EQ(gDmaPos, 0);
+  Receive((const uint8_t*)"s\r", 2);
+  CHECK(HC05_PopCommand(&gCmd));
+  CHECK(strcmp((const char*)gCmd.Data, "s") == 0);
+  CHECK(!HC05_PopCommand(&gCmd));
+}
+
+// messages queued during a transfer go out in the next one, a message
+// over the end of the ring goes out in two, in order
+static void
+TestTxChainedAndWrap(void)
+{
+  static uint8_t Data[TX_RING_SIZE];
+  static uint8_t Stream[4 * TX_RING_SIZE];
+  uint32_t Starts = gTxStarts;
+  uint32_t Len = 0;
+
+  gSentLen = 0;
+  MakeMessage(&Stream[Len], Len, 100);
+  CHECK_EQ(HC05_Write(&Stream[Len], 100), HAL_OK);
+  Len += 100;
+  CHECK_EQ(gTxStarts, Starts + 1);
+  CHECK_EQ(gTxSize, 100);
+
+  MakeMessage(&Stream[Len], Len, 30);
+  CHECK_EQ(HC05_Write(&Stream[Len], 30), HAL_OK);
+  Len += 30;
+  MakeMessage(&Stream[Len], Len, 20);
+  CHECK_EQ(HC05_Write(&Stream[Len], 20), HAL_OK);
+  Len += 20;
+  CHECK_EQ(gTxStarts, Starts + 1);
+  CompleteTx();
+  CHECK_EQ(gTxStarts, Starts + 2);
+  CHECK_EQ(gTxSize, 50);
+  CompleteTx();
+  CHECK(!gIsTxBusy);
+
+  // up to 10 bytes before the end of the ring, then over it
+  MakeMessage(&Stream[Len], Len, TX_RING_SIZE - 10 - (gTxHead & TX_RING_MASK));
+  CHECK_EQ(HC05_Write(&Stream[Len], TX_RING_SIZE - 10 - (gTxHead & TX_RING_MASK)), HAL_OK);
+  Len = gSentLen + (uint32_t)(gTxHead - gTxTail);
+  CompleteTx();
+  MakeMessage(Data, Len, 30);
+  memcpy(&Stream[Len], Data, 30);
+  CHECK_EQ(HC05_Write(Data, 30), HAL_OK);
+  Len += 30;
+  CHECK_EQ(gTxSize, 10);
+  CompleteTx();
+  CHECK_EQ(gTxSize, 20);
+  CHECK(gTxData == gTxRing);
+  CompleteTx();
+  CHECK(!gIsTxBusy);
+  CHECK_EQ(gSentLen, Len);
+  CHECK(memcmp(gSent, Stream, Len) == 0);
+}
+
+// a command waits while its reply doesn't fit, then it's answered
+static void
+TestTxBackPressure(void)
+{
+  static uint8_t Data[TX_RING_SIZE];
+  const char* Reply = "[ERROR] undefined command.\n";
+
+  gSentLen = 0;
+  MakeMessage(Data, 0, TX_RING_SIZE - TX_REPLY_MAX_SIZE + 1);
+  CHECK_EQ(HC05_Write(Data, TX_RING_SIZE - TX_REPLY_MAX_SIZE + 1), HAL_OK);
+  CHECK(HC05_GetTxFree() < TX_REPLY_MAX_SIZE);
+  Receive((const uint8_t*)"?\r", 2);
+  HC05_Update();
+  CHECK(gCmdHead != gCmdTail);
+
+  while(gIsTxBusy && gCmdHead != gCmdTail)
+    {
+      CompleteTx();
+      HC05_Update();
+    }
+  CHECK_EQ(gCmdHead, gCmdTail);
+  while(gIsTxBusy) CompleteTx();
+  CHECK_EQ(gSentLen, TX_RING_SIZE - TX_REPLY_MAX_SIZE + 1 + strlen(Reply));
+  CHECK(memcmp(&gSent[gSentLen - strlen(Reply)], Reply, strlen(Reply)) == 0);
+}
+
+// a start the HAL refused is retried by the main loop, a transfer a DMA
+// error aborted is sent again, nothing is lost
+static void
+TestTxRecovery(void)
+{
+  static uint8_t Stream[200];
+  uint32_t Starts = gTxStarts;
+
+  gSentLen = 0;
+  MakeMessage(Stream, 0, 120);
+  gTxFailStarts = 1;
+  CHECK_EQ(HC05_Write(Stream, 120), HAL_OK);
+  CHECK(!gIsTxBusy);
+  CHECK_EQ(gTxStarts, Starts);
+  HC05_Update();
+  CHECK(gIsTxBusy);
+  CHECK_EQ(gTxStarts, Starts + 1);
+  CHECK_EQ(gTxSize, 120);
+
+  // the DMA fails the transfer, a message queued meanwhile goes with it
+  MakeMessage(&Stream[120], 120, 80);
+  CHECK_EQ(HC05_Write(&Stream[120], 80), HAL_OK);
+  gUart.ErrorCode = HAL_UART_ERROR_DMA;
+  gUart.gState = HAL_UART_STATE_READY;
+  HAL_UART_ErrorCallback(&gUart);
+  gUart.ErrorCode = HAL_UART_ERROR_NONE;
+  CHECK_EQ(gTxStarts, Starts + 2);
+  CHECK_EQ(gTxSize, 200);
+  CompleteTx();
+  CHECK(!gIsTxBusy);
+  CHECK_EQ(gSentLen, 200);
+  CHECK(memcmp(gSent, Stream, 200) == 0);
+
+  // a receive error leaves a transfer in progress alone
+  CHECK_EQ(HC05_Write(Stream, 10), HAL_OK);
+  gUart.ErrorCode = HAL_UART_ERROR_ORE;
+  HAL_UART_ErrorCallback(&gUart);
+  gUart.ErrorCode = HAL_UART_ERROR_NONE;
+  CHECK_EQ(gTxStarts, Starts + 3);
+  CompleteTx();
+  CHECK_EQ(gSentLen, 210);
+}
+
+int
+main(void)
+{
+  gUart.hdmarx = &gDmaRx;
+  HC05_Init(&gUart);
+
+  TestCommandQueueStress();
+  TestBinaryFrameSplit();
+  TestBinaryFrameTimeout();
+  TestBinaryFrameTooLong();
+  TestRxErrorKeepsCommands();
+  TestTxChainedAndWrap();
+  TestTxBackPressure();
+  TestTxRecovery();
+  return TEST_RESULT();
+}
@@ -0,0 +1,286 @@
+/**
+ * @file test_hc05_baud.c
+ * @brief Host tests of the HC-05 rate negotiation against a model of the
+ * module's AT mode. The store sector is mapped at its flash address.
+ */
+
+#include "../src/Modules/hc-05/hc-05_baud.c"
+
+#include <sys/mman.h>
+
+#include "host.h"
+
+//---------------------------------------------------------------------------//
+//helpers
+typedef struct {
+  uint32_t Rate; // of the data and of the AT mode
+  uint32_t NewRate; // set by AT+UART, taken by AT+RESET
+  uint32_t MaxRate; // AT+UART above it is refused
+  bool IsKeyWired;
+} Module_t;
+
+static Module_t gModule;
+static char gReply[AT_LINE_SIZE];
+static uint8_t gReplyLen = 0;
+static uint8_t gReplyPos = 0;
+static uint32_t gAtCommands = 0; // reached the AT mode
+static uint32_t gDataBytes = 0; // reached a connected phone
+static uint32_t gErases = 0;
+static uint32_t* gStore;
+static UART_HandleTypeDef gUart;
+
+void
+Error_Handler(void)
+{
+  CHECK(false);
+}
+
+static void
+Reply(const char* Line)
+{
+  gReplyLen = (uint8_t)strlen(Line);
+  gReplyPos = 0;
+  memcpy(gReply, Line, gReplyLen);
+}
+
+HAL_StatusTypeDef
+HAL_UART_Transmit(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+  char Cmd[AT_LINE_SIZE] = {0};
+  uint32_t Rate;
+  (void)Timeout;
+
+  if(!gModule.IsKeyWired || HAL_GPIO_ReadPin(HC05_KEY_GPIO_Port, HC05_KEY_Pin) != GPIO_PIN_SET)
+    {
+      gDataBytes += Size;
+      return HAL_OK;
+    }
+  // garbage at another rate
+  if(huart->Init.BaudRate != gModule.Rate) return HAL_OK;
+
+  gAtCommands++;
+  memcpy(Cmd, pData, (Size < AT_LINE_SIZE) ? Size : AT_LINE_SIZE - 1);
+  if(strcmp(Cmd, "AT\r\n") == 0)
+    {
+      Reply("OK\r\n");
+    }
+  else if(sscanf(Cmd, "AT+UART=%" SCNu32 ",0,0\r\n", &Rate) == 1)
+    {
+      if(Rate <= gModule.MaxRate) gModule.NewRate = Rate;
+      Reply((Rate <= gModule.MaxRate) ? "OK\r\n" : "ERROR:(1D)\r\n");
+    }
+  else if(strcmp(Cmd, "AT+RESET\r\n") == 0)
+    {
+      Reply("OK\r\n");
+      gModule.Rate = gModule.NewRate;
+    }
+  else
+    {
+      Reply("ERROR:(0)\r\n");
+    }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Receive(UART_HandleTypeDef* huart, uint8_t* pData, uint16_t Size, uint32_t Timeout)
+{
+  (void)huart; (void)Size;
+
+  if(gReplyPos < gReplyLen)
+    {
+      *pData = (uint8_t)gReply[gReplyPos++];
+      return HAL_OK;
+    }
+  Host_AdvanceTick(Timeout);
+  return HAL_TIMEOUT;
+}
+
+// the flash cells only go from 1 to 0 when programmed
+HAL_StatusTypeDef
+HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+  CHECK_EQ(TypeProgram, FLASH_TYPEPROGRAM_WORD);
+  CHECK(Address >= STORE_ADDR && Address < STORE_ADDR + STORE_SIZE);
+  gStore[(Address - STORE_ADDR) / 4] &= (uint32_t)Data;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef* pEraseInit, uint32_t* SectorError)
+{
+  CHECK_EQ(pEraseInit->Sector, STORE_SECTOR);
+  CHECK_EQ(pEraseInit->NbSectors, 1);
+  memset(gStore, 0xFF, STORE_SIZE);
+  gErases++;
+  *SectorError = 0xFFFFFFFFU;
+  return HAL_OK;
+}
+
+// a module at its factory rate, with the store erased
+static void
+Reset(uint32_t MaxRate, bool IsKeyWired)
+{
+  gModule.Rate = DEFAULT_BAUD;
+  gModule.NewRate = DEFAULT_BAUD;
+  gModule.MaxRate = MaxRate;
+  gModule.IsKeyWired = IsKeyWired;
+  memset(gStore, 0xFF, STORE_SIZE);
+  gPendingRecord = STORE_ERASED;
+}
+
+// a boot, the rate and the time it took
+static uint32_t
+Boot(uint32_t* Ms)
+{
+  uint32_t Start = gHostTick;
+  uint32_t Baud;
+
+  gAtCommands = 0;
+  gDataBytes = 0;
+  gErases = 0;
+  gReplyLen = 0;
+  Baud = HC05_NegotiateBaud(&gUart);
+  *Ms = gHostTick - Start;
+  CHECK_EQ(gUart.Init.BaudRate, Baud);
+  CHECK(HAL_GPIO_ReadPin(HC05_KEY_GPIO_Port, HC05_KEY_Pin) == GPIO_PIN_RESET);
+  return Baud;
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// the fastest rate the module takes is negotiated once, then checked
+static void
+TestNegotiateThenCheck(void)
+{
+  uint32_t Ms;
+
+  Reset(115200, true);
+  CHECK_EQ(Boot(&Ms), 115200);
+  CHECK_EQ(gModule.Rate, 115200);
+  CHECK_EQ(gStore[0], STORE_TAG_RATE | 115200);
+  CHECK_EQ(gStore[1], STORE_ERASED);
+
+  CHECK_EQ(Boot(&Ms), 115200);
+  CHECK_EQ(gAtCommands, 1);
+  CHECK_EQ(gDataBytes, 0);
+  CHECK_EQ(gErases, 0);
+  CHECK(Ms < 2 * KEY_SETTLE_MS);
+  CHECK_EQ(gStore[1], STORE_ERASED);
+}
+
+// a module back at its factory rate doesn't answer at the saved one
+static void
+TestModuleReplaced(void)
+{
+  uint32_t Ms;
+
+  Reset(115200, true);
+  CHECK_EQ(Boot(&Ms), 115200);
+  gModule.Rate = DEFAULT_BAUD;
+  gModule.MaxRate = 230400;
+
+  CHECK_EQ(Boot(&Ms), 230400);
+  CHECK_EQ(gModule.Rate, 230400);
+  CHECK_EQ(gErases, 0);
+  CHECK_EQ(gStore[1], STORE_TAG_RATE | 230400);
+  CHECK_EQ(gStore[2], STORE_ERASED);
+}
+
+// without KEY the module is probed on a few boots, then the next boots
+// are quiet but for a probe every NO_AT_REPROBE_BOOTS
+static void
+TestKeyNotWired(void)
+{
+  uint32_t Ms;
+  uint32_t Boots = 0;
+
+  Reset(460800, false);
+  for(uint32_t i = 1; i < NO_AT_FAILURES; i++)
+    {
+      CHECK_EQ(Boot(&Ms), DEFAULT_BAUD);
+      CHECK(Ms > 0);
+      CHECK_EQ(gStore[i - 1], STORE_TAG_FAILED | (i << STORE_COUNT_SHIFT) | DEFAULT_BAUD);
+    }
+  CHECK_EQ(Boot(&Ms), DEFAULT_BAUD);
+  CHECK_EQ(gAtCommands, 0);
+  CHECK_EQ(gStore[NO_AT_FAILURES - 1], STORE_TAG_NO_AT | DEFAULT_BAUD);
+
+  do
+    {
+      CHECK_EQ(Boot(&Ms), DEFAULT_BAUD);
+      if(Ms == 0) CHECK_EQ(gDataBytes, 0);
+      Boots++;
+    }
+  while(Ms == 0 && Boots < 2 * NO_AT_REPROBE_BOOTS);
+  CHECK_EQ(Boots, NO_AT_REPROBE_BOOTS);
+  CHECK_EQ(HC05_LoadRecord(), STORE_TAG_NO_AT | DEFAULT_BAUD);
+  CHECK_EQ(gErases, 0);
+
+  // KEY wired since, the next probe finds the module
+  gModule.IsKeyWired = true;
+  for(Boots = 0; Boots < NO_AT_REPROBE_BOOTS; Boots++) Boot(&Ms);
+  CHECK_EQ(gUart.Init.BaudRate, 460800);
+  CHECK_EQ(HC05_LoadRecord(), STORE_TAG_RATE | 460800);
+
+  // a saved rate the unwired module can't confirm falls back too
+  Reset(460800, false);
+  gStore[0] = STORE_TAG_RATE | 115200;
+  CHECK_EQ(Boot(&Ms), DEFAULT_BAUD);
+  CHECK_EQ(gErases, 0);
+  CHECK_EQ(gStore[1], STORE_TAG_FAILED | (1 << STORE_COUNT_SHIFT) | DEFAULT_BAUD);
+  CHECK_EQ(gStore[2], STORE_ERASED);
+}
+
+// a module that was slow to answer once isn't given up
+static void
+TestFailureThenAnswer(void)
+{
+  uint32_t Ms;
+
+  Reset(230400, false);
+  CHECK_EQ(Boot(&Ms), DEFAULT_BAUD);
+  gModule.IsKeyWired = true;
+  CHECK_EQ(Boot(&Ms), 230400);
+  CHECK_EQ(HC05_LoadRecord(), STORE_TAG_RATE | 230400);
+}
+
+// a full store isn't erased by the boot, the main loop erases it then
+// adds the record
+static void
+TestStoreFull(void)
+{
+  uint32_t Ms;
+
+  Reset(460800, true);
+  for(uint32_t i = 0; i < STORE_SIZE / 4; i++) gStore[i] = 0;
+  CHECK_EQ(Boot(&Ms), 460800);
+  CHECK_EQ(gErases, 0);
+  CHECK_EQ(gStore[STORE_SIZE / 4 - 1], 0);
+
+  HC05_FlushBaudStore();
+  CHECK_EQ(gErases, 1);
+  CHECK_EQ(gStore[0], STORE_TAG_RATE | 460800);
+  CHECK_EQ(gStore[1], STORE_ERASED);
+  HC05_FlushBaudStore();
+  CHECK_EQ(gErases, 1);
+}
+
+int
+main(void)
+{
+  gStore = mmap((void*)STORE_ADDR, STORE_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if(gStore != (uint32_t*)STORE_ADDR)
+    {
+      printf("%s: the store can't be mapped at 0x%08lX\n", __FILE__, STORE_ADDR);
+      return 1;
+    }
+
+  TestNegotiateThenCheck();
+  TestModuleReplaced();
+  TestKeyNotWired();
+  TestFailureThenAnswer();
+  TestStoreFull();
+  return TEST_RESULT();
+}
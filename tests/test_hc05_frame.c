@@ -0,0 +1,140 @@
+/**
+ * @file test_hc05_frame.c
+ * @brief Host tests of the binary framing: the CRC-16 against its check
+ * value, frames of every length through encode and decode, and the frames
+ * the decoder must refuse.
+ */
+
+#include "../src/Modules/hc-05/hc-05_frame.c"
+
+#include "host.h"
+
+#define FRAME_MAX_SIZE (255 + HC05_FRAME_OVERHEAD)
+
+//---------------------------------------------------------------------------//
+//helpers
+static uint32_t gSeed = 1;
+
+static uint8_t
+Random(void)
+{
+  gSeed = gSeed * 1103515245U + 12345U;
+  return (uint8_t)(gSeed >> 16);
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// CRC-16/CCITT-FALSE of "123456789" is 0x29B1
+static void
+TestCrc16(void)
+{
+  CHECK_EQ(HC05Frame_Crc16((const uint8_t*)"123456789", 9), 0x29B1);
+  CHECK_EQ(HC05Frame_Crc16(NULL, 0), CRC16_INIT);
+}
+
+// the bytes of a known frame, a VOLUME 50 request
+static void
+TestEncodeLayout(void)
+{
+  static const uint8_t Expected[] = {HC05_FRAME_SYNC, 2, 7, HC05_OP_VOLUME, 50, 0, 0};
+  const uint8_t Payload[] = {HC05_OP_VOLUME, 50};
+  uint8_t Frame[FRAME_MAX_SIZE];
+  uint16_t Crc = HC05Frame_Crc16(&Expected[1], 4);
+
+  CHECK_EQ(HC05Frame_Encode(Frame, 7, Payload, sizeof(Payload)), sizeof(Expected));
+  CHECK(memcmp(Frame, Expected, 5) == 0);
+  CHECK_EQ(Frame[5], Crc & 0xFF);
+  CHECK_EQ(Frame[6], Crc >> 8);
+}
+
+// every payload length comes back as it was sent
+static void
+TestRoundTrip(void)
+{
+  uint8_t Payload[255];
+  uint8_t Frame[FRAME_MAX_SIZE];
+
+  for(uint16_t Len = 0; Len <= 255; Len++)
+    {
+      const uint8_t* Out;
+      uint8_t OutLen;
+      uint8_t Seq;
+      uint16_t Size;
+
+      for(uint16_t i = 0; i < Len; i++) Payload[i] = Random();
+      Size = HC05Frame_Encode(Frame, (uint8_t)Len, Payload, (uint8_t)Len);
+      CHECK_EQ(Size, Len + HC05_FRAME_OVERHEAD);
+      CHECK(HC05Frame_Decode(Frame, Size, &Seq, &Out, &OutLen));
+      CHECK_EQ(Seq, (uint8_t)Len);
+      CHECK_EQ(OutLen, Len);
+      CHECK(Out == &Frame[HC05_FRAME_HEADER_SIZE]);
+      CHECK(memcmp(Out, Payload, Len) == 0);
+    }
+}
+
+// a flipped bit anywhere, a wrong size or a wrong sync is refused
+static void
+TestDecodeRefuses(void)
+{
+  uint8_t Payload[40];
+  uint8_t Frame[FRAME_MAX_SIZE];
+  const uint8_t* Out;
+  uint8_t OutLen;
+  uint8_t Seq;
+  uint16_t Size;
+  uint32_t Accepted = 0;
+
+  for(uint16_t i = 0; i < sizeof(Payload); i++) Payload[i] = Random();
+  Size = HC05Frame_Encode(Frame, 9, Payload, sizeof(Payload));
+
+  for(uint16_t Bit = 0; Bit < Size * 8; Bit++)
+    {
+      Frame[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+      if(HC05Frame_Decode(Frame, Size, &Seq, &Out, &OutLen)) Accepted++;
+      Frame[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+    }
+  CHECK_EQ(Accepted, 0);
+
+  CHECK(HC05Frame_Decode(Frame, Size, &Seq, &Out, &OutLen));
+  CHECK(!HC05Frame_Decode(Frame, Size - 1, &Seq, &Out, &OutLen));
+  CHECK(!HC05Frame_Decode(Frame, Size + 1, &Seq, &Out, &OutLen));
+  CHECK(!HC05Frame_Decode(Frame, HC05_FRAME_OVERHEAD - 1, &Seq, &Out, &OutLen));
+  CHECK(!HC05Frame_Decode(Frame, 0, &Seq, &Out, &OutLen));
+}
+
+static void
+TestFields(void)
+{
+  uint8_t Data[4];
+
+  HC05Frame_PutU16(Data, 0xBEEF);
+  CHECK_EQ(Data[0], 0xEF);
+  CHECK_EQ(Data[1], 0xBE);
+  CHECK_EQ(HC05Frame_GetU16(Data), 0xBEEF);
+
+  HC05Frame_PutU32(Data, 0x12345678);
+  CHECK_EQ(Data[0], 0x78);
+  CHECK_EQ(Data[3], 0x12);
+  CHECK_EQ(HC05Frame_GetU32(Data), 0x12345678);
+  HC05Frame_PutU32(Data, 0xFFFFFFFF);
+  CHECK_EQ(HC05Frame_GetU32(Data), 0xFFFFFFFF);
+
+  CHECK_EQ(HC05Frame_ArgSize(HC05_OP_STATUS), 0);
+  CHECK_EQ(HC05Frame_ArgSize(HC05_OP_VOLUME), 1);
+  CHECK_EQ(HC05Frame_ArgSize(HC05_OP_TELEMETRY), 2);
+  CHECK_EQ(HC05Frame_ArgSize(HC05_OP_SEEK), 4);
+  CHECK_EQ(HC05Frame_ArgSize(0), HC05_FRAME_ARG_UNKNOWN);
+  CHECK_EQ(HC05Frame_ArgSize(HC05_OP_TELEMETRY + 1), HC05_FRAME_ARG_UNKNOWN);
+}
+
+int
+main(void)
+{
+  TestCrc16();
+  TestEncodeLayout();
+  TestRoundTrip();
+  TestDecodeRefuses();
+  TestFields();
+  return TEST_RESULT();
+}
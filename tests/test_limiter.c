@@ -0,0 +1,124 @@
+/**
+ * @file test_limiter.c
+ * @brief Host tests of the limiter: the sliding maximum of the deque
+ * against a brute-force one over the same window, and the output of a
+ * made up sine held below the ceiling.
+ */
+
+#include "../src/App/limiter.c"
+
+#include <stdlib.h>
+
+#include "host.h"
+
+#define RATE 44100
+#define SINE_FREQ 40
+#define SINE_PEAK 20000
+#define BLOCK_FRAMES 512
+#define TEST_FRAMES (RATE / 2)
+
+//---------------------------------------------------------------------------//
+//helpers
+static int16_t gSamples[2 * TEST_FRAMES];
+static uint32_t gPeaks[TEST_FRAMES];
+
+// a 40 Hz sine, the right channel a bit lower, with silence before it. A
+// period is 1100 frames, each half is a decreasing run longer than the delay
+static void
+MakeSine(uint32_t Silence)
+{
+  for(uint32_t i = 0; i < TEST_FRAMES; i++)
+    {
+      double x = (i < Silence) ? 0.0 : sin(2.0 * M_PI * SINE_FREQ * (i - Silence) / RATE);
+
+      gSamples[2 * i] = (int16_t)lrint(SINE_PEAK * x);
+      gSamples[2 * i + 1] = (int16_t)lrint(SINE_PEAK * 0.9 * x);
+    }
+}
+
+static void
+Start(uint32_t Makeup)
+{
+  Limiter_SetRate(RATE);
+  Limiter_SetCeiling(LIMITER_CEILING_DB10);
+  Limiter_SetCompressor(false, 0, 10);
+  Limiter_SetMakeup(Makeup);
+  Limiter_Reset();
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// the front of the deque is the largest linked peak of the frame coming
+// in and the LIMITER_DELAY before it, frame by frame
+static void
+TestSlidingMax(void)
+{
+  uint32_t Mismatches = 0;
+  uint16_t MaxSize = 0;
+
+  MakeSine(0);
+  Start(LIMITER_UNITY);
+  for(uint32_t i = 0; i < TEST_FRAMES; i++)
+    {
+      uint32_t Left = (uint32_t)abs(gSamples[2 * i]);
+      uint32_t Right = (uint32_t)abs(gSamples[2 * i + 1]);
+      uint32_t Max = 0;
+
+      gPeaks[i] = (Left > Right) ? Left : Right;
+      for(uint32_t j = (i > LIMITER_DELAY) ? i - LIMITER_DELAY : 0; j <= i; j++)
+        {
+          if(gPeaks[j] > Max) Max = gPeaks[j];
+        }
+
+      Limiter_Process(&gSamples[2 * i], 1);
+      if(gDequePeak[gDequeFront] != Max) Mismatches++;
+      if(gDequeSize > MaxSize) MaxSize = gDequeSize;
+    }
+  CHECK_EQ(Mismatches, 0);
+  CHECK_EQ(MaxSize, LIMITER_DELAY + 1);
+}
+
+// a sine made up by 6 dB stays below the ceiling, from its first peak
+// out of silence on, and comes out delayed
+static void
+TestCeiling(void)
+{
+  int32_t Ceiling = (int32_t)(32768.0 * pow(10.0, LIMITER_CEILING_DB10 / 200.0));
+  int32_t Max = 0;
+  int16_t First;
+  LimiterStats_t Stats;
+
+  MakeSine(1000);
+  First = gSamples[2 * 1001];
+  Start(2 * LIMITER_UNITY);
+  for(uint32_t i = 0; i < TEST_FRAMES; i += BLOCK_FRAMES)
+    {
+      uint32_t Frames = (TEST_FRAMES - i < BLOCK_FRAMES) ? TEST_FRAMES - i : BLOCK_FRAMES;
+
+      Limiter_Process(&gSamples[2 * i], Frames);
+    }
+
+  for(uint32_t i = 0; i < TEST_FRAMES; i++)
+    {
+      if(abs(gSamples[2 * i]) > Max) Max = abs(gSamples[2 * i]);
+      if(abs(gSamples[2 * i + 1]) > Max) Max = abs(gSamples[2 * i + 1]);
+    }
+  CHECK(Max <= Ceiling);
+  CHECK(Max > Ceiling * 95 / 100);
+  CHECK_EQ(gSamples[2 * (1000 + LIMITER_DELAY)], 0);
+  CHECK(gSamples[2 * (1001 + LIMITER_DELAY)] != 0);
+  CHECK(abs(gSamples[2 * (1001 + LIMITER_DELAY)]) <= 2 * abs(First));
+
+  Limiter_GetStats(&Stats);
+  CHECK(Stats.MinGain < LIMITER_UNITY * 80 / 100);
+  CHECK(Stats.LimitedFrames > 0);
+}
+
+int
+main(void)
+{
+  TestSlidingMax();
+  TestCeiling();
+  return TEST_RESULT();
+}
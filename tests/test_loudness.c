@@ -0,0 +1,145 @@
+/**
+ * @file test_loudness.c
+ * @brief Host tests of the BS.1770 loudness against the levels of the
+ * standard: a full-scale 997 Hz sine in one channel measures -3.0 LUFS and
+ * in both 0.0 LUFS, a quiet section under the relative gate and silence
+ * under the absolute one don't lower the measure, and a measure in chunks
+ * gives the same level as in one piece.
+ */
+
+#include "../src/App/loudness.c"
+
+#include <stdlib.h>
+
+#include "host.h"
+
+#define RATE 48000
+#define TONE_HZ 997.0
+#define CHUNK_FRAMES 512 // a half buffer of the player
+#define TOLERANCE_DB10 1 // 0.1 LU
+#define TEST_MAX_FRAMES (20 * RATE)
+
+//---------------------------------------------------------------------------//
+//helpers
+static int16_t gSamples[2 * TEST_MAX_FRAMES];
+
+// a tone of Frames at a level in dBFS from the frame First on, each
+// channel on or off
+static void
+MakeTone(uint32_t First, uint32_t Frames, double Dbfs, bool IsLeft, bool IsRight)
+{
+  double Peak = 32767.0 * pow(10.0, Dbfs / 20.0);
+
+  for(uint32_t i = First; i < First + Frames; i++)
+    {
+      int16_t x = (int16_t)lrint(Peak * sin(2.0 * M_PI * TONE_HZ * i / RATE));
+
+      gSamples[2 * i] = IsLeft ? x : 0;
+      gSamples[2 * i + 1] = IsRight ? x : 0;
+    }
+}
+
+static void
+MakeSilence(uint32_t First, uint32_t Frames)
+{
+  memset(&gSamples[2 * First], 0, Frames * 2 * sizeof(int16_t));
+}
+
+// the loudness of the frames, measured in chunks
+static bool
+Measure(uint32_t Frames, uint32_t Chunk, int16_t* Lufs, int16_t* Peak)
+{
+  Loudness_Begin(RATE);
+  for(uint32_t i = 0; i < Frames; i += Chunk)
+    {
+      Loudness_Process(&gSamples[2 * i], (Frames - i < Chunk) ? Frames - i : Chunk);
+    }
+  return Loudness_End(Lufs, Peak);
+}
+
+static void
+CheckLufs(int16_t Lufs, int16_t Expected, const char* What)
+{
+  if(abs(Lufs - Expected) > TOLERANCE_DB10)
+    {
+      printf("%s: %s at %.1f LUFS, expected %.1f LUFS\n", __FILE__, What, Lufs / 10.0,
+             Expected / 10.0);
+      gTestFailures++;
+    }
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// the reference levels of the standard
+static void
+TestFullScaleSine(void)
+{
+  int16_t Lufs;
+  int16_t Peak;
+
+  MakeTone(0, 10 * RATE, 0.0, true, false);
+  CHECK(Measure(10 * RATE, CHUNK_FRAMES, &Lufs, &Peak));
+  CheckLufs(Lufs, -30, "997 Hz, 0 dBFS, left");
+  CHECK_EQ(Peak, 0);
+
+  MakeTone(0, 10 * RATE, 0.0, true, true);
+  CHECK(Measure(10 * RATE, CHUNK_FRAMES, &Lufs, &Peak));
+  CheckLufs(Lufs, 0, "997 Hz, 0 dBFS, both");
+
+  MakeTone(0, 10 * RATE, -20.0, true, true);
+  CHECK(Measure(10 * RATE, CHUNK_FRAMES, &Lufs, &Peak));
+  CheckLufs(Lufs, -200, "997 Hz, -20 dBFS, both");
+  CHECK_EQ(Peak, -200);
+}
+
+// 10 s at -20 dBFS then 10 s at -40 dBFS: the quiet blocks are under the
+// relative gate, they'd pull an ungated mean 3 LU down. Silence is under
+// the absolute gate, and a track of silence only has no level.
+static void
+TestGates(void)
+{
+  int16_t Lufs;
+  int16_t Peak;
+
+  MakeTone(0, 10 * RATE, -20.0, true, true);
+  MakeTone(10 * RATE, 10 * RATE, -40.0, true, true);
+  CHECK(Measure(20 * RATE, CHUNK_FRAMES, &Lufs, &Peak));
+  CheckLufs(Lufs, -200, "-20 dBFS then -40 dBFS");
+
+  MakeSilence(10 * RATE, 10 * RATE);
+  CHECK(Measure(20 * RATE, CHUNK_FRAMES, &Lufs, &Peak));
+  CheckLufs(Lufs, -200, "-20 dBFS then silence");
+
+  MakeSilence(0, 20 * RATE);
+  CHECK(!Measure(20 * RATE, CHUNK_FRAMES, &Lufs, &Peak));
+  CHECK_EQ(Peak, INT16_MIN);
+}
+
+// the state carries over the chunks, any even chunk gives the same level
+static void
+TestChunks(void)
+{
+  static const uint32_t Chunks[] = {2, 256, 4410, 10 * RATE};
+  int16_t Whole;
+  int16_t Lufs;
+  int16_t Peak;
+
+  MakeTone(0, 5 * RATE, -10.0, true, false);
+  MakeTone(5 * RATE, 5 * RATE, -25.0, true, true);
+  CHECK(Measure(10 * RATE, 20 * RATE, &Whole, &Peak));
+  for(uint8_t c = 0; c < sizeof(Chunks) / sizeof(Chunks[0]); c++)
+    {
+      CHECK(Measure(10 * RATE, Chunks[c], &Lufs, &Peak));
+      CHECK_EQ(Lufs, Whole);
+    }
+}
+
+int
+main(void)
+{
+  TestFullScaleSine();
+  TestGates();
+  TestChunks();
+  return TEST_RESULT();
+}
@@ -0,0 +1,203 @@
+/**
+ * @file test_stretch.c
+ * @brief Host harness of the time-stretch, fed the way the player feeds it:
+ * the read-ahead asked for each half buffer, then the half made. A sine
+ * is stretched at the speeds of the range, the output is checked for its
+ * length, its pitch and jumps at the overlaps.
+ *   test_stretch bench  prints the cost per output frame at each speed
+ */
+
+#include "../src/App/stretch.c"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "host.h"
+
+#define RATE 44100
+#define SINE_FREQ 220.0
+#define SINE_PEAK 12000
+#define HALF_FRAMES 512 // of the DMA buffer
+#define IN_FRAMES (2 * RATE)
+#define OUT_FRAMES_MAX (2 * IN_FRAMES + 4 * HALF_FRAMES)
+
+//---------------------------------------------------------------------------//
+//helpers
+typedef struct {
+  uint32_t OutFrames;
+  uint32_t ShortHalves; // halves made short with input left to read
+  uint64_t Ns;
+} Run_t;
+
+static int16_t gIn[IN_FRAMES][2];
+static int16_t gOutput[OUT_FRAMES_MAX][2];
+
+static void
+MakeSine(void)
+{
+  for(uint32_t i = 0; i < IN_FRAMES; i++)
+    {
+      double x = SINE_PEAK * sin(2.0 * M_PI * SINE_FREQ * i / RATE);
+
+      gIn[i][0] = (int16_t)lrint(x);
+      gIn[i][1] = (int16_t)lrint(0.5 * x);
+    }
+}
+
+// play the whole input at a speed, a half at a time
+static void
+Play(uint16_t Speed, Run_t* Run)
+{
+  uint32_t Read = 0;
+  uint64_t Start;
+
+  memset(Run, 0, sizeof(Run_t));
+  CHECK(Stretch_SetSpeed(Speed));
+  Stretch_Reset();
+
+  while(!Stretch_IsDrained() && Run->OutFrames + HALF_FRAMES <= OUT_FRAMES_MAX)
+    {
+      int16_t* Buf;
+      uint32_t Space;
+      uint32_t Made;
+
+      while((Space = Stretch_GetSpace(&Buf, HALF_FRAMES)) > 0)
+        {
+          uint32_t Len = (Space < IN_FRAMES - Read) ? Space : IN_FRAMES - Read;
+
+          memcpy(Buf, gIn[Read], Len * sizeof(gIn[0]));
+          Stretch_Commit(Len);
+          Read += Len;
+          if(Len < Space) Stretch_End();
+        }
+
+      Start = Host_Ns();
+      Made = Stretch_Process(gOutput[Run->OutFrames], HALF_FRAMES);
+      Run->Ns += Host_Ns() - Start;
+      if(Made < HALF_FRAMES && Read < IN_FRAMES) Run->ShortHalves++;
+      Run->OutFrames += Made;
+      if(Made == 0) break;
+    }
+}
+
+// the largest step between frames of the left channel
+static int32_t
+MaxStep(const int16_t (*Frames)[2], uint32_t Num)
+{
+  int32_t Max = 0;
+
+  for(uint32_t i = 1; i < Num; i++)
+    {
+      int32_t Step = abs(Frames[i][0] - Frames[i - 1][0]);
+
+      if(Step > Max) Max = Step;
+    }
+  return Max;
+}
+
+// the frequency of the left channel from its rising zero crossings
+static double
+Frequency(const int16_t (*Frames)[2], uint32_t Num)
+{
+  uint32_t First = 0;
+  uint32_t Last = 0;
+  uint32_t Crossings = 0;
+
+  for(uint32_t i = 1; i < Num; i++)
+    {
+      if(Frames[i - 1][0] < 0 && Frames[i][0] >= 0)
+        {
+          if(Crossings == 0) First = i;
+          Last = i;
+          Crossings++;
+        }
+    }
+  if(Crossings < 2) return 0.0;
+  return (double)RATE * (Crossings - 1) / (Last - First);
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// at the unity speed the segments line up on the input, it comes out as is
+static void
+TestUnity(void)
+{
+  Run_t Run;
+
+  Play(STRETCH_UNITY, &Run);
+  CHECK_EQ(Run.ShortHalves, 0);
+  CHECK(Run.OutFrames >= IN_FRAMES);
+  CHECK(memcmp(gOutput, gIn, sizeof(gIn)) == 0);
+}
+
+// the output takes the input over the speed, keeps the pitch and has no
+// step larger than the sine's own at the overlaps
+static void
+TestSpeeds(void)
+{
+  static const uint16_t Speeds[] = {STRETCH_SPEED_MIN, 75, 125, 150, STRETCH_SPEED_MAX};
+  int32_t InStep = MaxStep((const int16_t (*)[2])gIn, IN_FRAMES);
+
+  for(uint8_t s = 0; s < sizeof(Speeds) / sizeof(Speeds[0]); s++)
+    {
+      uint32_t Expected = IN_FRAMES * STRETCH_UNITY / Speeds[s];
+      uint32_t Steady = Expected - 2 * STRETCH_HOP;
+      StretchStats_t Stats;
+      Run_t Run;
+
+      Play(Speeds[s], &Run);
+      CHECK(Stretch_IsDrained());
+      CHECK_EQ(Run.ShortHalves, 0);
+      if(abs((int32_t)Run.OutFrames - (int32_t)Expected) > 2 * STRETCH_HOP)
+        {
+          printf("%s: %u%% made %u frames, expected %u\n", __FILE__, Speeds[s],
+                 Run.OutFrames, Expected);
+          gTestFailures++;
+        }
+      if(MaxStep((const int16_t (*)[2])gOutput, Steady) > InStep * 11 / 10)
+        {
+          printf("%s: %u%% has a step of %d, the sine %d\n", __FILE__, Speeds[s],
+                 MaxStep((const int16_t (*)[2])gOutput, Steady), InStep);
+          gTestFailures++;
+        }
+      CHECK(fabs(Frequency((const int16_t (*)[2])gOutput, Steady) - SINE_FREQ) < SINE_FREQ / 100);
+
+      Stretch_GetStats(&Stats);
+      CHECK_EQ(Stats.Speed, Speeds[s]);
+      CHECK(Stats.CyclesPerFrame10 > 0);
+      CHECK(Stats.Steps >= Run.OutFrames / STRETCH_HOP);
+      CHECK(Stats.ReadAhead >= STRETCH_SEEK + 2 * STRETCH_HOP + STRETCH_HOP * Speeds[s] / STRETCH_UNITY);
+    }
+}
+
+// cost per output frame, in host ns, at each speed
+static void
+Bench(void)
+{
+  static const uint16_t Speeds[] = {STRETCH_SPEED_MIN, 75, STRETCH_UNITY, 125, 150, STRETCH_SPEED_MAX};
+
+  for(uint8_t s = 0; s < sizeof(Speeds) / sizeof(Speeds[0]); s++)
+    {
+      Run_t Run;
+
+      Play(Speeds[s], &Run);
+      printf("stretch: %3u%% %.1f ns per output frame on the host\n",
+             Speeds[s], (double)Run.Ns / Run.OutFrames);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+  MakeSine();
+  if(Host_IsBench(argc, argv))
+    {
+      Bench();
+      return 0;
+    }
+
+  TestUnity();
+  TestSpeeds();
+  return TEST_RESULT();
+}
@@ -0,0 +1,339 @@
+/**
+ * @file test_wav_decode.c
+ * @brief Host conformance tests of the WAV decoders against the decodes of
+ * libsndfile in data/ (made by data/make_fixtures.py): IMA ADPCM, A-law and
+ * u-law, mono and stereo, decoded whole in odd pieces and from seeks to
+ * any frame through its block. The G.711 tables are checked against the
+ * reference expansion of every code.
+ *   test_wav_decode bench  prints the decode throughput of each format
+ */
+
+#include "../src/App/wav_decode.c"
+
+#include <stdlib.h>
+
+#include "host.h"
+
+#define FIXTURE_MAX_SIZE 65536
+#define SEEK_FRAMES 64
+
+//---------------------------------------------------------------------------//
+//helpers
+typedef struct {
+  const char* Name;
+  uint16_t Tag;
+  uint16_t Channels;
+} Fixture_t;
+
+typedef struct {
+  WavFormat_t Format;
+  WavDecoder_t Decoder;
+  const uint8_t* Data;
+  uint32_t DataSize;
+  const int16_t* Ref; // stereo
+  uint32_t RefFrames;
+} Stream_t;
+
+static const Fixture_t gFixtures[] = {
+  {"ima_mono", WAV_FORMAT_IMA_ADPCM, 1},
+  {"ima_stereo", WAV_FORMAT_IMA_ADPCM, 2},
+  {"alaw_mono", WAV_FORMAT_ALAW, 1},
+  {"alaw_stereo", WAV_FORMAT_ALAW, 2},
+  {"ulaw_mono", WAV_FORMAT_MULAW, 1},
+  {"ulaw_stereo", WAV_FORMAT_MULAW, 2},
+};
+
+static uint8_t gWav[FIXTURE_MAX_SIZE];
+static int16_t gRef[FIXTURE_MAX_SIZE];
+static int16_t gOut[2 * SEEK_FRAMES];
+
+static uint32_t
+ReadFile(const char* Name, const char* Ext, void* Buf)
+{
+  char Path[64];
+  FILE* File;
+  size_t Len;
+
+  snprintf(Path, sizeof(Path), "data/%s.%s", Name, Ext);
+  File = fopen(Path, "rb");
+  if(File == NULL)
+    {
+      printf("%s: %s is missing\n", __FILE__, Path);
+      gTestFailures++;
+      return 0;
+    }
+  Len = fread(Buf, 1, FIXTURE_MAX_SIZE, File);
+  fclose(File);
+  return (uint32_t)Len;
+}
+
+// a chunk of the RIFF file, NULL when there's none
+static const uint8_t*
+FindChunk(const uint8_t* Wav, uint32_t Len, uint32_t Id, uint32_t* Size)
+{
+  uint32_t Ofs = 12;
+
+  while(Ofs + 8 <= Len)
+    {
+      uint32_t ChunkId = Wav[Ofs] | (Wav[Ofs + 1] << 8) | (Wav[Ofs + 2] << 16) |
+          ((uint32_t)Wav[Ofs + 3] << 24);
+
+      *Size = Wav[Ofs + 4] | (Wav[Ofs + 5] << 8) | (Wav[Ofs + 6] << 16) |
+          ((uint32_t)Wav[Ofs + 7] << 24);
+      if(ChunkId == Id) return &Wav[Ofs + 8];
+      Ofs += 8 + *Size + (*Size & 1);
+    }
+  return NULL;
+}
+
+static bool
+Open(const Fixture_t* Fixture, Stream_t* Stream)
+{
+  uint32_t WavLen = ReadFile(Fixture->Name, "wav", gWav);
+  uint32_t RefLen = ReadFile(Fixture->Name, "raw", gRef);
+  const uint8_t* Fmt;
+  uint32_t FmtSize;
+
+  memset(Stream, 0, sizeof(Stream_t));
+  if(WavLen == 0 || RefLen == 0) return false;
+
+  Fmt = FindChunk(gWav, WavLen, WAV_CHUNK_ID('f', 'm', 't', ' '), &FmtSize);
+  Stream->Data = FindChunk(gWav, WavLen, WAV_CHUNK_ID('d', 'a', 't', 'a'), &Stream->DataSize);
+  CHECK(Fmt != NULL && Stream->Data != NULL);
+  if(Fmt == NULL || Stream->Data == NULL) return false;
+
+  CHECK(WavDecode_ParseFmt(&Stream->Format, Fmt,
+                           (FmtSize < WAV_DECODE_FMT_SIZE) ? FmtSize : WAV_DECODE_FMT_SIZE));
+  CHECK_EQ(Stream->Format.Tag, Fixture->Tag);
+  CHECK_EQ(Stream->Format.Channels, Fixture->Channels);
+  CHECK(!WavDecode_IsNative(&Stream->Format));
+  CHECK(WavDecode_Init(&Stream->Decoder, &Stream->Format));
+  Stream->Ref = gRef;
+  Stream->RefFrames = RefLen / 4;
+  return true;
+}
+
+// decode from a frame on, loading the blocks as the player does
+static uint32_t
+Decode(Stream_t* Stream, uint32_t First, int16_t* Out, uint32_t Frames, uint32_t Piece)
+{
+  WavDecoder_t* Decoder = &Stream->Decoder;
+  uint32_t Block = First / Decoder->BlockFrames;
+  uint32_t Made = 0;
+  uint32_t Skip = First % Decoder->BlockFrames;
+
+  while(Made < Frames)
+    {
+      uint32_t Ofs = Block * Decoder->BlockBytes;
+      uint32_t Len;
+      uint32_t Step;
+
+      if(Ofs >= Stream->DataSize) break;
+      Len = Stream->DataSize - Ofs;
+      if(Len > Decoder->BlockBytes) Len = Decoder->BlockBytes;
+      WavDecode_Load(Decoder, &Stream->Data[Ofs], Len);
+      if(Skip)
+        {
+          CHECK_EQ(WavDecode_Run(Decoder, NULL, Skip), Skip);
+          Skip = 0;
+        }
+      do
+        {
+          uint32_t Want = (Frames - Made < Piece) ? Frames - Made : Piece;
+
+          Step = WavDecode_Run(Decoder, Out ? &Out[2 * Made] : NULL, Want);
+          Made += Step;
+        }
+      while(Step && Made < Frames);
+      Block++;
+    }
+  return Made;
+}
+
+// the frames that differ from the reference
+static uint32_t
+Mismatches(const Stream_t* Stream, uint32_t First, const int16_t* Out, uint32_t Frames)
+{
+  uint32_t Count = 0;
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      if(memcmp(&Out[2 * i], &Stream->Ref[2 * (First + i)], 4) != 0) Count++;
+    }
+  return Count;
+}
+
+// the expansions of ITU-T G.711, as in its reference code
+static int16_t
+Alaw2Linear(uint8_t Code)
+{
+  int16_t t;
+  int16_t Seg;
+
+  Code ^= 0x55;
+  t = (Code & 0x0F) << 4;
+  Seg = (Code & 0x70) >> 4;
+  switch(Seg)
+  {
+    case 0:
+      t += 8;
+      break;
+    case 1:
+      t += 0x108;
+      break;
+    default:
+      t += 0x108;
+      t <<= Seg - 1;
+  }
+  return (Code & 0x80) ? t : -t;
+}
+
+static int16_t
+Ulaw2Linear(uint8_t Code)
+{
+  int16_t t;
+
+  Code = ~Code;
+  t = ((Code & 0x0F) << 3) + 0x84;
+  t <<= (Code & 0x70) >> 4;
+  return (Code & 0x80) ? (0x84 - t) : (t - 0x84);
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// every code of both laws, and the ends of the scales
+static void
+TestG711Tables(void)
+{
+  uint32_t Wrong = 0;
+
+  if(!gIsBuilt) WavDecode_Build();
+  for(uint16_t Code = 0; Code < 256; Code++)
+    {
+      if(gAlaw[Code] != Alaw2Linear((uint8_t)Code)) Wrong++;
+      if(gMulaw[Code] != Ulaw2Linear((uint8_t)Code)) Wrong++;
+    }
+  CHECK_EQ(Wrong, 0);
+  CHECK_EQ(gAlaw[0xD5], 8);
+  CHECK_EQ(gAlaw[0x2A], -32256);
+  CHECK_EQ(gMulaw[0xFF], 0);
+  CHECK_EQ(gMulaw[0x00], -32124);
+  CHECK_EQ(gMulaw[0x80], 32124);
+}
+
+// each file decodes to the reference, in pieces that don't divide a block
+static void
+TestConformance(void)
+{
+  static const uint32_t Pieces[] = {1, 7, 100, WAV_DECODE_MAX_BLOCK};
+
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      Stream_t Stream;
+      uint32_t Frames;
+
+      if(!Open(&gFixtures[f], &Stream)) continue;
+      Frames = WavDecode_GetFrames(&Stream.Decoder, Stream.DataSize);
+      CHECK_EQ(Frames, Stream.RefFrames);
+
+      for(uint8_t p = 0; p < sizeof(Pieces) / sizeof(Pieces[0]); p++)
+        {
+          static int16_t Out[2 * FIXTURE_MAX_SIZE];
+          uint32_t Wrong;
+
+          CHECK_EQ(Decode(&Stream, 0, Out, Frames, Pieces[p]), Frames);
+          Wrong = Mismatches(&Stream, 0, Out, Frames);
+          if(Wrong)
+            {
+              printf("%s: %s in pieces of %u: %u of %u frames differ\n", __FILE__,
+                     gFixtures[f].Name, Pieces[p], Wrong, Frames);
+              gTestFailures++;
+            }
+        }
+    }
+}
+
+// a seek lands on any frame through the start of its block, around the
+// block edges and at the end of the data
+static void
+TestSeek(void)
+{
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      Stream_t Stream;
+      uint32_t Frames;
+      uint32_t Block;
+      uint32_t Targets[12];
+      uint32_t Wrong = 0;
+
+      if(!Open(&gFixtures[f], &Stream)) continue;
+      Frames = WavDecode_GetFrames(&Stream.Decoder, Stream.DataSize);
+      Block = Stream.Decoder.BlockFrames;
+      Targets[0] = 0;
+      Targets[1] = 1;
+      Targets[2] = Block - 1;
+      Targets[3] = Block;
+      Targets[4] = Block + 1;
+      Targets[5] = 2 * Block + Block / 2 + 3;
+      Targets[6] = Frames - SEEK_FRAMES;
+      Targets[7] = Frames - 1;
+      for(uint8_t i = 8; i < 12; i++) Targets[i] = (uint32_t)rand() % Frames;
+
+      for(uint8_t i = 0; i < 12; i++)
+        {
+          uint32_t Want = (Frames - Targets[i] < SEEK_FRAMES) ? Frames - Targets[i] : SEEK_FRAMES;
+
+          if(Targets[i] >= Frames) continue;
+          CHECK_EQ(Decode(&Stream, Targets[i], gOut, Want, SEEK_FRAMES), Want);
+          Wrong += Mismatches(&Stream, Targets[i], gOut, Want);
+        }
+      if(Wrong)
+        {
+          printf("%s: %s: %u frames after the seeks differ\n", __FILE__, gFixtures[f].Name, Wrong);
+          gTestFailures++;
+        }
+
+      // past the end there's nothing
+      CHECK_EQ(Decode(&Stream, Frames, gOut, SEEK_FRAMES, SEEK_FRAMES), 0);
+    }
+}
+
+// host throughput of each format, decoded in half buffers of 512 frames
+static void
+Bench(void)
+{
+  for(uint8_t f = 0; f < sizeof(gFixtures) / sizeof(gFixtures[0]); f++)
+    {
+      static int16_t Out[2 * FIXTURE_MAX_SIZE];
+      const uint32_t Runs = 200;
+      Stream_t Stream;
+      uint32_t Frames;
+      uint64_t Start;
+      uint64_t Ns;
+
+      if(!Open(&gFixtures[f], &Stream)) continue;
+      Frames = WavDecode_GetFrames(&Stream.Decoder, Stream.DataSize);
+      Start = Host_Ns();
+      for(uint32_t r = 0; r < Runs; r++) Decode(&Stream, 0, Out, Frames, 512);
+      Ns = Host_Ns() - Start;
+      printf("wav_decode: %-11s %.2f ns per frame, %.1f MB/s of input on the host\n",
+             gFixtures[f].Name, (double)Ns / ((double)Runs * Frames),
+             (double)Runs * Stream.DataSize * 1000.0 / Ns);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+  if(Host_IsBench(argc, argv))
+    {
+      Bench();
+      return 0;
+    }
+
+  TestG711Tables();
+  TestConformance();
+  TestSeek();
+  return TEST_RESULT();
+}
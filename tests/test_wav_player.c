@@ -0,0 +1,649 @@
+/**
+ * @file test_wav_player.c
+ * @brief Host tests of the player over RAM disks formatted as exFAT and
+ * FAT: the contiguous file detection of the raw sector streaming, the
+ * codec and track state around a drive change, and the refill reads
+ * failed by the RAM disk: the retries, their back-off and the
+ * concealment of a half they couldn't fill. The loudness scan of a track
+ * is suspended by a track opened for playing and resumes.
+ */
+
+#include "../src/App/wav_player.c"
+
+#include <stdlib.h>
+
+#include "host.h"
+#include "ramdisk.h"
+#include "audio_stub.h"
+
+#define DISK_SECTORS 16384 // 8 MB
+#define CLUSTER 4096
+#define SCAN_MAX_CALLS 100000
+
+//---------------------------------------------------------------------------//
+//helpers
+static uint8_t
+Pattern(uint32_t Ofs)
+{
+  return (uint8_t)((Ofs * 2654435761U) >> 24);
+}
+
+static void
+WriteFile(FIL* File, uint32_t Ofs, uint32_t Len)
+{
+  uint8_t Buf[CLUSTER];
+  UINT Written;
+
+  while(Len)
+    {
+      UINT Count = (Len > sizeof(Buf)) ? sizeof(Buf) : Len;
+
+      for(UINT i = 0; i < Count; i++) Buf[i] = Pattern(Ofs + i);
+      CHECK(f_write(File, Buf, Count, &Written) == FR_OK && Written == Count);
+      Ofs += Count;
+      Len -= Count;
+    }
+}
+
+static void
+MakeContiguous(const char* Path, uint32_t Size)
+{
+  FIL File;
+
+  CHECK(f_open(&File, Path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  WriteFile(&File, 0, Size);
+  f_close(&File);
+}
+
+// two files written a cluster each in turn, the first one is in Pieces fragments
+static void
+MakeFragmented(const char* Path, const char* Other, uint32_t Pieces)
+{
+  FIL File;
+  FIL Filler;
+
+  CHECK(f_open(&File, Path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  CHECK(f_open(&Filler, Other, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  for(uint32_t i = 0; i < Pieces; i++)
+    {
+      WriteFile(&File, i * CLUSTER, CLUSTER);
+      f_sync(&File);
+      WriteFile(&Filler, i * CLUSTER, CLUSTER);
+      f_sync(&Filler);
+    }
+  f_close(&Filler);
+  f_close(&File);
+}
+
+// open a file as the playing one, map it and read it back in odd pieces
+static void
+PlayFile(const char* Path)
+{
+  static uint8_t Buf[3001];
+  FSIZE_t Size;
+  FSIZE_t Ofs = 0;
+  UINT Len;
+  UINT Read;
+
+  CHECK(f_open(&gWavFile, Path, FA_READ) == FR_OK);
+  WavPlayer_MapClusters();
+  Size = f_size(&gWavFile);
+
+  WavPlayer_SeekFile(0);
+  while(Ofs < Size)
+    {
+      Len = (Ofs % 2) ? 511 : sizeof(Buf);
+      CHECK(WavPlayer_ReadFile(Buf, Len, &Read) == FR_OK);
+      if(Read == 0) break;
+      for(UINT i = 0; i < Read; i++)
+        {
+          if(Buf[i] != Pattern((uint32_t)Ofs + i))
+            {
+              CHECK(Buf[i] == Pattern((uint32_t)Ofs + i));
+              return;
+            }
+        }
+      Ofs += Read;
+    }
+  CHECK_EQ(Ofs, Size);
+
+  // a seek into the middle of a sector
+  WavPlayer_SeekFile(Size / 2 + 3);
+  CHECK_EQ(WavPlayer_TellFile(), Size / 2 + 3);
+  CHECK(WavPlayer_ReadFile(Buf, 100, &Read) == FR_OK && Read == 100);
+  for(UINT i = 0; i < Read; i++) CHECK_EQ(Buf[i], Pattern((uint32_t)(Size / 2 + 3) + i));
+}
+
+// the header of a 16-bit stereo WAV file
+static void
+WriteHeader(FIL* File, uint32_t Frames, uint32_t Rate)
+{
+  uint8_t Header[44];
+  uint32_t DataSize = Frames * 4;
+  UINT Written;
+
+  memcpy(&Header[0], "RIFF", 4);
+  *(uint32_t*)&Header[4] = 36 + DataSize;
+  memcpy(&Header[8], "WAVEfmt ", 8);
+  *(uint32_t*)&Header[16] = 16;
+  *(uint16_t*)&Header[20] = 1;
+  *(uint16_t*)&Header[22] = 2;
+  *(uint32_t*)&Header[24] = Rate;
+  *(uint32_t*)&Header[28] = Rate * 4;
+  *(uint16_t*)&Header[32] = 4;
+  *(uint16_t*)&Header[34] = 16;
+  memcpy(&Header[36], "data", 4);
+  *(uint32_t*)&Header[40] = DataSize;
+  CHECK(f_write(File, Header, sizeof(Header), &Written) == FR_OK);
+}
+
+// a 16-bit stereo WAV file of a ramp, in fragments of a cluster when
+// another file is written in turn
+static void
+MakeWav(const char* Path, uint32_t Frames, uint32_t Rate, const char* Other)
+{
+  FIL File;
+  FIL Filler;
+  UINT Written;
+
+  CHECK(f_open(&File, Path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  WriteHeader(&File, Frames, Rate);
+  if(Other) CHECK(f_open(&Filler, Other, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      int16_t Frame[2] = {(int16_t)i, (int16_t)-i};
+
+      CHECK(f_write(&File, Frame, sizeof(Frame), &Written) == FR_OK);
+      if(Other && f_tell(&File) % CLUSTER == 0)
+        {
+          f_sync(&File);
+          WriteFile(&Filler, (uint32_t)f_tell(&File), CLUSTER);
+          f_sync(&Filler);
+        }
+    }
+  if(Other) f_close(&Filler);
+  f_close(&File);
+}
+
+// a 16-bit stereo WAV file of a 997 Hz tone at a level in dBFS, the second
+// half of it 10 dB lower
+static void
+MakeTone(const char* Path, uint32_t Frames, uint32_t Rate, double Dbfs)
+{
+  static int16_t Chunk[2 * 1024];
+  FIL File;
+  UINT Written;
+
+  CHECK(f_open(&File, Path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK);
+  WriteHeader(&File, Frames, Rate);
+  for(uint32_t i = 0; i < Frames; i += 1024)
+    {
+      uint32_t Len = (Frames - i < 1024) ? Frames - i : 1024;
+
+      for(uint32_t j = 0; j < Len; j++)
+        {
+          double Level = (i + j < Frames / 2) ? Dbfs : Dbfs - 10.0;
+          double x = 32767.0 * pow(10.0, Level / 20.0) * sin(2.0 * M_PI * 997.0 * (i + j) / Rate);
+
+          Chunk[2 * j] = (int16_t)lrint(x);
+          Chunk[2 * j + 1] = (int16_t)lrint(x);
+        }
+      CHECK(f_write(&File, Chunk, Len * 4, &Written) == FR_OK);
+    }
+  f_close(&File);
+}
+
+// a drive of Volumes LUNs with two tracks on each, the player on the first one
+static void
+StartPlayer(uint8_t Volumes)
+{
+  static WavPlayerConfig_t Config = {.Muted = false, .Vol = 50};
+  char Path[16];
+
+  for(uint8_t Vol = 0; Vol < Volumes; Vol++)
+    {
+      CHECK(RamDisk_Create(Vol, DISK_SECTORS, FM_EXFAT | FM_SFD, CLUSTER));
+      sprintf(Path, "%u:/a.wav", Vol);
+      MakeWav(Path, 20000, 44100, NULL);
+      sprintf(Path, "%u:/b.wav", Vol);
+      MakeWav(Path, 20000, 44100, NULL);
+    }
+  FATFS_MountVolumes(Volumes);
+  WavPlayer_Init(&Config);
+  WavPlayer_ChooseTheFirstAudioFile();
+  CHECK(gPlayerState != PLAYER_STATE_IDLE);
+}
+
+static void
+StopPlayer(uint8_t Volumes)
+{
+  WavPlayer_OnDisconnect();
+  f_close(&gWavFile);
+  gIsSnapshotValid = false;
+  for(uint8_t Vol = 0; Vol < Volumes; Vol++) RamDisk_Destroy(Vol);
+  FATFS_UnmountVolumes();
+}
+
+static DWORD
+FirstSector(void)
+{
+  FATFS* fs = gWavFile.obj.fs;
+
+  return fs->database + (gWavFile.obj.sclust - 2) * fs->csize;
+}
+
+// a track of the ramp on its own drive, played from the start
+static void
+OpenTrack(uint32_t Rate, bool IsFragmented, WavPlayerConceal_t Conceal)
+{
+  static WavPlayerConfig_t Config = {.Muted = false, .Vol = 50};
+
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_EXFAT | FM_SFD, CLUSTER));
+  MakeWav("0:/a.wav", 20000, Rate, IsFragmented ? "0:/b.bin" : NULL);
+  FATFS_MountVolumes(1);
+  Config.Conceal = Conceal;
+  WavPlayer_Init(&Config);
+  CHECK(WavPlayer_OpenAudioFile("0:/a.wav", STREAM_DATA_OFS));
+  CHECK_EQ(gIsRawStream, !IsFragmented);
+}
+
+// the frames of a half that are the ramp from the stream position
+static uint32_t
+RampFrames(const int16_t* Half, FSIZE_t Pos, uint32_t Frames)
+{
+  uint32_t First = (uint32_t)(Pos - STREAM_DATA_OFS) / FRAME_SIZE;
+  uint32_t Count = 0;
+
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      if(Half[2 * i] == (int16_t)(First + i) && Half[2 * i + 1] == (int16_t)-(First + i)) Count++;
+    }
+  return Count;
+}
+
+// the frames of a half from First on that don't fade from Left and Right
+static uint32_t
+CheckFade(const int16_t* Half, uint32_t First, int32_t Left, int32_t Right)
+{
+  const uint32_t Frames = (DMA_BUFFER_SIZE / 2) / FRAME_SIZE;
+  uint32_t Wrong = 0;
+
+  for(uint32_t i = First; i < Frames; i++)
+    {
+      int32_t Ramp = (i - First < CONCEAL_FADE_FRAMES) ? CONCEAL_FADE_FRAMES - 1 - (i - First) : 0;
+
+      if(Half[2 * i] != Left * Ramp / CONCEAL_FADE_FRAMES ||
+          Half[2 * i + 1] != Right * Ramp / CONCEAL_FADE_FRAMES)
+        {
+          Wrong++;
+        }
+    }
+  return Wrong;
+}
+
+// scan until the track is measured
+static uint32_t
+ScanTrack(uint16_t Track)
+{
+  Catalogue_t* Cat = WavPlayer_GetCatalogue();
+  uint32_t Calls = 0;
+
+  while(Cat->LufsDb10[Track] == LOUDNESS_UNKNOWN && Calls < SCAN_MAX_CALLS)
+    {
+      WavPlayer_Scan();
+      Calls++;
+    }
+  return Calls;
+}
+
+//---------------------------------------------------------------------------//
+//tests
+
+// an exFAT file written in one go has no FAT chain, stat 2
+static void
+TestExfatContiguous(void)
+{
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_EXFAT | FM_SFD, CLUSTER));
+  MakeContiguous("0:/a.wav", 300 * 1024 + 77);
+
+  PlayFile("0:/a.wav");
+  CHECK_EQ(gWavFile.obj.fs->fs_type, FS_EXFAT);
+  CHECK_EQ(gWavFile.obj.stat, 2);
+  CHECK(gIsRawStream);
+  CHECK(gWavFile.cltbl == NULL);
+  CHECK_EQ(gRawFirstSector, FirstSector());
+  f_close(&gWavFile);
+  RamDisk_Destroy(0);
+}
+
+// a FAT file in one piece has a link map of a single fragment
+static void
+TestFatSingleFragment(void)
+{
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_FAT | FM_SFD, CLUSTER));
+  MakeContiguous("0:/a.wav", 200 * 1024 + 5);
+
+  PlayFile("0:/a.wav");
+  CHECK(gWavFile.obj.fs->fs_type != FS_EXFAT);
+  CHECK(gIsRawStream);
+  CHECK_EQ(gClusterMap[0], 4);
+  CHECK_EQ(gRawFirstSector, FirstSector());
+  f_close(&gWavFile);
+  RamDisk_Destroy(0);
+}
+
+// a fragmented exFAT file is read through f_read with the link map
+static void
+TestExfatFragmented(void)
+{
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_EXFAT | FM_SFD, CLUSTER));
+  MakeFragmented("0:/a.wav", "0:/b.bin", 8);
+
+  PlayFile("0:/a.wav");
+  CHECK(gWavFile.obj.stat != 2);
+  CHECK(!gIsRawStream);
+  CHECK(gWavFile.cltbl == gClusterMap);
+  CHECK_EQ(gClusterMap[0], 1 + 8 * 2 + 1);
+  f_close(&gWavFile);
+  RamDisk_Destroy(0);
+}
+
+// more fragments than the map holds, the FAT chain is followed
+static void
+TestFatTooFragmented(void)
+{
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_FAT | FM_SFD, CLUSTER));
+  MakeFragmented("0:/a.wav", "0:/b.bin", CLUSTER_MAP_SIZE);
+
+  PlayFile("0:/a.wav");
+  CHECK(!gIsRawStream);
+  CHECK(gWavFile.cltbl == NULL);
+  f_close(&gWavFile);
+  RamDisk_Destroy(0);
+}
+
+// the codec is powered down before MCLK stops, as on a track change
+static void
+TestDisconnectStopsCodecFirst(void)
+{
+  StartPlayer(1);
+  WavPlayer_Resume();
+  CHECK(gIsMclkOn);
+
+  Audio_ClearLog();
+  WavPlayer_OnDisconnect();
+  CHECK(!gIsMclkOn);
+  CHECK(strstr(gAudioLog, "CodecStop") != NULL);
+  CHECK(strstr(gAudioLog, "CodecStop") < strstr(gAudioLog, "I2sStop"));
+  CHECK_EQ(gCodecWritesWithoutMclk, 0);
+  CHECK_EQ(gPlayerState, PLAYER_STATE_IDLE);
+  StopPlayer(1);
+}
+
+// a file opened for reading on the stack seeks without touching the FAT
+static void
+TestExfatReadSeek(void)
+{
+  FIL File;
+
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_EXFAT, CLUSTER));
+  MakeFragmented("0:/a.wav", "0:/b.bin", 2);
+
+  memset(&File, 0xA5, sizeof(File));
+  CHECK(f_open(&File, "0:/a.wav", FA_READ) == FR_OK);
+  CHECK(f_lseek(&File, CLUSTER + 1) == FR_OK);
+  CHECK(f_lseek(&File, 0) == FR_OK);
+  CHECK_EQ(FATFS_GetVolume(0)->wflag, 0);
+  f_close(&File);
+  RamDisk_Destroy(0);
+}
+
+// a volume switch keeps the player stopped, paused or playing
+static void
+TestSwitchVolumeKeepsState(void)
+{
+  StartPlayer(2);
+  CHECK_EQ(gPlayerState, PLAYER_STATE_PAUSED);
+
+  WavPlayer_Stop();
+  CHECK_EQ(gPlayerState, PLAYER_STATE_READY);
+  Audio_ClearLog();
+  CHECK(WavPlayer_SwitchVolume(1));
+  CHECK_EQ(gVolume, 1);
+  CHECK_EQ(gTrack, 0);
+  CHECK_EQ(gPlayerState, PLAYER_STATE_READY);
+  CHECK(!gIsI2sRunning);
+  CHECK_EQ(CS43L22_GetPowerState(), CS43L22_POWER_OFF);
+
+  WavPlayer_Resume();
+  WavPlayer_Pause();
+  CHECK_EQ(gPlayerState, PLAYER_STATE_PAUSED);
+  CHECK(WavPlayer_SwitchVolume(0));
+  CHECK_EQ(gVolume, 0);
+  CHECK_EQ(gPlayerState, PLAYER_STATE_PAUSED);
+
+  WavPlayer_Resume();
+  CHECK(WavPlayer_SwitchVolume(1));
+  CHECK_EQ(gPlayerState, PLAYER_STATE_PLAYING);
+  CHECK(gIsI2sRunning);
+
+  // a volume that isn't mounted leaves the track alone
+  CHECK(!WavPlayer_SwitchVolume(2));
+  CHECK_EQ(gVolume, 1);
+  CHECK_EQ(gPlayerState, PLAYER_STATE_PLAYING);
+  StopPlayer(2);
+}
+
+// a read failing in the middle of a half is retried after 1 ms, through
+// the raw sector reads and through a file f_read failed on
+static void
+TestReadRetry(void)
+{
+  const uint32_t Frames = (DMA_BUFFER_SIZE / 2) / FRAME_SIZE;
+
+  for(uint8_t IsFragmented = 0; IsFragmented < 2; IsFragmented++)
+    {
+      static int16_t Half[DMA_BUFFER_SIZE / 4];
+      static int16_t Other[DMA_BUFFER_SIZE / 4];
+      WavPlayerReadStats_t Before;
+      WavPlayerReadStats_t After;
+      FSIZE_t Pos;
+      uint32_t Tick;
+
+      OpenTrack(44100, IsFragmented, WAV_PLAYER_CONCEAL_FADE);
+      WavPlayer_GetReadStats(&Before);
+      Pos = WavPlayer_TellSamples();
+      Tick = HAL_GetTick();
+      RamDisk_FailReadsAfter(0, 1, 1);
+      WavPlayer_RefillHalf((uint8_t*)Half, (uint8_t*)Other);
+      WavPlayer_GetReadStats(&After);
+
+      CHECK_EQ(RampFrames(Half, Pos, Frames), Frames);
+      CHECK_EQ(gFileReadBytesLen, DMA_BUFFER_SIZE / 2);
+      CHECK_EQ(After.Errors - Before.Errors, 1);
+      CHECK_EQ(After.Retries - Before.Retries, 1);
+      CHECK_EQ(After.Concealments, Before.Concealments);
+      CHECK_EQ(HAL_GetTick() - Tick, REFILL_FIRST_BACKOFF_MS);
+
+      // the file reads on from there
+      WavPlayer_RefillHalf((uint8_t*)Half, (uint8_t*)Other);
+      CHECK_EQ(RampFrames(Half, Pos + DMA_BUFFER_SIZE / 2, Frames), Frames);
+      StopPlayer(1);
+    }
+}
+
+// the retries double their wait while it fits in the play time of the
+// other half: 1, 2 and 4 ms at 44.1 kHz, 1 and 2 ms at 96 kHz
+static void
+TestReadBackoff(void)
+{
+  static const uint32_t Rates[] = {44100, 96000};
+  static const uint8_t Retries[] = {REFILL_MAX_RETRIES, 2};
+  static const uint32_t Waits[] = {1 + 2 + 4, 1 + 2};
+
+  for(uint8_t r = 0; r < 2; r++)
+    {
+      static int16_t Half[DMA_BUFFER_SIZE / 4];
+      static int16_t Other[DMA_BUFFER_SIZE / 4];
+      WavPlayerReadStats_t Before;
+      WavPlayerReadStats_t After;
+      uint32_t Tick;
+
+      OpenTrack(Rates[r], false, WAV_PLAYER_CONCEAL_FADE);
+      WavPlayer_GetReadStats(&Before);
+      Tick = HAL_GetTick();
+      RamDisk_FailReads(0, 100);
+      WavPlayer_RefillHalf((uint8_t*)Half, (uint8_t*)Other);
+      RamDisk_FailReads(0, 0);
+      WavPlayer_GetReadStats(&After);
+
+      CHECK_EQ(After.Retries - Before.Retries, Retries[r]);
+      CHECK_EQ(After.Errors - Before.Errors, Retries[r] + 1);
+      CHECK_EQ(After.Concealments - Before.Concealments, 1);
+      CHECK_EQ(HAL_GetTick() - Tick, Waits[r]);
+      StopPlayer(1);
+    }
+}
+
+// FADE ramps the last good frame down to silence in CONCEAL_FADE_FRAMES,
+// from the half when a part of it was read and from the other half when
+// nothing was
+static void
+TestConcealFade(void)
+{
+  const uint32_t Frames = (DMA_BUFFER_SIZE / 2) / FRAME_SIZE;
+  static int16_t Half[DMA_BUFFER_SIZE / 4];
+  static int16_t Other[DMA_BUFFER_SIZE / 4];
+  uint32_t Good;
+  FSIZE_t Pos;
+
+  OpenTrack(44100, false, WAV_PLAYER_CONCEAL_FADE);
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      Other[2 * i] = 12800;
+      Other[2 * i + 1] = -6400;
+    }
+
+  // the half starts in the middle of the sector the last read cached,
+  // that part comes in and the rest fails
+  Pos = WavPlayer_TellSamples();
+  RamDisk_FailReads(0, 100);
+  WavPlayer_RefillHalf((uint8_t*)Half, (uint8_t*)Other);
+  Good = gFileReadBytesLen / FRAME_SIZE;
+  CHECK(Good > 0 && Good < Frames);
+  CHECK_EQ(RampFrames(Half, Pos, Good), Good);
+  CHECK_EQ(CheckFade(Half, Good, Half[2 * (Good - 1)], Half[2 * Good - 1]), 0);
+
+  // from a sector boundary nothing comes in
+  WavPlayer_SeekFile(8 * _MAX_SS);
+  WavPlayer_RefillHalf((uint8_t*)Half, (uint8_t*)Other);
+  RamDisk_FailReads(0, 0);
+  CHECK_EQ(gFileReadBytesLen, 0);
+  CHECK_EQ(CheckFade(Half, 0, 12800, -6400), 0);
+  StopPlayer(1);
+}
+
+// REPEAT plays the other half again, halved on each concealment in a row
+// and from the full gain again after a good refill
+static void
+TestConcealRepeat(void)
+{
+  const uint32_t Frames = (DMA_BUFFER_SIZE / 2) / FRAME_SIZE;
+  static const uint8_t Shifts[] = {1, 2, 3, 0, 1};
+  static int16_t Half[DMA_BUFFER_SIZE / 4];
+  static int16_t Other[DMA_BUFFER_SIZE / 4];
+
+  OpenTrack(44100, false, WAV_PLAYER_CONCEAL_REPEAT);
+  WavPlayer_SeekFile(8 * _MAX_SS); // no read comes in
+  for(uint32_t i = 0; i < Frames; i++)
+    {
+      Other[2 * i] = (int16_t)(1000 + 7 * i);
+      Other[2 * i + 1] = (int16_t)(-2000 - 5 * i);
+    }
+
+  for(uint8_t n = 0; n < sizeof(Shifts) / sizeof(Shifts[0]); n++)
+    {
+      uint32_t Wrong = 0;
+      FSIZE_t Pos = WavPlayer_TellSamples();
+
+      RamDisk_FailReads(0, Shifts[n] ? 100 : 0);
+      WavPlayer_RefillHalf((uint8_t*)Half, (uint8_t*)Other);
+      RamDisk_FailReads(0, 0);
+      if(Shifts[n] == 0)
+        {
+          CHECK_EQ(RampFrames(Half, Pos, Frames), Frames);
+          continue;
+        }
+      for(uint32_t i = 0; i < Frames; i++)
+        {
+          if(Half[2 * i] != Other[2 * i] >> Shifts[n] ||
+              Half[2 * i + 1] != Other[2 * i + 1] >> Shifts[n])
+            {
+              Wrong++;
+            }
+        }
+      CHECK_EQ(Wrong, 0);
+    }
+  StopPlayer(1);
+}
+
+// a measure suspended by a track opened for playing resumes where it was
+// and ends on the level of a measure that ran through
+static void
+TestScanSuspendResume(void)
+{
+  static WavPlayerConfig_t Config = {.Muted = false, .Vol = 50};
+  Catalogue_t* Cat;
+  int16_t Whole;
+  uint32_t Calls;
+  FSIZE_t Pos;
+
+  CHECK(RamDisk_Create(0, DISK_SECTORS, FM_EXFAT | FM_SFD, CLUSTER));
+  MakeTone("0:/tone.wav", 3 * 44100, 44100, -20.0);
+  FATFS_MountVolumes(1);
+  WavPlayer_Init(&Config);
+  WavPlayer_ChooseTheFirstAudioFile();
+  WavPlayer_SetNormalize(true);
+  Cat = WavPlayer_GetCatalogue();
+  CHECK_EQ(Cat->TracksNum, 1);
+
+  // -20 dBFS then -30 dBFS, both above the relative gate
+  Calls = ScanTrack(0);
+  Whole = Cat->LufsDb10[0];
+  CHECK(Calls < SCAN_MAX_CALLS);
+  CHECK(abs(Whole + 226) <= 2);
+
+  Cat->LufsDb10[0] = LOUDNESS_UNKNOWN;
+  for(uint32_t i = 0; i < Calls / 2; i++) WavPlayer_Scan();
+  CHECK_EQ(gScanTrack, 0);
+  CHECK(gIsScanOpen);
+  CHECK(gScanPos > 44 && gScanPos < gScanEnd);
+  Pos = gScanPos;
+
+  CHECK(WavPlayer_OpenAudioFile("0:/tone.wav", STREAM_DATA_OFS));
+  CHECK(!gIsScanOpen);
+  CHECK_EQ(gScanPos, Pos);
+  CHECK(ScanTrack(0) < SCAN_MAX_CALLS);
+  CHECK_EQ(Cat->LufsDb10[0], Whole);
+
+  WavPlayer_SetNormalize(false);
+  StopPlayer(1);
+}
+
+int
+main(void)
+{
+  TestExfatContiguous();
+  TestFatSingleFragment();
+  TestExfatFragmented();
+  TestExfatReadSeek();
+  TestFatTooFragmented();
+  TestDisconnectStopsCodecFirst();
+  TestSwitchVolumeKeepsState();
+  TestReadRetry();
+  TestReadBackoff();
+  TestConcealFade();
+  TestConcealRepeat();
+  TestScanSuspendResume();
+  return TEST_RESULT();
+}